@@ -0,0 +1,280 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+#include <chrono>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "decoder.h"
+#include "renderer.h"
+#include "simd.h"
+
+namespace
+{
+	const u32 kWidth = 1024;
+	const u32 kHeight = 1024;
+	const u32 kRuns = 10;
+
+	struct Layout
+	{
+		const char* name;
+		int rgbaBits[4];
+		int rgbaChannels[4];
+		bool palette;
+		bool tiled;
+		bool bitwise;
+	};
+
+	const Layout kLayouts[] =
+	{
+		{ "RGBA 8888", { 8, 8, 8, 8 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "BGRA 8888", { 8, 8, 8, 8 }, { 2, 1, 0, 3 }, false, false, false },
+		{ "RGB 888", { 8, 8, 8, 0 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "ABGR 8888", { 8, 8, 8, 8 }, { 3, 2, 1, 0 }, false, false, false },
+		{ "RGB 565", { 5, 6, 5, 0 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "RGBA 5551", { 5, 5, 5, 1 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "RGBA 4444", { 4, 4, 4, 4 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "RGB 332", { 3, 3, 2, 0 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "RGB 6.6.6.6", { 6, 6, 6, 6 }, { 0, 1, 2, 3 }, false, false, false },
+		{ "Palette", { 8, 8, 8, 0 }, { 0, 1, 2, 3 }, true, false, false },
+		{ "RGBA 8888 (tiled)", { 8, 8, 8, 8 }, { 0, 1, 2, 3 }, false, true, false },
+		{ "RGBA 8888 (5 ops)", { 8, 8, 8, 8 }, { 0, 1, 2, 3 }, false, false, true },
+		{ "RGB 565 (5 ops)", { 5, 6, 5, 0 }, { 0, 1, 2, 3 }, false, false, true }
+	};
+
+	PixelFormat makeFormat(const Layout& layout)
+	{
+		PixelFormat format;
+		memset(&format, 0, sizeof(format));
+
+		int bpp = 0;
+		for(int i=0; i<4; ++i)
+		{
+			format.rgbaBits[i] = layout.rgbaBits[i];
+			format.rgbaChannels[i] = layout.rgbaChannels[i];
+			format.bitMask[layout.rgbaChannels[i]] = ~(((u32)-1) << layout.rgbaBits[i]);
+			bpp += layout.rgbaBits[i];
+		}
+
+		format.pixelSize = bpp / 8;
+		format.valid = true;
+
+		return format;
+	}
+
+	double elapsedMs(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Rewrites a file without changing its size, a reload has to miss the frames cached before
+	// Writes the file and pins its modification time, so only the content tells two versions apart
+	bool writeFile(const std::string& name, const std::vector<u8>& data, const char* mode)
+	{
+		FILE* f = fopen(name.c_str(), mode);
+		bool written = f && fwrite(&data[0], data.size(), 1, f) == 1;
+		if(f)
+		{
+			fclose(f);
+		}
+
+		struct utimbuf times = { 1000000000, 1000000000 };
+		return written && utime(name.c_str(), &times) == 0;
+	}
+
+	bool checkCacheReload()
+	{
+		const char* dir = getenv("TMPDIR");
+		dir = dir ? dir : getenv("TEMP");
+		std::string name = std::string(dir ? dir : ".") + "/pixeldbg_reload.tmp";
+
+		std::vector<u8> data(4096, 0x11);
+		MappedFile file;
+		if(!writeFile(name, data, "wb") || !file.open(name.c_str()))
+		{
+			remove(name.c_str());
+			return false;
+		}
+
+		ViewState state;
+		state.file = &file;
+		state.width = 32;
+		state.height = 32;
+		state.format = makeFormat(kLayouts[0]);
+		state.viewWidth = state.width;
+		state.viewHeight = state.height;
+
+		FrameCache cache;
+		FrameCache::Entry entry;
+		entry.pixels.assign(state.width * state.height * 3, 0x11);
+		entry.paletteUsed = false;
+		entry.paletteMin = 0;
+		entry.paletteMax = 0;
+		entry.complete = true;
+		cache.insert(FrameKey(state), entry);
+
+		// Same size and modification time, as a rewrite within the timestamp granularity would look
+		std::fill(data.begin(), data.end(), 0x22);
+		bool written = writeFile(name, data, "r+b");
+
+		u8 first = 0;
+		bool reloaded = written && file.refresh() && file.read(&first, 1, 0) == 1 && first == 0x22;
+		bool missed = reloaded && !cache.lookup(FrameKey(state), entry);
+
+		file.close();
+		remove(name.c_str());
+		return missed;
+	}
+};
+
+int runBenchmark()
+{
+	// Deterministic noise, no format gets an easy ride
+	std::vector<u8> data(kWidth * kHeight * 4);
+	u32 seed = 0x12345678;
+	for(size_t i=0; i<data.size(); ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		data[i] = (u8)(seed >> 24);
+	}
+
+	u8 palette[256 * 3];
+	for(u32 i=0; i<sizeof(palette); ++i)
+	{
+		palette[i] = (u8)(i * 7);
+	}
+
+	// Full bitwise pipeline
+	std::vector<BitwiseOp> ops(5);
+	BitwiseOp::Op opTypes[5] = { BitwiseOp::OP_XOR, BitwiseOp::OP_SHL, BitwiseOp::OP_ROR, BitwiseOp::OP_AND, BitwiseOp::OP_OR };
+	for(u32 i=0; i<ops.size(); ++i)
+	{
+		ops[i].op = opTypes[i];
+		ops[i].r = (u8)(i + 1);
+		ops[i].g = (u8)(0xf0 >> i);
+		ops[i].b = (u8)(0x3c + i);
+	}
+
+	BitwiseTable bitwise;
+	bitwise.compile(ops);
+
+	std::vector<u8> reference(kWidth * kHeight * 3);
+	std::vector<u8> output(kWidth * kHeight * 3);
+	int failed = 0;
+
+	SimdLevel level = getSimdLevel();
+
+	printf("Decoding %ux%u, best of %u runs, vector kernels: %s\n\n", kWidth, kHeight, kRuns, getSimdName(level));
+	printf("%-20s %12s %12s %12s %9s\n", "Format", "Reference", "Scalar", "SIMD", "Speedup");
+
+	for(u32 l=0; l<sizeof(kLayouts)/sizeof(kLayouts[0]); ++l)
+	{
+		const Layout& layout = kLayouts[l];
+		PixelFormat format = makeFormat(layout);
+		const u8* pal = layout.palette ? palette : NULL;
+		u32 tileX = layout.tiled ? 8 : kWidth;
+		u32 tileY = layout.tiled ? 8 : kHeight;
+		u32 size = kWidth * kHeight * (pal ? 1 : format.pixelSize);
+
+		double refTime = 1e9;
+
+		for(u32 run=0; run<kRuns; ++run)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			convertRawReference(format, kWidth, kHeight, &data[0], size, &reference[0], 0, layout.bitwise ? &ops : NULL, tileX, tileY, pal);
+			refTime = std::min(refTime, elapsedMs(start));
+		}
+
+		// Compiled once, as the renderer does
+		CompiledFormat compiled;
+		setSimdLevel(SIMD_None);
+		compiled.compile(format, 0, pal, layout.bitwise ? &bitwise : NULL);
+
+		double scalarTime = 0.0;
+		double simdTime = 0.0;
+		bool same = true;
+		bool vectorized = false;
+
+		for(int pass=0; pass<2; ++pass)
+		{
+			if(pass == 1)
+			{
+				setSimdLevel(level);
+				compiled.compile(format, 0, pal, layout.bitwise ? &bitwise : NULL);
+				vectorized = compiled.simd != SIMD_None;
+				if(!vectorized)
+				{
+					break;
+				}
+			}
+
+			double time = 1e9;
+			for(u32 run=0; run<kRuns; ++run)
+			{
+				memset(&output[0], 0, output.size());
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				convertRaw(compiled, &data[0], size, Viewport(kWidth, kHeight), OutputLayout(&output[0], kWidth, kHeight), 0, tileX, tileY);
+				time = std::min(time, elapsedMs(start));
+			}
+
+			same = same && memcmp(&reference[0], &output[0], output.size()) == 0;
+			(pass == 0 ? scalarTime : simdTime) = time;
+		}
+
+		if(!same)
+		{
+			++failed;
+		}
+
+		double best = vectorized ? simdTime : scalarTime;
+		char simd[32] = "-";
+		if(vectorized)
+		{
+			snprintf(simd, sizeof(simd), "%.3f ms", simdTime);
+		}
+
+		printf("%-20s %9.3f ms %9.3f ms %12s %8.1fx%s\n", layout.name, refTime, scalarTime, simd, best > 0.0 ? refTime / best : 0.0, same ? "" : "  MISMATCH");
+	}
+
+	setSimdLevel(level);
+
+	return failed;
+}
+
+int runSelfTest()
+{
+	bool reload = checkCacheReload();
+	printf("Frame cache misses after a rewrite keeping size and modification time: %s\n", reload ? "passed" : "FAILED");
+
+	return reload ? 0 : 1;
+}
+
@@ -0,0 +1,36 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+// Times the decoders against the reference loop and checks they produce the same output.
+// Prints to stdout, returns non-zero if any kernel disagrees with the reference.
+int runBenchmark();
+
+// Checks which need a real file rather than timing, returns non-zero if any of them fails.
+int runSelfTest();
+
+#endif
+
@@ -0,0 +1,1187 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "carver.h"
+#include "simd.h"
+
+const u32 ImageCarver::kChunkSize = 16 * 1024 * 1024;
+const u32 ImageCarver::kOverlap = 128 * 1024; // JPEG headers are walked up to this far
+const u32 ImageCarver::kMaxHits = 65536;
+
+namespace
+{
+	const u32 kMaxDimension = 1024 * 1024;
+	const u32 kMaxHeaderSize = 64 * 1024; // BMP pixel data and KTX key/value data start within this
+	const u32 kChunksPerThread = 2; // Chunks per thread and batch
+	const double kNotifyIntervalMs = 200.0;
+
+	// Bytes that can start a signature, and TGA image types (third byte of the header)
+	enum Trigger
+	{
+		TR_Signature = (1<<0),
+		TR_TgaType = (1<<1)
+	};
+
+	struct TriggerTable
+	{
+		TriggerTable()
+		{
+			memset(values, 0, sizeof(values));
+			values['B'] = values['D'] = values[0x89] = values[0xab] = values[0xff] = TR_Signature;
+			values[1] = values[2] = values[3] = values[9] = values[10] = values[11] = TR_TgaType;
+		}
+
+		u8 values[256];
+	};
+
+	const TriggerTable& getTriggerTable()
+	{
+		static TriggerTable s_table;
+		return s_table;
+	}
+
+	// Second byte of the signatures, colormap type and origin of TGA headers reject most
+	// trigger bytes before a header is looked at. p is the trigger byte at index i.
+	bool isCandidate(const u8* p, size_t i, size_t avail, size_t scanSize, u8 trigger)
+	{
+		if(trigger == TR_TgaType)
+		{
+			return i >= 2 && p[-1] <= 1 && avail >= 16 && (p[6] | p[7] | p[8] | p[9]) == 0;
+		}
+		if(i >= scanSize || avail < 2)
+		{
+			return false;
+		}
+
+		switch(p[0])
+		{
+		case 'B': return p[1] == 'M';
+		case 'D': return p[1] == 'D';
+		case 0x89: return p[1] == 'P';
+		case 0xab: return p[1] == 'K';
+		case 0xff: return p[1] == 0xd8;
+		default: return false;
+		}
+	}
+
+	u16 readLE16(const u8* p) { return (u16)(p[0] | (p[1] << 8)); }
+	u32 readLE32(const u8* p) { return (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24); }
+	u16 readBE16(const u8* p) { return (u16)((p[0] << 8) | p[1]); }
+	u32 readBE32(const u8* p) { return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3]; }
+
+	bool isDimValid(u64 width, u64 height)
+	{
+		return width >= 1 && height >= 1 && width <= kMaxDimension && height <= kMaxDimension;
+	}
+
+	// R, G, B and A bits at the given stream positions
+	void setFormat(ImageCarver::Hit& hit, int r, int g, int b, int a, int posR, int posG, int posB, int posA)
+	{
+		hit.rgbaBits[0] = r;
+		hit.rgbaBits[1] = g;
+		hit.rgbaBits[2] = b;
+		hit.rgbaBits[3] = a;
+		hit.rgbaChannels[0] = posR;
+		hit.rgbaChannels[1] = posG;
+		hit.rgbaChannels[2] = posB;
+		hit.rgbaChannels[3] = posA;
+		hit.flags |= ImageCarver::HIT_Raw;
+	}
+
+	// Channel masks of a little endian pixel (R, G, B, A) to stream positions. Channels have to
+	// be contiguous and tile the pixel from the lowest bit up, unused top bits become alpha.
+	bool setFormatFromMasks(ImageCarver::Hit& hit, const u32 masks[4], u32 bpp)
+	{
+		u32 shift[4], bits[4];
+		int order[4];
+		int numUsed = 0;
+
+		for(int c=0; c<4; ++c)
+		{
+			shift[c] = bits[c] = 0;
+			if(masks[c] == 0)
+			{
+				continue;
+			}
+
+			while(!((masks[c] >> shift[c]) & 1))
+			{
+				++shift[c];
+			}
+			while(shift[c] + bits[c] < 32 && ((masks[c] >> (shift[c] + bits[c])) & 1))
+			{
+				++bits[c];
+			}
+			if(bits[c] > 8 || (u64)masks[c] != (((1ull << bits[c]) - 1) << shift[c]))
+			{
+				return false;
+			}
+			order[numUsed++] = c;
+		}
+
+		for(int i=1; i<numUsed; ++i)
+		{
+			for(int j=i; j>0 && shift[order[j]] < shift[order[j - 1]]; --j)
+			{
+				std::swap(order[j], order[j - 1]);
+			}
+		}
+
+		u32 next = 0;
+		for(int i=0; i<numUsed; ++i)
+		{
+			if(shift[order[i]] != next)
+			{
+				return false;
+			}
+			next += bits[order[i]];
+		}
+
+		if(next < bpp && masks[3] == 0 && bpp - next <= 8)
+		{
+			shift[3] = next;
+			bits[3] = bpp - next;
+			order[numUsed++] = 3;
+			next = bpp;
+		}
+
+		if(next != bpp || numUsed == 0)
+		{
+			return false;
+		}
+
+		// Channels without bits take the remaining positions
+		int pos[4] = { -1, -1, -1, -1 };
+		for(int i=0; i<numUsed; ++i)
+		{
+			pos[order[i]] = i;
+		}
+		int free = numUsed;
+		for(int c=0; c<4; ++c)
+		{
+			if(pos[c] < 0)
+			{
+				pos[c] = free++;
+			}
+		}
+
+		setFormat(hit, (int)bits[0], (int)bits[1], (int)bits[2], (int)bits[3], pos[0], pos[1], pos[2], pos[3]);
+		return true;
+	}
+
+	// Rows padded to 4 bytes are shown as wider images if the padding is a whole number of pixels
+	u32 getPaddedWidth(u32 width, u32 bpp)
+	{
+		u64 pitch = (((u64)width * bpp + 31) / 32) * 4;
+		u32 pixelSize = bpp / 8;
+		return bpp >= 8 && bpp % 8 == 0 && pitch % pixelSize == 0 ? (u32)(pitch / pixelSize) : width;
+	}
+
+	bool fitsFile(const ImageCarver::Hit& hit, u64 fileSize)
+	{
+		return hit.dataOffset <= fileSize && hit.dataSize <= fileSize - hit.dataOffset;
+	}
+
+	bool checkBMP(const u8* p, size_t avail, u64 fileSize, ImageCarver::Hit& hit)
+	{
+		if(avail < 30 || p[1] != 'M' || readLE32(p + 6) != 0)
+		{
+			return false;
+		}
+
+		u32 dataOffset = readLE32(p + 10);
+		u32 headerSize = readLE32(p + 14);
+		if(headerSize != 12 && headerSize != 40 && headerSize != 52 && headerSize != 56 && headerSize != 64 && headerSize != 108 && headerSize != 124)
+		{
+			return false;
+		}
+
+		if(avail < 14 + headerSize + 12 || dataOffset < 14 + headerSize || dataOffset > kMaxHeaderSize)
+		{
+			return false;
+		}
+
+		// Core headers have 16 bit sizes and no compression
+		bool core = headerSize == 12;
+		i32 width = core ? (i32)readLE16(p + 18) : (i32)readLE32(p + 18);
+		i32 height = core ? (i32)readLE16(p + 20) : (i32)readLE32(p + 22);
+		u32 planes = core ? readLE16(p + 22) : readLE16(p + 26);
+		u32 bpp = core ? readLE16(p + 24) : readLE16(p + 28);
+		u32 compression = core ? 0 : readLE32(p + 30);
+		u32 absHeight = (u32)(height < 0 ? -(i64)height : height);
+
+		if(planes != 1 || width <= 0 || !isDimValid((u64)width, absHeight))
+		{
+			return false;
+		}
+
+		if(bpp != 1 && bpp != 4 && bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32)
+		{
+			return false;
+		}
+
+		// RGB, RLE8, RLE4, bit fields and bit fields with alpha
+		bool rle = compression == 1 || compression == 2;
+		if(compression > 3 && compression != 6)
+		{
+			return false;
+		}
+
+		hit.type = ImageCarver::IT_BMP;
+		hit.width = (u32)width;
+		hit.height = absHeight;
+		hit.rowWidth = getPaddedWidth(hit.width, bpp);
+		hit.bpp = (u8)bpp;
+		hit.dataOffset += dataOffset;
+		hit.dataSize = rle ? readLE32(p + 34) : (((u64)width * bpp + 31) / 32) * 4 * absHeight;
+		if(height > 0)
+		{
+			hit.flags |= ImageCarver::HIT_FlipV;
+		}
+
+		if(!fitsFile(hit, fileSize))
+		{
+			return false;
+		}
+
+		if(compression == 3 || compression == 6)
+		{
+			// Masks follow a 40 byte header and are part of the larger ones
+			u32 masks[4] = { readLE32(p + 54), readLE32(p + 58), readLE32(p + 62), 0 };
+			if(compression == 6 || headerSize >= 56)
+			{
+				if(avail < 70)
+				{
+					return false;
+				}
+				masks[3] = readLE32(p + 66);
+			}
+
+			if(!setFormatFromMasks(hit, masks, bpp))
+			{
+				hit.flags &= ~ImageCarver::HIT_Raw;
+			}
+		}
+		else if(compression == 0 && bpp >= 16)
+		{
+			// BGR(A) byte order, 16 bit pixels are X1R5G5B5
+			if(bpp == 16)
+			{
+				setFormat(hit, 5, 5, 5, 1, 2, 1, 0, 3);
+			}
+			else
+			{
+				setFormat(hit, 8, 8, 8, bpp == 32 ? 8 : 0, 2, 1, 0, 3);
+			}
+		}
+		else if(compression == 0 && bpp == 8)
+		{
+			// Palette entries are BGR on core headers and BGRX otherwise
+			hit.flags |= ImageCarver::HIT_Palette;
+			hit.paletteOffset = hit.offset + 14 + headerSize;
+			setFormat(hit, 8, 8, 8, core ? 0 : 8, 2, 1, 0, 3);
+		}
+
+		return true;
+	}
+
+	// p is the start of the header, its third byte triggered the check
+	bool checkTGA(const u8* p, size_t avail, u64 fileSize, ImageCarver::Hit& hit)
+	{
+		if(avail < sizeof(TgaHeader))
+		{
+			return false;
+		}
+
+		// Same layout as the files written by the TGA export
+		TgaHeader header;
+		memcpy(&header, p, sizeof(header));
+
+		u32 idSize = header.identsize;
+		u32 colorMapType = header.colormaptype;
+		u32 imageType = header.imagetype;
+		u32 paletteStart = header.palletestart;
+		u32 paletteLength = header.palettelength;
+		u32 paletteBits = header.palettebits;
+		u32 width = header.width;
+		u32 height = header.height;
+		u32 bpp = header.bpp;
+		u32 descriptor = header.descriptor;
+		u32 alphaBits = descriptor & 0x0f;
+
+		// No magic number, so everything has to fit. Origins other than 0 are practically unused.
+		if(header.xstart != 0 || header.ystart != 0 || width == 0 || height == 0 || (descriptor & 0xc0) != 0)
+		{
+			return false;
+		}
+
+		bool indexed = imageType == 1 || imageType == 9;
+		bool gray = imageType == 3 || imageType == 11;
+		if(indexed)
+		{
+			if(colorMapType != 1 || bpp != 8 || alphaBits != 0 || paletteLength == 0 || paletteStart + paletteLength > 256)
+			{
+				return false;
+			}
+
+			if(paletteBits != 15 && paletteBits != 16 && paletteBits != 24 && paletteBits != 32)
+			{
+				return false;
+			}
+		}
+		else if(colorMapType != 0 || paletteStart != 0 || paletteLength != 0 || paletteBits != 0)
+		{
+			return false;
+		}
+		else if(gray && (bpp != 8 || alphaBits != 0))
+		{
+			return false;
+		}
+		else if(!gray && !(bpp == 32 && (alphaBits == 0 || alphaBits == 8)) && !(bpp == 24 && alphaBits == 0) &&
+		        !((bpp == 16 || bpp == 15) && alphaBits <= 1))
+		{
+			return false;
+		}
+
+		u32 pixelSize = (bpp + 7) / 8;
+		u32 entrySize = (paletteBits + 7) / 8;
+		u64 paletteOffset = hit.offset + sizeof(TgaHeader) + idSize;
+		bool rle = imageType >= 9;
+
+		hit.type = ImageCarver::IT_TGA;
+		hit.width = width;
+		hit.height = height;
+		hit.rowWidth = width;
+		hit.bpp = (u8)bpp;
+		hit.dataOffset = paletteOffset + (indexed ? paletteLength * entrySize : 0);
+
+		// Run length encoded data takes at least one packet per 128 pixels
+		hit.dataSize = rle ? ((u64)width * height + 127) / 128 * (1 + pixelSize) : (u64)width * height * pixelSize;
+		if(!fitsFile(hit, fileSize))
+		{
+			return false;
+		}
+		if(rle)
+		{
+			hit.dataSize = 0;
+			hit.flags |= ImageCarver::HIT_RLE;
+		}
+
+		if((descriptor & 0x20) == 0)
+		{
+			hit.flags |= ImageCarver::HIT_FlipV;
+		}
+		if(descriptor & 0x10)
+		{
+			hit.flags |= ImageCarver::HIT_FlipH;
+		}
+
+		// BGR(A) byte order, 16 bit pixels are A1R5G5B5
+		u32 formatBits = indexed ? paletteBits : bpp;
+		if(gray)
+		{
+			hit.flags |= ImageCarver::HIT_Gray;
+			setFormat(hit, 8, 0, 0, 0, 0, 1, 2, 3);
+		}
+		else if(formatBits <= 16)
+		{
+			setFormat(hit, 5, 5, 5, 1, 2, 1, 0, 3);
+		}
+		else
+		{
+			setFormat(hit, 8, 8, 8, formatBits == 32 ? 8 : 0, 2, 1, 0, 3);
+		}
+
+		if(indexed)
+		{
+			hit.flags |= ImageCarver::HIT_Palette;
+			hit.paletteOffset = paletteOffset >= paletteStart * entrySize ? paletteOffset - paletteStart * entrySize : paletteOffset;
+		}
+
+		return true;
+	}
+
+	bool checkDDS(const u8* p, size_t avail, u64 fileSize, ImageCarver::Hit& hit)
+	{
+		if(avail < 128 || p[1] != 'D' || p[2] != 'S' || p[3] != ' ' || readLE32(p + 4) != 124 || readLE32(p + 76) != 32)
+		{
+			return false;
+		}
+
+		u32 height = readLE32(p + 12);
+		u32 width = readLE32(p + 16);
+		u32 pfFlags = readLE32(p + 80);
+		u32 fourCC = readLE32(p + 84);
+		u32 bpp = readLE32(p + 88);
+		u32 masks[4] = { readLE32(p + 92), readLE32(p + 96), readLE32(p + 100), readLE32(p + 104) };
+
+		// Height and width flags
+		if((readLE32(p + 8) & 0x6) != 0x6 || !isDimValid(width, height))
+		{
+			return false;
+		}
+
+		hit.type = ImageCarver::IT_DDS;
+		hit.width = width;
+		hit.height = height;
+		hit.rowWidth = width;
+		hit.dataOffset += 128;
+
+		u32 dxgiFormat = 0;
+		if(pfFlags & 0x4) // Four character code
+		{
+			if(fourCC == 0x30315844) // "DX10", extended header
+			{
+				if(avail < 148)
+				{
+					return false;
+				}
+				dxgiFormat = readLE32(p + 128);
+				hit.dataOffset += 20;
+			}
+
+			switch(fourCC)
+			{
+			case 0x31545844: hit.DXTType = 1; break; // "DXT1"
+			case 0x32545844: // "DXT2"
+			case 0x33545844: hit.DXTType = 3; break; // "DXT3"
+			case 0x34545844: // "DXT4"
+			case 0x35545844: hit.DXTType = 5; break; // "DXT5"
+			}
+
+			switch(dxgiFormat)
+			{
+			case 70: case 71: case 72: hit.DXTType = 1; break; // BC1
+			case 73: case 74: case 75: hit.DXTType = 3; break; // BC2
+			case 76: case 77: case 78: hit.DXTType = 5; break; // BC3
+			case 27: case 28: case 29: bpp = 32; setFormat(hit, 8, 8, 8, 8, 0, 1, 2, 3); break; // R8G8B8A8
+			case 87: case 90: case 91: bpp = 32; setFormat(hit, 8, 8, 8, 8, 2, 1, 0, 3); break; // B8G8R8A8
+			case 88: case 92: case 93: bpp = 32; setFormat(hit, 8, 8, 8, 8, 2, 1, 0, 3); break; // B8G8R8X8
+			case 85: bpp = 16; setFormat(hit, 5, 6, 5, 0, 2, 1, 0, 3); break; // B5G6R5
+			case 86: bpp = 16; setFormat(hit, 5, 5, 5, 1, 2, 1, 0, 3); break; // B5G5R5A1
+			case 61: case 65: bpp = 8; hit.flags |= ImageCarver::HIT_Gray; setFormat(hit, 8, 0, 0, 0, 0, 1, 2, 3); break; // R8, A8
+			}
+
+			if(hit.DXTType != 0)
+			{
+				// 5.6.5.0 blocks, rows of blocks
+				bpp = hit.DXTType == 1 ? 4 : 8;
+				hit.rowWidth = (width + 3) & ~3u;
+				hit.dataSize = (u64)((width + 3) / 4) * ((height + 3) / 4) * (hit.DXTType == 1 ? 8 : 16);
+				setFormat(hit, 5, 6, 5, 0, 0, 1, 2, 3);
+			}
+			else if(hit.flags & ImageCarver::HIT_Raw)
+			{
+				hit.dataSize = (u64)width * height * (bpp / 8);
+			}
+			else
+			{
+				// Other block compressions are listed but can't be shown
+				bpp = 0;
+			}
+		}
+		else if(pfFlags & 0x20) // Palette indices, 256 RGBA entries follow the header
+		{
+			if(bpp != 8)
+			{
+				return false;
+			}
+			hit.flags |= ImageCarver::HIT_Palette;
+			hit.paletteOffset = hit.dataOffset;
+			hit.dataOffset += 256 * 4;
+			hit.dataSize = (u64)width * height;
+			setFormat(hit, 8, 8, 8, 8, 0, 1, 2, 3);
+		}
+		else if(pfFlags & 0x20002) // Luminance or alpha only
+		{
+			if(bpp != 8)
+			{
+				return false;
+			}
+			hit.flags |= ImageCarver::HIT_Gray;
+			hit.dataSize = (u64)width * height;
+			setFormat(hit, 8, 0, 0, 0, 0, 1, 2, 3);
+		}
+		else if(pfFlags & 0x40) // RGB masks, alpha mask with alpha pixels only
+		{
+			if(bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32)
+			{
+				return false;
+			}
+			if(!(pfFlags & 0x1))
+			{
+				masks[3] = 0;
+			}
+			hit.dataSize = (u64)width * height * (bpp / 8);
+			setFormatFromMasks(hit, masks, bpp);
+		}
+		else
+		{
+			return false;
+		}
+
+		hit.bpp = (u8)bpp;
+		return fitsFile(hit, fileSize);
+	}
+
+	bool checkPNG(const u8* p, size_t avail, ImageCarver::Hit& hit)
+	{
+		static const u8 signature[8] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+		if(avail < 29 || memcmp(p, signature, 8) != 0 || readBE32(p + 8) != 13 || memcmp(p + 12, "IHDR", 4) != 0)
+		{
+			return false;
+		}
+
+		u32 width = readBE32(p + 16);
+		u32 height = readBE32(p + 20);
+		u32 depth = p[24];
+		u32 colorType = p[25];
+		if(width == 0 || height == 0 || width > 0x7fffffff || height > 0x7fffffff || p[26] != 0 || p[27] != 0 || p[28] > 1)
+		{
+			return false;
+		}
+
+		// Grey, RGB, palette, grey + alpha and RGBA with their allowed bit depths
+		u32 channels;
+		bool depthValid;
+		switch(colorType)
+		{
+		case 0: channels = 1; depthValid = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16; break;
+		case 2: channels = 3; depthValid = depth == 8 || depth == 16; break;
+		case 3: channels = 1; depthValid = depth == 1 || depth == 2 || depth == 4 || depth == 8; break;
+		case 4: channels = 2; depthValid = depth == 8 || depth == 16; break;
+		case 6: channels = 4; depthValid = depth == 8 || depth == 16; break;
+		default: return false;
+		}
+
+		if(!depthValid)
+		{
+			return false;
+		}
+
+		hit.type = ImageCarver::IT_PNG;
+		hit.width = width;
+		hit.height = height;
+		hit.rowWidth = width;
+		hit.bpp = (u8)(channels * depth);
+		return true;
+	}
+
+	bool checkJPEG(const u8* p, size_t avail, ImageCarver::Hit& hit)
+	{
+		if(avail < 4 || p[1] != 0xd8 || p[2] != 0xff)
+		{
+			return false;
+		}
+
+		// SOI is followed by an APPn, DQT, DHT, SOF, DRI or comment segment
+		u8 first = p[3];
+		if(!((first >= 0xe0 && first <= 0xef) || first == 0xdb || first == 0xc4 || (first >= 0xc0 && first <= 0xc2) || first == 0xdd || first == 0xfe))
+		{
+			return false;
+		}
+
+		// Walk the segments up to the frame header
+		size_t end = std::min(avail, (size_t)ImageCarver::kOverlap);
+		size_t pos = 2;
+		while(pos + 4 <= end)
+		{
+			if(p[pos] != 0xff)
+			{
+				return false;
+			}
+
+			u8 marker = p[pos + 1];
+			if(marker == 0xff) // Fill byte
+			{
+				++pos;
+				continue;
+			}
+
+			if(marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) // Without length
+			{
+				pos += 2;
+				continue;
+			}
+
+			// Image data or another image before a frame header
+			if(marker == 0xd8 || marker == 0xd9 || marker == 0xda || marker == 0x00)
+			{
+				return false;
+			}
+
+			u32 length = readBE16(p + pos + 2);
+			if(length < 2)
+			{
+				return false;
+			}
+
+			bool frame = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+			if(frame)
+			{
+				if(pos + 10 > end || length < 11)
+				{
+					return false;
+				}
+
+				u32 precision = p[pos + 4];
+				u32 height = readBE16(p + pos + 5);
+				u32 width = readBE16(p + pos + 7);
+				u32 components = p[pos + 9];
+				if((precision != 8 && precision != 12 && precision != 16) || width == 0 || height == 0 || (components != 1 && components != 3 && components != 4))
+				{
+					return false;
+				}
+
+				hit.type = ImageCarver::IT_JPEG;
+				hit.width = width;
+				hit.height = height;
+				hit.rowWidth = width;
+				hit.bpp = (u8)(precision * components);
+				return true;
+			}
+
+			pos += 2 + length;
+		}
+
+		return false;
+	}
+
+	bool checkKTX(const u8* p, size_t avail, u64 fileSize, ImageCarver::Hit& hit)
+	{
+		static const u8 identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, 0x0d, 0x0a, 0x1a, 0x0a };
+		if(avail < 64 || memcmp(p, identifier, 12) != 0)
+		{
+			return false;
+		}
+
+		u32 endianness = readLE32(p + 12);
+		if(endianness != 0x04030201 && endianness != 0x01020304)
+		{
+			return false;
+		}
+
+		bool little = endianness == 0x04030201;
+		u32 fields[12];
+		for(u32 i=0; i<12; ++i)
+		{
+			fields[i] = little ? readLE32(p + 16 + i * 4) : readBE32(p + 16 + i * 4);
+		}
+
+		u32 glType = fields[0];
+		u32 glFormat = fields[2];
+		u32 glInternalFormat = fields[3];
+		u32 width = fields[5];
+		u32 height = std::max(fields[6], 1u); // 0 on 1D textures
+		u32 faces = fields[9];
+		u32 keyValueBytes = fields[11];
+
+		if(!isDimValid(width, height) || (faces != 1 && faces != 6) || keyValueBytes % 4 != 0 || keyValueBytes > kMaxHeaderSize)
+		{
+			return false;
+		}
+
+		hit.type = ImageCarver::IT_KTX;
+		hit.width = width;
+		hit.height = height;
+		hit.rowWidth = width;
+
+		// Size of the first mip level precedes its data
+		u64 sizeOffset = 64 + keyValueBytes;
+		hit.dataOffset += sizeOffset + 4;
+
+		u32 bpp = 0;
+		if(glType == 0)
+		{
+			switch(glInternalFormat)
+			{
+			case 0x83f0: case 0x83f1: hit.DXTType = 1; break; // S3TC DXT1 RGB and RGBA
+			case 0x83f2: hit.DXTType = 3; break;
+			case 0x83f3: hit.DXTType = 5; break;
+			}
+
+			if(hit.DXTType != 0)
+			{
+				bpp = hit.DXTType == 1 ? 4 : 8;
+				hit.rowWidth = (width + 3) & ~3u;
+				setFormat(hit, 5, 6, 5, 0, 0, 1, 2, 3);
+			}
+		}
+		else if(glType == 0x1401) // Unsigned bytes
+		{
+			switch(glFormat)
+			{
+			case 0x1908: bpp = 32; setFormat(hit, 8, 8, 8, 8, 0, 1, 2, 3); break; // RGBA
+			case 0x1907: bpp = 24; setFormat(hit, 8, 8, 8, 0, 0, 1, 2, 3); break; // RGB
+			case 0x80e1: bpp = 32; setFormat(hit, 8, 8, 8, 8, 2, 1, 0, 3); break; // BGRA
+			case 0x80e0: bpp = 24; setFormat(hit, 8, 8, 8, 0, 2, 1, 0, 3); break; // BGR
+			case 0x1903: case 0x1906: case 0x1909: // Red, alpha, luminance
+				bpp = 8;
+				hit.flags |= ImageCarver::HIT_Gray;
+				setFormat(hit, 8, 0, 0, 0, 0, 1, 2, 3);
+				break;
+			}
+		}
+		else if(little && glFormat == 0x1907 && glType == 0x8363) // RGB 5:6:5, red in the top bits
+		{
+			bpp = 16;
+			setFormat(hit, 5, 6, 5, 0, 2, 1, 0, 3);
+		}
+		else if(little && glFormat == 0x1908 && (glType == 0x8034 || glType == 0x8033)) // RGBA 5:5:5:1 or 4:4:4:4, alpha in the low bits
+		{
+			bpp = 16;
+			if(glType == 0x8034)
+			{
+				setFormat(hit, 5, 5, 5, 1, 3, 2, 1, 0);
+			}
+			else
+			{
+				setFormat(hit, 4, 4, 4, 4, 3, 2, 1, 0);
+			}
+		}
+
+		if(hit.DXTType == 0 && bpp != 0)
+		{
+			// Rows are padded to 4 bytes
+			hit.rowWidth = getPaddedWidth(width, bpp);
+		}
+
+		hit.bpp = (u8)bpp;
+		if(sizeOffset + 4 <= avail)
+		{
+			hit.dataSize = little ? readLE32(p + sizeOffset) : readBE32(p + sizeOffset);
+		}
+		else if(bpp != 0)
+		{
+			hit.dataSize = hit.DXTType != 0 ? (u64)((width + 3) / 4) * ((height + 3) / 4) * (hit.DXTType == 1 ? 8 : 16) : (u64)hit.rowWidth * height * (bpp / 8);
+		}
+
+		return fitsFile(hit, fileSize);
+	}
+};
+
+struct ImageCarver::Batch
+{
+	const MappedFile* file;
+	u64 fileSize;
+	u64 start; // Of the first chunk
+	const std::atomic<u32>* generation;
+	u32 expected; // Generation the batch belongs to
+	std::vector<std::vector<Hit> > hits; // Per chunk
+};
+
+ImageCarver::ImageCarver(NotifyFunc notify, void* param, u32 numThreads /* 0 */) :
+	m_notify(notify),
+	m_param(param),
+	m_numThreads(numThreads),
+	m_pool(NULL),
+	m_generation(0),
+	m_quit(false),
+	m_pending(false),
+	m_file(NULL),
+	m_identity(0),
+	m_fileSize(0),
+	m_scanned(0),
+	m_complete(false),
+	m_truncated(false),
+	m_seconds(0.0)
+{
+}
+
+ImageCarver::~ImageCarver()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+
+	delete m_pool;
+}
+
+bool ImageCarver::start(const MappedFile& file)
+{
+	if(!file.isOpen() || file.size() <= 0)
+	{
+		detach();
+
+		// An empty file is a complete scan without hits, so callers waiting for it don't hang
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_complete = file.isOpen();
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_file == &file && m_identity == file.identity() && m_fileSize == (u64)file.size())
+		{
+			return false;
+		}
+	}
+
+	detach();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = &file;
+	m_identity = file.identity();
+	m_fileSize = (u64)file.size();
+	m_pending = true;
+
+	// Worker and pool are created on first use
+	if(!m_thread.joinable())
+	{
+		m_pool = new ThreadPool(m_numThreads);
+		m_thread = std::thread(&ImageCarver::run, this);
+	}
+	m_cond.notify_one();
+
+	return true;
+}
+
+void ImageCarver::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		m_file = NULL;
+		m_pending = false;
+		m_identity = 0;
+		m_fileSize = 0;
+		m_scanned = 0;
+		m_hits.clear();
+		m_complete = false;
+		m_truncated = false;
+		m_seconds = 0.0;
+	}
+
+	// Wait for the batch currently being scanned, afterwards the pool won't access the file anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+}
+
+ImageCarver::Stats ImageCarver::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Stats stats;
+	stats.fileSize = m_fileSize;
+	stats.scanned = m_scanned;
+	stats.numHits = (u32)m_hits.size();
+	stats.numThreads = m_pool ? m_pool->getNumThreads() : 0;
+	stats.seconds = m_seconds;
+	stats.complete = m_complete;
+	stats.truncated = m_truncated;
+	return stats;
+}
+
+void ImageCarver::getHits(std::vector<Hit>& hits) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	hits = m_hits;
+}
+
+const char* ImageCarver::getTypeName(u32 type)
+{
+	static const char* const names[IT_NumTypes] = { "BMP", "TGA", "DDS", "PNG", "KTX", "JPEG" };
+	return type < IT_NumTypes ? names[type] : "?";
+}
+
+void ImageCarver::getFormatName(const Hit& hit, char* name, size_t size)
+{
+	const int* bits = hit.rgbaBits;
+	const int* pos = hit.rgbaChannels;
+
+	if(!(hit.flags & HIT_Raw))
+	{
+		snprintf(name, size, "%u bpp, compressed", (u32)hit.bpp);
+	}
+	else if(hit.DXTType != 0)
+	{
+		snprintf(name, size, "DXT%u", (u32)hit.DXTType);
+	}
+	else if(hit.flags & HIT_Gray)
+	{
+		snprintf(name, size, "GRAY8");
+	}
+	else
+	{
+		snprintf(name, size, "%s%d.%d.%d.%d/%d%d%d%d%s", (hit.flags & HIT_Palette) ? "PAL8 " : "", bits[0], bits[1], bits[2], bits[3],
+			pos[0] + 1, pos[1] + 1, pos[2] + 1, pos[3] + 1, (hit.flags & HIT_RLE) ? " RLE" : "");
+	}
+}
+
+void ImageCarver::scanChunk(const u8* data, size_t size, size_t scanSize, u64 base, u64 fileSize, std::vector<Hit>& hits)
+{
+	const u8* table = getTriggerTable().values;
+
+	// TGA headers are found by their third byte. Runs without candidates are skipped by the
+	// vector prefilter where the CPU has one, which may read 1 byte before and 9 bytes after
+	size_t end = std::min(scanSize + 2, size);
+	size_t vectorEnd = size > 9 ? std::min(end, size - 9) : 0;
+	size_t i = 0;
+	while(i < end)
+	{
+		if(i > 0 && i < vectorEnd)
+		{
+			i += skipCarveSimd(data + i, vectorEnd - i);
+		}
+
+		size_t stop = std::min(i + 32, end);
+		for(; i<stop; ++i)
+		{
+			u8 trigger = table[data[i]];
+			if(trigger == 0)
+			{
+				continue;
+			}
+
+			const u8* p = data + i;
+			size_t avail = size - i;
+			if(!isCandidate(p, i, avail, scanSize, trigger))
+			{
+				continue;
+			}
+			if(trigger == TR_TgaType)
+			{
+				p -= 2;
+				avail += 2;
+			}
+
+			Hit hit;
+			memset(&hit, 0, sizeof(hit));
+			hit.offset = hit.dataOffset = base + (u64)(p - data);
+
+			bool found = false;
+			if(trigger == TR_TgaType)
+			{
+				found = checkTGA(p, avail, fileSize, hit);
+			}
+			else
+			{
+				switch(p[0])
+				{
+				case 'B': found = checkBMP(p, avail, fileSize, hit); break;
+				case 'D': found = checkDDS(p, avail, fileSize, hit); break;
+				case 0x89: found = checkPNG(p, avail, hit); break;
+				case 0xab: found = checkKTX(p, avail, fileSize, hit); break;
+				case 0xff: found = checkJPEG(p, avail, hit); break;
+				}
+			}
+
+			if(found)
+			{
+				hits.push_back(hit);
+			}
+		}
+	}
+}
+
+void ImageCarver::chunkTask(void* param, u32 task)
+{
+	Batch* batch = static_cast<Batch*>(param);
+	if(*batch->generation != batch->expected)
+	{
+		return;
+	}
+
+	u64 start = batch->start + (u64)task * kChunkSize;
+	u64 scanSize = std::min<u64>(kChunkSize, batch->fileSize - start);
+
+	MappedWindow window;
+	size_t size = window.map(*batch->file, (off_t)start, (size_t)(scanSize + kOverlap));
+	if(!window.data() || size == 0)
+	{
+		return;
+	}
+
+	scanChunk(window.data(), size, (size_t)std::min<u64>(scanSize, size), start, batch->fileSize, batch->hits[task]);
+}
+
+void ImageCarver::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_pending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		m_pending = false;
+		u32 generation = m_generation;
+		lock.unlock();
+
+		scan(generation);
+
+		lock.lock();
+	}
+}
+
+void ImageCarver::scan(u32 generation)
+{
+	Batch batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation || !m_file)
+		{
+			return;
+		}
+
+		batch.file = m_file;
+		batch.fileSize = m_fileSize;
+	}
+
+	batch.generation = &m_generation;
+	batch.expected = generation;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	m_lastNotify = std::chrono::steady_clock::time_point();
+
+	u32 chunksPerBatch = m_pool->getNumThreads() * kChunksPerThread;
+	u64 batchSize = (u64)chunksPerBatch * kChunkSize;
+	batch.file->willNeed(0, (size_t)std::min(batchSize, batch.fileSize));
+
+	for(u64 start=0; start<batch.fileSize; start+=batchSize)
+	{
+		// Next batch is read while this one is scanned
+		u64 next = start + batchSize;
+		if(next < batch.fileSize)
+		{
+			batch.file->willNeed((off_t)next, (size_t)std::min(batchSize, batch.fileSize - next));
+		}
+
+		u32 numChunks = (u32)((std::min(batchSize, batch.fileSize - start) + kChunkSize - 1) / kChunkSize);
+		batch.start = start;
+		batch.hits.resize(numChunks);
+		for(u32 i=0; i<numChunks; ++i)
+		{
+			batch.hits[i].clear();
+		}
+
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			m_pool->run(chunkTask, &batch, numChunks);
+		}
+
+		bool complete;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			// Chunks are in file order, so the list stays sorted
+			for(u32 i=0; i<numChunks; ++i)
+			{
+				for(size_t j=0; j<batch.hits[i].size(); ++j)
+				{
+					if(m_hits.size() < kMaxHits)
+					{
+						m_hits.push_back(batch.hits[i][j]);
+					}
+					else
+					{
+						m_truncated = true;
+					}
+				}
+			}
+
+			m_scanned = std::min(next, batch.fileSize);
+			m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			m_complete = complete = m_scanned == batch.fileSize;
+		}
+
+		notify(complete);
+	}
+}
+
+void ImageCarver::notify(bool force)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(force || std::chrono::duration<double, std::milli>(now - m_lastNotify).count() >= kNotifyIntervalMs)
+	{
+		m_lastNotify = now;
+		if(m_notify)
+		{
+			m_notify(m_param);
+		}
+	}
+}
+
+int runCarve(const char* filename, u32 numThreads)
+{
+	MappedFile file;
+	if(!file.open(filename))
+	{
+		printf("Can't open %s\n", filename);
+		return 1;
+	}
+
+	ImageCarver carver(NULL, NULL, numThreads);
+	carver.start(file);
+
+	ImageCarver::Stats stats = carver.getStats();
+	while(!stats.complete)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		stats = carver.getStats();
+	}
+
+	std::vector<ImageCarver::Hit> hits;
+	carver.getHits(hits);
+
+	printf("%-16s %-5s %-12s %-16s %s\n", "Offset", "Type", "Size", "Data offset", "Format");
+	for(size_t i=0; i<hits.size(); ++i)
+	{
+		const ImageCarver::Hit& hit = hits[i];
+		char size[32];
+		char format[64];
+		snprintf(size, sizeof(size), "%ux%u", hit.width, hit.height);
+		ImageCarver::getFormatName(hit, format, sizeof(format));
+		printf("%-16llu %-5s %-12s %-16llu %s\n", (unsigned long long)hit.offset, ImageCarver::getTypeName(hit.type), size,
+			(unsigned long long)hit.dataOffset, format);
+	}
+
+	printf("\n%u images%s in %.1f MB, %.1f ms on %u threads (%.2f GB/s)\n", stats.numHits, stats.truncated ? " (list truncated)" : "",
+		stats.scanned / (1024.0 * 1024.0), stats.seconds * 1000.0, stats.numThreads,
+		stats.seconds > 0.0 ? stats.scanned / stats.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+
+	return 0;
+}
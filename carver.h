@@ -0,0 +1,161 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __CARVER_H
+#define __CARVER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "common.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+//
+// Finds images embedded in a file (BMP, TGA, DDS, PNG, KTX and JPEG headers). A worker
+// splits the file into chunks which are scanned in parallel on a pool of its own, chunks
+// overlap by the largest header that is validated so signatures at chunk boundaries aren't
+// lost. Every candidate header is validated before it becomes a hit, and the next chunks
+// are read ahead while the current ones are scanned.
+//
+class ImageCarver
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	static const u32 kChunkSize;
+	static const u32 kOverlap;
+	static const u32 kMaxHits;
+
+	enum Type
+	{
+		IT_BMP = 0,
+		IT_TGA,
+		IT_DDS,
+		IT_PNG,
+		IT_KTX,
+		IT_JPEG,
+		IT_NumTypes
+	};
+
+	enum HitFlags
+	{
+		HIT_Raw = (1<<0), // Pixels can be shown with the raw decoders
+		HIT_FlipV = (1<<1), // Rows are stored bottom-up
+		HIT_FlipH = (1<<2), // Pixels are stored right to left
+		HIT_Palette = (1<<3), // Pixels index a palette, the format is the one of the palette entries
+		HIT_Gray = (1<<4), // 8 bit grey scale
+		HIT_RLE = (1<<5) // TGA run length encoding
+	};
+
+	struct Hit
+	{
+		u64 offset; // Of the header
+		u64 dataOffset; // First pixel, the header for compressed streams
+		u64 dataSize; // Bytes of pixel data, 0 if unknown
+		u64 paletteOffset; // HIT_Palette
+		u32 width;
+		u32 height;
+		u32 rowWidth; // Pixels per row in the file, rows can be padded
+		u8 type; // Type
+		u8 flags; // HitFlags
+		u8 DXTType; // 1, 3 or 5 on S3TC data, 0 otherwise
+		u8 bpp; // As stored
+		int rgbaBits[4]; // See PixelFormat
+		int rgbaChannels[4];
+	};
+
+	struct Stats
+	{
+		u64 fileSize;
+		u64 scanned; // Bytes
+		u32 numHits;
+		u32 numThreads;
+		double seconds; // Scanning time so far
+		bool complete;
+		bool truncated; // More than kMaxHits were found
+	};
+
+	// 0 threads = one per hardware thread
+	ImageCarver(NotifyFunc notify, void* param, u32 numThreads = 0);
+	~ImageCarver();
+
+	// Starts scanning the whole file in the background unless it was scanned already. Returns
+	// true if the scan (re)started. File must stay open until detach() is called.
+	bool start(const MappedFile& file);
+	void detach();
+
+	Stats getStats() const;
+	void getHits(std::vector<Hit>& hits) const; // Sorted by offset
+
+	static const char* getTypeName(u32 type);
+	static void getFormatName(const Hit& hit, char* name, size_t size); // i.e. "8.8.8.0/3214", "DXT1"
+
+	// Validated hits in data[0, scanSize), headers may reach up to size. base is the file
+	// offset of data.
+	static void scanChunk(const u8* data, size_t size, size_t scanSize, u64 base, u64 fileSize, std::vector<Hit>& hits);
+
+private:
+	// Not copyable
+	ImageCarver(const ImageCarver&);
+	ImageCarver& operator=(const ImageCarver&);
+
+	struct Batch;
+	static void chunkTask(void* param, u32 task);
+
+	void run();
+	void scan(u32 generation);
+	void notify(bool force);
+
+	NotifyFunc m_notify;
+	void* m_param;
+	u32 m_numThreads;
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex
+	std::mutex m_workMutex; // Held by the worker while the pool reads file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	ThreadPool* m_pool; // Created with the worker
+	std::atomic<u32> m_generation; // Bumped to abort a running scan
+	bool m_quit;
+	bool m_pending; // Scan requested
+
+	const MappedFile* m_file;
+	u64 m_identity;
+	u64 m_fileSize;
+	u64 m_scanned;
+	std::vector<Hit> m_hits;
+	bool m_complete;
+	bool m_truncated;
+	double m_seconds;
+	std::chrono::steady_clock::time_point m_lastNotify; // Worker only
+};
+
+// Prints the images found in a file and the scan throughput to stdout, returns non-zero on errors
+int runCarve(const char* filename, u32 numThreads);
+
+#endif
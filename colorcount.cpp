@@ -0,0 +1,238 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include "colorcount.h"
+
+namespace
+{
+	const u32 kNumWords = (1 << 24) / 64; // Words of a presence bitmap
+	const u32 kMinPixelsPerPart = 65536; // Smaller frames aren't worth another bitmap
+
+	inline u32 loadColor(const u8* rgb)
+	{
+		return rgb[0] << 16 | rgb[1] << 8 | rgb[2];
+	}
+
+	inline u32 popcount(u64 v)
+	{
+		#if defined __GNUC__
+		return (u32)__builtin_popcountll(v);
+		#else
+		v = v - ((v >> 1) & 0x5555555555555555ull);
+		v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+		v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+		return (u32)((v * 0x0101010101010101ull) >> 56);
+		#endif
+	}
+
+	struct CountJob
+	{
+		const u8* rgb;
+		u32 numPixels;
+		u64** bitmaps;
+		u32 numParts;
+		u32 counts[64]; // Per part of the merge
+	};
+
+	// Part marks its range of pixels in its own bitmap
+	void markTask(void* param, u32 task)
+	{
+		const CountJob* job = static_cast<const CountJob*>(param);
+		u32 first = (u32)((u64)job->numPixels * task / job->numParts);
+		u32 last = (u32)((u64)job->numPixels * (task + 1) / job->numParts);
+		u64* bits = job->bitmaps[task];
+		const u8* rgb = job->rgb + first * 3;
+
+		for(u32 i=first; i<last; ++i, rgb+=3)
+		{
+			u32 color = loadColor(rgb);
+			bits[color >> 6] |= (u64)1 << (color & 63);
+		}
+	}
+
+	// Part merges its slice of all bitmaps, counts and clears it
+	void mergeTask(void* param, u32 task)
+	{
+		CountJob* job = static_cast<CountJob*>(param);
+		u32 first = (u32)((u64)kNumWords * task / job->numParts);
+		u32 last = (u32)((u64)kNumWords * (task + 1) / job->numParts);
+		u64* merged = job->bitmaps[0];
+		u32 count = 0;
+
+		for(u32 b=1; b<job->numParts; ++b)
+		{
+			u64* bits = job->bitmaps[b];
+			for(u32 w=first; w<last; ++w)
+			{
+				merged[w] |= bits[w];
+			}
+			memset(bits + first, 0, (last - first) * sizeof(u64));
+		}
+
+		for(u32 w=first; w<last; ++w)
+		{
+			count += popcount(merged[w]);
+		}
+		memset(merged + first, 0, (last - first) * sizeof(u64));
+
+		job->counts[task] = count;
+	}
+
+	struct MoreFrequent
+	{
+		bool operator()(const ColorCounter::Color& a, const ColorCounter::Color& b) const
+		{
+			return a.count != b.count ? a.count > b.count : a.rgb < b.rgb;
+		}
+	};
+};
+
+ColorCounter::ColorCounter()
+{
+}
+
+u32 ColorCounter::count(const u8* rgb, u32 numPixels, ThreadPool* pool /* NULL */)
+{
+	if(!rgb || numPixels == 0)
+	{
+		return 0;
+	}
+
+	CountJob job;
+	job.rgb = rgb;
+	job.numPixels = numPixels;
+	job.numParts = 1;
+	if(pool)
+	{
+		u32 maxParts = std::min<u32>(pool->getNumThreads(), sizeof(job.counts) / sizeof(job.counts[0]));
+		job.numParts = std::max<u32>(1, std::min(numPixels / kMinPixelsPerPart, maxParts));
+	}
+
+	// Bitmaps are allocated once (zeroed) and kept
+	u64* bitmaps[sizeof(job.counts) / sizeof(job.counts[0])];
+	if(m_bitmaps.size() < job.numParts)
+	{
+		m_bitmaps.resize(job.numParts);
+	}
+	for(u32 i=0; i<job.numParts; ++i)
+	{
+		if(m_bitmaps[i].empty())
+		{
+			m_bitmaps[i].resize(kNumWords, 0);
+		}
+		bitmaps[i] = &m_bitmaps[i][0];
+	}
+	job.bitmaps = bitmaps;
+
+	if(pool && job.numParts > 1)
+	{
+		pool->run(markTask, &job, job.numParts);
+		pool->run(mergeTask, &job, job.numParts);
+	}
+	else
+	{
+		markTask(&job, 0);
+		mergeTask(&job, 0);
+	}
+
+	u32 total = 0;
+	for(u32 i=0; i<job.numParts; ++i)
+	{
+		total += job.counts[i];
+	}
+
+	return total;
+}
+
+void ColorCounter::getTopColors(const u8* rgb, u32 numPixels, u32 n, std::vector<Color>& out)
+{
+	out.clear();
+	if(!rgb || numPixels == 0 || n == 0)
+	{
+		return;
+	}
+
+	// Radix sort of the 24 bit colors (3 passes of 8 bits), equal colors end up next to each other.
+	// The digit histograms of all passes are gathered while loading.
+	u32 offsets[3][256];
+	memset(offsets, 0, sizeof(offsets));
+	m_keys.resize(numPixels);
+	m_sorted.resize(numPixels);
+	for(u32 i=0; i<numPixels; ++i, rgb+=3)
+	{
+		++offsets[0][rgb[2]];
+		++offsets[1][rgb[1]];
+		++offsets[2][rgb[0]];
+		m_keys[i] = loadColor(rgb);
+	}
+
+	for(u32 pass=0; pass<3; ++pass)
+	{
+		u32 sum = 0;
+		for(u32 d=0; d<256; ++d)
+		{
+			u32 count = offsets[pass][d];
+			offsets[pass][d] = sum;
+			sum += count;
+		}
+
+		u32 shift = pass * 8;
+		for(u32 i=0; i<numPixels; ++i)
+		{
+			m_sorted[offsets[pass][(m_keys[i] >> shift) & 0xff]++] = m_keys[i];
+		}
+		m_keys.swap(m_sorted);
+	}
+
+	// Keep the n largest runs (smallest of them on top of the heap)
+	MoreFrequent moreFrequent;
+	for(u32 i=0; i<numPixels; )
+	{
+		u32 j = i + 1;
+		while(j < numPixels && m_keys[j] == m_keys[i])
+		{
+			++j;
+		}
+
+		Color color = { m_keys[i], j - i };
+		if(out.size() < n)
+		{
+			out.push_back(color);
+			std::push_heap(out.begin(), out.end(), moreFrequent);
+		}
+		else if(moreFrequent(color, out.front()))
+		{
+			std::pop_heap(out.begin(), out.end(), moreFrequent);
+			out.back() = color;
+			std::push_heap(out.begin(), out.end(), moreFrequent);
+		}
+
+		i = j;
+	}
+
+	std::sort_heap(out.begin(), out.end(), moreFrequent);
+}
+
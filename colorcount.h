@@ -0,0 +1,66 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __COLORCOUNT_H
+#define __COLORCOUNT_H
+
+#include <vector>
+#include "common.h"
+#include "threadpool.h"
+
+//
+// Distinct colors of 24bpp RGB frames. Every part of a frame marks the colors it sees in
+// its own presence bitmap (one bit per color, 2 MiB), the bitmaps are then OR-ed slice by
+// slice and popcounted. Bitmaps are left cleared for the next frame, so nothing is allocated
+// per frame. Not thread safe, one counter per render thread.
+//
+class ColorCounter
+{
+public:
+	struct Color
+	{
+		u32 rgb; // 0xRRGGBB
+		u32 count; // Number of pixels
+	};
+
+	ColorCounter();
+
+	// Number of distinct colors, parts are spread over the pool if there is one
+	u32 count(const u8* rgb, u32 numPixels, ThreadPool* pool = NULL);
+
+	// Most frequent colors, most frequent first
+	void getTopColors(const u8* rgb, u32 numPixels, u32 n, std::vector<Color>& out);
+
+private:
+	// Not copyable
+	ColorCounter(const ColorCounter&);
+	ColorCounter& operator=(const ColorCounter&);
+
+	std::vector<std::vector<u64> > m_bitmaps; // One per part, cleared after every count
+	std::vector<u32> m_keys; // Sort buffers of getTopColors
+	std::vector<u32> m_sorted;
+};
+
+#endif
+
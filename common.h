@@ -0,0 +1,88 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __COMMON_H
+#define __COMMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef signed char i8;
+typedef unsigned char u8;
+typedef signed short i16;
+typedef unsigned short u16;
+typedef signed int i32;
+typedef unsigned int u32;
+typedef signed long long i64;
+typedef unsigned long long u64;
+
+#define IS64BIT (INTPTR_MAX == INT64_MAX)
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+
+#pragma pack(push, packing)
+#pragma pack(1)
+struct TgaHeader
+{
+	u8 identsize;		// Size of id field that follows 18 byte header (0 usually)
+	u8 colormaptype;	// Type of color map 0 = none, 1 = has palette
+	u8 imagetype;		// Type of image 0 = none,1 = indexed,2 = rgb,3 = grey, +8 = rle packed
+	u16 palletestart;	// First color map entry in palette
+	u16 palettelength;	// Number of colors in palette
+	u8 palettebits;		// Number of bits per palette entry 15,16,24,32
+	u16 xstart;			// Image x origin
+	u16 ystart;			// Image y origin
+	u16 width;			// Image width
+	u16 height;			// Image height
+	u8 bpp;				// Image bit depth
+	u8 descriptor;		// Image descriptor bits (vh flip bits)
+};
+#pragma pack(pop)
+
+// Range of file bytes
+struct ByteRange
+{
+	u64 offset;
+	u64 size;
+};
+
+// FNV-1a, used to build cache keys
+inline u64 hashBytes(const void* data, size_t size, u64 seed = 14695981039346656037ULL)
+{
+	const u8* bytes = (const u8*)data;
+	u64 hash = seed;
+	for(size_t i=0; i<size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+#endif
+
@@ -0,0 +1,1137 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include "decoder.h"
+
+namespace
+{
+	inline void applyBitwiseOps(const std::vector<BitwiseOp>& ops, u8& rc, u8& gc, u8& bc)
+	{
+		for(std::vector<BitwiseOp>::const_iterator iter = ops.begin(); iter != ops.end(); ++iter)
+		{
+			switch(iter->op)
+			{
+			case BitwiseOp::OP_AND:
+				rc &= iter->r;
+				gc &= iter->g;
+				bc &= iter->b;
+				break;
+			case BitwiseOp::OP_OR:
+				rc |= iter->r;
+				gc |= iter->g;
+				bc |= iter->b;
+				break;
+			case BitwiseOp::OP_XOR:
+				rc ^= iter->r;
+				gc ^= iter->g;
+				bc ^= iter->b;
+				break;
+			case BitwiseOp::OP_SHL:
+				rc <<= iter->r;
+				gc <<= iter->g;
+				bc <<= iter->b;
+				break;
+			case BitwiseOp::OP_SHR:
+				rc >>= iter->r;
+				gc >>= iter->g;
+				bc >>= iter->b;
+				break;
+			case BitwiseOp::OP_ROL:
+				rc = (rc << std::min<u8>(iter->r, 8)) | (rc >> (8 - std::min<u8>(iter->r, 8)));
+				gc = (gc << std::min<u8>(iter->g, 8)) | (gc >> (8 - std::min<u8>(iter->g, 8)));
+				bc = (bc << std::min<u8>(iter->b, 8)) | (bc >> (8 - std::min<u8>(iter->b, 8)));
+				break;
+			case BitwiseOp::OP_ROR:
+				rc = (rc >> std::min<u8>(iter->r, 8)) | (rc << (8 - std::min<u8>(iter->r, 8)));
+				gc = (gc >> std::min<u8>(iter->g, 8)) | (gc << (8 - std::min<u8>(iter->g, 8)));
+				bc = (bc >> std::min<u8>(iter->b, 8)) | (bc << (8 - std::min<u8>(iter->b, 8)));
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	// Pixels are stored little endian
+	template <u32 PS>
+	inline u32 loadPixel(const u8* data)
+	{
+		u32 pixel = 0;
+		for(u32 j=0; j<PS; ++j)
+		{
+			pixel |= data[j] << (j * 8);
+		}
+		return pixel;
+	}
+
+	inline u8 extractChannel(const CompiledFormat& format, u32 pixel, int c)
+	{
+		return (u8)(((pixel >> format.shift[c]) & format.mask[c]) << format.scale[c]);
+	}
+
+	// Kernels step through the output by STEP bytes (3 or -3) and store BGR instead of RGB if asked
+	template <int STEP, bool BGR>
+	void decodeTable8(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		const u8* table = &format.table[0];
+		const int r = BGR ? 2 : 0, b = BGR ? 0 : 2;
+
+		for(u32 n=0; n<count; ++n, rgbOut+=STEP)
+		{
+			const u8* rgb = table + data[n] * 3;
+			rgbOut[r] = rgb[0];
+			rgbOut[1] = rgb[1];
+			rgbOut[b] = rgb[2];
+		}
+	}
+
+	template <int STEP, bool BGR>
+	void decodeTable16(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		const u8* table = &format.table[0];
+		const int r = BGR ? 2 : 0, b = BGR ? 0 : 2;
+
+		for(u32 n=0; n<count; ++n, data+=2, rgbOut+=STEP)
+		{
+			const u8* rgb = table + loadPixel<2>(data) * 3;
+			rgbOut[r] = rgb[0];
+			rgbOut[1] = rgb[1];
+			rgbOut[b] = rgb[2];
+		}
+	}
+
+	template <u32 PS, int STEP, bool BGR>
+	void decodeShift(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		const u32 rs = format.shift[0], gs = format.shift[1], bs = format.shift[2];
+		const u32 rm = format.mask[0], gm = format.mask[1], bm = format.mask[2];
+		const u32 ru = format.scale[0], gu = format.scale[1], bu = format.scale[2];
+		const int r = BGR ? 2 : 0, b = BGR ? 0 : 2;
+
+		for(u32 n=0; n<count; ++n, data+=PS, rgbOut+=STEP)
+		{
+			u32 pixel = loadPixel<PS>(data);
+			rgbOut[r] = (u8)(((pixel >> rs) & rm) << ru);
+			rgbOut[1] = (u8)(((pixel >> gs) & gm) << gu);
+			rgbOut[b] = (u8)(((pixel >> bs) & bm) << bu);
+		}
+	}
+
+	// 8 bit channels are plain byte copies (masks are either 0xff or 0 for channels that are off)
+	template <u32 PS, int STEP, bool BGR>
+	void decodeBytes(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		const u32 ro = format.shift[0] / 8, go = format.shift[1] / 8, bo = format.shift[2] / 8;
+		const u8 rm = (u8)format.mask[0], gm = (u8)format.mask[1], bm = (u8)format.mask[2];
+		const int r = BGR ? 2 : 0, b = BGR ? 0 : 2;
+
+		for(u32 n=0; n<count; ++n, data+=PS, rgbOut+=STEP)
+		{
+			rgbOut[r] = data[ro] & rm;
+			rgbOut[1] = data[go] & gm;
+			rgbOut[b] = data[bo] & bm;
+		}
+	}
+
+	// Pixels per bitwise pass, small enough for the decoded span to still be in cache
+	const u32 kBitwiseChunk = 4096;
+
+	template <int STEP, bool BGR>
+	void decodeScalar(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		switch(format.kernel)
+		{
+		case CompiledFormat::K_Table8:
+			decodeTable8<STEP, BGR>(format, data, count, rgbOut);
+			break;
+		case CompiledFormat::K_Table16:
+			decodeTable16<STEP, BGR>(format, data, count, rgbOut);
+			break;
+		case CompiledFormat::K_Shift24:
+			decodeShift<3, STEP, BGR>(format, data, count, rgbOut);
+			break;
+		case CompiledFormat::K_Shift32:
+			decodeShift<4, STEP, BGR>(format, data, count, rgbOut);
+			break;
+		case CompiledFormat::K_Bytes24:
+			decodeBytes<3, STEP, BGR>(format, data, count, rgbOut);
+			break;
+		case CompiledFormat::K_Bytes32:
+			decodeBytes<4, STEP, BGR>(format, data, count, rgbOut);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Vector kernels only write plain RGB spans, mirrored and BGR output is done by the scalar ones
+	void decodePlain(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut, int step, bool bgr)
+	{
+		if(step > 0 && !bgr)
+		{
+			if(format.simd != SIMD_None)
+			{
+				u32 done = decodeSpanSimd(format, data, count, rgbOut);
+				data += done * format.pixelSize;
+				rgbOut += done * 3;
+				count -= done;
+			}
+			decodeScalar<3, false>(format, data, count, rgbOut);
+		}
+		else if(step > 0)
+		{
+			decodeScalar<3, true>(format, data, count, rgbOut);
+		}
+		else if(!bgr)
+		{
+			decodeScalar<-3, false>(format, data, count, rgbOut);
+		}
+		else
+		{
+			decodeScalar<-3, true>(format, data, count, rgbOut);
+		}
+	}
+
+	// count pixels written step bytes apart (3 or -3) starting at rgbOut
+	void decodeRow(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut, int step, bool bgr)
+	{
+		if(!format.bitwisePass)
+		{
+			decodePlain(format, data, count, rgbOut, step, bgr);
+			return;
+		}
+
+		for(u32 n=0; n<count; n+=kBitwiseChunk)
+		{
+			u32 chunk = std::min(count - n, kBitwiseChunk);
+			u8* out = rgbOut + (ptrdiff_t)n * step;
+			decodePlain(format, data + n * format.pixelSize, chunk, out, step, bgr);
+
+			// Table works on memory order, a mirrored chunk starts at its last pixel
+			format.bitwise.apply(step > 0 ? out : out + (ptrdiff_t)(chunk - 1) * step, chunk, bgr);
+		}
+	}
+
+	void fillPixels(u8* out, u32 count, const u8* color)
+	{
+		if(color[0] == color[1] && color[0] == color[2])
+		{
+			memset(out, color[0], count * 3);
+			return;
+		}
+
+		// Double the filled part until the span is complete
+		memcpy(out, color, 3);
+		for(u32 filled=1; filled<count; )
+		{
+			u32 n = std::min(filled, count - filled);
+			memcpy(out + filled * 3, out, n * 3);
+			filled += n;
+		}
+	}
+
+	// count copies of one RGB pixel starting at the index-th pixel of the frame
+	void fillSpan(const OutputLayout& out, u32 index, u32 count, const u8* rgb)
+	{
+		u8 color[3] = { rgb[out.bgr ? 2 : 0], rgb[1], rgb[out.bgr ? 0 : 2] };
+
+		if(out.isContiguous())
+		{
+			fillPixels(out.origin + (size_t)index * 3, count, color);
+			return;
+		}
+
+		while(count > 0)
+		{
+			u32 x = index % out.width;
+			u32 n = std::min(count, out.width - x);
+
+			// All pixels are the same, so a mirrored row is filled from its lowest address
+			u8* dest = out.pixel(x, index / out.width);
+			if(out.pixelStride < 0)
+			{
+				dest += (ptrdiff_t)(n - 1) * out.pixelStride;
+			}
+			fillPixels(dest, n, color);
+
+			index += n;
+			count -= n;
+		}
+	}
+};
+
+//
+// BitwiseTable
+//
+BitwiseTable::BitwiseTable()
+{
+	for(u32 i=0; i<256; ++i)
+	{
+		lut[0][i] = lut[1][i] = lut[2][i] = (u8)i;
+	}
+}
+
+void BitwiseTable::compile(const std::vector<BitwiseOp>& ops)
+{
+	// Every op works on a single channel value, so running all 256 values through the chain covers everything
+	for(u32 i=0; i<256; ++i)
+	{
+		u8 r = (u8)i, g = (u8)i, b = (u8)i;
+		applyBitwiseOps(ops, r, g, b);
+		lut[0][i] = r;
+		lut[1][i] = g;
+		lut[2][i] = b;
+	}
+}
+
+bool BitwiseTable::isIdentity() const
+{
+	for(u32 i=0; i<256; ++i)
+	{
+		if(lut[0][i] != i || lut[1][i] != i || lut[2][i] != i)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void BitwiseTable::apply(u8* rgb, u32 numPixels, bool bgr /* false */) const
+{
+	const u8* r = lut[bgr ? 2 : 0];
+	const u8* g = lut[1];
+	const u8* b = lut[bgr ? 0 : 2];
+
+	for(u32 n=0; n<numPixels; ++n, rgb+=3)
+	{
+		rgb[0] = r[rgb[0]];
+		rgb[1] = g[rgb[1]];
+		rgb[2] = b[rgb[2]];
+	}
+}
+
+
+//
+// OutputLayout
+//
+OutputLayout::OutputLayout() :
+	origin(NULL),
+	rowStride(0),
+	pixelStride(3),
+	bgr(false),
+	width(0),
+	height(0)
+{
+}
+
+OutputLayout::OutputLayout(u8* buffer, u32 width, u32 height, bool flipV /* false */, bool flipH /* false */, bool bgr /* false */, u32 rowAlign /* 1 */) :
+	origin(buffer),
+	rowStride(getPitch(width, rowAlign)),
+	pixelStride(3),
+	bgr(bgr),
+	width(width),
+	height(height)
+{
+	if(flipV && height > 0)
+	{
+		origin += (ptrdiff_t)(height - 1) * rowStride;
+		rowStride = -rowStride;
+	}
+
+	if(flipH && width > 0)
+	{
+		origin += (ptrdiff_t)(width - 1) * 3;
+		pixelStride = -3;
+	}
+}
+
+u32 OutputLayout::getPitch(u32 width, u32 rowAlign /* 1 */)
+{
+	rowAlign = std::max(rowAlign, 1u);
+	return (width * 3 + rowAlign - 1) / rowAlign * rowAlign;
+}
+
+
+//
+// Viewport
+//
+Viewport::Viewport() :
+	canvasWidth(0),
+	canvasHeight(0),
+	x(0),
+	y(0),
+	width(0),
+	height(0)
+{
+}
+
+Viewport::Viewport(u32 canvasWidth, u32 canvasHeight) :
+	canvasWidth(canvasWidth),
+	canvasHeight(canvasHeight),
+	x(0),
+	y(0),
+	width(canvasWidth),
+	height(canvasHeight)
+{
+}
+
+Viewport::Viewport(u32 canvasWidth, u32 canvasHeight, u32 x, u32 y, u32 width, u32 height) :
+	canvasWidth(canvasWidth),
+	canvasHeight(canvasHeight),
+	x(x),
+	y(y),
+	width(width),
+	height(height)
+{
+}
+
+
+//
+// CompiledFormat
+//
+CompiledFormat::CompiledFormat() :
+	kernel(K_None),
+	pixelSize(0),
+	bitwisePass(false),
+	simd(SIMD_None),
+	simdLevel(SIMD_None),
+	signature(0)
+{
+	memset(shift, 0, sizeof(shift));
+	memset(mask, 0, sizeof(mask));
+	memset(scale, 0, sizeof(scale));
+}
+
+bool CompiledFormat::compile(const PixelFormat& format, u32 flags /* 0 */, const u8* palette /* NULL */, const BitwiseTable* bitwiseTable /* NULL */)
+{
+	// Hash the inputs member by member, PixelFormat has padding
+	u8 hasPalette = palette ? 1 : 0;
+	u8 hasBitwise = (bitwiseTable && !bitwiseTable->isIdentity()) ? 1 : 0;
+	SimdLevel level = getSimdLevel();
+	u64 sig = hashBytes(format.bitMask, sizeof(format.bitMask));
+	sig = hashBytes(format.rgbaChannels, sizeof(format.rgbaChannels), sig);
+	sig = hashBytes(format.rgbaBits, sizeof(format.rgbaBits), sig);
+	sig = hashBytes(&format.pixelSize, sizeof(format.pixelSize), sig);
+	sig = hashBytes(&format.valid, sizeof(format.valid), sig);
+	sig = hashBytes(&flags, sizeof(flags), sig);
+	sig = hashBytes(&hasPalette, sizeof(hasPalette), sig);
+	sig = hashBytes(&hasBitwise, sizeof(hasBitwise), sig);
+
+	if(palette)
+	{
+		sig = hashBytes(palette, 256 * 3, sig);
+	}
+
+	if(hasBitwise)
+	{
+		sig = hashBytes(bitwiseTable->lut, sizeof(bitwiseTable->lut), sig);
+	}
+
+	// The vector level only picks the kernels, their output is the same so it isn't part of the signature
+	if(signature != 0 && sig == signature && level == simdLevel)
+	{
+		return isValid();
+	}
+
+	signature = sig;
+	simdLevel = level;
+	kernel = K_None;
+	pixelSize = 0;
+	simd = SIMD_None;
+	bitwise = BitwiseTable();
+	bitwisePass = false;
+	table.clear();
+	memset(shift, 0, sizeof(shift));
+	memset(mask, 0, sizeof(mask));
+	memset(scale, 0, sizeof(scale));
+
+	if(!format.valid)
+	{
+		return false;
+	}
+
+	// Same channel setup as the reference loop
+	PixelFormat fmt = format;
+	int* bitMask = fmt.bitMask;
+	int* rgbaChannels = fmt.rgbaChannels;
+	int* rgbaBits = fmt.rgbaBits;
+	int ps = palette ? 1 : fmt.pixelSize;
+
+	if(ps < 1 || ps > 4)
+	{
+		return false;
+	}
+
+	for(int i=0; i<4; ++i)
+	{
+		if(rgbaChannels[i] < 0 || rgbaChannels[i] > 3 || rgbaBits[i] < 0 || rgbaBits[i] > 8)
+		{
+			return false;
+		}
+	}
+
+	if((flags & CF_IgnoreChannelOrder) != 0)
+	{
+		int rgbaMask[4] = { bitMask[rgbaChannels[0]], bitMask[rgbaChannels[1]], bitMask[rgbaChannels[2]], bitMask[rgbaChannels[3]] };
+		for(int i=0; i<4; ++i)
+		{
+			bitMask[i] = rgbaMask[i];
+			rgbaChannels[i] = i;
+		}
+	}
+
+	int bitCount[4];
+	for(int i=0; i<4; ++i)
+	{
+		bitCount[rgbaChannels[i]] = rgbaBits[i];
+	}
+
+	bool masked[3] = { (flags & CF_IgnoreRedChannel) != 0, (flags & CF_IgnoreGreenChannel) != 0, (flags & CF_IgnoreBlueChannel) != 0 };
+	bool alphaOnly = masked[0] && masked[1] && masked[2];
+
+	for(int c=0; c<3; ++c)
+	{
+		// Alpha only shows the alpha channel as grey scale
+		int src = alphaOnly ? 3 : c;
+		bool on = alphaOnly ? rgbaBits[3] != 0 : (!masked[c] && rgbaBits[c] != 0);
+
+		int start = 0;
+		for(int j=0; j<rgbaChannels[src]; ++j)
+		{
+			start += bitCount[j];
+		}
+
+		if(on && start < 32)
+		{
+			shift[c] = (u32)start;
+			mask[c] = (u32)bitMask[rgbaChannels[src]] & 0xff;
+			scale[c] = (u32)(8 - bitCount[rgbaChannels[src]]);
+		}
+	}
+
+	pixelSize = (u32)ps;
+
+	if(palette)
+	{
+		// Indices past the palette (alpha position of the last entry) read as black
+		table.resize(256 * 3);
+		for(u32 i=0; i<256; ++i)
+		{
+			for(int c=0; c<3; ++c)
+			{
+				u32 index = i * 3 + rgbaChannels[c];
+				table[i * 3 + c] = (masked[c] || index >= 256 * 3) ? 0 : palette[index];
+			}
+		}
+		kernel = K_Table8;
+	}
+	else if(ps <= 2)
+	{
+		u32 entries = 1 << (ps * 8);
+		table.resize(entries * 3);
+		for(u32 i=0; i<entries; ++i)
+		{
+			table[i * 3 + 0] = extractChannel(*this, i, 0);
+			table[i * 3 + 1] = extractChannel(*this, i, 1);
+			table[i * 3 + 2] = extractChannel(*this, i, 2);
+		}
+		kernel = ps == 1 ? K_Table8 : K_Table16;
+	}
+	else
+	{
+		bool bytes = true;
+		for(int c=0; c<3; ++c)
+		{
+			if(mask[c] != 0 && (mask[c] != 0xff || shift[c] % 8 != 0))
+			{
+				bytes = false;
+			}
+		}
+
+		if(bytes)
+		{
+			kernel = ps == 3 ? K_Bytes24 : K_Bytes32;
+		}
+		else
+		{
+			kernel = ps == 3 ? K_Shift24 : K_Shift32;
+		}
+	}
+
+	// Bitwise ops work on the final channel values, tables can take them in right away.
+	// All other kernels run a table pass over what they decoded.
+	if(hasBitwise)
+	{
+		bitwise = *bitwiseTable;
+
+		if(!table.empty())
+		{
+			for(size_t i=0; i<table.size(); i+=3)
+			{
+				table[i+0] = bitwise.lut[0][table[i+0]];
+				table[i+1] = bitwise.lut[1][table[i+1]];
+				table[i+2] = bitwise.lut[2][table[i+2]];
+			}
+		}
+		else
+		{
+			bitwisePass = true;
+		}
+	}
+
+	// The vector kernels decode the plain format, folded tables are scalar only
+	if((!hasBitwise || bitwisePass) && hasSimdKernel(*this, level))
+	{
+		simd = level;
+	}
+
+	return true;
+}
+
+void decodeSpan(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+{
+	decodeRow(format, data, count, rgbOut, 3, false);
+}
+
+void decodeSpan(const CompiledFormat& format, const u8* data, u32 count, const OutputLayout& out, u32 index)
+{
+	if(out.isContiguous())
+	{
+		decodeRow(format, data, count, out.origin + (size_t)index * 3, 3, false);
+		return;
+	}
+
+	// Split at row ends, every row has its own start and direction
+	while(count > 0)
+	{
+		u32 x = index % out.width;
+		u32 n = std::min(count, out.width - x);
+		decodeRow(format, data, n, out.pixel(x, index / out.width), out.pixelStride, out.bgr);
+
+		data += n * format.pixelSize;
+		index += n;
+		count -= n;
+	}
+}
+
+void convertRaw(const PixelFormat& format, u32 width, u32 height, const u8* data, u32 size, u8* rgbOut, u32 flags /* 0 */, const std::vector<BitwiseOp>* bwOps /* NULL */, u32 tileX /* 0xffff */, u32 tileY /* 0xffff */, const u8* palette /* NULL */)
+{
+	BitwiseTable bitwise;
+	if(bwOps)
+	{
+		bitwise.compile(*bwOps);
+	}
+
+	CompiledFormat compiled;
+	if(compiled.compile(format, flags, palette, bwOps ? &bitwise : NULL))
+	{
+		convertRaw(compiled, data, size, Viewport(width, height), OutputLayout(rgbOut, width, height), flags, tileX, tileY);
+	}
+}
+
+void convertRaw(const CompiledFormat& format, const u8* data, u32 size, const Viewport& view, const OutputLayout& out, u32 flags /* 0 */, u32 tileX /* 0xffff */, u32 tileY /* 0xffff */, u32 part /* 0 */, u32 numParts /* 1 */)
+{
+	u32 width = view.canvasWidth;
+	u32 height = view.canvasHeight;
+
+	if(!format.isValid() || width == 0 || height == 0 || view.width == 0 || view.height == 0 || tileX == 0 || tileY == 0 || part >= numParts)
+	{
+		return;
+	}
+
+	u32 ps = format.pixelSize;
+	u32 xTiles = 1;
+	u32 yTiles = 1;
+
+	if((flags & CF_IgnoreTiles) == 0 && tileX < width && tileY < height)
+	{
+		xTiles = width / tileX;
+		yTiles = height / tileY;
+	}
+
+	// Canvas pixels are in the same order as the reference loop: tile by tile, tileX pixels
+	// per tile row. Untiled rows are back to back.
+	u64 endPixel = std::min((u64)xTiles * yTiles * tileY * tileX, (u64)(size / ps));
+	bool contiguous = xTiles == 1 && yTiles == 1 && tileX == width;
+
+	// Parts are ranges of viewport rows
+	u32 first = (u32)((u64)view.height * part / numParts);
+	u32 last = (u32)((u64)view.height * (part + 1) / numParts);
+
+	// Whole untiled rows, decode them as a single span
+	if(contiguous && view.x == 0 && view.width == width)
+	{
+		u64 origin = (u64)view.y * width;
+		u64 begin = std::min(origin + (u64)first * width, endPixel);
+		u64 end = std::min(origin + (u64)last * width, endPixel);
+		if(begin < end)
+		{
+			decodeSpan(format, data + begin * ps, (u32)(end - begin), out, (u32)(begin - origin));
+		}
+		return;
+	}
+
+	// Otherwise viewport rows are split where they cross tile rows
+	for(u32 row=first; row<last; ++row)
+	{
+		u64 canvasPixel = (u64)(view.y + row) * width + view.x;
+
+		for(u32 x=0; x<view.width; )
+		{
+			u64 numPixels = canvasPixel + x;
+			if(numPixels >= endPixel)
+			{
+				return;
+			}
+
+			u32 count = (u32)std::min<u64>(view.width - x, endPixel - numPixels);
+			u64 src = numPixels;
+
+			if(!contiguous)
+			{
+				u64 tileRow = numPixels / tileX;
+				u32 k = (u32)(numPixels % tileX);
+				u64 tile = tileRow / tileY;
+				u64 y = tileRow % tileY;
+				u64 tx = tile % xTiles;
+				u64 ty = tile / xTiles;
+
+				count = std::min(count, tileX - k);
+				src = (ty * tileY + y) * width + tx * tileX + k;
+			}
+
+			// Never read past the data, such pixels stay black
+			u64 avail = src < size / ps ? size / ps - src : 0;
+			if(avail > 0)
+			{
+				decodeSpan(format, data + src * ps, (u32)std::min<u64>(count, avail), out, row * view.width + x);
+			}
+
+			x += count;
+		}
+	}
+}
+
+void convertRawReference(const PixelFormat& format, u32 width, u32 height, const u8* data, u32 size, u8* rgbOut, u32 flags /* 0 */, const std::vector<BitwiseOp>* bwOps /* NULL */, u32 tileX /* 0xffff */, u32 tileY /* 0xffff */, const u8* palette /* NULL */)
+{	
+	if(!format.valid || width == 0 || height == 0)
+	{
+		return;
+	}
+
+	PixelFormat fmt = format;
+	int* bitMask = fmt.bitMask;
+	int* rgbaChannels = fmt.rgbaChannels;
+	int* rgbaBits = fmt.rgbaBits;
+	u32 ps = (u32)fmt.pixelSize;
+
+	if((flags & CF_IgnoreChannelOrder) != 0)
+	{
+		int rgbaMask[4] = { bitMask[rgbaChannels[0]], bitMask[rgbaChannels[1]], bitMask[rgbaChannels[2]], bitMask[rgbaChannels[3]] };
+		bitMask[0] = rgbaMask[0];
+		bitMask[1] = rgbaMask[1];
+		bitMask[2] = rgbaMask[2];
+		bitMask[3] = rgbaMask[3];
+
+		rgbaChannels[0] = 0;
+		rgbaChannels[1] = 1;
+		rgbaChannels[2] = 2;
+		rgbaChannels[3] = 3;
+	}
+
+	// In palette mode each pixel is 1 byte wide indexing a total of 255 colors
+	if(palette)
+	{
+		ps = 1;
+	}
+
+	int bitCount[4];
+	bitCount[rgbaChannels[0]] = rgbaBits[0];
+	bitCount[rgbaChannels[1]] = rgbaBits[1];
+	bitCount[rgbaChannels[2]] = rgbaBits[2];
+	bitCount[rgbaChannels[3]] = rgbaBits[3];
+	
+	// Shift pixels up by the difference between 8bit per channel and the interpreted data.
+	// This will avoid darker images for lower precision formats (i.e. 5551 -> 8888 = 1.1111 -> 0001.1111).
+	int rdiff = 8 - bitCount[rgbaChannels[0]];
+	int gdiff = 8 - bitCount[rgbaChannels[1]];
+	int bdiff = 8 - bitCount[rgbaChannels[2]];
+	int adiff = 8 - bitCount[rgbaChannels[3]];
+	
+	// Align backwards
+	while(size % ps != 0)
+	{
+		--size;
+	}
+	
+	// Convert
+	bool redMasked = (flags & CF_IgnoreRedChannel) != 0;
+	bool greenMasked = (flags & CF_IgnoreGreenChannel) != 0;
+	bool blueMasked = (flags & CF_IgnoreBlueChannel) != 0;
+	bool alphaOnly = redMasked && greenMasked && blueMasked;
+	if(alphaOnly)
+	{
+		rdiff = gdiff = bdiff = adiff;
+	}
+
+	u32 xTiles = 1;
+	u32 yTiles = 1;
+
+	if((flags & CF_IgnoreTiles) == 0 && tileX < width && tileY < height)
+	{
+		xTiles = width / tileX;
+		yTiles = height / tileY;
+	}
+	
+	u32 numPixels = 0;
+	u32 totalPixels = size / ps;
+	u32 stride = width * ps;
+	u32 dest = 0;
+	
+	for(u32 ty=0; ty<yTiles; ++ty)
+	{
+		u32 by = ty * tileY;
+		
+		for(u32 tx=0; tx<xTiles; ++tx)
+		{
+			u32 bx = tx * tileX;
+			
+			for(u32 y=0; y<tileY; ++y)
+			{
+				for(u32 x=0; x<tileX; ++x, dest+=3, ++numPixels)
+				{
+					u32 i = (by + y) * stride + (bx + x) * ps;
+					
+					if(numPixels >= totalPixels)
+					{
+						return;
+					}
+					
+					// Read pixel byte-wise
+					u32 pixel = 0;
+					for(u32 j=0; j<ps; ++j)
+					{
+						pixel |= data[i+j] << (j * 8);
+					}
+					
+					// Final channel values
+					u8 r = 0, g = 0, b = 0;
+
+					if(!palette)
+					{
+						if(alphaOnly)
+						{
+							if(rgbaChannels[3] >= 0 && rgbaBits[3] != 0)
+							{
+								int start = 0;
+								for(int j=0; j<rgbaChannels[3]; ++j)
+								{
+									start += bitCount[j];
+								}
+								r = pixel >> start;
+								r &= bitMask[rgbaChannels[3]];
+								g = b = r;
+							}
+						}
+						else
+						{
+							if(!redMasked && rgbaChannels[0] >= 0 && rgbaBits[0] != 0)
+							{
+								int start = 0;
+								for(int j=0; j<rgbaChannels[0]; ++j)
+								{
+									start += bitCount[j];
+								}
+								r = pixel >> start;
+								r &= bitMask[rgbaChannels[0]];
+							}
+					
+							if(!greenMasked && rgbaChannels[1] >= 0 && rgbaBits[1] != 0)
+							{
+								int start = 0;
+								for(int j=0; j<rgbaChannels[1]; ++j)
+								{
+									start += bitCount[j];
+								}
+								g = pixel >> start;
+								g &= bitMask[rgbaChannels[1]];
+							}
+					
+							if(!blueMasked && rgbaChannels[2] >= 0 && rgbaBits[2] != 0)
+							{
+								int start = 0;
+								for(int j=0; j<rgbaChannels[2]; ++j)
+								{
+									start += bitCount[j];
+								}
+								b = pixel >> start;
+								b &= bitMask[rgbaChannels[2]];
+							}
+						}
+
+						rgbOut[dest+0] = r << rdiff;
+						rgbOut[dest+1] = g << gdiff;
+						rgbOut[dest+2] = b << bdiff;
+					}
+					else
+					{
+						rgbOut[dest+0] = redMasked ? 0 : palette[pixel * 3 + rgbaChannels[0]];
+						rgbOut[dest+1] = greenMasked ? 0 : palette[pixel * 3 + rgbaChannels[1]];
+						rgbOut[dest+2] = blueMasked ? 0 : palette[pixel * 3 + rgbaChannels[2]];
+					}
+
+					if(bwOps)
+					{
+						applyBitwiseOps(*bwOps, rgbOut[dest+0], rgbOut[dest+1], rgbOut[dest+2]);
+					}
+				}
+			}
+		}
+	}
+}
+
+void convertDXT(const PixelFormat& format, const u8* data, u32 size, const Viewport& view, const OutputLayout& out, u32 flags, int DXTType, bool oneBitAlpha /* false */, u32 part /* 0 */, u32 numParts /* 1 */)
+{
+	u32 width = view.canvasWidth;
+	u32 height = view.canvasHeight;
+
+	if(!format.valid || width == 0 || height == 0 || view.width == 0 || view.height == 0)
+	{
+		return;
+	}
+
+	PixelFormat fmt = format;
+	int* rgbaChannels = fmt.rgbaChannels;
+
+	bool redMasked = (flags & CF_IgnoreRedChannel) != 0;
+	bool greenMasked = (flags & CF_IgnoreGreenChannel) != 0;
+	bool blueMasked = (flags & CF_IgnoreBlueChannel) != 0;
+	bool alphaOnly = redMasked && greenMasked && blueMasked;
+	
+	const u8* start = data;
+	u32 xTiles = width / 4;
+	u32 r = out.bgr ? 2 : 0;
+	u32 b = out.bgr ? 0 : 2;
+	u32 blockSize = DXTType > 1 ? 16 : 8;
+	u8 codes[16];
+
+	// Block rows and columns touching the viewport, the last block row may be cut off by the canvas height
+	u32 viewBottom = std::min(view.y + view.height, height);
+	u32 viewRight = std::min(view.x + view.width, xTiles * 4);
+	u32 firstRow = view.y / 4;
+	u32 endRow = (viewBottom + 3) / 4;
+	u32 firstCol = view.x / 4;
+	u32 endCol = (viewRight + 3) / 4;
+
+	// Parts are ranges of those block rows
+	u32 numRows = endRow > firstRow ? endRow - firstRow : 0;
+	u32 first = firstRow + (u32)((u64)numRows * part / numParts);
+	u32 last = firstRow + (u32)((u64)numRows * (part + 1) / numParts);
+
+	if(part >= numParts)
+	{
+		return;
+	}
+	
+	for(u32 ty=first; ty<last; ++ty)
+	{
+		u32 by = ty * 4;
+		u32 top = std::max(by, view.y);
+		u32 bottom = std::min(by + 4, viewBottom);
+		
+		for(u32 tx=firstCol; tx<endCol; ++tx)
+		{
+			// Blocks are stored row by row, make sure we don't read more then is given
+			u64 offset = ((u64)ty * xTiles + tx) * blockSize;
+			if(offset + blockSize > size)
+			{
+				return;
+			}
+
+			data = start + offset;
+			u32 bx = tx * 4;
+			u32 left = std::max(bx, view.x);
+			u32 right = std::min(bx + 4, viewRight);
+			
+			// Skip alpha in DXT3/DXT5
+			if(DXTType > 1)
+			{
+				data += 8;
+			}
+			
+			u32 colors = *((u32*)data);
+			u32 clrlut = *((u32*)data + 1);
+			data += 8;
+			
+			// Extract two 16bit colors
+			u16 rgb0 = colors & 0x0000ffff;
+			u16 rgb1 = colors >> 16;
+			
+			// Decode colors to 8888 format
+			int lut[4 * 6];
+			lut[0]  = ((rgb0 >> 11) << 3);
+			lut[1]  = oneBitAlpha ? ((rgb0 >> 6) << 3) & 0xff : ((rgb0 >> 5) << 2) & 0xff;
+			lut[2]  = oneBitAlpha ? ((rgb0 >> 1) << 3) & 0xff : ((rgb0 << 3) & 0xff);
+			lut[3]  = oneBitAlpha ? rgb0 << 15 : 0;
+			lut[4]  = ((rgb1 >> 11) << 3);
+			lut[5]  = oneBitAlpha ? ((rgb1 >> 6) << 3) & 0xff : ((rgb1 >> 5) << 2) & 0xff;
+			lut[6]  = oneBitAlpha ? ((rgb1 >> 1) << 3) & 0xff : ((rgb1 << 3) & 0xff);
+			lut[7]  = oneBitAlpha ? rgb1 << 15 : 0;
+			lut[8]  = (lut[0] * 2 + lut[4]) / 3;
+			lut[9]  = (lut[1] * 2 + lut[5]) / 3;
+			lut[10] = (lut[2] * 2 + lut[6]) / 3;
+			lut[11] = (lut[3] * 2 + lut[7]) / 3;
+			lut[12] = (lut[0] + lut[4] * 2) / 3;
+			lut[13] = (lut[1] + lut[5] * 2) / 3;
+			lut[14] = (lut[2] + lut[6] * 2) / 3;
+			lut[15] = (lut[3] + lut[7] * 2) / 3;
+			lut[16] = (lut[0] + lut[4]) / 2;
+			lut[17] = (lut[1] + lut[5]) / 2;
+			lut[18] = (lut[2] + lut[6]) / 2;
+			lut[19] = (lut[3] + lut[7]) / 2;
+			lut[20] = 0;
+			lut[21] = 0;
+			lut[22] = 0;
+			lut[23] = 0;
+			
+			// Read color codes
+			for(u32 c=0; c<16; ++c)
+			{
+				codes[c] = (clrlut >> c * 2) & 3;
+			}
+			
+			// Decode the block's pixels inside of the viewport
+			for(u32 cy=top; cy<bottom; ++cy)
+			{
+				for(u32 cx=left; cx<right; ++cx)
+				{
+					u32 code = codes[(cy - by) * 4 + cx - bx];
+					u8* dest = out.pixel(cx - view.x, cy - view.y);
+					
+					switch(code)
+					{
+					case 0:
+					case 1:
+						code *= 4;
+						break;
+					case 2:
+						code = (DXTType == 1 && rgb0 < rgb1) ? 16 : 8;
+						break;
+					case 3:
+						code = (DXTType == 1 && rgb0 < rgb1) ? 20 : 12;
+						break;
+					};
+					
+					if(alphaOnly && oneBitAlpha)
+					{
+						dest[0] = lut[code + rgbaChannels[3]];
+						dest[1] = lut[code + rgbaChannels[3]];
+						dest[2] = lut[code + rgbaChannels[3]];
+					}
+					else
+					{
+						dest[r] = lut[code + rgbaChannels[2]];
+						dest[1] = lut[code + rgbaChannels[1]];
+						dest[b] = lut[code + rgbaChannels[0]];
+					}
+				}
+			}
+		}
+	}
+}
+
+void convertRLE(const PixelFormat& format, u32 width, u32 height, const u8* data, u32 size, u8* rgbOut, u32 flags, u32 RLmask, bool RLmsb, const std::vector<BitwiseOp>* bwOps /* NULL */)
+{
+	BitwiseTable bitwise;
+	if(bwOps)
+	{
+		bitwise.compile(*bwOps);
+	}
+
+	CompiledFormat compiled;
+	if(compiled.compile(format, flags, NULL, bwOps ? &bitwise : NULL))
+	{
+		convertRLE(compiled, data, size, Viewport(width, height), OutputLayout(rgbOut, width, height), RLmask, RLmsb);
+	}
+}
+
+void convertRLE(const CompiledFormat& format, const u8* data, u32 size, const Viewport& view, const OutputLayout& out, u32 RLmask, bool RLmsb, u32 skip /* 0 */)
+{
+	u32 width = view.canvasWidth;
+
+	if(!format.isValid() || width == 0 || view.canvasHeight == 0 || view.width == 0 || view.height == 0)
+	{
+		return;
+	}
+
+	u32 ps = format.pixelSize;
+	u64 totalPixels = (u64)width * std::min(view.y + view.height, view.canvasHeight);
+	u64 numPixels = 0;
+	u32 RLbyte = RLmsb ? ps : 0;
+	u32 RLpixel = RLmsb ? 0 : 1;
+
+	for(u32 i=0; i+ps+1<=size && numPixels<totalPixels; i+=ps+1)
+	{
+		u32 len = (data[i + RLbyte] & RLmask) + 1;
+
+		// View may start inside of the first run
+		if(skip > 0)
+		{
+			u32 skipped = std::min(skip, len);
+			len -= skipped;
+			skip -= skipped;
+			if(len == 0)
+			{
+				continue;
+			}
+		}
+
+		u64 begin = numPixels;
+		u64 end = std::min(numPixels + len, totalPixels);
+		numPixels = end;
+
+		// Runs above the viewport are only counted
+		if(end <= (u64)view.y * width)
+		{
+			continue;
+		}
+
+		// Decode the run's pixel once and fill the visible part of every row it covers with it
+		u8 rgb[3];
+		decodeSpan(format, data + i + RLpixel, 1, rgb);
+
+		for(u64 y=begin/width; y*width<end; ++y)
+		{
+			u64 left = std::max(begin, y * width + view.x);
+			u64 right = std::min(end, y * width + view.x + view.width);
+			if(y >= view.y && left < right)
+			{
+				fillSpan(out, (u32)((y - view.y) * view.width + left - y * width - view.x), (u32)(right - left), rgb);
+			}
+		}
+	}
+}
+
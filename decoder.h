@@ -0,0 +1,180 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __DECODER_H
+#define __DECODER_H
+
+#include <stddef.h>
+#include <vector>
+#include "common.h"
+#include "simd.h"
+
+enum ConvertFlags
+{
+	CF_IgnoreChannelOrder = (1<<0),
+	CF_IgnoreTiles = (1<<1),
+	CF_IgnoreRedChannel = (1<<2),
+	CF_IgnoreGreenChannel = (1<<3),
+	CF_IgnoreBlueChannel = (1<<4),
+	CF_IgnoreAlphaChannel = (1<<5)
+};
+
+struct BitwiseOp
+{
+	enum Op
+	{
+		OP_NOP = 0,
+		OP_AND,
+		OP_OR,
+		OP_XOR,
+		OP_SHL,
+		OP_SHR,
+		OP_ROL,
+		OP_ROR
+	};
+
+	Op op;
+	u8 r, g, b; // bits
+};
+
+//
+// Chain of bitwise ops (any number of stages) folded into one lookup table per channel
+//
+struct BitwiseTable
+{
+	BitwiseTable(); // Identity
+
+	void compile(const std::vector<BitwiseOp>& ops);
+	bool isIdentity() const;
+	void apply(u8* rgb, u32 numPixels, bool bgr = false) const;
+
+	u8 lut[3][256]; // R, G, B
+};
+
+// Parsed pixel format (see PixelDbgWnd::getPixelFormat)
+struct PixelFormat
+{
+	int bitMask[4]; // Indexed by channel position in stream
+	int rgbaChannels[4]; // Stream position of R, G, B and A
+	int rgbaBits[4]; // Bits of R, G, B and A
+	int pixelSize; // In bytes
+	bool valid;
+};
+
+//
+// Pixel format compiled into a decoding kernel. Everything that stays the same for the whole
+// frame (channel shifts and masks, masked channels, alpha-only, palette, bitwise table) is
+// resolved once here instead of per pixel. 1 and 2 byte formats become a lookup table,
+// 3 and 4 byte formats a shift/mask kernel or plain byte copies for 8 bit channels.
+// Byte layouts and 2 byte formats also get a vector kernel if the CPU has one (see simd.h).
+//
+struct CompiledFormat
+{
+	enum Kernel
+	{
+		K_None = 0,
+		K_Table8, // 256 entry RGB table (1 byte pixels, palette)
+		K_Table16, // 65536 entry RGB table (2 byte pixels)
+		K_Shift24,
+		K_Shift32,
+		K_Bytes24, // 8 bit channels at byte boundaries
+		K_Bytes32
+	};
+
+	CompiledFormat();
+
+	// Returns false for invalid formats, recompiles only if any of the inputs changed
+	bool compile(const PixelFormat& format, u32 flags = 0, const u8* palette = NULL, const BitwiseTable* bitwise = NULL);
+	bool isValid() const { return kernel != K_None; }
+
+	Kernel kernel;
+	u32 pixelSize;
+	u32 shift[3]; // Per output channel (R, G, B)
+	u32 mask[3]; // 0 if the channel is off
+	u32 scale[3]; // Left shift up to 8 bits
+	BitwiseTable bitwise;
+	bool bitwisePass; // Bitwise table applied after decoding (not baked into the table)
+	std::vector<u8> table; // RGB triplets of the table kernels
+	SimdLevel simd; // Vector kernel used in front of the scalar one
+	SimdLevel simdLevel; // getSimdLevel() the kernels were picked at
+	u64 signature; // Of the decode inputs (format, flags, palette and bitwise table)
+};
+
+//
+// Where converters put decoded pixels. Rows can run bottom-up (negative row stride), pixels
+// right to left (negative pixel stride) and channels can be stored in BGR order, so flips and
+// file layouts are part of the addressing instead of extra passes over the frame.
+//
+struct OutputLayout
+{
+	OutputLayout();
+	OutputLayout(u8* buffer, u32 width, u32 height, bool flipV = false, bool flipH = false, bool bgr = false, u32 rowAlign = 1);
+
+	static u32 getPitch(u32 width, u32 rowAlign = 1); // Bytes per row in the buffer
+	u8* pixel(u32 x, u32 y) const { return origin + (ptrdiff_t)y * rowStride + (ptrdiff_t)x * pixelStride; }
+	bool isContiguous() const { return pixelStride == 3 && !bgr && rowStride == (ptrdiff_t)width * 3; } // Plain RGB frame
+
+	u8* origin; // Pixel (0, 0)
+	ptrdiff_t rowStride; // In bytes
+	int pixelStride; // 3 or -3
+	bool bgr;
+	u32 width;
+	u32 height;
+};
+
+//
+// Part of a canvas that is decoded. The canvas is canvasWidth pixels wide and starts at the
+// data handed to the converters, only pixels inside of the rectangle are read and written.
+// The output has the rectangle's size.
+//
+struct Viewport
+{
+	Viewport();
+	Viewport(u32 canvasWidth, u32 canvasHeight); // Whole canvas
+	Viewport(u32 canvasWidth, u32 canvasHeight, u32 x, u32 y, u32 width, u32 height);
+
+	u32 canvasWidth;
+	u32 canvasHeight;
+	u32 x;
+	u32 y;
+	u32 width;
+	u32 height;
+};
+
+//
+// Stateless converters from raw data to 24bpp RGB, safe to call from any thread. Raw and DXT
+// frames can be split into numParts independent parts (viewport rows, DXT block rows) that
+// write disjoint parts of the output.
+//
+void convertRaw(const PixelFormat& format, u32 width, u32 height, const u8* data, u32 size, u8* rgbOut, u32 flags = 0, const std::vector<BitwiseOp>* bwOps = NULL, u32 tileX = 0xffff, u32 tileY = 0xffff, const u8* palette = NULL);
+void convertRaw(const CompiledFormat& format, const u8* data, u32 size, const Viewport& view, const OutputLayout& out, u32 flags = 0, u32 tileX = 0xffff, u32 tileY = 0xffff, u32 part = 0, u32 numParts = 1);
+void convertRawReference(const PixelFormat& format, u32 width, u32 height, const u8* data, u32 size, u8* rgbOut, u32 flags = 0, const std::vector<BitwiseOp>* bwOps = NULL, u32 tileX = 0xffff, u32 tileY = 0xffff, const u8* palette = NULL); // Original per pixel loop
+void decodeSpan(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut); // count contiguous pixels
+void decodeSpan(const CompiledFormat& format, const u8* data, u32 count, const OutputLayout& out, u32 index); // Starting at the index-th pixel of the frame
+void convertDXT(const PixelFormat& format, const u8* data, u32 size, const Viewport& view, const OutputLayout& out, u32 flags, int DXTType, bool oneBitAlpha = false, u32 part = 0, u32 numParts = 1);
+void convertRLE(const PixelFormat& format, u32 width, u32 height, const u8* data, u32 size, u8* rgbOut, u32 flags, u32 RLmask, bool RLmsb, const std::vector<BitwiseOp>* bwOps = NULL);
+void convertRLE(const CompiledFormat& format, const u8* data, u32 size, const Viewport& view, const OutputLayout& out, u32 RLmask, bool RLmsb, u32 skip = 0); // skip: pixels dropped from the first run
+
+#endif
+
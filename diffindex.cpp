@@ -0,0 +1,583 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include "diffindex.h"
+#include "simd.h"
+
+const u32 DiffIndex::kChunkSize = 1024 * 1024;
+
+namespace
+{
+	const u32 kChunksPerThread = 4; // Chunks per thread and batch
+	const double kNotifyIntervalMs = 200.0;
+
+	// Lane rounds, must match hashStripesSimd
+	const u32 kHashPrime1 = 2654435761u;
+	const u32 kHashPrime2 = 2246822519u;
+
+	// Merging of the lanes
+	const u64 kMergePrime1 = 11400714785074694791ull;
+	const u64 kMergePrime2 = 14029467366897019727ull;
+	const u64 kMergePrime3 = 1609587929392839161ull;
+	const u64 kMergePrime4 = 9650029242287828579ull;
+	const u64 kMergePrime5 = 2870177450012600261ull;
+
+	inline u32 rotl32(u32 value, u32 bits)
+	{
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+	inline u64 rotl64(u64 value, u32 bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	inline bool sameSource(const MappedFile* fileA, u64 offsetA, const MappedFile* fileB, u64 offsetB)
+	{
+		return fileA == fileB && offsetA == offsetB;
+	}
+
+	// First (last if not forward) position in [begin, end) at which both sides differ
+	bool findDifference(const MappedFile* const files[2], const u64 offsets[2], u64 begin, u64 end, bool forward, u64& position)
+	{
+		size_t size = (size_t)(end - begin);
+		MappedWindow windowA, windowB;
+		size_t sizeA = windowA.map(*files[0], (off_t)(offsets[0] + begin), size);
+		size_t sizeB = windowB.map(*files[1], (off_t)(offsets[1] + begin), size);
+		if(!windowA.data() || !windowB.data() || sizeA < size || sizeB < size)
+		{
+			return false;
+		}
+
+		const u8* a = windowA.data();
+		const u8* b = windowB.data();
+
+		// Whole words are compared until one differs
+		if(forward)
+		{
+			size_t i = 0;
+			for(; i+8<=size; i+=8)
+			{
+				u64 wordA, wordB;
+				memcpy(&wordA, a + i, 8);
+				memcpy(&wordB, b + i, 8);
+				if(wordA != wordB)
+				{
+					break;
+				}
+			}
+			for(; i<size; ++i)
+			{
+				if(a[i] != b[i])
+				{
+					position = begin + i;
+					return true;
+				}
+			}
+		}
+		else
+		{
+			size_t i = size;
+			for(; i>=8; i-=8)
+			{
+				u64 wordA, wordB;
+				memcpy(&wordA, a + i - 8, 8);
+				memcpy(&wordB, b + i - 8, 8);
+				if(wordA != wordB)
+				{
+					break;
+				}
+			}
+			for(; i>0; --i)
+			{
+				if(a[i - 1] != b[i - 1])
+				{
+					position = begin + i - 1;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+};
+
+struct DiffIndex::Batch
+{
+	const MappedFile* files[2];
+	u64 offsets[2];
+	u64 length;
+	u64 first; // Chunk of the first task
+	u64* hashes[2];
+	u64 numHashed[2]; // Chunks whose hashes are kept
+	const std::atomic<u32>* generation;
+	u32 expected; // Generation the batch belongs to
+	std::atomic<u64> hashed; // Bytes
+	std::vector<u8> changed; // Per task
+};
+
+DiffIndex::DiffIndex(NotifyFunc notify, void* param, u32 numThreads /* 0 */) :
+	m_notify(notify),
+	m_param(param),
+	m_numThreads(numThreads),
+	m_pool(NULL),
+	m_generation(0),
+	m_quit(false),
+	m_pending(false),
+	m_length(0),
+	m_numCompared(0),
+	m_scanned(0),
+	m_hashed(0),
+	m_complete(false),
+	m_seconds(0.0)
+{
+	for(u32 i=0; i<2; ++i)
+	{
+		m_files[i] = NULL;
+		m_offsets[i] = 0;
+		m_sources[i].file = NULL;
+		m_sources[i].identity = 0;
+		m_sources[i].offset = 0;
+		m_sources[i].numHashed = 0;
+	}
+}
+
+DiffIndex::~DiffIndex()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+
+	delete m_pool;
+}
+
+bool DiffIndex::start(const MappedFile& fileA, u64 offsetA, const MappedFile& fileB, u64 offsetB)
+{
+	detach();
+
+	if(!fileA.isOpen() || !fileB.isOpen() || offsetA >= (u64)fileA.size() || offsetB >= (u64)fileB.size())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files[0] = &fileA;
+	m_files[1] = &fileB;
+	m_offsets[0] = offsetA;
+	m_offsets[1] = offsetB;
+	m_length = std::min((u64)fileA.size() - offsetA, (u64)fileB.size() - offsetB);
+	m_pending = true;
+
+	// Worker and pool are created on first use
+	if(!m_thread.joinable())
+	{
+		m_pool = new ThreadPool(m_numThreads);
+		m_thread = std::thread(&DiffIndex::run, this);
+	}
+	m_cond.notify_one();
+
+	return true;
+}
+
+void DiffIndex::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		m_files[0] = m_files[1] = NULL;
+		m_pending = false;
+		m_length = 0;
+		m_changed.clear();
+		m_numCompared = 0;
+		m_scanned = 0;
+		m_hashed = 0;
+		m_complete = false;
+		m_seconds = 0.0;
+	}
+
+	// Wait for the batch currently being hashed, afterwards the pool won't access the files anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+}
+
+DiffIndex::Stats DiffIndex::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Stats stats;
+	stats.length = m_length;
+	stats.scanned = m_scanned;
+	stats.hashed = m_hashed;
+	stats.numChanged = m_changed.size();
+	stats.numThreads = m_pool ? m_pool->getNumThreads() : 0;
+	stats.seconds = m_seconds;
+	stats.complete = m_complete;
+	return stats;
+}
+
+bool DiffIndex::findChange(u64 from, bool forward, u64& position) const
+{
+	const MappedFile* files[2];
+	u64 offsets[2];
+	u64 length;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(!m_files[0])
+		{
+			return false;
+		}
+		files[0] = m_files[0];
+		files[1] = m_files[1];
+		offsets[0] = m_offsets[0];
+		offsets[1] = m_offsets[1];
+		length = m_length;
+	}
+
+	if(forward)
+	{
+		// The part of a chunk before from can hold its only differences, then the next one is tried
+		for(u64 chunk=from/kChunkSize; ; ++chunk)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				std::vector<u64>::const_iterator it = std::lower_bound(m_changed.begin(), m_changed.end(), chunk);
+				if(it == m_changed.end() || m_files[0] != files[0])
+				{
+					return false;
+				}
+				chunk = *it;
+			}
+
+			u64 begin = std::max(from, chunk * kChunkSize);
+			u64 end = std::min(length, (chunk + 1) * kChunkSize);
+			if(begin < end && findDifference(files, offsets, begin, end, true, position))
+			{
+				return true;
+			}
+		}
+	}
+
+	if(from == 0)
+	{
+		return false;
+	}
+
+	for(u64 chunk=(from-1)/kChunkSize; ; --chunk)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::vector<u64>::const_iterator it = std::upper_bound(m_changed.begin(), m_changed.end(), chunk);
+			if(it == m_changed.begin() || m_files[0] != files[0])
+			{
+				return false;
+			}
+			chunk = *--it;
+		}
+
+		u64 begin = chunk * kChunkSize;
+		u64 end = std::min(std::min(length, from), (chunk + 1) * kChunkSize);
+		if(begin < end && findDifference(files, offsets, begin, end, false, position))
+		{
+			return true;
+		}
+		if(chunk == 0)
+		{
+			return false;
+		}
+	}
+}
+
+u64 DiffIndex::hashChunk(const u8* data, size_t size)
+{
+	// Eight lanes of 32 bit rounds over 32 byte stripes, which vector units do side by side
+	u32 lanes[8];
+	for(u32 i=0; i<8; ++i)
+	{
+		lanes[i] = (i + 1) * kHashPrime1;
+	}
+
+	size_t n = hashStripesSimd(data, size, lanes);
+	for(; n+32<=size; n+=32)
+	{
+		for(u32 i=0; i<8; ++i)
+		{
+			u32 value;
+			memcpy(&value, data + n + i * 4, 4);
+			lanes[i] = rotl32(lanes[i] + value * kHashPrime2, 13) * kHashPrime1;
+		}
+	}
+
+	u64 hash = (u64)size * kMergePrime5;
+	for(u32 i=0; i<8; ++i)
+	{
+		hash ^= rotl64(lanes[i] * kMergePrime2, 31) * kMergePrime1;
+		hash = rotl64(hash, 27) * kMergePrime1 + kMergePrime4;
+	}
+	for(; n<size; ++n)
+	{
+		hash ^= data[n] * kMergePrime5;
+		hash = rotl64(hash, 11) * kMergePrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= kMergePrime2;
+	hash ^= hash >> 29;
+	hash *= kMergePrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+void DiffIndex::chunkTask(void* param, u32 task)
+{
+	Batch* batch = static_cast<Batch*>(param);
+	if(*batch->generation != batch->expected)
+	{
+		return;
+	}
+
+	u64 chunk = batch->first + task;
+	u64 start = chunk * kChunkSize;
+	size_t size = (size_t)std::min<u64>(kChunkSize, batch->length - start);
+
+	MappedWindow windows[2];
+	const u8* data[2] = { NULL, NULL };
+	for(u32 i=0; i<2; ++i)
+	{
+		if(size < kChunkSize || chunk >= batch->numHashed[i])
+		{
+			if(windows[i].map(*batch->files[i], (off_t)(batch->offsets[i] + start), size) < size || !windows[i].data())
+			{
+				batch->changed[task] = 1;
+				return;
+			}
+			data[i] = windows[i].data();
+		}
+	}
+
+	// The tail is too short to be worth keeping hashes for
+	if(size < kChunkSize)
+	{
+		batch->changed[task] = memcmp(data[0], data[1], size) != 0;
+		return;
+	}
+
+	for(u32 i=0; i<2; ++i)
+	{
+		if(data[i])
+		{
+			batch->hashes[i][chunk] = hashChunk(data[i], size);
+			batch->hashed += size;
+		}
+	}
+	batch->changed[task] = batch->hashes[0][chunk] != batch->hashes[1][chunk];
+}
+
+void DiffIndex::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_pending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		m_pending = false;
+		u32 generation = m_generation;
+		lock.unlock();
+
+		compare(generation);
+
+		lock.lock();
+	}
+}
+
+void DiffIndex::compare(u32 generation)
+{
+	Batch batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation || !m_files[0])
+		{
+			return;
+		}
+
+		for(u32 i=0; i<2; ++i)
+		{
+			batch.files[i] = m_files[i];
+			batch.offsets[i] = m_offsets[i];
+		}
+		batch.length = m_length;
+	}
+
+	// Identical ranges, nothing to hash
+	if(sameSource(batch.files[0], batch.offsets[0], batch.files[1], batch.offsets[1]))
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+			m_complete = true;
+		}
+		notify(true);
+		return;
+	}
+
+	// Hashes are kept for sides which are still there, also if they swapped places
+	int match[2] = { -1, -1 };
+	for(u32 i=0; i<2; ++i)
+	{
+		for(u32 j=0; j<2; ++j)
+		{
+			const Source& source = m_sources[j];
+			if(match[1 - i] != (int)j && source.file == batch.files[i] && source.identity == batch.files[i]->identity() && source.offset == batch.offsets[i])
+			{
+				match[i] = j;
+				break;
+			}
+		}
+	}
+	if(match[0] == 1 || match[1] == 0)
+	{
+		std::swap(m_sources[0], m_sources[1]);
+	}
+
+	u64 numChunks = (batch.length + kChunkSize - 1) / kChunkSize;
+	u64 numWhole = batch.length / kChunkSize;
+	for(u32 i=0; i<2; ++i)
+	{
+		Source& source = m_sources[i];
+		if(match[i] < 0)
+		{
+			source.file = batch.files[i];
+			source.identity = batch.files[i]->identity();
+			source.offset = batch.offsets[i];
+			source.hashes.clear();
+			source.numHashed = 0;
+		}
+		source.hashes.resize((size_t)numWhole);
+		source.numHashed = std::min(source.numHashed, numWhole);
+
+		batch.hashes[i] = source.hashes.empty() ? NULL : &source.hashes[0];
+		batch.numHashed[i] = source.numHashed;
+	}
+
+	batch.generation = &m_generation;
+	batch.expected = generation;
+	batch.hashed = 0;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	m_lastNotify = std::chrono::steady_clock::time_point();
+
+	u32 chunksPerBatch = m_pool->getNumThreads() * kChunksPerThread;
+	u64 batchSize = (u64)chunksPerBatch * kChunkSize;
+
+	for(u64 first=0; first<numChunks; first+=chunksPerBatch)
+	{
+		// Next batch is read while this one is hashed, sides with kept hashes aren't read at all
+		u64 next = (first + chunksPerBatch) * kChunkSize;
+		if(next < batch.length)
+		{
+			for(u32 i=0; i<2; ++i)
+			{
+				if(first + 2 * chunksPerBatch > batch.numHashed[i])
+				{
+					batch.files[i]->willNeed((off_t)(batch.offsets[i] + next), (size_t)std::min(batchSize, batch.length - next));
+				}
+			}
+		}
+
+		u32 numTasks = (u32)std::min<u64>(chunksPerBatch, numChunks - first);
+		batch.first = first;
+		batch.changed.assign(numTasks, 0);
+
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			m_pool->run(chunkTask, &batch, numTasks);
+		}
+
+		bool complete;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			// All tasks ran, the hashes of the batch are valid
+			u64 done = std::min(first + numTasks, numWhole);
+			for(u32 i=0; i<2; ++i)
+			{
+				m_sources[i].numHashed = batch.numHashed[i] = std::max(m_sources[i].numHashed, done);
+			}
+
+			for(u32 task=0; task<numTasks; ++task)
+			{
+				if(batch.changed[task])
+				{
+					m_changed.push_back(first + task);
+				}
+			}
+
+			m_numCompared = first + numTasks;
+			m_scanned = std::min(m_numCompared * kChunkSize, batch.length);
+			m_hashed = batch.hashed;
+			m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			m_complete = complete = m_numCompared >= numChunks;
+		}
+
+		notify(complete);
+	}
+}
+
+void DiffIndex::notify(bool force)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(force || std::chrono::duration<double, std::milli>(now - m_lastNotify).count() >= kNotifyIntervalMs)
+	{
+		m_lastNotify = now;
+		if(m_notify)
+		{
+			m_notify(m_param);
+		}
+	}
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __DIFFINDEX_H
+#define __DIFFINDEX_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "common.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+//
+// Finds the chunks in which two byte ranges (of two files or at two offsets of one file)
+// differ. A worker hashes the chunks of both sides in parallel on a pool of its own and
+// keeps the hashes of each side, so moving or replacing one side only rehashes that one.
+// Jumping to the next difference then only has to look at the changed chunks. The tail
+// which doesn't fill a whole chunk is compared directly.
+//
+class DiffIndex
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	static const u32 kChunkSize;
+
+	struct Stats
+	{
+		u64 length; // Bytes compared, the shorter of both sides
+		u64 scanned; // Bytes of the chunks compared so far
+		u64 hashed; // Bytes hashed, sides whose hashes were kept aren't hashed again
+		u64 numChanged; // Chunks
+		u32 numThreads;
+		double seconds; // Hashing time so far
+		bool complete;
+	};
+
+	// 0 threads = one per hardware thread
+	DiffIndex(NotifyFunc notify, void* param, u32 numThreads = 0);
+	~DiffIndex();
+
+	// Starts comparing fileA from offsetA with fileB from offsetB in the background, a running
+	// comparison is aborted. Both files must stay open until detach() is called.
+	bool start(const MappedFile& fileA, u64 offsetA, const MappedFile& fileB, u64 offsetB);
+	void detach();
+
+	Stats getStats() const;
+
+	// First differing byte at or after from (the last one before from if not forward), relative
+	// to the start offsets. Only the chunks compared so far are looked at.
+	bool findChange(u64 from, bool forward, u64& position) const;
+
+	static u64 hashChunk(const u8* data, size_t size);
+
+private:
+	// Not copyable
+	DiffIndex(const DiffIndex&);
+	DiffIndex& operator=(const DiffIndex&);
+
+	struct Source
+	{
+		const MappedFile* file;
+		u64 identity;
+		u64 offset;
+		std::vector<u64> hashes; // Of the whole chunks
+		u64 numHashed; // Leading chunks with a valid hash
+	};
+
+	struct Batch;
+	static void chunkTask(void* param, u32 task);
+
+	void run();
+	void compare(u32 generation);
+	void notify(bool force);
+
+	NotifyFunc m_notify;
+	void* m_param;
+	u32 m_numThreads;
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex and the hashes
+	std::mutex m_workMutex; // Held by the worker while the pool reads file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	ThreadPool* m_pool; // Created with the worker
+	std::atomic<u32> m_generation; // Bumped to abort a running comparison
+	bool m_quit;
+	bool m_pending; // Comparison requested
+
+	const MappedFile* m_files[2];
+	u64 m_offsets[2];
+	u64 m_length;
+	std::vector<u64> m_changed; // Chunks, ascending
+	u64 m_numCompared; // Leading chunks compared so far
+	u64 m_scanned;
+	u64 m_hashed;
+	bool m_complete;
+	double m_seconds;
+	Source m_sources[2]; // Worker only
+	std::chrono::steady_clock::time_point m_lastNotify; // Worker only
+};
+
+#endif
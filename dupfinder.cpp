@@ -0,0 +1,925 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "dupfinder.h"
+#include "diffindex.h"
+
+const u32 DuplicateFinder::kMinChunkSize = 1024;
+const u32 DuplicateFinder::kMaxChunkSize = 64 * 1024;
+const u32 DuplicateFinder::kSegmentSize = 16 * 1024 * 1024;
+const size_t DuplicateFinder::kMemoryBudget = 64 * 1024 * 1024;
+const u32 DuplicateFinder::kMaxRegions = 1024 * 1024;
+const u32 DuplicateFinder::kMaxRuns = 1000;
+const u32 DuplicateFinder::kMaxRunOffsets = 1000;
+
+namespace
+{
+	const u32 kSegmentsPerThread = 2; // Segments per thread and batch
+	const double kNotifyIntervalMs = 200.0;
+	const u64 kBoundaryMask = 0xfff0000000000000ull; // 12 bits, a boundary every 4 KB on average
+	const u32 kGearWindow = 64; // Bytes a gear hash depends on
+	const u32 kNoCandidate = ~0u;
+	const u32 kMinPartitions = 16;
+	const u32 kMaxPartitions = 512; // Every spill writes a block per partition
+
+	struct Record
+	{
+		u64 hash;
+		u64 offset;
+		u64 size;
+	};
+
+	// Equal chunks are neighbours, ordered by their offset
+	struct HashOrder
+	{
+		bool operator()(const Record& a, const Record& b) const
+		{
+			if(a.hash != b.hash)
+			{
+				return a.hash < b.hash;
+			}
+			if(a.size != b.size)
+			{
+				return a.size < b.size;
+			}
+			return a.offset < b.offset;
+		}
+	};
+
+	struct OffsetOrder
+	{
+		bool operator()(const Record& a, const Record& b) const
+		{
+			return a.offset < b.offset;
+		}
+	};
+
+	// Largest copies first, then the most copies
+	struct RunOrder
+	{
+		bool operator()(const DuplicateFinder::Run& a, const DuplicateFinder::Run& b) const
+		{
+			if(a.size != b.size)
+			{
+				return a.size > b.size;
+			}
+			if(a.numCopies != b.numCopies)
+			{
+				return a.numCopies > b.numCopies;
+			}
+			return a.offsets[0] < b.offsets[0];
+		}
+	};
+
+	struct RegionStart
+	{
+		bool operator()(u64 offset, const ByteRange& region) const
+		{
+			return offset < region.offset;
+		}
+	};
+
+	// Random value per byte value for the gear hash (splitmix64)
+	struct GearTable
+	{
+		GearTable()
+		{
+			u64 state = 0;
+			for(u32 i=0; i<256; ++i)
+			{
+				u64 z = (state += 0x9e3779b97f4a7c15ull);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+				values[i] = z ^ (z >> 31);
+			}
+		}
+
+		u64 values[256];
+	};
+
+	const GearTable g_gear;
+
+	inline bool isFill(const u8* data, size_t size)
+	{
+		return size > 0 && memcmp(data, data + 1, size - 1) == 0;
+	}
+
+	// Power of two partitions holding about the memory budget each
+	u32 getNumPartitions(u64 numRecords)
+	{
+		u32 numPartitions = kMinPartitions;
+		while(numPartitions < kMaxPartitions && numRecords * sizeof(Record) / numPartitions > DuplicateFinder::kMemoryBudget)
+		{
+			numPartitions *= 2;
+		}
+		return numPartitions;
+	}
+
+	//
+	// Records in partitions. Once more than the budget are held, all of them are appended to one
+	// temporary file, a block per partition. If that fails the table stops taking records (and
+	// memory), the scan is aborted then.
+	//
+	class SpillTable
+	{
+	public:
+		SpillTable(u32 numPartitions, size_t budget) :
+			m_partitions(numPartitions),
+			m_blocks(numPartitions),
+			m_file(NULL),
+			m_budget(std::max(budget / sizeof(Record), (size_t)1)),
+			m_held(0),
+			m_spilled(0),
+			m_failed(false)
+		{
+		}
+
+		~SpillTable()
+		{
+			if(m_file)
+			{
+				fclose(m_file);
+			}
+		}
+
+		u32 getNumPartitions() const { return (u32)m_partitions.size(); }
+		u64 getSpilled() const { return m_spilled; } // Bytes
+		bool hasFailed() const { return m_failed; } // Temporary file couldn't be written or read back
+
+		void add(u32 partition, const Record& record)
+		{
+			if(m_failed)
+			{
+				return;
+			}
+
+			m_partitions[partition].push_back(record);
+			if(++m_held >= m_budget)
+			{
+				spill();
+			}
+		}
+
+		// Moves the records of a partition to records
+		void take(u32 partition, std::vector<Record>& records)
+		{
+			records.clear();
+
+			std::vector<Block>& blocks = m_blocks[partition];
+			for(size_t i=0; i<blocks.size() && !m_failed; ++i)
+			{
+				size_t first = records.size();
+				records.resize(first + blocks[i].count);
+				if(fseeko(m_file, blocks[i].offset, SEEK_SET) != 0 || fread(&records[first], sizeof(Record), blocks[i].count, m_file) != blocks[i].count)
+				{
+					m_failed = true;
+				}
+			}
+			std::vector<Block>().swap(blocks);
+
+			std::vector<Record>& held = m_partitions[partition];
+			records.insert(records.end(), held.begin(), held.end());
+			m_held -= held.size();
+			std::vector<Record>().swap(held);
+
+			if(m_failed)
+			{
+				records.clear();
+			}
+		}
+
+	private:
+		struct Block
+		{
+			off_t offset;
+			size_t count; // Records
+		};
+
+		void spill()
+		{
+			if(!m_file)
+			{
+				m_file = tmpfile();
+			}
+			if(!m_file || fseeko(m_file, 0, SEEK_END) != 0)
+			{
+				m_failed = true;
+				return;
+			}
+
+			for(size_t i=0; i<m_partitions.size(); ++i)
+			{
+				std::vector<Record>& held = m_partitions[i];
+				if(held.empty())
+				{
+					continue;
+				}
+
+				Block block = { ftello(m_file), held.size() };
+				if(block.offset < 0 || fwrite(&held[0], sizeof(Record), held.size(), m_file) != held.size())
+				{
+					m_failed = true;
+					return;
+				}
+
+				m_blocks[i].push_back(block);
+				m_spilled += held.size() * sizeof(Record);
+				m_held -= held.size();
+				std::vector<Record>().swap(held);
+			}
+		}
+
+		std::vector<std::vector<Record> > m_partitions; // Held in memory
+		std::vector<std::vector<Block> > m_blocks; // Spilled, per partition
+		FILE* m_file;
+		size_t m_budget; // Records
+		size_t m_held;
+		u64 m_spilled;
+		bool m_failed;
+	};
+
+	// A run of duplicate chunks is grouped by its hash later on, neighbouring runs form one region
+	void addSpan(const Record& span, SpillTable& spans, std::vector<ByteRange>& regions, bool& truncated)
+	{
+		spans.add((u32)(span.hash % spans.getNumPartitions()), span);
+
+		if(!regions.empty() && regions.back().offset + regions.back().size == span.offset)
+		{
+			regions.back().size += span.size;
+		}
+		else if(regions.size() < DuplicateFinder::kMaxRegions)
+		{
+			ByteRange region = { span.offset, span.size };
+			regions.push_back(region);
+		}
+		else
+		{
+			truncated = true;
+		}
+	}
+};
+
+struct DuplicateFinder::Batch
+{
+	const MappedFile* file;
+	u64 fileSize;
+	u64 first; // Segment of the first task
+	const std::atomic<u32>* generation;
+	u32 expected; // Generation the batch belongs to
+	std::atomic<u64> scanned; // Bytes
+	std::vector<std::vector<Record> > records; // Per task
+};
+
+DuplicateFinder::DuplicateFinder(NotifyFunc notify, void* param, u32 numThreads /* 0 */) :
+	m_notify(notify),
+	m_param(param),
+	m_numThreads(numThreads),
+	m_pool(NULL),
+	m_generation(0),
+	m_quit(false),
+	m_pending(false),
+	m_file(NULL),
+	m_identity(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+DuplicateFinder::~DuplicateFinder()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+
+	delete m_pool;
+}
+
+bool DuplicateFinder::start(const MappedFile& file)
+{
+	if(!file.isOpen() || file.size() <= 0)
+	{
+		detach();
+
+		// An empty file is a complete scan without runs, so callers waiting for it don't hang
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.complete = file.isOpen();
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_file == &file && m_identity == file.identity() && m_stats.fileSize == (u64)file.size())
+		{
+			return false;
+		}
+	}
+
+	detach();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = &file;
+	m_identity = file.identity();
+	m_stats.fileSize = (u64)file.size();
+	m_pending = true;
+
+	// Worker and pool are created on first use
+	if(!m_thread.joinable())
+	{
+		m_pool = new ThreadPool(m_numThreads);
+		m_thread = std::thread(&DuplicateFinder::run, this);
+	}
+	m_cond.notify_one();
+
+	return true;
+}
+
+void DuplicateFinder::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		m_file = NULL;
+		m_identity = 0;
+		m_pending = false;
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_regions.clear();
+		m_runs.clear();
+	}
+
+	// Wait for the batch currently being chunked, afterwards the pool won't access the file anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+}
+
+DuplicateFinder::Stats DuplicateFinder::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Stats stats = m_stats;
+	stats.numThreads = m_pool ? m_pool->getNumThreads() : 0;
+	return stats;
+}
+
+void DuplicateFinder::getRuns(std::vector<Run>& runs) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	runs = m_runs;
+}
+
+void DuplicateFinder::getRegions(u64 offset, u64 size, std::vector<ByteRange>& regions) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	regions.clear();
+
+	// Last region starting at or before the offset may reach into the range
+	std::vector<ByteRange>::const_iterator it = std::upper_bound(m_regions.begin(), m_regions.end(), offset, RegionStart());
+	if(it != m_regions.begin() && (it - 1)->offset + (it - 1)->size > offset)
+	{
+		--it;
+	}
+
+	for(; it != m_regions.end() && it->offset < offset + size; ++it)
+	{
+		regions.push_back(*it);
+	}
+}
+
+void DuplicateFinder::getDensity(u32 numBins, std::vector<float>& density) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	density.assign(numBins, 0.0f);
+
+	u64 fileSize = m_stats.fileSize;
+	if(fileSize == 0 || numBins == 0)
+	{
+		return;
+	}
+
+	// Bytes of every region are split up among the bins they cover
+	std::vector<u64> bytes(numBins, 0);
+	for(size_t i=0; i<m_regions.size(); ++i)
+	{
+		u64 offset = m_regions[i].offset;
+		u64 end = offset + m_regions[i].size;
+		while(offset < end)
+		{
+			u32 bin = (u32)std::min<u64>(offset * numBins / fileSize, numBins - 1);
+			u64 binEnd = std::max((u64)(bin + 1) * fileSize / numBins, offset + 1);
+			u64 part = std::min(end, binEnd) - offset;
+			bytes[bin] += part;
+			offset += part;
+		}
+	}
+
+	double binSize = std::max(double(fileSize) / double(numBins), 1.0);
+	for(u32 i=0; i<numBins; ++i)
+	{
+		density[i] = (float)std::min(bytes[i] / binSize, 1.0);
+	}
+}
+
+void DuplicateFinder::findBoundaries(const u8* data, size_t size, u64 base, std::vector<u32>& boundaries)
+{
+	// A byte whose hash has the mask bits clear is a candidate, it ends a chunk unless another
+	// one is less than kMinChunkSize bytes before it. Data without boundaries is cut where the
+	// file offset is a multiple of kMaxChunkSize. Both only depend on the kMaxChunkSize +
+	// kMinChunkSize + kGearWindow bytes before, boundaries closer to the start of data are only
+	// exact at the start of the file.
+	u64 hash = 0;
+	u32 lastCandidate = kNoCandidate;
+	u64 lastBoundary = base;
+
+	for(u32 i=0; i<(u32)size; ++i)
+	{
+		hash = (hash << 1) + g_gear.values[data[i]];
+		u64 position = base + i + 1;
+
+		if((hash & kBoundaryMask) == 0)
+		{
+			bool boundary = lastCandidate == kNoCandidate || i - lastCandidate >= kMinChunkSize;
+			lastCandidate = i;
+			if(boundary)
+			{
+				boundaries.push_back(i + 1);
+				lastBoundary = position;
+				continue;
+			}
+		}
+
+		if(position - lastBoundary >= kMaxChunkSize && position % kMaxChunkSize == 0)
+		{
+			boundaries.push_back(i + 1);
+			lastBoundary = position;
+		}
+	}
+}
+
+void DuplicateFinder::chunkTask(void* param, u32 task)
+{
+	Batch* batch = static_cast<Batch*>(param);
+	std::vector<Record>& records = batch->records[task];
+	records.clear();
+	if(*batch->generation != batch->expected)
+	{
+		return;
+	}
+
+	// The bytes before the segment decide its first boundaries, the last chunk reaches behind it
+	// (forced cuts are less than two kMaxChunkSize apart)
+	u64 start = (batch->first + task) * kSegmentSize;
+	u64 end = std::min<u64>(start + kSegmentSize, batch->fileSize);
+	u64 context = std::min<u64>(start, kMaxChunkSize + kMinChunkSize + kGearWindow);
+	u64 windowEnd = std::min<u64>(end + 2 * kMaxChunkSize, batch->fileSize);
+	size_t size = (size_t)(windowEnd - start + context);
+
+	MappedWindow window;
+	if(window.map(*batch->file, (off_t)(start - context), size) < size || !window.data())
+	{
+		return;
+	}
+
+	const u8* data = window.data();
+	std::vector<u32> boundaries;
+	findBoundaries(data, size, start - context, boundaries);
+	if(windowEnd == batch->fileSize && (boundaries.empty() || boundaries.back() != size))
+	{
+		boundaries.push_back((u32)size);
+	}
+
+	// Chunks start at the first boundary in the segment (or at the start of the file)
+	size_t i = 0;
+	while(i < boundaries.size() && boundaries[i] < context)
+	{
+		++i;
+	}
+	u32 begin = start == 0 ? 0 : (i < boundaries.size() ? boundaries[i++] : (u32)size);
+
+	for(; i<boundaries.size() && begin<end-start+context; ++i)
+	{
+		u32 chunkEnd = boundaries[i];
+		if(!isFill(data + begin, chunkEnd - begin))
+		{
+			Record record;
+			record.hash = DiffIndex::hashChunk(data + begin, chunkEnd - begin);
+			record.offset = start - context + begin;
+			record.size = chunkEnd - begin;
+			records.push_back(record);
+		}
+		begin = chunkEnd;
+	}
+
+	batch->scanned += end - start;
+}
+
+void DuplicateFinder::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_pending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		m_pending = false;
+		u32 generation = m_generation;
+		lock.unlock();
+
+		scan(generation);
+
+		lock.lock();
+	}
+}
+
+bool DuplicateFinder::isCurrent(u32 generation) const
+{
+	return generation == m_generation;
+}
+
+void DuplicateFinder::scan(u32 generation)
+{
+	Batch batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation || !m_file)
+		{
+			return;
+		}
+
+		batch.file = m_file;
+		batch.fileSize = m_stats.fileSize;
+	}
+
+	batch.generation = &m_generation;
+	batch.expected = generation;
+	batch.scanned = 0;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	m_lastNotify = std::chrono::steady_clock::time_point();
+
+	// Chunk records by their hash
+	u64 numSegments = (batch.fileSize + kSegmentSize - 1) / kSegmentSize;
+	u32 segmentsPerBatch = m_pool->getNumThreads() * kSegmentsPerThread;
+	u64 batchSize = (u64)segmentsPerBatch * kSegmentSize;
+	u64 estimate = batch.fileSize / (kMinChunkSize + 4096) + 1;
+	SpillTable chunks(getNumPartitions(estimate), kMemoryBudget);
+	u64 numChunks = 0;
+
+	batch.file->willNeed(0, (size_t)std::min(batchSize, batch.fileSize));
+	for(u64 first=0; first<numSegments; first+=segmentsPerBatch)
+	{
+		// Next batch is read while this one is chunked
+		u64 next = (first + segmentsPerBatch) * kSegmentSize;
+		if(next < batch.fileSize)
+		{
+			batch.file->willNeed((off_t)next, (size_t)std::min(batchSize, batch.fileSize - next));
+		}
+
+		u32 numTasks = (u32)std::min<u64>(segmentsPerBatch, numSegments - first);
+		batch.first = first;
+		batch.records.resize(numTasks);
+
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			m_pool->run(chunkTask, &batch, numTasks);
+		}
+
+		for(u32 task=0; task<numTasks; ++task)
+		{
+			const std::vector<Record>& records = batch.records[task];
+			for(size_t i=0; i<records.size(); ++i)
+			{
+				chunks.add((u32)(records[i].hash % chunks.getNumPartitions()), records[i]);
+			}
+			numChunks += records.size();
+		}
+
+		if(chunks.hasFailed())
+		{
+			fail(generation);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			m_stats.scanned = batch.scanned;
+			m_stats.numChunks = numChunks;
+			m_stats.spilled = chunks.getSpilled();
+			m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			m_stats.phase = next < batch.fileSize ? DP_Chunking : DP_Grouping;
+		}
+		notify(next >= batch.fileSize);
+	}
+	std::vector<std::vector<Record> >().swap(batch.records);
+
+	// Chunks which occur more than once, by their offset
+	SpillTable duplicates(getNumPartitions(estimate), kMemoryBudget);
+	u64 partitionSize = batch.fileSize / duplicates.getNumPartitions() + 1;
+	u64 duplicateChunks = 0;
+	u64 duplicateBytes = 0;
+	std::vector<Record> records;
+
+	for(u32 partition=0; partition<chunks.getNumPartitions(); ++partition)
+	{
+		if(!isCurrent(generation))
+		{
+			return;
+		}
+
+		chunks.take(partition, records);
+		std::sort(records.begin(), records.end(), HashOrder());
+
+		for(size_t i=0; i<records.size(); )
+		{
+			size_t j = i + 1;
+			while(j < records.size() && records[j].hash == records[i].hash && records[j].size == records[i].size)
+			{
+				++j;
+			}
+
+			if(j - i > 1)
+			{
+				for(size_t k=i; k<j; ++k)
+				{
+					duplicates.add((u32)(records[k].offset / partitionSize), records[k]);
+					duplicateBytes += records[k].size;
+				}
+				duplicateChunks += j - i;
+			}
+			i = j;
+		}
+	}
+
+	if(chunks.hasFailed() || duplicates.hasFailed())
+	{
+		fail(generation);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation)
+		{
+			return;
+		}
+
+		m_stats.duplicateChunks = duplicateChunks;
+		m_stats.duplicateBytes = duplicateBytes;
+		m_stats.spilled = chunks.getSpilled() + duplicates.getSpilled();
+		m_stats.phase = DP_Merging;
+		m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	}
+	notify(true);
+
+	// Duplicate chunks which follow each other form a span, which ends before its first chunk
+	// repeats so periodic data splits into its periods
+	SpillTable spans(getNumPartitions(duplicateChunks), kMemoryBudget);
+	std::vector<ByteRange> regions;
+	bool truncated = false;
+	Record span;
+	u64 firstHash = 0;
+	bool open = false;
+
+	for(u32 partition=0; partition<duplicates.getNumPartitions(); ++partition)
+	{
+		if(!isCurrent(generation))
+		{
+			return;
+		}
+
+		duplicates.take(partition, records);
+		std::sort(records.begin(), records.end(), OffsetOrder());
+
+		for(size_t i=0; i<records.size(); ++i)
+		{
+			const Record& record = records[i];
+			if(open && record.offset == span.offset + span.size && record.hash != firstHash)
+			{
+				span.size += record.size;
+				span.hash = hashBytes(&record.hash, sizeof(record.hash), span.hash);
+				continue;
+			}
+
+			if(open)
+			{
+				addSpan(span, spans, regions, truncated);
+			}
+			span = record;
+			firstHash = record.hash;
+			open = true;
+		}
+	}
+	if(open)
+	{
+		addSpan(span, spans, regions, truncated);
+	}
+
+	if(duplicates.hasFailed() || spans.hasFailed())
+	{
+		fail(generation);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation)
+		{
+			return;
+		}
+
+		m_regions.swap(regions);
+		m_stats.numRegions = (u32)m_regions.size();
+		m_stats.spilled += spans.getSpilled();
+	}
+	notify(true);
+
+	// Spans which occur more than once are the runs, only the largest ones are kept
+	std::vector<Run> runs;
+	for(u32 partition=0; partition<spans.getNumPartitions(); ++partition)
+	{
+		if(!isCurrent(generation))
+		{
+			return;
+		}
+
+		spans.take(partition, records);
+		std::sort(records.begin(), records.end(), HashOrder());
+
+		for(size_t i=0; i<records.size(); )
+		{
+			size_t j = i + 1;
+			while(j < records.size() && records[j].hash == records[i].hash && records[j].size == records[i].size)
+			{
+				++j;
+			}
+
+			if(j - i > 1)
+			{
+				runs.push_back(Run());
+				Run& run = runs.back();
+				run.size = records[i].size;
+				run.numCopies = j - i;
+				for(size_t k=i; k<j && run.offsets.size()<kMaxRunOffsets; ++k)
+				{
+					run.offsets.push_back(records[k].offset);
+				}
+
+				if(runs.size() >= 2 * kMaxRuns)
+				{
+					std::sort(runs.begin(), runs.end(), RunOrder());
+					runs.resize(kMaxRuns);
+					truncated = true;
+				}
+			}
+			i = j;
+		}
+	}
+
+	if(spans.hasFailed())
+	{
+		fail(generation);
+		return;
+	}
+
+	std::sort(runs.begin(), runs.end(), RunOrder());
+	if(runs.size() > kMaxRuns)
+	{
+		runs.resize(kMaxRuns);
+		truncated = true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation)
+		{
+			return;
+		}
+
+		m_runs.swap(runs);
+		m_stats.numRuns = (u32)m_runs.size();
+		m_stats.truncated = truncated;
+		m_stats.phase = DP_Done;
+		m_stats.complete = true;
+		m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	}
+	notify(true);
+}
+
+void DuplicateFinder::fail(u32 generation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation)
+		{
+			return;
+		}
+
+		m_stats.phase = DP_Done;
+		m_stats.complete = true;
+		m_stats.failed = true;
+	}
+	notify(true);
+}
+
+void DuplicateFinder::notify(bool force)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(force || std::chrono::duration<double, std::milli>(now - m_lastNotify).count() >= kNotifyIntervalMs)
+	{
+		m_lastNotify = now;
+		if(m_notify)
+		{
+			m_notify(m_param);
+		}
+	}
+}
+
+int runDuplicates(const char* filename, u32 numThreads)
+{
+	MappedFile file;
+	if(!file.open(filename))
+	{
+		printf("Can't open %s\n", filename);
+		return 1;
+	}
+
+	DuplicateFinder finder(NULL, NULL, numThreads);
+	bool started = finder.start(file);
+
+	DuplicateFinder::Stats stats = finder.getStats();
+	while(started && !stats.complete)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		stats = finder.getStats();
+	}
+
+	if(stats.failed)
+	{
+		printf("Out of temporary space after %.1f MB of records were spilled\n", stats.spilled / (1024.0 * 1024.0));
+		return 1;
+	}
+
+	std::vector<DuplicateFinder::Run> runs;
+	finder.getRuns(runs);
+
+	printf("%-12s %-8s %s\n", "Size", "Copies", "Offsets");
+	for(size_t i=0; i<runs.size(); ++i)
+	{
+		const DuplicateFinder::Run& run = runs[i];
+		printf("%-12llu %-8llu", (unsigned long long)run.size, (unsigned long long)run.numCopies);
+		for(size_t j=0; j<run.offsets.size(); ++j)
+		{
+			printf(" %llu", (unsigned long long)run.offsets[j]);
+		}
+		printf("%s\n", run.numCopies > run.offsets.size() ? " ..." : "");
+	}
+
+	printf("\n%u runs%s, %.1f MB in %llu of %llu chunks repeated, %.1f MB spilled, %.1f ms on %u threads (%.2f GB/s)\n", stats.numRuns,
+		stats.truncated ? " (list truncated)" : "", stats.duplicateBytes / (1024.0 * 1024.0), (unsigned long long)stats.duplicateChunks,
+		(unsigned long long)stats.numChunks, stats.spilled / (1024.0 * 1024.0), stats.seconds * 1000.0, stats.numThreads,
+		stats.seconds > 0.0 ? stats.scanned / stats.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __DUPFINDER_H
+#define __DUPFINDER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "common.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+//
+// Finds repeated blocks in a file. A worker cuts the file into content-defined chunks and hashes
+// them in parallel on a pool of its own. A gear rolling hash picks the boundaries and they only
+// depend on the bytes right before them, so copies at any alignment are cut alike, no matter
+// which task cuts them. The chunk records are grouped by hash in partitions which move to a
+// temporary file once they outgrow the memory budget, so files of any size can be scanned (the
+// scan fails if the temporary space runs out). Chunks which occur more than once are merged
+// into duplicate regions and runs of them that repeat as a whole are listed with their offsets.
+// Chunks of a single repeated byte are left out, those are marked as zero-filled data by the
+// minimap already.
+//
+class DuplicateFinder
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	static const u32 kMinChunkSize;
+	static const u32 kMaxChunkSize; // Forced cuts in data without boundaries, chunks average about 5 KB
+	static const u32 kSegmentSize; // Chunks starting in it are cut by one task
+	static const size_t kMemoryBudget; // Bytes of records kept in memory before they are spilled
+	static const u32 kMaxRegions;
+	static const u32 kMaxRuns;
+	static const u32 kMaxRunOffsets; // Listed per run
+
+	enum Phase
+	{
+		DP_Chunking = 0, // Cutting and hashing the file
+		DP_Grouping, // Finding the chunks which occur more than once
+		DP_Merging, // Merging duplicate chunks into regions and runs
+		DP_Done
+	};
+
+	// Bytes which occur more than once as a whole
+	struct Run
+	{
+		u64 size; // Of each copy
+		u64 numCopies;
+		std::vector<u64> offsets; // Ascending, the first kMaxRunOffsets copies
+	};
+
+	struct Stats
+	{
+		u64 fileSize;
+		u64 scanned; // Bytes chunked
+		u64 numChunks; // Without the ones of a single repeated byte
+		u64 duplicateChunks;
+		u64 duplicateBytes; // Every copy counted
+		u64 spilled; // Bytes of records written to the temporary files
+		u32 numRegions;
+		u32 numRuns;
+		u32 numThreads;
+		u32 phase; // Phase
+		double seconds; // Time so far
+		bool complete;
+		bool truncated; // More than kMaxRegions regions or kMaxRuns runs
+		bool failed; // Records couldn't be spilled or read back, the scan was aborted
+	};
+
+	// 0 threads = one per hardware thread
+	DuplicateFinder(NotifyFunc notify, void* param, u32 numThreads = 0);
+	~DuplicateFinder();
+
+	// Starts scanning the whole file in the background unless it was scanned already. Returns
+	// true if the scan (re)started. File must stay open until detach() is called.
+	bool start(const MappedFile& file);
+	void detach();
+
+	Stats getStats() const;
+	void getRuns(std::vector<Run>& runs) const; // Largest copies first
+	void getRegions(u64 offset, u64 size, std::vector<ByteRange>& regions) const; // Duplicate regions overlapping the range, ascending
+	void getDensity(u32 numBins, std::vector<float>& density) const; // Duplicate fraction of equal parts of the file
+
+private:
+	// Not copyable
+	DuplicateFinder(const DuplicateFinder&);
+	DuplicateFinder& operator=(const DuplicateFinder&);
+
+	struct Batch;
+	static void chunkTask(void* param, u32 task);
+	static void findBoundaries(const u8* data, size_t size, u64 base, std::vector<u32>& boundaries);
+
+	void run();
+	void scan(u32 generation);
+	void notify(bool force);
+	bool isCurrent(u32 generation) const;
+	void fail(u32 generation); // Ends the scan without results
+
+	NotifyFunc m_notify;
+	void* m_param;
+	u32 m_numThreads;
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex
+	std::mutex m_workMutex; // Held by the worker while the pool reads file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	ThreadPool* m_pool; // Created with the worker
+	std::atomic<u32> m_generation; // Bumped to abort a running scan
+	bool m_quit;
+	bool m_pending; // Scan requested
+
+	const MappedFile* m_file;
+	u64 m_identity;
+	Stats m_stats;
+	std::vector<ByteRange> m_regions; // Ascending, set once merged
+	std::vector<Run> m_runs;
+	std::chrono::steady_clock::time_point m_lastNotify; // Worker only
+};
+
+// Lists the largest duplicate runs of a file with their offsets on stdout, returns non-zero on errors
+int runDuplicates(const char* filename, u32 numThreads);
+
+#endif
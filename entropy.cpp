@@ -0,0 +1,355 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include "entropy.h"
+
+const u32 EntropyEngine::kMinBlockSize = 256;
+const u32 EntropyEngine::kMaxBlockSize = 1024 * 1024;
+const u32 EntropyEngine::kDefaultBlockSize = 4096;
+const float EntropyEngine::kNoiseEntropy = 7.5f;
+
+namespace
+{
+	// Counts up to this are looked up in the c * log2(c) table
+	const u32 kLogTableSize = 4096;
+
+	// Below this size a block uses a single histogram which is cleared by walking the block again
+	const u32 kInterleaveSize = 4096;
+
+	// Bytes of a profile bin mapped at a time
+	const u32 kProfileChunk = 64 * 1024 * 1024;
+
+	// Blocks per pool task, so tiny blocks don't cost a task each
+	const u32 kMinBytesPerTask = 256 * 1024;
+
+	struct LogTable
+	{
+		LogTable()
+		{
+			values[0] = 0.0f;
+			for(u32 i=1; i<kLogTableSize; ++i)
+			{
+				values[i] = (float)(i * log2((double)i));
+			}
+		}
+
+		float values[kLogTableSize]; // c * log2(c)
+	};
+
+	const LogTable& getLogTable()
+	{
+		static LogTable s_table;
+		return s_table;
+	}
+
+	// Four tables take turns, so the increments of a run of equal bytes don't depend on each other
+	void countInterleaved(const u8* data, size_t size, u32 tables[4][256])
+	{
+		size_t i = 0;
+		for(; i+8<=size; i+=8)
+		{
+			u64 v;
+			memcpy(&v, data + i, 8);
+			++tables[0][v & 0xff];
+			++tables[1][(v >> 8) & 0xff];
+			++tables[2][(v >> 16) & 0xff];
+			++tables[3][(v >> 24) & 0xff];
+			++tables[0][(v >> 32) & 0xff];
+			++tables[1][(v >> 40) & 0xff];
+			++tables[2][(v >> 48) & 0xff];
+			++tables[3][v >> 56];
+		}
+
+		for(; i<size; ++i)
+		{
+			++tables[0][data[i]];
+		}
+	}
+
+	struct BlockJob
+	{
+		const u8* data;
+		u64 size;
+		u32 blockSize;
+		u32 numBlocks;
+		u32 numTasks;
+		float* out;
+	};
+
+	void blockTask(void* param, u32 task)
+	{
+		const BlockJob* job = static_cast<const BlockJob*>(param);
+		u32 first = (u32)((u64)job->numBlocks * task / job->numTasks);
+		u32 last = (u32)((u64)job->numBlocks * (task + 1) / job->numTasks);
+		u32 histogram[256];
+		memset(histogram, 0, sizeof(histogram));
+
+		for(u32 b=first; b<last; ++b)
+		{
+			u64 start = (u64)b * job->blockSize;
+			u32 size = (u32)std::min<u64>(job->blockSize, job->size - start);
+			const u8* data = job->data + start;
+
+			if(size < kInterleaveSize)
+			{
+				// Walking the block again visits every used bin once, it is summed up and cleared
+				// on the way instead of going through all 256 of them twice
+				const float* table = getLogTable().values;
+				for(u32 i=0; i<size; ++i)
+				{
+					++histogram[data[i]];
+				}
+
+				float sum = 0.0f;
+				for(u32 i=0; i<size; ++i)
+				{
+					sum += table[histogram[data[i]]];
+					histogram[data[i]] = 0;
+				}
+
+				job->out[b] = std::max(log2f((float)size) - sum / (float)size, 0.0f);
+			}
+			else
+			{
+				EntropyEngine::countBytes(data, size, histogram);
+				job->out[b] = EntropyEngine::getEntropy(histogram, size);
+				memset(histogram, 0, sizeof(histogram));
+			}
+		}
+	}
+
+	struct ProfileJob
+	{
+		const MappedFile* file;
+		u64 fileSize;
+		u64 binSize;
+		float* out;
+		u64* bytesRead; // Per bin
+	};
+
+	void profileTask(void* param, u32 bin)
+	{
+		const ProfileJob* job = static_cast<const ProfileJob*>(param);
+		u64 start = (u64)bin * job->binSize;
+		u64 end = std::min(start + job->binSize, job->fileSize);
+		u64 totals[256];
+		memset(totals, 0, sizeof(totals));
+		u64 numBytes = 0;
+
+		MappedWindow window;
+		for(u64 offset=start; offset<end; offset+=kProfileChunk)
+		{
+			size_t size = window.map(*job->file, (off_t)offset, (size_t)std::min<u64>(kProfileChunk, end - offset));
+			if(!window.data() || size == 0)
+			{
+				break;
+			}
+
+			u32 histogram[256];
+			memset(histogram, 0, sizeof(histogram));
+			EntropyEngine::countBytes(window.data(), size, histogram);
+			for(u32 i=0; i<256; ++i)
+			{
+				totals[i] += histogram[i];
+			}
+			numBytes += size;
+		}
+
+		// Scaled into 32 bits, the entropy only depends on the shares
+		u32 histogram[256];
+		u32 shift = 0;
+		while((numBytes >> shift) > 0xffffffffull)
+		{
+			++shift;
+		}
+		for(u32 i=0; i<256; ++i)
+		{
+			histogram[i] = (u32)(totals[i] >> shift);
+		}
+
+		job->out[bin] = EntropyEngine::getEntropy(histogram, numBytes >> shift);
+		job->bytesRead[bin] = numBytes;
+	}
+};
+
+void EntropyEngine::computeBlocks(const u8* data, u64 size, u32 blockSize, std::vector<float>& out, ThreadPool* pool /* NULL */)
+{
+	blockSize = std::min(std::max(blockSize, kMinBlockSize), kMaxBlockSize);
+	out.clear();
+	if(!data || size == 0)
+	{
+		return;
+	}
+
+	BlockJob job;
+	job.data = data;
+	job.size = size;
+	job.blockSize = blockSize;
+	job.numBlocks = (u32)((size + blockSize - 1) / blockSize);
+	job.numTasks = pool ? (u32)std::max<u64>(std::min<u64>(size / kMinBytesPerTask, (u64)pool->getNumThreads() * 4), 1) : 1;
+	job.numTasks = std::min(job.numTasks, job.numBlocks);
+
+	out.resize(job.numBlocks);
+	job.out = &out[0];
+
+	if(pool && job.numTasks > 1)
+	{
+		pool->run(blockTask, &job, job.numTasks);
+	}
+	else
+	{
+		blockTask(&job, 0);
+	}
+}
+
+u64 EntropyEngine::computeProfile(const MappedFile& file, u32 numBins, std::vector<float>& out, ThreadPool* pool /* NULL */)
+{
+	out.clear();
+	u64 fileSize = file.isOpen() ? (u64)file.size() : 0;
+	if(fileSize == 0 || numBins == 0)
+	{
+		return 0;
+	}
+
+	numBins = (u32)std::min<u64>(numBins, fileSize);
+	std::vector<u64> bytesRead(numBins, 0);
+	out.assign(numBins, 0.0f);
+
+	ProfileJob job;
+	job.file = &file;
+	job.fileSize = fileSize;
+	job.binSize = (fileSize + numBins - 1) / numBins;
+	job.out = &out[0];
+	job.bytesRead = &bytesRead[0];
+
+	// Rounding up may leave the last bins empty
+	numBins = (u32)((fileSize + job.binSize - 1) / job.binSize);
+	out.resize(numBins);
+
+	if(pool)
+	{
+		pool->run(profileTask, &job, numBins);
+	}
+	else
+	{
+		for(u32 i=0; i<numBins; ++i)
+		{
+			profileTask(&job, i);
+		}
+	}
+
+	u64 total = 0;
+	for(u32 i=0; i<numBins; ++i)
+	{
+		total += bytesRead[i];
+	}
+	return total;
+}
+
+float EntropyEngine::getEntropy(const u32 histogram[256], u64 numBytes)
+{
+	if(numBytes == 0)
+	{
+		return 0.0f;
+	}
+
+	// H = log2(n) - sum(c * log2(c)) / n
+	const float* table = getLogTable().values;
+	double sum = 0.0;
+	for(u32 i=0; i<256; ++i)
+	{
+		u32 c = histogram[i];
+		sum += c < kLogTableSize ? (double)table[c] : c * log2((double)c);
+	}
+
+	double entropy = log2((double)numBytes) - sum / (double)numBytes;
+	return (float)std::min(std::max(entropy, 0.0), 8.0);
+}
+
+void EntropyEngine::countBytes(const u8* data, size_t size, u32 histogram[256])
+{
+	u32 tables[4][256];
+	memset(tables, 0, sizeof(tables));
+	countInterleaved(data, size, tables);
+
+	for(u32 i=0; i<256; ++i)
+	{
+		histogram[i] += tables[0][i] + tables[1][i] + tables[2][i] + tables[3][i];
+	}
+}
+
+void EntropyEngine::getHeatColor(float entropy, u8 rgb[3])
+{
+	// Blue to green up to 4 bits, on to yellow at 6 and red at the noise level
+	static const float stops[4] = { 0.0f, 4.0f, 6.0f, kNoiseEntropy };
+	static const u8 colors[4][3] = { { 0x10, 0x20, 0x80 }, { 0x20, 0xc0, 0x40 }, { 0xf0, 0xe0, 0x20 }, { 0xe0, 0x20, 0x20 } };
+
+	entropy = std::min(std::max(entropy, 0.0f), kNoiseEntropy);
+	u32 i = 0;
+	while(i < 2 && entropy > stops[i + 1])
+	{
+		++i;
+	}
+
+	float t = (entropy - stops[i]) / (stops[i + 1] - stops[i]);
+	for(u32 c=0; c<3; ++c)
+	{
+		rgb[c] = (u8)(colors[i][c] + (colors[i + 1][c] - colors[i][c]) * t + 0.5f);
+	}
+}
+
+int runEntropyProfile(const char* filename, u32 numThreads)
+{
+	const u32 kNumBins = 64;
+
+	MappedFile file;
+	if(!file.open(filename))
+	{
+		printf("Can't open %s\n", filename);
+		return 1;
+	}
+
+	ThreadPool pool(numThreads);
+	std::vector<float> profile;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	u64 bytes = EntropyEngine::computeProfile(file, kNumBins, profile, &pool);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	u64 binSize = ((u64)file.size() + kNumBins - 1) / kNumBins;
+	printf("%-16s %s\n", "Offset", "Bits per byte");
+	for(size_t i=0; i<profile.size(); ++i)
+	{
+		printf("%-16llu %5.2f%s\n", (unsigned long long)(i * binSize), profile[i], profile[i] >= EntropyEngine::kNoiseEntropy ? "  high" : "");
+	}
+
+	printf("\n%.1f MB in %.1f ms on %u threads (%.2f GB/s)\n", bytes / (1024.0 * 1024.0), seconds * 1000.0, pool.getNumThreads(),
+		seconds > 0.0 ? bytes / seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+
+	return bytes == (u64)file.size() ? 0 : 1;
+}
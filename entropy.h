@@ -0,0 +1,64 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ENTROPY_H
+#define __ENTROPY_H
+
+#include <vector>
+#include "common.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+//
+// Byte entropy (Shannon entropy of the byte histogram, 0 to 8 bits per byte) of equally sized
+// blocks of data, from the visible bytes up to the whole file. Histograms are counted into
+// interleaved tables so equal neighbouring bytes don't wait for each other's increments,
+// blocks and profile bins are spread over the pool. Stateless, safe to call from any thread.
+//
+class EntropyEngine
+{
+public:
+	static const u32 kMinBlockSize;
+	static const u32 kMaxBlockSize;
+	static const u32 kDefaultBlockSize;
+	static const float kNoiseEntropy; // Compressed or encrypted data lies above
+
+	// Entropy of every blockSize bytes of data, the last block may be shorter
+	static void computeBlocks(const u8* data, u64 size, u32 blockSize, std::vector<float>& out, ThreadPool* pool = NULL);
+
+	// Entropy of numBins equally sized parts of the whole file, every byte is read once.
+	// Returns the number of bytes read.
+	static u64 computeProfile(const MappedFile& file, u32 numBins, std::vector<float>& out, ThreadPool* pool = NULL);
+
+	static float getEntropy(const u32 histogram[256], u64 numBytes);
+	static void countBytes(const u8* data, size_t size, u32 histogram[256]); // Adds to the histogram
+
+	// Heat map color of an entropy, dark blue (constant) over green and yellow to red (noise)
+	static void getHeatColor(float entropy, u8 rgb[3]);
+};
+
+// Prints the whole file entropy profile and its throughput to stdout, returns non-zero on errors
+int runEntropyProfile(const char* filename, u32 numThreads);
+
+#endif
@@ -0,0 +1,311 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "formatdetect.h"
+
+const u32 FormatDetector::kMaxWindow = 4 * 1024 * 1024;
+const u32 FormatDetector::kNumStrips = 32;
+const u32 FormatDetector::kStripWidth = 256;
+const u32 FormatDetector::kStripHeight = 8;
+
+namespace
+{
+	// Channels whose far pixel pairs differ less than this on average are flat, they look
+	// smooth in every format (i.e. alpha in a color channel) but tell nothing
+	const u32 kMinContrast = 2;
+
+	// Twice the pixel size shows two rows side by side, which are as coherent as the real
+	// image. Pixels 1/2, 1/3 and 1/4 of a row apart are compared to catch that.
+	const u32 kMaxSplit = 4;
+	const u32 kSplitWidth = 32;
+
+	struct BetterScore
+	{
+		bool operator()(const FormatDetector::Result& a, const FormatDetector::Result& b) const
+		{
+			return a.score != b.score ? a.score > b.score : a.index < b.index;
+		}
+	};
+
+	void addDifference(u64 sums[3], const u8* a, const u8* b)
+	{
+		sums[0] += (u32)abs((int)a[0] - (int)b[0]);
+		sums[1] += (u32)abs((int)a[1] - (int)b[1]);
+		sums[2] += (u32)abs((int)a[2] - (int)b[2]);
+	}
+
+	// Rows of the candidate within size bytes, DXT rows come in blocks of 4
+	u32 getNumRows(const FormatCandidate& candidate, u32 size, u32 width)
+	{
+		if(candidate.kind == FormatCandidate::FC_DXT)
+		{
+			u64 blockRow = (u64)((width + 3) / 4) * (candidate.DXTType == 1 ? 8 : 16);
+			return (u32)(size / blockRow) * 4;
+		}
+
+		u64 row = (u64)width * (candidate.kind == FormatCandidate::FC_Raw ? candidate.format.pixelSize : 1);
+		return row > 0 ? (u32)(size / row) : 0;
+	}
+};
+
+struct FormatDetector::Sums
+{
+	u64 horizontal[3]; // Per channel differences of left/right neighbours
+	u64 vertical[3]; // Of up/down neighbours
+	u64 far[3]; // Of pixels half a strip apart
+	u64 split[kMaxSplit - 1][3]; // Of pixels 1/2, 1/3 and 1/4 of a row apart
+	u32 numHorizontal;
+	u32 numVertical;
+	u32 numFar;
+	u32 numSplit[kMaxSplit - 1];
+};
+
+struct FormatDetector::Job
+{
+	const u8* data;
+	u32 size;
+	u32 width;
+	const std::vector<FormatCandidate>* candidates;
+	const CompiledFormat* compiled;
+	const u8* usable; // Per candidate
+	Sums* sums; // Per candidate and strip
+};
+
+FormatDetector::FormatDetector()
+{
+}
+
+void FormatDetector::stripTask(void* param, u32 task)
+{
+	const Job* job = static_cast<const Job*>(param);
+	u32 index = task / kNumStrips;
+	u32 strip = task % kNumStrips;
+	const FormatCandidate& candidate = (*job->candidates)[index];
+	Sums& sums = job->sums[task];
+	memset(&sums, 0, sizeof(sums));
+
+	u32 numRows = getNumRows(candidate, job->size, job->width);
+	if(!job->usable[index] || numRows < kStripHeight)
+	{
+		return;
+	}
+
+	// Strips are spread over the rows and wander across wide images, DXT strips start at blocks
+	bool dxt = candidate.kind == FormatCandidate::FC_DXT;
+	u32 mask = dxt ? ~3u : ~0u;
+	u32 width = std::min(job->width, kStripWidth);
+	u32 x0 = (u32)((u64)(job->width - width) * ((strip * 7) % kNumStrips) / (kNumStrips - 1)) & mask;
+	u32 y0 = (u32)((u64)(numRows - kStripHeight) * strip / (kNumStrips - 1)) & mask;
+
+	u8 pixels[kStripWidth * kStripHeight * 3];
+	decodeStrip(*job, index, Viewport(job->width, numRows, x0, y0, width, kStripHeight), pixels);
+
+	// DXT blocks are smooth whatever the data is, only their edges tell
+	for(u32 y=0; y<kStripHeight; ++y)
+	{
+		const u8* row = pixels + y * width * 3;
+		const u8* farRow = pixels + ((y + kStripHeight / 2) % kStripHeight) * width * 3;
+		bool verticalEdge = y + 1 < kStripHeight && (!dxt || ((y0 + y + 1) & 3) == 0);
+
+		for(u32 x=0; x<width; ++x)
+		{
+			const u8* p = row + x * 3;
+			if(x + 1 < width && (!dxt || ((x0 + x + 1) & 3) == 0))
+			{
+				addDifference(sums.horizontal, p, p + 3);
+				++sums.numHorizontal;
+			}
+			if(verticalEdge)
+			{
+				addDifference(sums.vertical, p, p + width * 3);
+				++sums.numVertical;
+			}
+
+			addDifference(sums.far, p, farRow + ((x + width / 2) % width) * 3);
+			++sums.numFar;
+		}
+	}
+
+	u32 splitWidth = std::min(width, kSplitWidth);
+	for(u32 k=2; k<=kMaxSplit; ++k)
+	{
+		u32 splitX = (x0 + job->width / k) & mask;
+		if(splitX + splitWidth > job->width)
+		{
+			continue;
+		}
+
+		u8 split[kSplitWidth * kStripHeight * 3];
+		decodeStrip(*job, index, Viewport(job->width, numRows, splitX, y0, splitWidth, kStripHeight), split);
+		for(u32 y=0; y<kStripHeight; ++y)
+		{
+			for(u32 x=0; x<splitWidth; ++x)
+			{
+				addDifference(sums.split[k - 2], pixels + (y * width + x) * 3, split + (y * splitWidth + x) * 3);
+			}
+		}
+		sums.numSplit[k - 2] += splitWidth * kStripHeight;
+	}
+}
+
+void FormatDetector::decodeStrip(const Job& job, u32 index, const Viewport& view, u8* pixels)
+{
+	const FormatCandidate& candidate = (*job.candidates)[index];
+	OutputLayout out(pixels, view.width, view.height);
+	memset(pixels, 0, (size_t)view.width * view.height * 3);
+
+	if(candidate.kind == FormatCandidate::FC_DXT)
+	{
+		convertDXT(candidate.format, job.data, job.size, view, out, 0, candidate.DXTType);
+	}
+	else
+	{
+		convertRaw(job.compiled[index], job.data, job.size, view, out);
+	}
+}
+
+void FormatDetector::rank(const u8* data, u32 size, u32 width, const std::vector<FormatCandidate>& candidates, const u8* palette, std::vector<Result>& out, ThreadPool* pool /* NULL */)
+{
+	out.clear();
+
+	u32 n = (u32)candidates.size();
+	size = std::min(size, kMaxWindow);
+	if(!data || size == 0 || width == 0 || n == 0)
+	{
+		return;
+	}
+
+	u8 grayPalette[256 * 3];
+	for(u32 i=0; i<256; ++i)
+	{
+		grayPalette[i * 3 + 0] = grayPalette[i * 3 + 1] = grayPalette[i * 3 + 2] = (u8)i;
+	}
+
+	// Formats are compiled up front, the strips only decode
+	m_compiled.resize(n);
+	std::vector<u8> usable(n, 0);
+	for(u32 i=0; i<n; ++i)
+	{
+		const FormatCandidate& candidate = candidates[i];
+		if(!candidate.format.valid)
+		{
+			continue;
+		}
+
+		switch(candidate.kind)
+		{
+		case FormatCandidate::FC_DXT: usable[i] = 1; break;
+		case FormatCandidate::FC_Raw: usable[i] = m_compiled[i].compile(candidate.format) ? 1 : 0; break;
+		case FormatCandidate::FC_Palette: usable[i] = palette && m_compiled[i].compile(candidate.format, 0, palette) ? 1 : 0; break;
+		case FormatCandidate::FC_Gray: usable[i] = m_compiled[i].compile(candidate.format, 0, grayPalette) ? 1 : 0; break;
+		}
+	}
+
+	std::vector<Sums> sums(n * kNumStrips);
+	Job job;
+	job.data = data;
+	job.size = size;
+	job.width = width;
+	job.candidates = &candidates;
+	job.compiled = &m_compiled[0];
+	job.usable = &usable[0];
+	job.sums = &sums[0];
+
+	if(pool)
+	{
+		pool->run(stripTask, &job, n * kNumStrips);
+	}
+	else
+	{
+		for(u32 task=0; task<n*kNumStrips; ++task)
+		{
+			stripTask(&job, task);
+		}
+	}
+
+	// Neighbours relative to far pairs per channel, rows and columns weigh the same. Flat
+	// channels count as noise, so a constant alpha byte doesn't pass for a smooth channel.
+	for(u32 i=0; i<n; ++i)
+	{
+		Sums total;
+		memset(&total, 0, sizeof(total));
+		for(u32 s=0; s<kNumStrips; ++s)
+		{
+			const Sums& part = sums[i * kNumStrips + s];
+			for(u32 c=0; c<3; ++c)
+			{
+				total.horizontal[c] += part.horizontal[c];
+				total.vertical[c] += part.vertical[c];
+				total.far[c] += part.far[c];
+				for(u32 k=0; k<kMaxSplit-1; ++k)
+				{
+					total.split[k][c] += part.split[k][c];
+				}
+			}
+			total.numHorizontal += part.numHorizontal;
+			total.numVertical += part.numVertical;
+			total.numFar += part.numFar;
+			for(u32 k=0; k<kMaxSplit-1; ++k)
+			{
+				total.numSplit[k] += part.numSplit[k];
+			}
+		}
+
+		if(total.numHorizontal == 0 || total.numVertical == 0 || total.numFar == 0)
+		{
+			continue;
+		}
+
+		double score = 0.0;
+		for(u32 c=0; c<3; ++c)
+		{
+			double far = (double)total.far[c] / total.numFar;
+			if(far >= kMinContrast)
+			{
+				double near = ((double)total.horizontal[c] / total.numHorizontal + (double)total.vertical[c] / total.numVertical) * 0.5;
+
+				// Parts of a row as close as neighbours are rows side by side
+				double reference = far;
+				for(u32 k=0; k<kMaxSplit-1; ++k)
+				{
+					if(total.numSplit[k] > 0)
+					{
+						reference = std::min(reference, (double)total.split[k][c] / total.numSplit[k]);
+					}
+				}
+				score += std::max(0.0, 1.0 - near / std::max(reference, 1.0));
+			}
+		}
+
+		Result result;
+		result.index = i;
+		result.score = (float)(score / 3.0);
+		out.push_back(result);
+	}
+
+	std::stable_sort(out.begin(), out.end(), BetterScore());
+}
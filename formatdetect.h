@@ -0,0 +1,74 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __FORMATDETECT_H
+#define __FORMATDETECT_H
+
+#include <vector>
+#include "common.h"
+#include "decoder.h"
+#include "renderer.h"
+#include "threadpool.h"
+
+//
+// Ranks candidate formats of raw data by how coherent the decoded image is. Real images are
+// smooth: neighbouring pixels and the same pixel in the next row are much closer than two
+// pixels far apart, while a wrong pixel size or bit layout shears rows and breaks channels
+// into noise. Every candidate decodes the same strips spread over the data (a subsample),
+// the strips of all candidates are spread over the pool. Not thread safe.
+//
+class FormatDetector
+{
+public:
+	static const u32 kMaxWindow; // Bytes analysed
+	static const u32 kNumStrips; // Per candidate
+	static const u32 kStripWidth; // In pixels, at most
+	static const u32 kStripHeight; // In rows, a multiple of the DXT block height
+
+	struct Result
+	{
+		u32 index; // Into the candidates
+		float score; // 0 = noise (or flat data), 1 = perfectly smooth
+	};
+
+	FormatDetector();
+
+	// Candidates scored on the data seen as a width pixels wide image, best first. palette is
+	// the RGB palette of FC_Palette candidates. Candidates without any complete strip are left out.
+	void rank(const u8* data, u32 size, u32 width, const std::vector<FormatCandidate>& candidates, const u8* palette, std::vector<Result>& out, ThreadPool* pool = NULL);
+
+private:
+	// Not copyable
+	FormatDetector(const FormatDetector&);
+	FormatDetector& operator=(const FormatDetector&);
+
+	struct Job;
+	struct Sums;
+	static void stripTask(void* param, u32 task);
+	static void decodeStrip(const Job& job, u32 index, const Viewport& view, u8* pixels);
+
+	std::vector<CompiledFormat> m_compiled; // Per candidate, kept for the next call
+};
+
+#endif
@@ -0,0 +1,216 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include "framecache.h"
+#include "renderer.h"
+
+const size_t FrameCache::kDefaultBudget = 256 * 1024 * 1024;
+
+//
+// FrameKey
+//
+FrameKey::FrameKey()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+FrameKey::FrameKey(const ViewState& state)
+{
+	memset(this, 0, sizeof(*this));
+
+	fileIdentity = state.file ? state.file->identity() : 0;
+	offset = (u64)state.offset;
+	width = state.width;
+	height = state.height;
+	viewX = state.viewX;
+	viewY = state.viewY;
+	viewWidth = state.viewWidth;
+	viewHeight = state.viewHeight;
+	zoom = state.zoom;
+	zoomAverage = state.zoom > 1 && state.zoomAverage ? 1 : 0;
+	flags = state.flags;
+	flipV = state.flipV ? 1 : 0;
+	flipH = state.flipH ? 1 : 0;
+	entropyBlockSize = state.RLEMode ? 0 : state.entropyBlockSize;
+
+	for(int i=0; i<4; ++i)
+	{
+		rgbaBits[i] = state.format.rgbaBits[i];
+		rgbaChannels[i] = state.format.rgbaChannels[i];
+	}
+
+	if(state.DXTMode)
+	{
+		DXTType = state.DXTType;
+		oneBitAlpha = state.oneBitAlpha ? 1 : 0;
+	}
+	else if(state.RLEMode)
+	{
+		RLmask = state.RLmask;
+		RLmsb = state.RLmsb ? 1 : 0;
+		RLskip = state.RLskip;
+	}
+	else
+	{
+		tileX = state.tileX;
+		tileY = state.tileY;
+	}
+
+	if(!state.highlights.empty() && !state.RLEMode)
+	{
+		highlightHash = hashBytes(&state.highlights[0], state.highlights.size() * sizeof(ByteRange));
+	}
+
+	if(state.paletteMode && !state.DXTMode && !state.RLEMode)
+	{
+		paletteHash = hashBytes(state.palette, sizeof(state.palette));
+	}
+
+	// Chains with the same effect share their frames, an identity table is the same as no ops
+	if(state.bitwise && !state.DXTMode && !state.bwTable.isIdentity())
+	{
+		bitwiseHash = hashBytes(state.bwTable.lut, sizeof(state.bwTable.lut), 1);
+	}
+
+	rehash();
+}
+
+void FrameKey::rehash()
+{
+	// Key is zero-initialized including padding, so the raw bytes can be hashed
+	hash = hashBytes(this, offsetof(FrameKey, hash));
+}
+
+bool FrameKey::operator==(const FrameKey& other) const
+{
+	return hash == other.hash && memcmp(this, &other, offsetof(FrameKey, hash)) == 0;
+}
+
+
+//
+// FrameCache
+//
+FrameCache::FrameCache(size_t budget /* kDefaultBudget */)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.budget = budget;
+}
+
+void FrameCache::setBudget(size_t budget)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.budget = budget;
+	evict(budget);
+}
+
+void FrameCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_map.clear();
+	m_stats.entries = 0;
+	m_stats.bytes = 0;
+}
+
+bool FrameCache::lookup(const FrameKey& key, Entry& out)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	++m_stats.lookups;
+
+	EntryMap::iterator iter = m_map.find(key);
+	if(iter == m_map.end())
+	{
+		++m_stats.misses;
+		return false;
+	}
+
+	// Move to front
+	m_entries.splice(m_entries.begin(), m_entries, iter->second);
+
+	const Entry& entry = iter->second->second;
+	out.pixels.assign(entry.pixels.begin(), entry.pixels.end());
+	out.paletteUsed = entry.paletteUsed;
+	out.paletteMin = entry.paletteMin;
+	out.paletteMax = entry.paletteMax;
+	out.complete = entry.complete;
+
+	++m_stats.hits;
+
+	return true;
+}
+
+bool FrameCache::contains(const FrameKey& key) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_map.find(key) != m_map.end();
+}
+
+void FrameCache::insert(const FrameKey& key, const Entry& entry)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	size_t size = entry.pixels.size();
+	if(size > m_stats.budget)
+	{
+		return;
+	}
+
+	EntryMap::iterator iter = m_map.find(key);
+	if(iter != m_map.end())
+	{
+		m_stats.bytes -= iter->second->second.pixels.size();
+		m_entries.erase(iter->second);
+		m_map.erase(iter);
+	}
+
+	evict(m_stats.budget - size);
+
+	m_entries.push_front(std::make_pair(key, entry));
+	m_map[key] = m_entries.begin();
+	m_stats.bytes += size;
+	m_stats.entries = (u32)m_entries.size();
+}
+
+FrameCache::Stats FrameCache::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void FrameCache::evict(size_t budget)
+{
+	while(!m_entries.empty() && m_stats.bytes > budget)
+	{
+		EntryList::iterator last = --m_entries.end();
+		m_stats.bytes -= last->second.pixels.size();
+		m_map.erase(last->first);
+		m_entries.erase(last);
+		++m_stats.evictions;
+	}
+
+	m_stats.entries = (u32)m_entries.size();
+}
+
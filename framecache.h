@@ -0,0 +1,134 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __FRAMECACHE_H
+#define __FRAMECACHE_H
+
+#include <list>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include "common.h"
+
+struct ViewState;
+
+//
+// Everything which changes the decoded image (flips are part of the decoding)
+//
+struct FrameKey
+{
+	FrameKey();
+	explicit FrameKey(const ViewState& state);
+
+	bool operator==(const FrameKey& other) const;
+	void rehash(); // After fields were changed
+
+	u64 fileIdentity;
+	u64 offset;
+	u32 width;
+	u32 height;
+	u32 viewX;
+	u32 viewY;
+	u32 viewWidth;
+	u32 viewHeight;
+	u32 zoom;
+	u32 zoomAverage;
+	i32 rgbaBits[4];
+	i32 rgbaChannels[4];
+	u32 flags;
+	u32 tileX;
+	u32 tileY;
+	u64 paletteHash; // 0 if not in palette mode
+	u64 bitwiseHash; // 0 if no bitwise ops
+	i32 DXTType; // 0 if not in DXT mode
+	u32 oneBitAlpha;
+	u32 RLmask; // 0 if not in RLE mode
+	u32 RLmsb;
+	u32 RLskip;
+	u32 flipV;
+	u32 flipH;
+	u32 entropyBlockSize; // 0 if there is no heat map
+	u64 highlightHash; // 0 if no bytes are highlighted
+	u64 hash;
+};
+
+struct FrameKeyHasher
+{
+	size_t operator()(const FrameKey& key) const { return (size_t)key.hash; }
+};
+
+//
+// LRU cache of decoded frames with a memory budget
+//
+class FrameCache
+{
+public:
+	static const size_t kDefaultBudget;
+
+	struct Entry
+	{
+		std::vector<u8> pixels;
+		bool paletteUsed;
+		u8 paletteMin;
+		u8 paletteMax;
+		bool complete; // Every pixel had data, passes over the pixels can be added later
+	};
+
+	struct Stats
+	{
+		u32 lookups;
+		u32 hits;
+		u32 misses;
+		u32 evictions;
+		u32 entries;
+		size_t bytes;
+		size_t budget;
+	};
+
+	explicit FrameCache(size_t budget = kDefaultBudget);
+
+	void setBudget(size_t budget);
+	void clear();
+
+	// Copies a cached entry into out, returns false if not cached
+	bool lookup(const FrameKey& key, Entry& out);
+	bool contains(const FrameKey& key) const; // Not counted as a lookup
+	void insert(const FrameKey& key, const Entry& entry);
+
+	Stats getStats() const;
+
+private:
+	typedef std::list<std::pair<FrameKey, Entry> > EntryList;
+	typedef std::unordered_map<FrameKey, EntryList::iterator, FrameKeyHasher> EntryMap;
+
+	void evict(size_t budget);
+
+	mutable std::mutex m_mutex;
+	EntryList m_entries; // Front is most recently used
+	EntryMap m_map;
+	Stats m_stats;
+};
+
+#endif
+
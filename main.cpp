@@ -23,11 +23,19 @@
  ***************************************************************************/
 
 #include <cmath>
+#include <chrono>
 #include "main.h"
-
-const u32 PixelDbgWnd::kMaxDim = 1024;
-const u32 PixelDbgWnd::kMaxBufferSize = kMaxDim * kMaxDim * 4;
-const u32 PixelDbgWnd::kMaxImageSize = kMaxDim * kMaxDim * 3;
+#include "benchmark.h"
+#include "entropy.h"
+
+const u32 PixelDbgWnd::kMaxDim = 1024 * 1024;
+const u32 PixelDbgWnd::kMaxBufferSize = 4 * 1024 * 1024;
+const u32 PixelDbgWnd::kMinimapWidth = 12;
+const char* const PixelDbgWnd::kDefaultCandidates = "8.8.8.8/3214,8.8.8.8,8.8.8.0/3214,5.6.5.0,5.5.5.1,DXT1,DXT5,PAL8,GRAY8";
+const char* const PixelDbgWnd::kSuggestCandidates = "8.8.8.8/3214,8.8.8.8,8.8.8.8/2341,8.8.8.8/4321,8.8.8.0/3214,8.8.8.0,"
+	"5.6.5.0/3214,5.6.5.0,5.5.5.1/3214,5.5.5.1,4.4.4.4/3214,4.4.4.4,3.3.2.0/3214,DXT1,DXT3,DXT5,GRAY8,PAL8";
+const u32 PixelDbgWnd::kMaxSuggestions = 6;
+const u32 PixelDbgWnd::kMaxStrideCandidates = 9; // CTRL + 1 to 9
 const u32 PixelDbgWnd::kVersionMajor = 0;
 const u32 PixelDbgWnd::kVersionMinor = 8;
 
@@ -62,6 +70,151 @@ namespace
 		return std::min(std::max(i, l), h);
 	}
 	
+	// Pixels have to be in file layout already (bottom-up BGR rows padded to 4 bytes)
+	bool writeBitmapFile(const char* filename, u32 w, u32 h, const std::vector<u8>& pixels)
+	{
+		FILE* f = fopen(filename, "wb");
+		if(!f)
+		{
+			return false;
+		}
+
+		u32 size = (u32)pixels.size();
+		unsigned char header[54];
+		memset(header, 0, sizeof(header));
+
+		*reinterpret_cast<u16*>(&header[0]) = 0x4D42;
+		*reinterpret_cast<u32*>(&header[2]) = size + 54;
+		*reinterpret_cast<u32*>(&header[10]) = 54;
+		*reinterpret_cast<u32*>(&header[14]) = 40;
+		*reinterpret_cast<u32*>(&header[18]) = w;
+		*reinterpret_cast<u32*>(&header[22]) = h;
+		*reinterpret_cast<u16*>(&header[26]) = 1;
+		*reinterpret_cast<u16*>(&header[28]) = 24;
+		*reinterpret_cast<u32*>(&header[34]) = size;
+		
+		fwrite(header, sizeof(header), 1, f);
+		fwrite(&pixels[0], size, 1, f);
+		fclose(f);
+
+		return true;
+	}
+
+	// Channel masks and pixel size of a format, returns false if it isn't valid
+	bool buildPixelFormat(const int rgbaBits[4], const int rgbaChannels[4], int bitMask[4], int& pixelSize)
+	{
+		pixelSize = 0;
+
+		if(rgbaBits[0] <= 0 && rgbaBits[1] <= 0 && rgbaBits[2] <= 0 && rgbaBits[3] <= 0)
+		{
+			return false;
+		}
+
+		// Do not allow channel depth larger then 8 until proper handling is implemented
+		if(rgbaBits[0] > 8 || rgbaBits[1] > 8 || rgbaBits[2] > 8 || rgbaBits[3] > 8)
+		{
+			return false;
+		}
+
+		bitMask[0] = bitMask[1] = bitMask[2] = bitMask[3] = 0;
+
+		for(int i=0; i<4; ++i)
+		{
+			if(rgbaChannels[i] == -1)
+			{
+				return false;
+			}
+
+			if(rgbaChannels[i] > 3)
+			{
+				return false;
+			}
+
+			// No duplicate channels allowed (i.e. R=1, G=1)
+			for(int j=0; j<4; ++j)
+			{
+				if(i != j && rgbaChannels[i] == rgbaChannels[j])
+				{
+					return false;
+				}
+			}
+
+			if(rgbaChannels[i] >= 0)
+			{
+				bitMask[rgbaChannels[i]] = ~(((u32)-1) << rgbaBits[i]);
+			}
+		}
+
+		int bpp = rgbaBits[0] + rgbaBits[1] + rgbaBits[2] + rgbaBits[3];
+		pixelSize = bpp / 8;
+
+		return pixelSize != 0 && (bpp % 8) == 0 && bpp <= 32;
+	}
+
+	// "R.G.B.A" bits with optional "/RGBA" stream positions (1-4, default 1234), DXT1/3/5,
+	// PAL8 (current palette) or GRAY8
+	bool parseCandidate(const char* text, FormatCandidate& candidate)
+	{
+		memset(&candidate, 0, sizeof(candidate));
+		snprintf(candidate.name, sizeof(candidate.name), "%s", text);
+
+		int* bits = candidate.format.rgbaBits;
+		int* channels = candidate.format.rgbaChannels;
+		bits[0] = 8;
+		for(int i=0; i<4; ++i)
+		{
+			channels[i] = i;
+		}
+
+		if(strcmp(text, "DXT1") == 0 || strcmp(text, "DXT3") == 0 || strcmp(text, "DXT5") == 0)
+		{
+			candidate.kind = FormatCandidate::FC_DXT;
+			candidate.DXTType = text[3] - '0';
+			bits[0] = 5;
+			bits[1] = 6;
+			bits[2] = 5;
+		}
+		else if(strcmp(text, "PAL8") == 0)
+		{
+			candidate.kind = FormatCandidate::FC_Palette;
+		}
+		else if(strcmp(text, "GRAY8") == 0)
+		{
+			candidate.kind = FormatCandidate::FC_Gray;
+		}
+		else
+		{
+			candidate.kind = FormatCandidate::FC_Raw;
+
+			int used = 0;
+			if(sscanf(text, "%d.%d.%d.%d%n", &bits[0], &bits[1], &bits[2], &bits[3], &used) != 4)
+			{
+				return false;
+			}
+
+			const char* order = text + used;
+			if(order[0] == '/')
+			{
+				if(strlen(order) != 5)
+				{
+					return false;
+				}
+
+				for(int i=0; i<4; ++i)
+				{
+					channels[i] = order[i + 1] - '1';
+				}
+			}
+			else if(order[0] != 0)
+			{
+				return false;
+			}
+		}
+
+		candidate.format.valid = buildPixelFormat(bits, channels, candidate.format.bitMask, candidate.format.pixelSize);
+		return candidate.format.valid;
+	}
+
 	int randomInt(int _min, int _max)
 	{
 		return (_min + (rand() % (_max - _min + 1)));
@@ -79,6 +232,121 @@ namespace
 
 		return buff;
 	}
+
+	// Orders of the embedded image list (see m_carveSort), ties are broken by the offset
+	struct CarveHitOrder
+	{
+		CarveHitOrder(int key) : key(key) {}
+
+		bool operator()(const ImageCarver::Hit& a, const ImageCarver::Hit& b) const
+		{
+			if(key == 1 && a.type != b.type)
+			{
+				return a.type < b.type;
+			}
+			if(key == 2 && (u64)a.width * a.height != (u64)b.width * b.height)
+			{
+				return (u64)a.width * a.height > (u64)b.width * b.height; // Largest first
+			}
+			if(key == 3 && a.dataSize != b.dataSize)
+			{
+				return a.dataSize > b.dataSize;
+			}
+			return a.offset < b.offset;
+		}
+
+		int key;
+	};
+	
+	// Strips our own switches from the command line, everything else is passed on to FLTK
+	bool parseOptions(int& argc, char** argv, PixelDbgWnd::Options& options)
+	{
+		int count = 1;
+		for(int i=1; i<argc; ++i)
+		{
+			if(strcmp(argv[i], "--frame-cache") == 0 && i + 1 < argc)
+			{
+				options.frameCacheBudget = (size_t)std::max(atoi(argv[++i]), 0) * 1024 * 1024;
+			}
+			else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			{
+				options.threads = (u32)std::max(atoi(argv[++i]), 0);
+			}
+			else if(strcmp(argv[i], "--top-colors") == 0 && i + 1 < argc)
+			{
+				options.topColors = (u32)std::max(atoi(argv[++i]), 0);
+			}
+			else if(strcmp(argv[i], "--minimap-cache") == 0 && i + 1 < argc)
+			{
+				options.minimapCache = argv[++i];
+			}
+			else if(strcmp(argv[i], "--compare-formats") == 0 && i + 1 < argc)
+			{
+				options.compareFormats = argv[++i];
+			}
+			else if(strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+			{
+				options.maxFps = (u32)std::max(atoi(argv[++i]), 1);
+			}
+			else if(strcmp(argv[i], "--entropy-profile") == 0 && i + 1 < argc)
+			{
+				options.entropyProfile = argv[++i];
+			}
+			else if(strcmp(argv[i], "--carve") == 0 && i + 1 < argc)
+			{
+				options.carve = argv[++i];
+			}
+			else if(strcmp(argv[i], "--search") == 0 && i + 2 < argc)
+			{
+				options.search = argv[++i];
+				options.searchPattern = argv[++i];
+			}
+			else if(strcmp(argv[i], "--duplicates") == 0 && i + 1 < argc)
+			{
+				options.duplicates = argv[++i];
+			}
+			else if(strcmp(argv[i], "--bench") == 0)
+			{
+				options.benchmark = true;
+			}
+			else if(strcmp(argv[i], "--self-test") == 0)
+			{
+				options.selfTest = true;
+			}
+			else if(strcmp(argv[i], "--no-simd") == 0)
+			{
+				setSimdLevel(SIMD_None);
+			}
+			else if(strcmp(argv[i], "--help") == 0)
+			{
+				printf("Usage: %s [options] [FLTK options]\n\n"
+				       "  --frame-cache <MB>   Memory budget of the decoded frame cache (default %u)\n"
+				       "  --threads <n>        Threads decoding a frame (default 0 = one per core)\n"
+				       "  --top-colors <n>     List the n most frequent colors while counting colors (default 0)\n"
+				       "  --minimap-cache <dir> Directory the minimap of each file is stored in (\"\" = don't store)\n"
+				       "  --compare-formats <list> Comma separated formats of the comparison grid, R.G.B.A bits with\n"
+				       "                       optional /RGBA stream positions, DXT1, DXT3, DXT5, PAL8 or GRAY8\n"
+				       "                       (default %s)\n"
+				       "  --max-fps <n>        Frames rendered per second at most while controls change (default 60)\n"
+				       "  --entropy-profile <file> Print the byte entropy across the whole file and exit\n"
+				       "  --carve <file>       List the images embedded in a file and exit\n"
+				       "  --search <file> <pattern> List the offsets of a byte pattern in a file and exit\n"
+				       "  --duplicates <file>  List the blocks which occur more than once in a file and exit\n"
+				       "  --bench              Benchmark the pixel decoders and exit\n"
+				       "  --self-test          Check that reloading a rewritten file drops its cached frames and exit\n"
+				       "  --no-simd            Use the scalar pixel decoders only\n",
+				       argv[0], (u32)(FrameCache::kDefaultBudget / (1024 * 1024)), PixelDbgWnd::kDefaultCandidates);
+				return false;
+			}
+			else
+			{
+				argv[count++] = argv[i];
+			}
+		}
+
+		argc = count;
+		return true;
+	}
 	
 	//Since FLTK doesn't expose any method to scroll the scrollbar with doubles, we just
 	//make our own
@@ -100,13 +368,49 @@ int main(int argc, char** argv)
 	_CrtMemCheckpoint(&memState);
 	#endif
 
+	PixelDbgWnd::Options options;
+	if(!parseOptions(argc, argv, options))
+	{
+		return 0;
+	}
+
+	if(options.benchmark)
+	{
+		return runBenchmark();
+	}
+
+	if(options.selfTest)
+	{
+		return runSelfTest();
+	}
+
+	if(!options.entropyProfile.empty())
+	{
+		return runEntropyProfile(options.entropyProfile.c_str(), options.threads);
+	}
+
+	if(!options.carve.empty())
+	{
+		return runCarve(options.carve.c_str(), options.threads);
+	}
+
+	if(!options.search.empty())
+	{
+		return runSearch(options.search.c_str(), options.searchPattern.c_str(), options.threads);
+	}
+
+	if(!options.duplicates.empty())
+	{
+		return runDuplicates(options.duplicates.c_str(), options.threads);
+	}
+
 	int ret;
 	{
 		char buff[32];
 		memset(buff, 0, sizeof(buff));
 		snprintf(buff, sizeof(buff)-1, "PixelDbg %u.%u", PixelDbgWnd::kVersionMajor, PixelDbgWnd::kVersionMinor);
 
-		PixelDbgWnd window(buff);
+		PixelDbgWnd window(buff, options);
 		window.end();
 
 		#ifdef _WIN32
@@ -114,6 +418,9 @@ int main(int argc, char** argv)
 		window.icon(hIcon);
 		#endif
 
+		// Frames are rendered on a worker thread and handed over with Fl::awake
+		Fl::lock();
+
 		window.show(argc, argv);
 		ret = Fl::run();
 	}
@@ -143,13 +450,22 @@ void PixelDbgWnd::draw()
 			int imageh = getImageHeight();
 			int deltaw = w - m_windowSize.x;
 			int deltah = h - m_windowSize.y;
+			int oldw = m_windowSize.x - getImageBox().x() - getSideBarWidth() - 6;
+			int oldh = m_windowSize.y - getImageBox().y() - m_imageHScroll->h();
 			m_windowSize.set(w, h);
 			
-			imagew = clampValue(imagew + deltaw, 1, (int)kMaxDim);
-			m_width.value(intToString(imagew));
+			// Images filling the window grow and shrink with it, larger ones are only scrolled
+			if(imagew == oldw)
+			{
+				imagew = clampValue(imagew + deltaw, 1, (int)kMaxDim);
+				m_width.value(intToString(imagew));
+			}
 			
-			imageh = clampValue(imageh + deltah, 1, (int)kMaxDim);
-			m_height.value(intToString(imageh));
+			if(imageh == oldh)
+			{
+				imageh = clampValue(imageh + deltah, 1, (int)kMaxDim);
+				m_height.value(intToString(imageh));
+			}
 
 			updateScrollbar(m_imageScroll->Fl_Valuator::value(), true);
 
@@ -161,19 +477,101 @@ void PixelDbgWnd::draw()
 		}
 	}
 	
+	// Presenting is the last stage of a frame, see getStatistics
+	std::chrono::steady_clock::time_point presentStart = std::chrono::steady_clock::now();
 	Fl_Double_Window::draw();
+	m_frame.stageTime[RS_Present] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - presentStart).count();
+
+	// Name the cells of the comparison grid
+	if(isComparing() && m_image && m_frame.width == getViewportWidth() && m_frame.height == getViewportHeight())
+	{
+		ViewState grid;
+		grid.candidates = m_candidates;
+		grid.gridColumns = getGridColumns();
+		grid.viewWidth = m_frame.width;
+		grid.viewHeight = m_frame.height;
+
+		fl_font(FL_HELVETICA, 11);
+		for(u32 i=0; i<m_candidates.size(); ++i)
+		{
+			u32 x, y, width, height;
+			if(grid.getGridCell(i, x, y, width, height))
+			{
+				int left = getImageBox().x() + (int)x;
+				int top = getImageBox().y() + (int)y;
+				char name[32];
+				if(i < m_candidateScores.size())
+				{
+					snprintf(name, sizeof(name), "%s  %.0f %%", m_candidates[i].name, m_candidateScores[i] * 100.0f);
+				}
+				else
+				{
+					snprintf(name, sizeof(name), "%s", m_candidates[i].name);
+				}
+
+				fl_color(FL_DARK3);
+				fl_rect(left, top, (int)width, (int)height);
+				fl_color(FL_BLACK);
+				fl_rectf(left + 1, top + 1, (int)fl_width(name) + 6, fl_height() + 2);
+				fl_color(FL_YELLOW);
+				fl_draw(name, left + 4, top + 2 + fl_height() - fl_descent());
+			}
+		}
+	}
+
+	// Results of the stride detection in the top right corner of the image
+	if(m_strideOverlay)
+	{
+		std::vector<std::string> lines;
+		lines.push_back(formatString("Row widths at offset %s (%.1f ms)", offsetToString(m_strideOffset), m_strideTime));
+		for(size_t i=0; i<m_strideCandidates.size(); ++i)
+		{
+			u32 width = m_strideCandidates[i].value * m_strideUnitWidth;
+			lines.push_back(formatString("%sCTRL + %u: %u (%.2f)", (int)width == getImageWidth() ? "> " : "", (u32)i + 1, width, m_strideCandidates[i].score));
+		}
+		if(m_strideCandidates.empty())
+		{
+			lines.push_back("No repeating rows found");
+		}
+
+		std::string sizes = "Pixel size:";
+		for(size_t i=0; i<m_pixelSizeCandidates.size(); ++i)
+		{
+			sizes += formatString(" %u (%.2f)", m_pixelSizeCandidates[i].value, m_pixelSizeCandidates[i].score);
+		}
+		lines.push_back(sizes);
+		lines.push_back("ESC closes");
+
+		fl_font(FL_COURIER, 12);
+		int width = 0;
+		for(size_t i=0; i<lines.size(); ++i)
+		{
+			width = std::max(width, (int)fl_width(lines[i].c_str()));
+		}
+
+		int lineHeight = fl_height();
+		int left = getImageBox().x() + std::max((int)getMaxViewportWidth() - width - 12, 0);
+		int top = getImageBox().y() + 4;
+		fl_color(FL_BLACK);
+		fl_rectf(left, top, width + 8, lineHeight * (int)lines.size() + 4);
+		fl_color(FL_YELLOW);
+		for(size_t i=0; i<lines.size(); ++i)
+		{
+			fl_draw(lines[i].c_str(), left + 4, top + 2 + lineHeight * (int)(i + 1) - fl_descent());
+		}
+	}
 }
 	
 int PixelDbgWnd::handle(int event)
 {
-	u32 w = (u32)getImageWidth();
-	u32 h = (u32)getImageHeight();
+	u32 w = getViewportWidth();
+	u32 h = getViewportHeight();
 	u32 x = (u32)Fl::event_x();
 	u32 y = (u32)Fl::event_y();
-	u32 r = w + x;
-    u32 b = h + y;
+	u32 r = getImageBox().x() + w;
+	u32 b = getImageBox().y() + h;
 
-	bool insideImage = x >= getImageBox().x() && y >= getImageBox().y() && x <= r && y <= b;
+	bool insideImage = x >= (u32)getImageBox().x() && y >= (u32)getImageBox().y() && x < r && y < b;
 	bool ctrlDown = false;
 
 	// Handle keys on certain cotnrols for faster editing
@@ -262,100 +660,177 @@ int PixelDbgWnd::handle(int event)
 		}
 	}
 	
-	if(event == FL_MOVE && ctrlDown && insideImage)
+	if(event == FL_MOVE && ctrlDown && insideImage && !isComparing())
 	{
 		// Calculate offset on mouse move if CTRL is pressed and we are inside the image box
 		x -= getImageBox().x();
 		y -= getImageBox().y();
-		
-		// Take flipping ops into account
-		if(m_flipV.value() != 0)
-		{
-			y = h - y;
-		}
-		if(m_flipH.value() != 0)
-		{
-			x = w - x;
-		}
-		
-		// Calculate offset in bytes
-		u32 ps = (u32)getPixelSize();
-		u32 offset = y * w * ps + x * ps;
-		
-		// Check for DXT mode (6:1 or 4:1 compression ratio)
-		if(isDXTMode())
-		{
-			int bx = x / 4;
-			int by = y / 4;
-			int numbx = w / 4;
-			int numby = h / 4;
-			int block = by * numby + bx;
-			
-			switch(m_DXTType.value())
-			{
-			case 0:
-				offset = block * 8;
-				break;
-			case 1:
-			case 2:
-				offset = block * 16;			
-				break;
-			}
-		}
 
+		// Viewport to image position, taking flipping ops and zoom (centre of the block) into account
+		ViewState state;
+		getViewState(state);
+		x = m_flipH.value() != 0 ? state.viewX + state.viewWidth - 1 - x : state.viewX + x;
+		y = m_flipV.value() != 0 ? state.viewY + state.viewHeight - 1 - y : state.viewY + y;
+		x = std::min(x * state.zoom + state.zoom / 2, state.width - 1);
+		y = std::min(y * state.zoom + state.zoom / 2, state.height - 1);
+		
 		memset(m_offsetText, 0, sizeof(m_offsetText));
-		snprintf(m_offsetText, sizeof(m_offsetText)-1, "%s", offsetToString(m_accumOffset + offset));
+		snprintf(m_offsetText, sizeof(m_offsetText)-1, "%s", offsetToString(getOffsetAt(x, y)));
 		m_offset.value(m_offsetText);
 	}
-	
-	return Fl_Double_Window::handle(event);
-}
-
-bool PixelDbgWnd::isFormatValid() const
-{
-	int bitMask[4];
-	int rgbaChannels[4];
-	int rgbaBits[4];
-	int pixelSize;
-	
-	return getPixelFormat(bitMask, rgbaChannels, rgbaBits, pixelSize);
-}
 
-int PixelDbgWnd::getRedBits() const
-{
-	const char* bits = m_rgbaBits.value();
-	const char* r = strchr(bits, '.');
-	if(!r)
+	// Minimap jumps to the clicked part of the file
+	if(event == FL_PUSH && m_currentFileSize > 0 && Fl::event_button() == FL_LEFT_MOUSE && Fl::event_inside(m_minimapBox))
 	{
-		return 0;
+		m_minimapDrag = true;
 	}
-	
-	char num[4] = { 0, 0, 0, 0 };
-	strncpy(num, bits, r - bits);
-	return atoi(num);
-}
 
-int PixelDbgWnd::getGreenBits() const
-{
-	const char* bits = m_rgbaBits.value();
-	const char* g = strchr(bits, '.');		
-	if(!g)
+	if((event == FL_PUSH || event == FL_DRAG) && m_minimapDrag)
 	{
-		return 0;
+		int pos = clampValue(Fl::event_y() - m_minimapBox->y(), 0, m_minimapBox->h() - 1);
+		seekOffset((off_t)((double)pos / (double)m_minimapBox->h() * (double)m_currentFileSize));
+		return 1;
 	}
-	bits = g + 1;
-	g = strchr(bits, '.');
-	if(!g)
+	else if(event == FL_RELEASE && m_minimapDrag)
 	{
-		return 0;
+		m_minimapDrag = false;
+		return 1;
 	}
-	
-	char num[4] = { 0, 0, 0, 0 };
-	strncpy(num, bits, g - bits);
-	return atoi(num);
-}
 
-int PixelDbgWnd::getBlueBits() const
+	// Clicking a cell of the comparison grid switches to its format
+	u32 candidate;
+	if(event == FL_PUSH && Fl::event_button() == FL_LEFT_MOUSE && insideImage && isComparing() && getGridCellAt(Fl::event_x(), Fl::event_y(), candidate))
+	{
+		adoptCandidate(candidate);
+		return 1;
+	}
+
+	// CTRL + mouse wheel zooms
+	if(event == FL_MOUSEWHEEL && (Fl::event_state() & FL_CTRL) && insideImage && !isComparing() && Fl::event_dy() != 0)
+	{
+		setZoom(Fl::event_dy() > 0 ? getZoom() * 2 : getZoom() / 2);
+		return 1;
+	}
+
+	// CTRL + J
+	if(event == FL_SHORTCUT && (Fl::event_state() & FL_CTRL) && Fl::event_key() == 'j')
+	{
+		jumpToPixel();
+		return 1;
+	}
+
+	// CTRL + D detects the row width, CTRL + 1 to 9 applies one of the results
+	if(event == FL_SHORTCUT && (Fl::event_state() & FL_CTRL) && Fl::event_key() == 'd')
+	{
+		detectStrides();
+		return 1;
+	}
+
+	if(event == FL_SHORTCUT && m_strideOverlay && (Fl::event_state() & FL_CTRL) && Fl::event_key() >= '1' && Fl::event_key() <= '9')
+	{
+		applyStride((u32)(Fl::event_key() - '1'));
+		return 1;
+	}
+
+	// CTRL + F, F3 finds the next match and SHIFT + F3 the previous one
+	if(event == FL_SHORTCUT && (Fl::event_state() & FL_CTRL) && Fl::event_key() == 'f')
+	{
+		m_search.take_focus();
+		m_search.position(m_search.size(), 0);
+		return 1;
+	}
+
+	if(event == FL_SHORTCUT && Fl::event_key() == FL_F + 3)
+	{
+		findPattern((Fl::event_state() & FL_SHIFT) == 0);
+		return 1;
+	}
+
+	// F4 jumps to the next difference of the diff view and SHIFT + F4 to the previous one
+	if(event == FL_SHORTCUT && Fl::event_key() == FL_F + 4)
+	{
+		findDifference((Fl::event_state() & FL_SHIFT) == 0);
+		return 1;
+	}
+
+	// CTRL + G
+	if(event == FL_SHORTCUT && (Fl::event_state() & FL_CTRL) && Fl::event_key() == 'g')
+	{
+		suggestFormats();
+		return 1;
+	}
+
+	// Escape would close the window otherwise
+	if(event == FL_SHORTCUT && m_strideOverlay && Fl::event_key() == FL_Escape)
+	{
+		m_strideOverlay = false;
+		redraw();
+		return 1;
+	}
+	
+	return Fl_Double_Window::handle(event);
+}
+
+void PixelDbgWnd::hide()
+{
+	// The jump lists are windows of their own and would keep the application running
+	if(m_carveWindow)
+	{
+		m_carveWindow->hide();
+	}
+	if(m_dupWindow)
+	{
+		m_dupWindow->hide();
+	}
+
+	Fl_Double_Window::hide();
+}
+
+bool PixelDbgWnd::isFormatValid() const
+{
+	int bitMask[4];
+	int rgbaChannels[4];
+	int rgbaBits[4];
+	int pixelSize;
+	
+	return getPixelFormat(bitMask, rgbaChannels, rgbaBits, pixelSize);
+}
+
+int PixelDbgWnd::getRedBits() const
+{
+	const char* bits = m_rgbaBits.value();
+	const char* r = strchr(bits, '.');
+	if(!r)
+	{
+		return 0;
+	}
+	
+	char num[4] = { 0, 0, 0, 0 };
+	strncpy(num, bits, r - bits);
+	return atoi(num);
+}
+
+int PixelDbgWnd::getGreenBits() const
+{
+	const char* bits = m_rgbaBits.value();
+	const char* g = strchr(bits, '.');		
+	if(!g)
+	{
+		return 0;
+	}
+	bits = g + 1;
+	g = strchr(bits, '.');
+	if(!g)
+	{
+		return 0;
+	}
+	
+	char num[4] = { 0, 0, 0, 0 };
+	strncpy(num, bits, g - bits);
+	return atoi(num);
+}
+
+int PixelDbgWnd::getBlueBits() const
 {
 	const char* bits = m_rgbaBits.value();
 	const char* b = strchr(bits, '.');		
@@ -414,55 +889,18 @@ bool PixelDbgWnd::getPixelFormat(int bitMask[4], int rgbaChannels[4], int rgbaBi
 	rgbaBits[2] = getBlueBits();
 	rgbaBits[3] = getAlphaBits();
 	
-	if(rgbaBits[0] <= 0 && rgbaBits[1] <= 0 && rgbaBits[2] <= 0 && rgbaBits[3] <= 0)
-	{
-		return false;
-	}
-
-	// Do not allow channel depth larger then 8 until proper handling is implemented
-	if(rgbaBits[0] > 8 || rgbaBits[1] > 8 || rgbaBits[2] > 8 || rgbaBits[3] > 8)
-	{
-		return false;
-	}
-	
 	rgbaChannels[0] = atoi(m_redChannel.value()) - 1;
 	rgbaChannels[1] = atoi(m_greenChannel.value()) - 1;
 	rgbaChannels[2] = atoi(m_blueChannel.value()) - 1;
 	rgbaChannels[3] = atoi(m_alphaChannel.value()) - 1;
 	
-	bitMask[0] = bitMask[1] = bitMask[2] = bitMask[3] = 0;
-	
-	for(int i=0; i<4; ++i)
-	{
-		if(rgbaChannels[i] == -1)
-		{
-			return false;
-		}
-		
-		if(rgbaChannels[i] > 3)
-		{
-			return false;
-		}	
-		
-		// No duplicate channels allowed (i.e. R=1, G=1)
-		for(int j=0; j<4; ++j)
-		{
-			if(i != j && rgbaChannels[i] == rgbaChannels[j])
-			{
-				return false;
-			}
-		}
-		
-		if(rgbaChannels[i] >= 0)
-		{
-			bitMask[rgbaChannels[i]] = ~(((u32)-1) << rgbaBits[i]);
-		}
-	}
-	
-	int bpp = rgbaBits[0] + rgbaBits[1] + rgbaBits[2] + rgbaBits[3];
-	pixelSize = bpp / 8;
+	return buildPixelFormat(rgbaBits, rgbaChannels, bitMask, pixelSize);
+}
 
-	return pixelSize != 0 && (bpp % 8) == 0 && bpp <= 32;
+bool PixelDbgWnd::getPixelFormat(PixelFormat& format) const
+{
+	format.valid = getPixelFormat(format.bitMask, format.rgbaChannels, format.rgbaBits, format.pixelSize);
+	return format.valid;
 }
 
 bool PixelDbgWnd::getRGBABits(int rgbaBits[4])
@@ -590,9 +1028,11 @@ bool PixelDbgWnd::updateBitwiseOps()
 	const Fl_Choice* op[] = { &m_bitwiseStage1, &m_bitwiseStage2, &m_bitwiseStage3, &m_bitwiseStage4, &m_bitwiseStage5 };
 	const Fl_Input* bits[] = { &m_bitwiseStage1Bits, &m_bitwiseStage2Bits, &m_bitwiseStage3Bits, &m_bitwiseStage4Bits, &m_bitwiseStage5Bits };
 
-	assert(m_bitwiseOpVec.size() == sizeof(op)/sizeof(op[0]) && "Size mismatch");
+	// The pipeline has as many stages as there are widgets, the table doesn't care how many
+	m_bitwiseOpVec.resize(sizeof(op)/sizeof(op[0]));
 	
-	int r, g, b, a;
+	bool valid = true;
+	int r, g, b;
 	for(size_t i=0; i<m_bitwiseOpVec.size(); ++i)
 	{
 		assert(op[i]->value() < 8 && "Invalid bitwise op in choice");
@@ -604,7 +1044,8 @@ bool PixelDbgWnd::updateBitwiseOps()
 			const char* bitsStr = bits[i]->value();
 			if(!getRGBABitsFromHexString(bitsStr, &r, &g, &b))
 			{
-				return false;
+				valid = false;
+				break;
 			}
 
 			m_bitwiseOpVec[i].r = r;
@@ -613,21 +1054,74 @@ bool PixelDbgWnd::updateBitwiseOps()
 		}
 	}
 
-	return true;
+	// Collapse all stages into one lookup table per channel
+	m_bitwiseTable.compile(m_bitwiseOpVec);
+
+	return valid;
 }
 
 void PixelDbgWnd::updateScrollbar(off_t pos, bool resize)
 {
+	// Indexed RLE streams are scrolled in pixels instead of bytes
+	u64 rlePixels = isRLEMode() ? m_rleIndex.getIndexedPixels() : 0;
+	if(rlePixels > 0)
+	{
+		pos = (off_t)m_rlePixel;
+	}
+	else if(isScrollingRows())
+	{
+		pos = (off_t)m_viewY;
+	}
+
 	if(resize)
 	{
-		if(m_currentFileSize > 0)
+		u32 width = getZoomedWidth();
+		u32 height = getZoomedHeight();
+		u32 viewWidth = getViewportWidth();
+		u32 viewHeight = getViewportHeight();
+
+		// Keep the scroll position inside of the image
+		m_viewX = std::min(m_viewX, width - viewWidth);
+		m_viewY = std::min(m_viewY, height - viewHeight);
+
+		m_imageHScroll->resize(m_leftArea.w(), h() - m_imageHScroll->h(), w() - m_imageScroll->w() - m_leftArea.w(), m_imageHScroll->h());
+		m_minimapBox->resize(w() - getSideBarWidth(), 0, m_minimapBox->w(), h() - m_imageHScroll->h());
+		scrollValueDouble(m_imageHScroll, (double)m_viewX, viewWidth, 0, width);
+		m_imageHScroll->linesize(std::max(viewWidth / 4, 1u));
+
+		if(width > viewWidth && m_currentFileSize > 0 && !isComparing())
+		{
+			m_imageHScroll->activate();
+		}
+		else
+		{
+			m_imageHScroll->deactivate();
+		}
+
+		if(rlePixels > 0)
+		{
+			u64 numVisiblePixels = std::min((u64)getImageWidth() * viewHeight, rlePixels);
+
+			m_imageScroll->resize(w() - m_imageScroll->w(), 0, m_imageScroll->w(), h() - m_imageHScroll->h());
+			scrollValueDouble(m_imageScroll, (double)m_rlePixel, 0, 0, (double)(rlePixels - numVisiblePixels));
+
+			m_imageScroll->linesize((int)(numVisiblePixels / 4));
+			m_imageScroll->slider_size(double(numVisiblePixels) / double(rlePixels));
+		}
+		else if(isScrollingRows() && m_currentFileSize > 0)
+		{
+			m_imageScroll->resize(w() - m_imageScroll->w(), 0, m_imageScroll->w(), h() - m_imageHScroll->h());
+			scrollValueDouble(m_imageScroll, (double)m_viewY, viewHeight, 0, height);
+			m_imageScroll->linesize(std::max(viewHeight / 4, 1u));
+		}
+		else if(m_currentFileSize > 0)
 		{
 			u32 pixelSize = (u32)getPixelSize();
 			off_t offset = getOffset();
 			size_t totalBytes = m_currentFileSize;
-			size_t numVisibleBytes = std::min((size_t)getNumVisibleBytes(), totalBytes);
+			size_t numVisibleBytes = (size_t)std::min(getNumVisibleBytes(), (u64)totalBytes);
 
-			m_imageScroll->resize(w() - m_imageScroll->w(), 0, m_imageScroll->w(), h());
+			m_imageScroll->resize(w() - m_imageScroll->w(), 0, m_imageScroll->w(), h() - m_imageHScroll->h());
 			//m_imageScroll->value(offset, 0, 0, totalBytes - numVisibleBytes);
 			scrollValueDouble(m_imageScroll, (double)offset, 0, 0, totalBytes - numVisibleBytes);
 
@@ -636,7 +1130,7 @@ void PixelDbgWnd::updateScrollbar(off_t pos, bool resize)
 		}
 		else
 		{
-			m_imageScroll->resize(w() - m_imageScroll->w(), 1, m_imageScroll->w(), h());
+			m_imageScroll->resize(w() - m_imageScroll->w(), 1, m_imageScroll->w(), h() - m_imageHScroll->h());
 			m_imageScroll->slider_size(1.0f);
 		}
 	}
@@ -645,518 +1139,1181 @@ void PixelDbgWnd::updateScrollbar(off_t pos, bool resize)
 	{
 		m_imageScroll->value((double)pos);
 	}
+
+	if(resize)
+	{
+		updateMinimap();
+	}
 }
 
-void PixelDbgWnd::convertRaw(const u8* data, u32 size, u8* rgbOut, u32 flags /* 0 */, const std::vector<BitwiseOp>* bwOps /* NULL */, u32 tileX /* 0xffff */, u32 tileY /* 0xffff */, u8* palette /* NULL */)
-{	
-	int bitMask[4];
-	int rgbaChannels[4];
-	int rgbaBits[4];
-	int ps;
-	
-	if(!isDimValid() || !getPixelFormat(bitMask, rgbaChannels, rgbaBits, ps))
+void PixelDbgWnd::updateMinimap()
+{
+	u32 w = (u32)m_minimapBox->w();
+	u32 h = (u32)std::max(m_minimapBox->h(), 1);
+	m_minimapPixels.assign(w * h * 3, 0);
+	m_minimap.getCells(m_minimapCells);
+
+	// Visible bytes are marked at the right edge
+	u32 numCells = (u32)m_minimapCells.size();
+	double scale = m_currentFileSize > 0 ? double(h) / double(m_currentFileSize) : 0.0;
+	u32 markFirst = (u32)(m_accumOffset * scale);
+	u32 markLast = (u32)std::max((double)markFirst, (m_accumOffset + std::min(getNumVisibleBytes(), (u64)m_currentFileSize)) * scale - 1.0);
+
+	// Rows with duplicate blocks are marked next to the class while their list is open
+	std::vector<float> duplicates;
+	if(m_dupWindow && m_dupWindow->shown())
 	{
-		return;
+		m_duplicateFinder.getDensity(h, duplicates);
 	}
 
-	if((flags & CF_IgnoreChannelOrder) != 0)
+	for(u32 y=0; y<h && numCells>0; ++y)
 	{
-		int rgbaMask[4] = { bitMask[rgbaChannels[0]], bitMask[rgbaChannels[1]], bitMask[rgbaChannels[2]], bitMask[rgbaChannels[3]] };
-		bitMask[0] = rgbaMask[0];
-		bitMask[1] = rgbaMask[1];
-		bitMask[2] = rgbaMask[2];
-		bitMask[3] = rgbaMask[3];
+		// Every row sums up the cells it covers
+		u32 first = (u32)((u64)y * numCells / h);
+		u32 last = std::max(first + 1, (u32)((u64)(y + 1) * numCells / h));
+		u32 sum[3] = { 0, 0, 0 };
+		u32 scanned = 0, zero = 0, noise = 0, entropy = 0;
+
+		for(u32 i=first; i<last; ++i)
+		{
+			const Minimap::Cell& cell = m_minimapCells[i];
+			if(cell.flags & Minimap::CELL_Scanned)
+			{
+				sum[0] += cell.rgb[0];
+				sum[1] += cell.rgb[1];
+				sum[2] += cell.rgb[2];
+				++scanned;
+				zero += (cell.flags & Minimap::CELL_Zero) ? 1 : 0;
+				noise += (cell.flags & Minimap::CELL_Noise) ? 1 : 0;
+				entropy += cell.entropy;
+			}
+		}
+
+		// Not scanned yet stays grey, the class of the data is shown at the left edge
+		u8 color[3] = { 0x50, 0x50, 0x50 };
+		u8 mark[3] = { 0x50, 0x50, 0x50 };
+		if(scanned > 0)
+		{
+			for(u32 c=0; c<3; ++c)
+			{
+				color[c] = mark[c] = (u8)(sum[c] / scanned);
+			}
+
+			// Cells store bits per byte * 32
+			if(m_entropy.value() != 0)
+			{
+				EntropyEngine::getHeatColor(float(entropy) / float(scanned * 32), color);
+			}
+
+			if(zero * 2 > scanned)
+			{
+				mark[0] = 0x20; mark[1] = 0x40; mark[2] = 0xc0;
+			}
+			else if(noise * 2 > scanned)
+			{
+				mark[0] = 0xe0; mark[1] = 0x20; mark[2] = 0x20;
+			}
+		}
+
+		u8* row = &m_minimapPixels[y * w * 3];
+		for(u32 x=0; x<w; ++x)
+		{
+			const u8* rgb = x < 3 ? mark : color;
+			if(x + 2 >= w && y >= markFirst && y <= markLast && m_currentFileSize > 0)
+			{
+				static const u8 yellow[3] = { 0xff, 0xe0, 0x00 };
+				rgb = yellow;
+			}
+			else if(x >= 3 && x < 5 && y < duplicates.size() && duplicates[y] > 0.0f)
+			{
+				static const u8 magenta[3] = { 0xff, 0x00, 0xff };
+				rgb = magenta;
+			}
 
-		rgbaChannels[0] = 0;
-		rgbaChannels[1] = 1;
-		rgbaChannels[2] = 2;
-		rgbaChannels[3] = 3;
+			row[x * 3 + 0] = rgb[0];
+			row[x * 3 + 1] = rgb[1];
+			row[x * 3 + 2] = rgb[2];
+		}
 	}
 
-	// In palette mode each pixel is 1 byte wide indexing a total of 255 colors
-	if(palette)
+	delete m_minimapImage;
+	m_minimapImage = new Fl_RGB_Image(&m_minimapPixels[0], w, h, 3);
+	m_minimapBox->image(m_minimapImage);
+	m_minimapBox->redraw();
+}
+
+void PixelDbgWnd::convertPalette(const u8* data, u32 size, u8* rgbOut)
+{
+	PixelFormat format;
+
+	if(getPixelFormat(format) && isDimValid())
 	{
-		ps = 1;
+		memset(m_palette, 0, sizeof(m_palette));
+		convertRaw(format, (u32)getImageWidth(), (u32)getImageHeight(), data, (u32)(256 * format.pixelSize), rgbOut, CF_IgnoreChannelOrder | CF_IgnoreTiles);
 	}
+}
 
-	int bitCount[4];
-	bitCount[rgbaChannels[0]] = rgbaBits[0];
-	bitCount[rgbaChannels[1]] = rgbaBits[1];
-	bitCount[rgbaChannels[2]] = rgbaBits[2];
-	bitCount[rgbaChannels[3]] = rgbaBits[3];
-	
-	// Shift pixels up by the difference between 8bit per channel and the interpreted data.
-	// This will avoid darker images for lower precision formats (i.e. 5551 -> 8888 = 1.1111 -> 0001.1111).
-	int rdiff = 8 - bitCount[rgbaChannels[0]];
-	int gdiff = 8 - bitCount[rgbaChannels[1]];
-	int bdiff = 8 - bitCount[rgbaChannels[2]];
-	int adiff = 8 - bitCount[rgbaChannels[3]];
-	
-	// Align backwards
-	while(size % ps != 0)
+size_t PixelDbgWnd::readFile(const char* name, void* out, size_t size, off_t offset /* 0 */)
+{
+	#if IS64BIT
+	FILE* f = fopen64(name, "rb");
+	#else
+	FILE* f = fopen(name, "rb");
+	#endif
+	if(f)
 	{
-		--size;
+		fseeko(f, 0, SEEK_END);
+		size_t filesize = (size_t)ftello(f);
+		fseeko(f, offset, SEEK_SET);
+
+		size = std::min(size + offset, filesize) - offset;
+		fread(out, size, 1, f);
+		fclose(f);
+
+		return size;
 	}
-	
-	// Convert
-	bool redMasked = (flags & CF_IgnoreRedChannel) != 0;
-	bool greenMasked = (flags & CF_IgnoreGreenChannel) != 0;
-	bool blueMasked = (flags & CF_IgnoreBlueChannel) != 0;
-	bool alphaOnly = redMasked && greenMasked && blueMasked;
-	if(alphaOnly)
+
+	return 0;
+}
+
+size_t PixelDbgWnd::viewFile(off_t offset)
+{
+	// Let the read-ahead know where we are heading before touching the pages
+	m_prefetcher.request(offset, kMaxBufferSize);
+
+	// Point data field straight into the file mapping (no copy)
+	size_t size = m_view.map(m_file, offset, kMaxBufferSize);
+	if(size > 0)
 	{
-		rdiff = gdiff = bdiff = adiff;
+		m_data.static_value(reinterpret_cast<const char*>(m_view.data()), size);
+		m_data.position(0, 0);
 	}
 
-	u32 width = (u32)getImageWidth();
-	u32 height = (u32)getImageHeight();
-	u32 xTiles = 1;
-	u32 yTiles = 1;
+	return size;
+}
 
-	if((flags & CF_IgnoreTiles) == 0 && tileX < width && tileY < height)
+bool PixelDbgWnd::updateRleIndex()
+{
+	if(!isRLEMode() || !m_file.isOpen() || getPixelSize() <= 0)
 	{
-		xTiles = width / tileX;
-		yTiles = height / tileY;
+		return false;
 	}
-	
-	u32 numPixels = 0;
-	u32 totalPixels = size / ps;
-	u32 stride = width * ps;
-	u32 dest = 0;
-	
-	for(u32 ty=0; ty<yTiles; ++ty)
+
+	// A new index starts at the current offset, the view is then its first pixel
+	u32 RLmask = m_RLEType.value() == 2 ? 0x7f : 0xff;
+	bool RLmsb = m_RLEType.value() == 1;
+	if(m_rleIndex.build(m_file, m_accumOffset, (u32)getPixelSize(), RLmask, RLmsb))
 	{
-		u32 by = ty * tileY;
-		
-		for(u32 tx=0; tx<xTiles; ++tx)
-		{
-			u32 bx = tx * tileX;
-			
-			for(u32 y=0; y<tileY; ++y)
-			{
-				for(u32 x=0; x<tileX; ++x, dest+=3, ++numPixels)
-				{
-					u32 i = (by + y) * stride + (bx + x) * ps;
-					
-					if(numPixels >= totalPixels)
-					{
-						return;
-					}
-					
-					// Read pixel byte-wise
-					u32 pixel = 0;
-					for(u32 j=0; j<ps; ++j)
-					{
-						pixel |= data[i+j] << (j * 8);
-					}
-					
-					// Final channel values
-					u8 r = 0, g = 0, b = 0;
+		m_rlePixel = 0;
+		m_rleSkip = 0;
+		return true;
+	}
 
-					if(!palette)
-					{
-						if(alphaOnly)
-						{
-							if(rgbaChannels[3] >= 0 && rgbaBits[3] != 0)
-							{
-								int start = 0;
-								for(int j=0; j<rgbaChannels[3]; ++j)
-								{
-									start += bitCount[j];
-								}
-								r = pixel >> start;
-								r &= bitMask[rgbaChannels[3]];
-								g = b = r;
-							}
-						}
-						else
-						{
-							if(!redMasked && rgbaChannels[0] >= 0 && rgbaBits[0] != 0)
-							{
-								int start = 0;
-								for(int j=0; j<rgbaChannels[0]; ++j)
-								{
-									start += bitCount[j];
-								}
-								r = pixel >> start;
-								r &= bitMask[rgbaChannels[0]];
-							}
-					
-							if(!greenMasked && rgbaChannels[1] >= 0 && rgbaBits[1] != 0)
-							{
-								int start = 0;
-								for(int j=0; j<rgbaChannels[1]; ++j)
-								{
-									start += bitCount[j];
-								}
-								g = pixel >> start;
-								g &= bitMask[rgbaChannels[1]];
-							}
-					
-							if(!blueMasked && rgbaChannels[2] >= 0 && rgbaBits[2] != 0)
-							{
-								int start = 0;
-								for(int j=0; j<rgbaChannels[2]; ++j)
-								{
-									start += bitCount[j];
-								}
-								b = pixel >> start;
-								b &= bitMask[rgbaChannels[2]];
-							}
-						}
-
-						rgbOut[dest+0] = r << rdiff;
-						rgbOut[dest+1] = g << gdiff;
-						rgbOut[dest+2] = b << bdiff;
-					}
-					else
-					{
-						rgbOut[dest+0] = redMasked ? 0 : palette[pixel * 3 + rgbaChannels[0]];
-						rgbOut[dest+1] = greenMasked ? 0 : palette[pixel * 3 + rgbaChannels[1]];
-						rgbOut[dest+2] = blueMasked ? 0 : palette[pixel * 3 + rgbaChannels[2]];
-					}
+	return false;
+}
+
+bool PixelDbgWnd::viewPixel(u64 pixel)
+{
+	RleIndex::Position pos;
+	if(!m_rleIndex.seekPixel(pixel, pos) || !viewFile(pos.offset))
+	{
+		return false;
+	}
+
+	m_accumOffset = pos.offset;
+	m_offset.value(offsetToString(pos.offset));
+	m_rlePixel = pixel;
+	m_rleSkip = pos.skip;
+
+	return true;
+}
+
+off_t PixelDbgWnd::getOffsetAt(u32 x, u32 y)
+{
+	u32 w = (u32)getImageWidth();
+	u32 ps = (u32)getPixelSize();
+
+	// Run holding the pixel
+	if(isRLEMode())
+	{
+		RleIndex::Position pos;
+		if(m_rleIndex.seekPixel(m_rlePixel + (u64)y * w + x, pos))
+		{
+			return pos.offset;
+		}
+		return m_accumOffset;
+	}
+
+	// Block holding the pixel (6:1 or 4:1 compression ratio)
+	if(isDXTMode())
+	{
+		off_t block = (off_t)(y / 4) * (w / 4) + x / 4;
+		return m_accumOffset + block * (m_DXTType.value() == 0 ? 8 : 16);
+	}
+
+	return m_accumOffset + ((off_t)y * w + x) * ps;
+}
+
+void PixelDbgWnd::jumpToPixel()
+{
+	if(!m_file.isOpen() || !isValid())
+	{
+		return;
+	}
+
+	const char* input = fl_input(isRLEMode() ? "Jump to pixel (counted from the RLE index start):" : "Jump to pixel:", "0");
+	if(!input || input[0] == 0)
+	{
+		return;
+	}
+
+	u64 pixel = strtoull(input, NULL, 10);
+
+	if(isRLEMode())
+	{
+		if(!viewPixel(pixel))
+		{
+			fl_message("Pixel %s is not indexed (yet).", input);
+			return;
+		}
+	}
+	else
+	{
+		u32 w = (u32)getImageWidth();
+		u32 ps = (u32)getPixelSize();
+		off_t offset = (off_t)(pixel * ps);
+
+		if(isDXTMode())
+		{
+			u64 block = (pixel / w / 4) * (w / 4) + (pixel % w) / 4;
+			offset = (off_t)(block * (m_DXTType.value() == 0 ? 8 : 16));
+		}
+
+		if(offset >= (off_t)m_currentFileSize || !viewFile(offset))
+		{
+			fl_message("Pixel %s lies behind the end of the file.", input);
+			return;
+		}
+
+		m_accumOffset = offset;
+		m_offset.value(offsetToString(offset));
+	}
+
+	// Pixel is the top left one of the image now
+	m_viewX = 0;
+	m_viewY = 0;
+	updateScrollbar(m_accumOffset, true);
+	RedrawCallback(&m_data, this);
+}
+
+void PixelDbgWnd::setZoom(u32 zoom)
+{
+	if(!isValid() || zoom == getZoom())
+	{
+		return;
+	}
+
+	ViewState state;
+	getViewState(state);
+	if(!state.zoomTo(zoom))
+	{
+		return;
+	}
+
+	u32 level = 0;
+	while((1u << level) < zoom)
+	{
+		++level;
+	}
+	m_zoom.value(level);
+	m_displayedZoom = level;
+
+	// Back to the displayed (flipped) scroll position
+	m_viewX = state.flipH ? state.getZoomedWidth() - state.viewX - state.viewWidth : state.viewX;
+	m_viewY = state.flipV ? state.getZoomedHeight() - state.viewY - state.viewHeight : state.viewY;
+
+	updateScrollbar(m_accumOffset, true);
+	RedrawCallback(&m_zoom, this);
+}
+
+void PixelDbgWnd::seekOffset(off_t offset, bool keepAlignment /* true */)
+{
+	if(!m_file.isOpen() || m_currentFileSize == 0)
+	{
+		return;
+	}
+
+	// Same byte within a pixel as the current offset, so channels stay where they are
+	off_t ps = (off_t)std::max(getPixelSize(), 1);
+	offset = clampValue(offset, (off_t)0, (off_t)m_currentFileSize - 1);
+	if(keepAlignment)
+	{
+		offset += m_accumOffset % ps - offset % ps;
+		if(offset >= (off_t)m_currentFileSize)
+		{
+			offset -= ps;
+		}
+	}
+
+	if(offset < 0 || offset == m_accumOffset || !viewFile(offset))
+	{
+		return;
+	}
+
+	m_accumOffset = offset;
+	m_offset.value(offsetToString(offset));
+	m_viewY = 0;
+
+	// Stream wasn't indexed from there, restart at the new offset
+	if(isRLEMode())
+	{
+		m_rleIndex.detach();
+	}
+
+	updateScrollbar(offset, true);
+	RedrawCallback(m_minimapBox, this);
+}
+
+void PixelDbgWnd::detectStrides()
+{
+	if(!m_file.isOpen() || !isValid())
+	{
+		return;
+	}
+
+	// Runs have no fixed size, so RLE streams have no row stride
+	if(isRLEMode())
+	{
+		fl_message("Row widths can't be detected on RLE data.");
+		return;
+	}
+
+	// DXT rows are rows of 4x4 blocks
+	u32 unitSize = (u32)getPixelSize();
+	m_strideUnitWidth = 1;
+	if(isDXTMode())
+	{
+		unitSize = m_DXTType.value() == 0 ? 8 : 16;
+		m_strideUnitWidth = 4;
+	}
+
+	MappedWindow window;
+	size_t size = window.map(m_file, m_accumOffset, StrideDetector::kMaxWindow);
+	if(size == 0 || !window.data())
+	{
+		return;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	m_strideDetector.rankPixelSizes(window.data(), (u32)size, m_pixelSizeCandidates);
+	m_strideDetector.rankStrides(window.data(), (u32)size, unitSize, kMaxStrideCandidates, m_strideCandidates, &m_renderer.getPool());
+	m_strideTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// Widths beyond the limit can't be applied
+	for(size_t i=m_strideCandidates.size(); i-->0; )
+	{
+		if(m_strideCandidates[i].value * m_strideUnitWidth > kMaxDim)
+		{
+			m_strideCandidates.erase(m_strideCandidates.begin() + i);
+		}
+	}
+
+	m_strideOffset = m_accumOffset;
+	m_strideOverlay = true;
+	redraw();
+}
+
+void PixelDbgWnd::applyStride(u32 index)
+{
+	if(index >= m_strideCandidates.size())
+	{
+		return;
+	}
+
+	m_width.value(intToString((int)(m_strideCandidates[index].value * m_strideUnitWidth)));
+	DimCallback(&m_width, this);
+	redraw();
+}
+
+void PixelDbgWnd::suggestFormats()
+{
+	if(!m_file.isOpen() || !isValid())
+	{
+		return;
+	}
+
+	if(isRLEMode())
+	{
+		fl_message("Formats can't be suggested on RLE data.");
+		return;
+	}
+
+	MappedWindow window;
+	size_t size = window.map(m_file, m_accumOffset, FormatDetector::kMaxWindow);
+	if(size == 0 || !window.data())
+	{
+		return;
+	}
+
+	// PAL8 is only scored with a palette loaded
+	std::vector<FormatDetector::Result> results;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	m_formatDetector.rank(window.data(), (u32)size, (u32)getImageWidth(), m_suggestCandidates, isPaletteMode() ? m_palette : NULL, results, &m_renderer.getPool());
+	m_suggestTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if(results.empty())
+	{
+		fl_message("Not enough data at the offset for the current width.");
+		return;
+	}
+
+	m_candidates.clear();
+	m_candidateScores.clear();
+	for(size_t i=0; i<results.size() && i<kMaxSuggestions; ++i)
+	{
+		m_candidates.push_back(m_suggestCandidates[results[i].index]);
+		m_candidateScores.push_back(results[i].score);
+	}
+
+	m_compare.activate();
+	m_compare.value(1);
+	updateScrollbar(m_accumOffset, true);
+	RedrawCallback(&m_compare, this);
+}
+
+bool PixelDbgWnd::getGridCellAt(int x, int y, u32& index) const
+{
+	ViewState grid;
+	grid.candidates = m_candidates;
+	grid.gridColumns = getGridColumns();
+	grid.viewWidth = getViewportWidth();
+	grid.viewHeight = getViewportHeight();
+
+	for(u32 i=0; i<m_candidates.size(); ++i)
+	{
+		u32 cx, cy, width, height;
+		if(grid.getGridCell(i, cx, cy, width, height))
+		{
+			int left = getImageBox().x() + (int)cx;
+			int top = getImageBox().y() + (int)cy;
+			if(x >= left && y >= top && x < left + (int)width && y < top + (int)height)
+			{
+				index = i;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void PixelDbgWnd::adoptCandidate(u32 index)
+{
+	const FormatCandidate& candidate = m_candidates[index];
+	bool dxt = candidate.kind == FormatCandidate::FC_DXT;
+	bool palette = candidate.kind == FormatCandidate::FC_Palette || candidate.kind == FormatCandidate::FC_Gray;
+
+	m_compare.value(0);
+
+	// Modes go through their callbacks, so dependent widgets are (de)activated as if clicked.
+	// Palette mode has to be off before DXT mode can be switched on.
+	if(isRLEMode())
+	{
+		m_RLEMode.value(0);
+		RLECallback(&m_RLEMode, this);
+	}
+
+	if(isPaletteMode() && !palette)
+	{
+		m_paletteMode.value(0);
+		PaletteCallback(&m_paletteMode, this);
+	}
+
+	if(isDXTMode() != dxt)
+	{
+		m_DXTMode.value(dxt ? 1 : 0);
+		DXTCallback(&m_DXTMode, this);
+	}
+
+	if(palette && !isPaletteMode())
+	{
+		m_paletteMode.value(1);
+		PaletteCallback(&m_paletteMode, this);
+	}
+
+	if(dxt)
+	{
+		m_DXTType.value(candidate.DXTType == 1 ? 0 : (candidate.DXTType == 3 ? 1 : 2));
+		DXTCallback(&m_DXTType, this);
+		return;
+	}
+
+	if(candidate.kind == FormatCandidate::FC_Gray)
+	{
+		for(int i=0; i<256; ++i)
+		{
+			m_palette[i*3+0] = m_palette[i*3+1] = m_palette[i*3+2] = (u8)i;
+			m_rawPalette[i*3+0] = m_rawPalette[i*3+1] = m_rawPalette[i*3+2] = (u8)i;
+			m_rawPalette[i*3+3] = 0;
+		}
+	}
+	else if(candidate.kind == FormatCandidate::FC_Raw)
+	{
+		const PixelFormat& format = candidate.format;
+		m_rgbaBits.value(formatString("%d.%d.%d.%d", format.rgbaBits[0], format.rgbaBits[1], format.rgbaBits[2], format.rgbaBits[3]));
+		m_redChannel.value(intToString(format.rgbaChannels[0] + 1));
+		m_greenChannel.value(intToString(format.rgbaChannels[1] + 1));
+		m_blueChannel.value(intToString(format.rgbaChannels[2] + 1));
+		m_alphaChannel.value(intToString(format.rgbaChannels[3] + 1));
+		updatePixelFormat();
+	}
+
+	updateScrollbar(m_accumOffset, true);
+	RedrawCallback(&m_compare, this);
+}
+
+void PixelDbgWnd::showCarveList()
+{
+	if(!m_file.isOpen())
+	{
+		fl_message("No file opened.");
+		return;
+	}
+
+	if(!m_carveWindow)
+	{
+		// Top level window, not a child of the main window
+		Fl_Group* current = Fl_Group::current();
+		Fl_Group::current(NULL);
+
+		m_carveWindow = new Fl_Double_Window(640, 400, "Embedded images");
+		m_carveSort = new Fl_Choice(60, 5, 110, 22, "Sort by:");
+		m_carveStatus = new Fl_Box(175, 5, 460, 22);
+		m_carveList = new Fl_Hold_Browser(5, 32, 630, 363);
+		m_carveWindow->end();
+		m_carveWindow->resizable(m_carveList);
+
+		Fl_Group::current(current);
+
+		m_carveSort->textfont(FL_COURIER);
+		m_carveSort->textsize(12);
+		m_carveSort->add("Offset");
+		m_carveSort->add("Type");
+		m_carveSort->add("Pixels");
+		m_carveSort->add("Data size");
+		m_carveSort->value(0);
+		m_carveSort->when(FL_WHEN_CHANGED);
+		m_carveSort->callback(CarveListCallback, this);
+		m_carveSort->tooltip("Order of the list, largest images first by pixels and data size.");
+
+		m_carveStatus->labelsize(12);
+		m_carveStatus->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+
+		static const int columns[] = { 130, 50, 120, 130, 0 };
+		m_carveList->column_widths(columns);
+		m_carveList->column_char('\t');
+		m_carveList->textfont(FL_COURIER);
+		m_carveList->textsize(12);
+		m_carveList->when(FL_WHEN_CHANGED);
+		m_carveList->callback(CarveListCallback, this);
+		m_carveList->tooltip("Select an image to jump to its pixels and switch to its size and format.");
+	}
+
+	m_carver.start(m_file);
+	updateCarveList();
+	m_carveWindow->show();
+}
+
+void PixelDbgWnd::updateCarveList()
+{
+	if(!m_carveWindow)
+	{
+		return;
+	}
+
+	// Selection and scroll position are kept while the list grows (the first line is the header)
+	int line = m_carveList->value();
+	u64 selected = line > 1 && line - 2 < (int)m_carveHits.size() ? m_carveHits[line - 2].offset : ~0ull;
+	int top = m_carveList->topline();
+
+	m_carver.getHits(m_carveHits);
+	std::stable_sort(m_carveHits.begin(), m_carveHits.end(), CarveHitOrder(m_carveSort->value()));
+
+	m_carveList->clear();
+	m_carveList->add("@bOffset\t@bType\t@bSize\t@bData offset\t@bFormat");
+	for(size_t i=0; i<m_carveHits.size(); ++i)
+	{
+		const ImageCarver::Hit& hit = m_carveHits[i];
+		char format[64];
+		ImageCarver::getFormatName(hit, format, sizeof(format));
+		m_carveList->add(formatString("%llu\t%s\t%ux%u\t%llu\t%s", (unsigned long long)hit.offset, ImageCarver::getTypeName(hit.type),
+			hit.width, hit.height, (unsigned long long)hit.dataOffset, format));
+
+		if(hit.offset == selected)
+		{
+			m_carveList->value((int)i + 2);
+		}
+	}
+	m_carveList->topline(top);
+
+	ImageCarver::Stats stats = m_carver.getStats();
+	double rate = stats.seconds > 0.0 ? stats.scanned / stats.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0;
+	if(stats.complete)
+	{
+		m_carveStatus->copy_label(formatString("%u images%s in %.1f MB, %.2f s on %u threads (%.2f GB/s)", stats.numHits,
+			stats.truncated ? " (list truncated)" : "", stats.fileSize / (1024.0 * 1024.0), stats.seconds, stats.numThreads, rate));
+	}
+	else
+	{
+		float progress = stats.fileSize > 0 ? float(stats.scanned) / float(stats.fileSize) * 100.0f : 0.0f;
+		m_carveStatus->copy_label(formatString("Scanning %.0f %%, %u images so far (%.2f GB/s)", progress, stats.numHits, rate));
+	}
+}
+
+void PixelDbgWnd::showDuplicateList()
+{
+	if(!m_file.isOpen())
+	{
+		fl_message("No file opened.");
+		return;
+	}
+
+	if(!m_dupWindow)
+	{
+		// Top level window, not a child of the main window
+		Fl_Group* current = Fl_Group::current();
+		Fl_Group::current(NULL);
+
+		m_dupWindow = new Fl_Double_Window(640, 400, "Duplicate blocks");
+		m_dupStatus = new Fl_Box(5, 5, 630, 22);
+		m_dupList = new Fl_Hold_Browser(5, 32, 630, 363);
+		m_dupWindow->end();
+		m_dupWindow->resizable(m_dupList);
+		m_dupWindow->callback(DuplicateListCallback, this);
+
+		Fl_Group::current(current);
+
+		m_dupStatus->labelsize(12);
+		m_dupStatus->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+
+		static const int columns[] = { 130, 90, 0 };
+		m_dupList->column_widths(columns);
+		m_dupList->column_char('\t');
+		m_dupList->textfont(FL_COURIER);
+		m_dupList->textsize(12);
+		m_dupList->when(FL_WHEN_CHANGED);
+		m_dupList->callback(DuplicateListCallback, this);
+		m_dupList->tooltip("Blocks which occur more than once, largest first, followed by the offsets of their copies. Select a copy to jump to it.");
+	}
+
+	m_duplicateFinder.start(m_file);
+	updateDuplicateList();
+	m_dupWindow->show();
+
+	// Duplicates are tinted while the list is open
+	updateMinimap();
+	RedrawCallback(&m_compare, this);
+}
+
+void PixelDbgWnd::updateDuplicateList()
+{
+	if(!m_dupWindow)
+	{
+		return;
+	}
+
+	// Browser lines of a run beyond this many copies are left out
+	const size_t kMaxListedCopies = 100;
+
+	int line = m_dupList->value();
+	u64 selected = line > 1 && line - 2 < (int)m_dupOffsets.size() ? m_dupOffsets[line - 2] : ~0ull;
+	int top = m_dupList->topline();
+
+	std::vector<DuplicateFinder::Run> runs;
+	m_duplicateFinder.getRuns(runs);
+
+	m_dupList->clear();
+	m_dupOffsets.clear();
+	m_dupList->add("@bSize\t@bCopies\t@bOffset");
+	for(size_t i=0; i<runs.size(); ++i)
+	{
+		const DuplicateFinder::Run& run = runs[i];
+		m_dupList->add(formatString("%llu\t%llu\t", (unsigned long long)run.size, (unsigned long long)run.numCopies));
+		m_dupOffsets.push_back(~0ull);
+
+		size_t numListed = std::min(run.offsets.size(), kMaxListedCopies);
+		for(size_t j=0; j<numListed; ++j)
+		{
+			m_dupList->add(formatString("\t\t%llu", (unsigned long long)run.offsets[j]));
+			m_dupOffsets.push_back(run.offsets[j]);
+
+			if(run.offsets[j] == selected)
+			{
+				m_dupList->value((int)m_dupOffsets.size() + 1);
+			}
+		}
+
+		if(run.numCopies > numListed)
+		{
+			m_dupList->add(formatString("\t\t%llu more", (unsigned long long)(run.numCopies - numListed)));
+			m_dupOffsets.push_back(~0ull);
+		}
+	}
+	m_dupList->topline(top);
+
+	DuplicateFinder::Stats stats = m_duplicateFinder.getStats();
+	double rate = stats.seconds > 0.0 ? stats.scanned / stats.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0;
+	if(stats.failed)
+	{
+		m_dupStatus->copy_label(formatString("Aborted, out of temporary space after %.1f MB of records were spilled", stats.spilled / (1024.0 * 1024.0)));
+	}
+	else if(stats.complete)
+	{
+		m_dupStatus->copy_label(formatString("%u runs%s, %.1f MB of %.1f MB repeated, %.2f s on %u threads (%.2f GB/s)", stats.numRuns,
+			stats.truncated ? " (list truncated)" : "", stats.duplicateBytes / (1024.0 * 1024.0), stats.fileSize / (1024.0 * 1024.0),
+			stats.seconds, stats.numThreads, rate));
+	}
+	else if(stats.phase == DuplicateFinder::DP_Chunking)
+	{
+		float progress = stats.fileSize > 0 ? float(stats.scanned) / float(stats.fileSize) * 100.0f : 0.0f;
+		m_dupStatus->copy_label(formatString("Chunking %.0f %%, %llu chunks (%.2f GB/s)", progress, (unsigned long long)stats.numChunks, rate));
+	}
+	else if(stats.phase == DuplicateFinder::DP_Grouping)
+	{
+		m_dupStatus->copy_label(formatString("Grouping %llu chunks", (unsigned long long)stats.numChunks));
+	}
+	else
+	{
+		m_dupStatus->copy_label(formatString("Merging %llu duplicate chunks", (unsigned long long)stats.duplicateChunks));
+	}
+}
+
+void PixelDbgWnd::adoptCarvedImage(const ImageCarver::Hit& hit)
+{
+	off_t offset = (off_t)hit.dataOffset;
+	if(offset >= (off_t)m_currentFileSize || !viewFile(offset))
+	{
+		return;
+	}
+
+	// Jump first, a run length encoded stream is indexed from the new offset
+	m_accumOffset = offset;
+	m_offset.value(offsetToString(offset));
+	m_viewX = 0;
+	m_viewY = 0;
+	m_rleIndex.detach();
+	m_compare.value(0);
+
+	// Compressed streams (PNG, JPEG) only get their size, the header is shown as it is
+	if(hit.flags & ImageCarver::HIT_Raw)
+	{
+		bool rle = (hit.flags & ImageCarver::HIT_RLE) != 0;
+		bool dxt = hit.DXTType != 0;
+		bool gray = (hit.flags & ImageCarver::HIT_Gray) != 0;
+		bool palette = !rle && (gray || (hit.flags & ImageCarver::HIT_Palette) != 0);
+
+		// Same order as in adoptCandidate, RLE mode is exclusive like DXT mode
+		if(isRLEMode() && !rle)
+		{
+			m_RLEMode.value(0);
+			RLECallback(&m_RLEMode, this);
+		}
+
+		if(isPaletteMode() && !palette)
+		{
+			m_paletteMode.value(0);
+			PaletteCallback(&m_paletteMode, this);
+		}
+
+		if(isDXTMode() != dxt)
+		{
+			m_DXTMode.value(dxt ? 1 : 0);
+			DXTCallback(&m_DXTMode, this);
+		}
+
+		if(rle && !isRLEMode())
+		{
+			m_RLEMode.value(1);
+			RLECallback(&m_RLEMode, this);
+		}
+
+		if(palette && !isPaletteMode())
+		{
+			m_paletteMode.value(1);
+			PaletteCallback(&m_paletteMode, this);
+		}
+
+		if(dxt)
+		{
+			m_DXTType.value(hit.DXTType == 1 ? 0 : (hit.DXTType == 3 ? 1 : 2));
+			DXTCallback(&m_DXTType, this);
+		}
+		else if(gray && palette)
+		{
+			for(int i=0; i<256; ++i)
+			{
+				m_palette[i*3+0] = m_palette[i*3+1] = m_palette[i*3+2] = (u8)i;
+				m_rawPalette[i*3+0] = m_rawPalette[i*3+1] = m_rawPalette[i*3+2] = (u8)i;
+				m_rawPalette[i*3+3] = 0;
+			}
+		}
+		else
+		{
+			// Indices of run length encoded palette images are shown as intensities
+			bool indices = rle && (hit.flags & (ImageCarver::HIT_Palette | ImageCarver::HIT_Gray)) != 0;
+			const int* bits = hit.rgbaBits;
+			const int* channels = hit.rgbaChannels;
+			m_rgbaBits.value(indices ? "8.0.0.0" : formatString("%d.%d.%d.%d", bits[0], bits[1], bits[2], bits[3]));
+			m_redChannel.value(intToString(indices ? 1 : channels[0] + 1));
+			m_greenChannel.value(intToString(indices ? 2 : channels[1] + 1));
+			m_blueChannel.value(intToString(indices ? 3 : channels[2] + 1));
+			m_alphaChannel.value(intToString(indices ? 4 : channels[3] + 1));
+			updatePixelFormat();
+
+			if(rle)
+			{
+				m_RLEType.value(2); // TGA
+				RLECallback(&m_RLEType, this);
+			}
+			else if(palette)
+			{
+				// Entries are converted with the format set above
+				m_paletteOffset.value(offsetToString((off_t)hit.paletteOffset));
+				PaletteCallback(&m_paletteOffset, this);
+			}
+		}
+
+		m_flipV.value((hit.flags & ImageCarver::HIT_FlipV) ? 1 : 0);
+		m_flipH.value((hit.flags & ImageCarver::HIT_FlipH) ? 1 : 0);
+	}
+
+	// Padded rows are part of the image, clamped to the maximum size
+	m_width.value(intToString((int)std::min(hit.rowWidth, kMaxDim)));
+	m_height.value(intToString((int)std::min(hit.height, kMaxDim)));
+	DimCallback(&m_width, this);
+}
+
+void PixelDbgWnd::findPattern(bool forward)
+{
+	if(!m_file.isOpen() || m_currentFileSize == 0)
+	{
+		return;
+	}
+
+	PatternSearch::Pattern pattern;
+	if(!PatternSearch::parsePattern(m_search.value(), pattern))
+	{
+		fl_message("Invalid pattern, expected hex bytes (42 4d ?? 00), \"ASCII\" or u\"UTF-16\" with at least one whole byte and at most %u bytes.",
+			PatternSearch::kMaxPatternSize);
+		return;
+	}
+
+	// A match at the offset is the one shown already
+	u64 from = (u64)m_accumOffset + (forward ? 1 : 0);
+	m_searching = m_patternSearch.start(m_file, pattern, from, forward);
+	updateSearchStatus();
+}
 
-					if(bwOps)
-					{
-						u8& rc = rgbOut[dest+0];
-						u8& gc = rgbOut[dest+1];
-						u8& bc = rgbOut[dest+2];
-
-						for(std::vector<BitwiseOp>::const_iterator iter = bwOps->begin(); iter != bwOps->end(); ++iter)
-						{
-							switch(iter->op)
-							{
-							case BitwiseOp::OP_AND:
-								rc &= iter->r;
-								gc &= iter->g;
-								bc &= iter->b;
-								break;
-							case BitwiseOp::OP_OR:
-								rc |= iter->r;
-								gc |= iter->g;
-								bc |= iter->b;
-								break;
-							case BitwiseOp::OP_XOR:
-								rc ^= iter->r;
-								gc ^= iter->g;
-								bc ^= iter->b;
-								break;
-							case BitwiseOp::OP_SHL:
-								rc <<= iter->r;
-								gc <<= iter->g;
-								bc <<= iter->b;
-								break;
-							case BitwiseOp::OP_SHR:
-								rc >>= iter->r;
-								gc >>= iter->g;
-								bc >>= iter->b;
-								break;
-							case BitwiseOp::OP_ROL:
-								rc = (rc << std::min<u8>(iter->r, 8)) | (rc >> (8 - std::min<u8>(iter->r, 8)));
-								gc = (gc << std::min<u8>(iter->g, 8)) | (gc >> (8 - std::min<u8>(iter->g, 8)));
-								bc = (bc << std::min<u8>(iter->b, 8)) | (bc >> (8 - std::min<u8>(iter->b, 8)));
-								break;
-							case BitwiseOp::OP_ROR:
-								rc = (rc >> std::min<u8>(iter->r, 8)) | (rc << (8 - std::min<u8>(iter->r, 8)));
-								gc = (gc >> std::min<u8>(iter->g, 8)) | (gc << (8 - std::min<u8>(iter->g, 8)));
-								bc = (bc >> std::min<u8>(iter->b, 8)) | (bc << (8 - std::min<u8>(iter->b, 8)));
-								break;
-							}
-						}
-					}
-				}
-			}
+void PixelDbgWnd::updateSearchStatus()
+{
+	PatternSearch::Stats stats = m_patternSearch.getStats();
+	double rate = stats.seconds > 0.0 ? stats.scanned / stats.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0;
+
+	if(stats.fileSize == 0)
+	{
+		m_searchStatus.copy_label("");
+	}
+	else if(!stats.complete)
+	{
+		m_searchStatus.copy_label(formatString("Searching, %.1f GB", stats.scanned / (1024.0 * 1024.0 * 1024.0)));
+	}
+	else
+	{
+		m_searchStatus.copy_label(formatString("%s (%.2f GB/s)", stats.found ? "Found" : "Not found", rate));
+
+		// Only once, the offset may have been changed since
+		if(m_searching && stats.found)
+		{
+			seekOffset((off_t)stats.offset, false);
 		}
+		m_searching = false;
 	}
 }
 
-void PixelDbgWnd::convertDXT(const u8* data, u32 size, u8* rgbOut, u32 flags, int DXTType, bool oneBitAlpha /* false */)
+void PixelDbgWnd::updateDiffIndex()
 {
-	int bitMask[4];
-	int rgbaChannels[4];
-	int rgbaBits[4];
-	int ps;
-	
-	if(!isDimValid() || !getPixelFormat(bitMask, rgbaChannels, rgbaBits, ps))
+	if(!isDiffMode())
 	{
+		m_diffIndex.detach();
+		updateDiffStatus();
 		return;
 	}
 
-	bool redMasked = (flags & CF_IgnoreRedChannel) != 0;
-	bool greenMasked = (flags & CF_IgnoreGreenChannel) != 0;
-	bool blueMasked = (flags & CF_IgnoreBlueChannel) != 0;
-	bool alphaOnly = redMasked && greenMasked && blueMasked;
-	
-	u32 width = static_cast<u32>(getImageWidth());
-	u32 height = static_cast<u32>(getImageHeight());
-	u32 stride = width * 3;
-	u32 xTiles = width / 4;
-	u32 yTiles = height / 4;
-	const u8* end = data + size;
-	u8 codes[16];
-	
-	for(u32 ty=0; ty<=yTiles; ++ty)
+	// Only the range both sources have is compared, from where the later one starts
+	i64 shift = getDiffShift();
+	const MappedFile& other = m_diffFile.isOpen() ? m_diffFile : m_file;
+	m_diffIndex.start(m_file, shift < 0 ? (u64)-shift : 0, other, shift > 0 ? (u64)shift : 0);
+	updateDiffStatus();
+}
+
+void PixelDbgWnd::findDifference(bool forward)
+{
+	if(!isDiffMode())
 	{
-		u32 by = ty * 4;
-		
-		for(u32 tx=0; tx<xTiles; ++tx)
-		{
-			// We iterate block by block, make sure we don't read more then is given
-			if(data + 8 > end)
-			{
-				return;
-			}
-			
-			u32 bx = tx * 4;
-			
-			// Skip alpha in DXT3/DXT5
-			if(DXTType > 1)
-			{
-				data += 8;
-			}
-			
-			u32 colors = *((u32*)data);
-			u32 clrlut = *((u32*)data + 1);
-			data += 8;
-			
-			// Extract two 16bit colors
-			u16 rgb0 = colors & 0x0000ffff;
-			u16 rgb1 = colors >> 16;
-			
-			// Decode colors to 8888 format
-			int lut[4 * 6];
-			lut[0]  = ((rgb0 >> 11) << 3);
-			lut[1]  = oneBitAlpha ? ((rgb0 >> 6) << 3) & 0xff : ((rgb0 >> 5) << 2) & 0xff;
-			lut[2]  = oneBitAlpha ? ((rgb0 >> 1) << 3) & 0xff : ((rgb0 << 3) & 0xff);
-			lut[3]  = oneBitAlpha ? rgb0 << 15 : 0;
-			lut[4]  = ((rgb1 >> 11) << 3);
-			lut[5]  = oneBitAlpha ? ((rgb1 >> 6) << 3) & 0xff : ((rgb1 >> 5) << 2) & 0xff;
-			lut[6]  = oneBitAlpha ? ((rgb1 >> 1) << 3) & 0xff : ((rgb1 << 3) & 0xff);
-			lut[7]  = oneBitAlpha ? rgb1 << 15 : 0;
-			lut[8]  = (lut[0] * 2 + lut[4]) / 3;
-			lut[9]  = (lut[1] * 2 + lut[5]) / 3;
-			lut[10] = (lut[2] * 2 + lut[6]) / 3;
-			lut[11] = (lut[3] * 2 + lut[7]) / 3;
-			lut[12] = (lut[0] + lut[4] * 2) / 3;
-			lut[13] = (lut[1] + lut[5] * 2) / 3;
-			lut[14] = (lut[2] + lut[6] * 2) / 3;
-			lut[15] = (lut[3] + lut[7] * 2) / 3;
-			lut[16] = (lut[0] + lut[4]) / 2;
-			lut[17] = (lut[1] + lut[5]) / 2;
-			lut[18] = (lut[2] + lut[6]) / 2;
-			lut[19] = (lut[3] + lut[7]) / 2;
-			lut[20] = 0;
-			lut[21] = 0;
-			lut[22] = 0;
-			lut[23] = 0;
-			
-			// Read color codes
-			for(u32 c=0; c<16; ++c)
-			{
-				codes[c] = (clrlut >> c * 2) & 3;
-			}
-			
-			// Decode 16 pixels
-			for(u32 y=0; y<4; ++y)
-			{
-				for(u32 x=0; x<4; ++x)
-				{
-					u32 code = codes[y * 4 + x];
-					u32 i = (by + y) * stride + (bx + x) * 3;
-					
-					switch(code)
-					{
-					case 0:
-					case 1:
-						code *= 4;
-						break;
-					case 2:
-						code = (DXTType == 1 && rgb0 < rgb1) ? 16 : 8;
-						break;
-					case 3:
-						code = (DXTType == 1 && rgb0 < rgb1) ? 20 : 12;
-						break;
-					};
-					
-					if(alphaOnly && oneBitAlpha)
-					{
-						rgbOut[i+0] = lut[code + rgbaChannels[3]];
-						rgbOut[i+1] = lut[code + rgbaChannels[3]];
-						rgbOut[i+2] = lut[code + rgbaChannels[3]];
-					}
-					else
-					{
-						rgbOut[i+0] = lut[code + rgbaChannels[2]];
-						rgbOut[i+1] = lut[code + rgbaChannels[1]];
-						rgbOut[i+2] = lut[code + rgbaChannels[0]];
-					}
-				}
-			}
-		}
+		return;
+	}
+
+	// Positions are counted from the start of the compared range
+	i64 shift = getDiffShift();
+	u64 start = shift < 0 ? (u64)-shift : 0;
+	u64 offset = (u64)m_accumOffset;
+	u64 from = offset > start ? offset - start : 0;
+	if(forward)
+	{
+		from = offset >= start ? from + std::max(getNumVisibleBytes(), (u64)1) : 0;
+	}
+
+	u64 position;
+	if(m_diffIndex.findChange(from, forward, position))
+	{
+		seekOffset((off_t)(start + position));
+	}
+	else
+	{
+		DiffIndex::Stats stats = m_diffIndex.getStats();
+		m_diffStatus.copy_label(stats.complete ? "No difference" : "Not hashed yet");
 	}
 }
 
-void PixelDbgWnd::convertRLE(const u8* data, u32 size, u8* rgbOut, u32 flags, u32 RLmask, bool RLmsb, const std::vector<BitwiseOp>* bwOps /* NULL */)
+void PixelDbgWnd::updateDiffStatus()
 {
-	int bitMask[4];
-	int rgbaChannels[4];
-	int rgbaBits[4];
-	int ps;
-	
-	if(!isDimValid() || !getPixelFormat(bitMask, rgbaChannels, rgbaBits, ps))
+	DiffIndex::Stats stats = m_diffIndex.getStats();
+
+	if(stats.length == 0)
 	{
-		return;
+		m_diffStatus.copy_label("");
+	}
+	else if(!stats.complete)
+	{
+		m_diffStatus.copy_label(formatString("Hashing, %.1f GB", stats.scanned / (1024.0 * 1024.0 * 1024.0)));
+	}
+	else if(stats.numChanged == 0)
+	{
+		m_diffStatus.copy_label("Identical");
+	}
+	else
+	{
+		m_diffStatus.copy_label(formatString("%llu MB differ", (unsigned long long)stats.numChanged * DiffIndex::kChunkSize / (1024 * 1024)));
 	}
+}
 
-	u32 width = (u32)getImageWidth();
-	u32 height = (u32)getImageHeight();
-	u32 totalPixels = width * height;
-	u32 stride = width * ps;
-	u32 numBytes = stride * height;
-	u32 numPixels = 0;
-	u32 RLbyte = RLmsb ? ps : 0;
-	u32 RLpixel = RLmsb ? 0 : 1;
+u32 PixelDbgWnd::parseCandidates(const char* list, std::vector<FormatCandidate>& candidates)
+{
+	candidates.clear();
 
-	for(u32 i=0; i<size; i+=ps+1)
+	std::string text(list);
+	size_t start = 0;
+	while(start <= text.size())
 	{
-		u32 len = (data[i + RLbyte] & RLmask) + 1;
-		if(numPixels + len > totalPixels)
+		size_t end = text.find(',', start);
+		if(end == std::string::npos)
 		{
-			len = totalPixels - numPixels;
+			end = text.size();
 		}
 
-		convertRaw(data + i + RLpixel, ps, rgbOut, flags, bwOps);
-		u8* pixel = rgbOut + 3;
-		
-		for(u32 j=0; j<len; ++j, rgbOut+=3, pixel+=3, ++numPixels)
+		FormatCandidate candidate;
+		std::string entry = text.substr(start, end - start);
+		if(!entry.empty() && parseCandidate(entry.c_str(), candidate))
 		{
-			pixel[0] = rgbOut[0];
-			pixel[1] = rgbOut[1];
-			pixel[2] = rgbOut[2];
+			candidates.push_back(candidate);
 		}
-
-		if(numPixels >= totalPixels)
+		else if(!entry.empty())
 		{
-			break;
+			fprintf(stderr, "Ignoring invalid comparison format \"%s\"\n", entry.c_str());
 		}
+
+		start = end + 1;
 	}
+
+	return (u32)candidates.size();
 }
 
-void PixelDbgWnd::convertPalette(const u8* data, u32 size, u8* rgbOut)
+std::string PixelDbgWnd::getStatistics() const
 {
-	int bitMask[4];
-	int rgbaChannels[4];
-	int rgbaBits[4];
-	int pixelSize;
+	std::string text;
 
-	if(getPixelFormat(bitMask, rgbaChannels, rgbaBits, pixelSize))
+	Prefetcher::Stats pf = m_prefetcher.getStats();
+	float hitRate = pf.requests > 0 ? float(pf.hits) / float(pf.requests) * 100.0f : 0.0f;
+	const char* dir = pf.direction > 0 ? "forward" : (pf.direction < 0 ? "backward" : "none");
+	text += formatString("Read-ahead: %u requests, %u hits, %u misses (%.1f %% hit rate)\n", pf.requests, pf.hits, pf.misses, hitRate);
+	text += formatString("Read-ahead: %u chunks loaded, %u evicted, %u/%u cached, direction %s\n",
+		pf.chunksLoaded, pf.chunksEvicted, pf.cachedChunks, Prefetcher::kDefaultMaxChunks, dir);
+
+	Renderer::Stats rs = m_renderer.getStats();
+	text += formatString("Renderer: %u submitted, %u rendered, %u dropped, %u cancelled, last frame %.2f ms\n",
+		rs.submitted, rs.rendered, rs.dropped, rs.cancelled, rs.lastRenderTime);
+	text += formatString("Renderer: %u zoom levels rendered ahead, last frame at 1:%u%s\n",
+		rs.prerendered, getZoom(), m_frame.cached ? " (cached)" : "");
+	text += formatString("Renderer: %llu rows decoded, %llu reused while scrolling\n", (unsigned long long)rs.decodedRows, (unsigned long long)rs.reusedRows);
+
+	text += formatString("Redraws: %u requested, %u merged, %u deferred to the frame rate, %u submitted\n",
+		m_redrawStats.requested, m_redrawStats.merged, m_redrawStats.deferred, m_redrawStats.submitted);
+
+	// Stages which didn't run for the last frame took their output from the cache
+	static const char* const stageNames[RS_NumStages] = { "fetch", "decode", "bitwise", "orientation", "entropy", "highlight", "diff", "statistics", "present" };
+	std::string stages;
+	std::string runs;
+	for(u32 i=0; i<RS_NumStages; ++i)
 	{
-		memset(m_palette, 0, sizeof(m_palette));
-		convertRaw(data, (u32)(256 * pixelSize), rgbOut, CF_IgnoreChannelOrder | CF_IgnoreTiles);
+		bool ran = i == RS_Present || ((m_frame.stagesRun >> i) & 1) != 0;
+		stages += ran ? formatString("%s %s %.2f", i > 0 ? "," : "", stageNames[i], m_frame.stageTime[i]) : formatString("%s %s -", i > 0 ? "," : "", stageNames[i]);
+		runs += formatString("%s %s %u", i > 0 ? "," : "", stageNames[i], i == RS_Present ? m_redrawStats.presented : rs.stageRuns[i]);
 	}
-}
+	text += formatString("Last frame: %.2f ms on %u threads, stages (ms):%s\n", m_frame.renderTime, m_frame.numThreads, stages.c_str());
+	text += formatString("Stage runs:%s\n", runs.c_str());
 
-void PixelDbgWnd::flipVertically(int w, int h, void* data)
-{
-	if(w > 0 && h > 0 && data)
+	if(m_frame.colorsCounted && !m_frame.topColors.empty())
 	{
-		int stride = w * 3; // Always 24bpp
-
-		for(int y=0; y<h/2; ++y)
+		u32 numPixels = std::max(m_frame.width * m_frame.height, 1u);
+		text += formatString("Top colors of %u:", m_frame.numColors);
+		for(size_t i=0; i<m_frame.topColors.size(); ++i)
 		{
-			u8* src = ((u8*)data) + y * stride;
-			u8* dest = ((u8*)data) + (h - y - 1) * stride;
-			
-			for(int x=0; x<w; ++x, src+=3, dest+=3)
-			{
-				std::swap(src[0], dest[0]);
-				std::swap(src[1], dest[1]);
-				std::swap(src[2], dest[2]);
-			}
+			const ColorCounter::Color& color = m_frame.topColors[i];
+			text += formatString("%s #%06X (%.1f %%)", i % 4 == 0 ? "\n" : ",", color.rgb, float(color.count) / float(numPixels) * 100.0f);
 		}
+		text += "\n";
 	}
-}
 
-size_t PixelDbgWnd::readFile(const char* name, void* out, size_t size, off_t offset /* 0 */)
-{
-	#if IS64BIT
-	FILE* f = fopen64(name, "rb");
-	#else
-	FILE* f = fopen(name, "rb");
-	#endif
-	if(f)
+	FrameCache::Stats fc = m_renderer.getCacheStats();
+	float cacheHitRate = fc.lookups > 0 ? float(fc.hits) / float(fc.lookups) * 100.0f : 0.0f;
+	text += formatString("Frame cache: %u hits, %u misses (%.1f %% hit rate), %u evictions\n", fc.hits, fc.misses, cacheHitRate, fc.evictions);
+	text += formatString("Frame cache: %u frames, %.1f of %.1f MB\n", fc.entries, fc.bytes / (1024.0 * 1024.0), fc.budget / (1024.0 * 1024.0));
+
+	if(m_strideTime > 0.0)
 	{
-		fseeko(f, 0, SEEK_END);
-		size_t filesize = (size_t)ftello(f);
-		fseeko(f, offset, SEEK_SET);
+		text += formatString("Stride detection: %.2f ms on %u threads\n", m_strideTime, m_renderer.getNumThreads());
+	}
 
-		size = std::min(size + offset, filesize) - offset;
-		fread(out, size, 1, f);
-		fclose(f);
+	if(m_suggestTime > 0.0)
+	{
+		text += formatString("Format suggestion: %.2f ms on %u threads\n", m_suggestTime, m_renderer.getNumThreads());
+	}
 
-		return size;
+	Minimap::Stats ms = m_minimap.getStats();
+	text += formatString("Minimap: %u of %u cells (%u from the cache file), %.1f KB per cell%s\n", ms.scanned, ms.numCells, ms.loaded,
+		ms.cellSize / 1024.0, ms.complete ? "" : ", scanning");
+
+	if(isRLEMode())
+	{
+		text += formatString("RLE index: %llu pixels in %.1f MB, %u checkpoints (%s)\n", (unsigned long long)m_rleIndex.getIndexedPixels(),
+			m_rleIndex.getIndexedBytes() / (1024.0 * 1024.0), m_rleIndex.getNumCheckpoints(), m_rleIndex.isComplete() ? "complete" : "in progress");
 	}
 
-	return 0;
+	PatternSearch::Stats ps = m_patternSearch.getStats();
+	if(ps.fileSize > 0)
+	{
+		text += formatString("Pattern search: %.1f MB %s, %.1f ms on %u threads (%.2f GB/s)\n", ps.scanned / (1024.0 * 1024.0),
+			ps.forward ? "forward" : "backward", ps.seconds * 1000.0, ps.numThreads, ps.seconds > 0.0 ? ps.scanned / ps.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+	}
+
+	DiffIndex::Stats ds = m_diffIndex.getStats();
+	if(ds.length > 0)
+	{
+		text += formatString("Diff index: %.1f of %.1f MB compared, %llu changed chunks, %.1f MB hashed in %.1f ms on %u threads (%.2f GB/s)\n",
+			ds.scanned / (1024.0 * 1024.0), ds.length / (1024.0 * 1024.0), (unsigned long long)ds.numChanged, ds.hashed / (1024.0 * 1024.0),
+			ds.seconds * 1000.0, ds.numThreads, ds.seconds > 0.0 ? ds.hashed / ds.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+	}
+
+	ImageCarver::Stats cs = m_carver.getStats();
+	if(cs.fileSize > 0)
+	{
+		text += formatString("Embedded images: %u in %.1f of %.1f MB, %.1f ms on %u threads (%.2f GB/s)\n", cs.numHits, cs.scanned / (1024.0 * 1024.0),
+			cs.fileSize / (1024.0 * 1024.0), cs.seconds * 1000.0, cs.numThreads, cs.seconds > 0.0 ? cs.scanned / cs.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+	}
+
+	DuplicateFinder::Stats us = m_duplicateFinder.getStats();
+	if(us.fileSize > 0)
+	{
+		text += formatString("Duplicate blocks: %llu of %llu chunks repeated in %u regions, %.1f of %.1f MB chunked, %.1f MB spilled%s, %.1f ms on %u threads (%.2f GB/s)\n",
+			(unsigned long long)us.duplicateChunks, (unsigned long long)us.numChunks, us.numRegions, us.scanned / (1024.0 * 1024.0), us.fileSize / (1024.0 * 1024.0),
+			us.spilled / (1024.0 * 1024.0), us.failed ? " (aborted, out of temporary space)" : "", us.seconds * 1000.0, us.numThreads, us.seconds > 0.0 ? us.scanned / us.seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+	}
+
+	return text;
 }
 
-bool PixelDbgWnd::writeBitmap(const char* filename, int width, int height, void* data)
+bool PixelDbgWnd::writeBitmap(const char* filename, int width, int height, const void* data)
 {
 	if(!data || width <= 0 || height <= 0 || !isValid())
 	{
 		return false;
 	}
-	
-	FILE* f = fopen(filename, "wb");
-	if(f)
-	{
-		u32 w = (u32)width;
-		u32 h = (u32)height;
-		u32 size = w * h * 3;
-		u8* pixels = (u8*)data;
 
-		flipVertically(width, height, pixels);
+	// Copy into file layout (bottom-up BGR rows), the source stays untouched
+	u32 w = (u32)width;
+	u32 h = (u32)height;
+	std::vector<u8> pixels(OutputLayout::getPitch(w, 4) * h, 0);
+	OutputLayout out(&pixels[0], w, h, true, false, true, 4);
+	const u8* src = static_cast<const u8*>(data);
 
-		// Swap before saving (we have Fl_RGB_Image but need BGR order)
-		for(u32 i=0; i<size; i+=3)
+	for(u32 y=0; y<h; ++y)
+	{
+		for(u32 x=0; x<w; ++x, src+=3)
 		{
-			std::swap(pixels[i+0], pixels[i+2]);
+			u8* dest = out.pixel(x, y);
+			dest[0] = src[2];
+			dest[1] = src[1];
+			dest[2] = src[0];
 		}
-		
-		unsigned char header[54];
-		memset(header, 0, sizeof(header));
+	}
 
-		*reinterpret_cast<u16*>(&header[0]) = 0x4D42;
-		*reinterpret_cast<u32*>(&header[2]) = size + 54;
-		*reinterpret_cast<u32*>(&header[10]) = 54;
-		*reinterpret_cast<u32*>(&header[14]) = 40;
-		*reinterpret_cast<u32*>(&header[18]) = w;
-		*reinterpret_cast<u32*>(&header[22]) = h;
-		*reinterpret_cast<u16*>(&header[26]) = 1;
-		*reinterpret_cast<u16*>(&header[28]) = 24;
-		*reinterpret_cast<u32*>(&header[34]) = size;
-		
-		fwrite(header, sizeof(header), 1, f);
-		fwrite(pixels, size, 1, f);
-		fclose(f);
+	return writeBitmapFile(filename, w, h, pixels);
+}
 
-		// Swap back
-		for(u32 i=0; i<size; i+=3)
-		{
-			std::swap(pixels[i+0], pixels[i+2]);
-		}
+bool PixelDbgWnd::writeBitmap(const char* filename)
+{
+	if(!m_file.isOpen() || m_data.size() == 0 || !isValid())
+	{
+		return false;
+	}
 
-		flipVertically(width, height, data);
-		
-		return true;
+	ViewState state;
+	getViewState(state, true);
+
+	// Sizes in the header are 32 bit
+	u64 bytes = (u64)OutputLayout::getPitch(state.width, 4) * state.height;
+	if(state.width == 0 || state.height == 0 || bytes > 0x7fffffff)
+	{
+		return false;
 	}
-	
-	return false;
+
+	// Decode straight into file layout, rows are stored bottom-up so the vertical flip is inverted
+	std::vector<u8> pixels((size_t)bytes, 0);
+	OutputLayout out(&pixels[0], state.width, state.height, !state.flipV, state.flipH, true, 4);
+
+	return Renderer::exportView(state, out) && writeBitmapFile(filename, state.width, state.height, pixels);
 }
 
 bool PixelDbgWnd::writeTga(const char* filename)
 {
-	if(m_data.size() <= 0 || !isValid())
+	if(!m_file.isOpen() || m_data.size() == 0 || !isValid())
+	{
+		return false;
+	}
+
+	ViewState state;
+	getViewState(state, true);
+
+	// Size in the header is 16 bit
+	if(state.width == 0 || state.height == 0 || state.width > 0xffff || state.height > 0xffff)
+	{
+		return false;
+	}
+
+	// Decode straight into file layout (top-down BGR rows)
+	std::vector<u8> pixels((size_t)state.width * state.height * 3, 0);
+	OutputLayout out(&pixels[0], state.width, state.height, state.flipV, state.flipH, true);
+	if(!Renderer::exportView(state, out))
 	{
 		return false;
 	}
@@ -1164,28 +2321,15 @@ bool PixelDbgWnd::writeTga(const char* filename)
 	FILE* f = fopen(filename, "wb");
 	if(f)
 	{
-		u16 w = static_cast<u16>(getImageWidth());
-		u16 h = static_cast<u16>(getImageHeight());
+		u16 w = static_cast<u16>(state.width);
+		u16 h = static_cast<u16>(state.height);
 		u8 bd = 24;
 		TgaHeader header = { 0, 0, 2, 0, 0, 0, 0, 0, w, h, bd, 32 };
-		
-		// Swap before saving (we have Fl_RGB_Image but need BGR order)
-		u32 size = w * h * 3;
-		for(u32 i=0; i<size; i+=3)
-		{
-			std::swap(m_pixels[i+0], m_pixels[i+2]);
-		}
 
 		fwrite(&header, sizeof(header), 1, f);
-		fwrite(m_pixels, size, 1, f);
+		fwrite(&pixels[0], pixels.size(), 1, f);
 		fclose(f);
 		
-		// Swap back
-		for(u32 i=0; i<size; i+=3)
-		{
-			std::swap(m_pixels[i+0], m_pixels[i+2]);
-		}
-		
 		return true;
 	}
 	
@@ -1215,7 +2359,7 @@ void PixelDbgWnd::ButtonCallback(Fl_Widget* widget, void* param)
 		const char* filename = formatString("%s_%dx%d_%d.bmp", name ? name : "", w, h, o);
 		#endif
 		
-		if(!p->writeBitmap(filename, w, h, p->m_pixels))
+		if(!p->writeBitmap(filename))
 		{
 			fl_message("Saving failed. Either format is invalid or no data exists."); 
 		}
@@ -1251,86 +2395,108 @@ void PixelDbgWnd::ButtonCallback(Fl_Widget* widget, void* param)
 		
 		if(filename && filename[0] != 0)
 		{
-			#if IS64BIT
-			FILE* f = fopen64(filename, "rb");
-			#else
-			FILE* f = fopen(filename, "rb");
-			#endif
-			if(f)
-			{
-			    fseeko(f, 0, SEEK_END);
-			    p->m_currentFileSize = (size_t)ftello(f);
-			    
-			    if(offset >= p->m_currentFileSize)
-			    {
-					// If auto-reload is on do nothing when pointing out of bounds
-					if(p->m_autoReload.value() != 0)
-					{
-						fclose(f);
-						return;
-					}
-					
-					#if IS64BIT
-					fl_message("Offset %lld larger then file size (%lld Bytes). Reading from offset 0 instead.", offset, p->m_currentFileSize);
-					#else
-					fl_message("Offset %d larger then file size (%d Bytes). Reading from offset 0 instead.", offset, p->m_currentFileSize);
-					#endif
-					offset = 0;
-					p->m_accumOffset = 0;
-			    }
-			    
-			    // Reset accumulated offset if we opened a different file or changed it manually
-			    if(strcmp(filename, p->m_currentFile) != 0)
-			    {
-			        p->m_accumOffset = 0;
-			    }
-			    else
-			    {
-			        if(p->m_offsetChanged)
-			        {
-			            p->m_accumOffset = 0;
-			            p->m_offsetChanged = false;
-			        }
-			    }
-			    
-			    size_t size = std::min(p->m_currentFileSize - offset, (size_t)kMaxImageSize);
-			    p->m_accumOffset = offset;
-			    
-			    memset(p->m_text, 0, kMaxBufferSize);
-			    fseeko(f, offset, SEEK_SET);
-			    fread(p->m_text, size, 1, f);
-			    fclose(f);
-			    
-			    // Store current file for the accumulated offset
-			    if(strcmp(filename, p->m_currentFile) != 0)
-			    {
-			        memset(p->m_currentFile, 0, sizeof(p->m_currentFile));
-			        snprintf(p->m_currentFile, sizeof(p->m_currentFile)-1, "%s", filename);
-			    }
-			    
-			    // Set data and update image view
-			    p->m_data.static_value(reinterpret_cast<char*>(p->m_text), size);
-			    RedrawCallback(&p->m_data, param);
-			    
-			    // Move data cursor to data start
-			    p->m_data.position(0, 0);
-				
-				// Assign new accumulation offset
-				p->m_offset.value(offsetToString(p->m_accumOffset));
+			// Keep the file mapped for the whole session, only remap if another file is opened
+			bool sameFile = p->m_file.isOpen() && strcmp(filename, p->m_currentFile) == 0;
+			p->m_prefetcher.detach();
+			p->m_rleIndex.detach(); // Rebuilt from the new offset
+			p->m_minimap.detach(); // Progress is kept in the cache file, reattached on redraw
+			p->m_carver.detach(); // Rescanned below while the list is open
+			p->m_duplicateFinder.detach(); // Same
+			p->m_patternSearch.detach();
+			p->m_searching = false;
+			p->m_searchStatus.copy_label("");
+			p->m_diffIndex.detach(); // Restarted below
+			p->m_renderer.cancel();
+
+			// Auto-reload watches files other processes rewrite, a mapping would fault once they truncate it
+			p->m_file.setMapped(p->m_autoReload.value() == 0);
+			bool opened = sameFile ? p->m_file.refresh() : p->m_file.open(filename);
+			if(!opened)
+			{
+				p->m_view.unmap();
+				p->m_data.static_value("", 0);
+				p->m_currentFileSize = 0;
+				memset(p->m_currentFile, 0, sizeof(p->m_currentFile));
+				p->m_imageScroll->deactivate();
+				fl_message("Unable to open file %s", filename);
+				return;
+			}
 
-				// Update scroll bar on valid file
-				p->m_imageScroll->activate();
-				p->updateScrollbar(p->m_accumOffset, true);
+			p->m_currentFileSize = (size_t)p->m_file.size();
+			p->m_prefetcher.attach(p->m_file);
+			p->updateDiffIndex();
+			
+			if(offset >= p->m_currentFileSize)
+			{
+				// If auto-reload is on do nothing when pointing out of bounds
+				if(p->m_autoReload.value() != 0)
+				{
+					return;
+				}
 				
-				// Adjust window title
 				#if IS64BIT
-				const char* title = formatString("PixelDbg %u.%u  -  %s (%llu Bytes)", 
-					PixelDbgWnd::kVersionMajor, PixelDbgWnd::kVersionMinor, p->getCurrentFileName(), p->m_currentFileSize);
+				fl_message("Offset %lld larger then file size (%lld Bytes). Reading from offset 0 instead.", offset, p->m_currentFileSize);
 				#else
-				const char* title = formatString("PixelDbg %u.%u  -  %s (%u Bytes)", 
-					PixelDbgWnd::kVersionMajor, PixelDbgWnd::kVersionMinor, p->getCurrentFileName(), p->m_currentFileSize);
+				fl_message("Offset %d larger then file size (%d Bytes). Reading from offset 0 instead.", offset, p->m_currentFileSize);
 				#endif
-				p->copy_label(title);
+				offset = 0;
+				p->m_accumOffset = 0;
+			}
+			
+			// Reset accumulated offset if we opened a different file or changed it manually
+			if(!sameFile)
+			{
+				p->m_accumOffset = 0;
+			}
+			else
+			{
+				if(p->m_offsetChanged)
+				{
+					p->m_accumOffset = 0;
+					p->m_offsetChanged = false;
+				}
+			}
+			
+			p->m_accumOffset = offset;
+			
+			// Store current file for the accumulated offset
+			if(!sameFile)
+			{
+				memset(p->m_currentFile, 0, sizeof(p->m_currentFile));
+				snprintf(p->m_currentFile, sizeof(p->m_currentFile)-1, "%s", filename);
+			}
+			
+			// Set data and update image view
+			p->viewFile(offset);
+			RedrawCallback(&p->m_data, param);
+			
+			// Assign new accumulation offset
+			p->m_offset.value(offsetToString(p->m_accumOffset));
+
+			// Update scroll bar on valid file
+			p->m_imageScroll->activate();
+			p->updateScrollbar(p->m_accumOffset, true);
+			
+			// Adjust window title
+			#if IS64BIT
+			const char* title = formatString("PixelDbg %u.%u  -  %s (%llu Bytes)", 
+				PixelDbgWnd::kVersionMajor, PixelDbgWnd::kVersionMinor, p->getCurrentFileName(), p->m_currentFileSize);
+			#else
+			const char* title = formatString("PixelDbg %u.%u  -  %s (%u Bytes)", 
+				PixelDbgWnd::kVersionMajor, PixelDbgWnd::kVersionMinor, p->getCurrentFileName(), p->m_currentFileSize);
+			#endif
+			p->copy_label(title);
+
+			if(p->m_carveWindow && p->m_carveWindow->shown())
+			{
+				p->m_carver.start(p->m_file);
+				p->updateCarveList();
+			}
+
+			if(p->m_dupWindow && p->m_dupWindow->shown())
+			{
+				p->m_duplicateFinder.start(p->m_file);
+				p->updateDuplicateList();
 			}
 		}
 	}
@@ -1353,6 +2519,63 @@ void PixelDbgWnd::ButtonCallback(Fl_Widget* widget, void* param)
 
 		fl_message(about);
 	}
+	else if(widget == &p->m_statsButton)
+	{
+		fl_message("%s", p->getStatistics().c_str());
+	}
+	else if(widget == &p->m_carveButton)
+	{
+		p->showCarveList();
+	}
+	else if(widget == &p->m_dupButton)
+	{
+		p->showDuplicateList();
+	}
+	else if(widget == &p->m_suggestButton)
+	{
+		p->suggestFormats();
+	}
+	else if(widget == &p->m_search || widget == &p->m_findNextButton)
+	{
+		p->findPattern(true);
+	}
+	else if(widget == &p->m_findPrevButton)
+	{
+		p->findPattern(false);
+	}
+	else if(widget == &p->m_diffFileButton)
+	{
+		Fl_Native_File_Chooser browser;
+		browser.title("Compare with file");
+		browser.type(Fl_Native_File_Chooser::BROWSE_FILE);
+		browser.filter("Any file\t*.*\n");
+
+		// Cancelling keeps comparing with the current file
+		if(browser.show() != 0)
+		{
+			return;
+		}
+
+		// Frames and hashing may read the old file until they are done
+		p->m_diffIndex.detach();
+		p->m_renderer.cancel();
+		if(!p->m_diffFile.open(browser.filename()))
+		{
+			p->m_diffFile.close();
+			fl_message("Unable to open file %s", browser.filename());
+		}
+
+		p->updateDiffIndex();
+		RedrawCallback(widget, param);
+	}
+	else if(widget == &p->m_diffNextButton)
+	{
+		p->findDifference(true);
+	}
+	else if(widget == &p->m_diffPrevButton)
+	{
+		p->findDifference(false);
+	}
 }
 
 void PixelDbgWnd::OffsetCallback(Fl_Widget* widget, void* param)
@@ -1370,6 +2593,9 @@ void PixelDbgWnd::OffsetCallback(Fl_Widget* widget, void* param)
 		if(p->m_autoReload.value() != 0)
 		{
 			p->m_openButton.deactivate();
+
+			// Reload right away so the file is copied from now on instead of mapped
+			ButtonCallback(&p->m_openButton, p);
 		}
 		else
 		{
@@ -1461,7 +2687,27 @@ void PixelDbgWnd::DimCallback(Fl_Widget* widget, void* param)
 	
 	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
 
-	if(widget == &p->m_backwardButton || widget == &p->m_forwardButton)
+	if((widget == &p->m_backwardButton || widget == &p->m_forwardButton) && p->isRLEMode())
+	{
+		// Step by one pixel through the indexed stream
+		u64 pixel = p->m_rlePixel;
+		if(widget == &p->m_backwardButton && pixel > 0)
+		{
+			--pixel;
+		}
+		else if(widget == &p->m_forwardButton)
+		{
+			++pixel;
+		}
+
+		if(pixel != p->m_rlePixel && p->viewPixel(pixel))
+		{
+			p->updateScrollbar(p->m_accumOffset, false);
+
+			RedrawCallback(widget, param);
+		}
+	}
+	else if(widget == &p->m_backwardButton || widget == &p->m_forwardButton)
 	{
 		off_t offset = p->m_accumOffset;
 
@@ -1478,14 +2724,10 @@ void PixelDbgWnd::DimCallback(Fl_Widget* widget, void* param)
 		{
 			p->m_imageScroll->Fl_Valuator::value((double)offset);
 
-			memset(p->m_pixels, 0, kMaxImageSize);
-
- 			if(size_t size = p->readFile(p->m_currentFile, p->m_text, kMaxBufferSize, offset))
+ 			if(p->viewFile(offset))
 			{
 				p->m_accumOffset = offset;
 				p->m_offset.value(offsetToString(offset));
-				p->m_data.static_value(reinterpret_cast<char*>(p->m_text), size);
-				p->m_data.position(0, 0);
 
 				ScrollbarCallback(p->m_imageScroll, p);	
 
@@ -1495,13 +2737,13 @@ void PixelDbgWnd::DimCallback(Fl_Widget* widget, void* param)
 	}
 	else if(widget == &p->m_width || widget == &p->m_height)
 	{
+		// Images larger than the window are scrolled
 		int w = p->getImageWidth();
 		if(w != -1)
 		{
-			int maxw = p->w() - p->getImageBox().x() - p->m_imageScroll->w() - 6;
-			if(w < 1 || w > maxw)
+			if(w < 1 || w > (int)kMaxDim)
 			{
-				w = clampValue(w, 1, maxw);
+				w = clampValue(w, 1, (int)kMaxDim);
 				p->m_width.value(intToString(w));
 			}
 		}
@@ -1509,10 +2751,9 @@ void PixelDbgWnd::DimCallback(Fl_Widget* widget, void* param)
 		int h = p->getImageHeight();
 		if(h != -1)
 		{
-			int maxh = p->h() - p->getImageBox().y();
-			if(h < 1 || h > maxh)
+			if(h < 1 || h > (int)kMaxDim)
 			{
-				h = clampValue(h, 1, maxh);
+				h = clampValue(h, 1, (int)kMaxDim);
 				p->m_height.value(intToString(h));
 			}
 		}
@@ -1522,6 +2763,8 @@ void PixelDbgWnd::DimCallback(Fl_Widget* widget, void* param)
 			p->m_dimGroup.color(FL_DARK1);
 			p->redraw();
 
+			p->updateScrollbar(p->m_accumOffset, true);
+
 			if(p->updatePixelFormat())
 			{
 				RedrawCallback(widget, param);
@@ -1768,9 +3011,10 @@ void PixelDbgWnd::PaletteCallback(Fl_Widget* widget, void* param)
 
 		// Read palette from given offset and convert to specified format
 		memset(p->m_rawPalette, 0, sizeof(p->m_rawPalette));
-		if(p->readFile(filename, p->m_rawPalette, sizeof(p->m_rawPalette), offset) != 0)
+		size_t read = (filename == p->m_currentFile) ? p->m_file.read(p->m_rawPalette, sizeof(p->m_rawPalette), offset) :
+		                                               p->readFile(filename, p->m_rawPalette, sizeof(p->m_rawPalette), offset);
+		if(read != 0)
 		{
-			
 			p->convertPalette(p->m_rawPalette, sizeof(p->m_rawPalette), p->m_palette);
 
 			RedrawCallback(widget, param);
@@ -1916,6 +3160,9 @@ void PixelDbgWnd::RLECallback(Fl_Widget* widget, void* param)
 
 			p->m_DXTMode.activate();
 			p->m_RLEType.deactivate();
+			p->m_zoom.activate();
+			p->m_zoomAverage.activate();
+			p->m_rleIndex.detach();
 		}
 		else
 		{
@@ -1929,6 +3176,8 @@ void PixelDbgWnd::RLECallback(Fl_Widget* widget, void* param)
 			p->m_savePalette.deactivate();
 			p->m_DXTMode.deactivate();
 			p->m_RLEType.activate();
+			p->m_zoom.deactivate();
+			p->m_zoomAverage.deactivate();
 		}
 		
 		p->updateScrollbar(p->m_imageScroll->Fl_Valuator::value(), true);
@@ -1963,6 +3212,63 @@ void PixelDbgWnd::OpsCallback(Fl_Widget* widget, void* param)
 			RedrawCallback(widget, param);
 		}
 	}
+	else if(widget == &p->m_zoom)
+	{
+		// Choice already moved to the new level, go back to the old one to keep the centre
+		u32 zoom = p->getZoom();
+		p->m_zoom.value(p->m_displayedZoom);
+		p->setZoom(zoom);
+	}
+	else if(widget == &p->m_zoomAverage)
+	{
+		RedrawCallback(widget, param);
+	}
+	else if(widget == &p->m_entropy)
+	{
+		if(p->m_entropy.value() != 0)
+		{
+			p->m_entropyBlock.activate();
+		}
+		else
+		{
+			p->m_entropyBlock.deactivate();
+		}
+
+		// Minimap switches between mean colors and entropy
+		p->updateMinimap();
+		RedrawCallback(widget, param);
+	}
+	else if(widget == &p->m_entropyBlock)
+	{
+		RedrawCallback(widget, param);
+	}
+	else if(widget == &p->m_compare)
+	{
+		// Suggestions last until the grid is toggled, then the configured formats return
+		if(!p->m_candidateScores.empty())
+		{
+			p->m_candidates = p->m_configuredCandidates;
+			p->m_candidateScores.clear();
+			if(p->m_candidates.empty())
+			{
+				p->m_compare.value(0);
+				p->m_compare.deactivate();
+			}
+		}
+
+		// The grid takes the whole window and the scrollbar moves through the file
+		p->updateScrollbar(p->m_accumOffset, true);
+		RedrawCallback(widget, param);
+	}
+	else if(widget == &p->m_diff || widget == &p->m_diffShift)
+	{
+		p->updateDiffIndex();
+		RedrawCallback(widget, param);
+	}
+	else if(widget == &p->m_diffMode)
+	{
+		RedrawCallback(widget, param);
+	}
 }
 
 void PixelDbgWnd::ScrollbarCallback(Fl_Widget* widget, void* param)
@@ -1974,25 +3280,60 @@ void PixelDbgWnd::ScrollbarCallback(Fl_Widget* widget, void* param)
 		return;
 	}
 
-	if(widget == p->m_imageScroll)
+	if(widget == p->m_imageHScroll)
+	{
+		u32 pos = (u32)std::floor(p->m_imageHScroll->Fl_Valuator::value());
+		if(pos != p->m_viewX)
+		{
+			p->m_viewX = pos;
+
+			RedrawCallback(widget, param);
+		}
+	}
+	else if(widget == p->m_imageScroll && p->isScrollingRows())
+	{
+		// Scrollbar is in rows of the image if it doesn't fit into the window
+		u32 pos = (u32)std::floor(p->m_imageScroll->Fl_Valuator::value());
+		if(pos != p->m_viewY)
+		{
+			p->m_viewY = pos;
+
+			RedrawCallback(widget, param);
+		}
+	}
+	else if(widget == p->m_imageScroll)
 	{
 		off_t pos = (off_t)std::floor(p->m_imageScroll->Fl_Valuator::value());
 		off_t offset = p->getOffset();
-		u32 numVisibleBytes = p->getNumVisibleBytes();
 
-		if(numVisibleBytes > p->m_currentFileSize || pos == p->m_currentFileSize || pos == offset)
+		// Scrollbar is in pixels on indexed RLE streams
+		if(p->isRLEMode() && p->m_rleIndex.getIndexedPixels() > 0)
 		{
+			if((u64)pos != p->m_rlePixel && p->viewPixel((u64)pos))
+			{
+				p->updateScrollbar(pos, true);
+
+				RedrawCallback(widget, param);
+			}
 			return;
 		}
+		u64 numVisibleBytes = p->getNumVisibleBytes();
 
-		memset(p->m_pixels, 0, kMaxImageSize);
+		if(numVisibleBytes > p->m_currentFileSize || pos == p->m_currentFileSize || pos == offset)
+		{
+			return;
+		}
 
- 		if(size_t size = p->readFile(p->m_currentFile, p->m_text, kMaxBufferSize, pos))
+		if(p->viewFile(pos))
 		{
 			p->m_accumOffset = pos;
 			p->m_offset.value(offsetToString(pos));
-			p->m_data.static_value(reinterpret_cast<char*>(p->m_text), size);
-			p->m_data.position(0, 0);
+
+			// Stream wasn't indexed yet, restart from the new offset
+			if(p->isRLEMode())
+			{
+				p->m_rleIndex.detach();
+			}
 
 			p->updateScrollbar(pos, true);
 
@@ -2005,174 +3346,389 @@ void PixelDbgWnd::RedrawCallback(Fl_Widget* widget, void* param) // Callback to
 {
 	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
 
-	if(!p || !p->isValid())
+	if(!p)
 	{
 		return;
 	}
-	
-	const u8* text = reinterpret_cast<const u8*>(p->m_data.value());
-	u32 length = (u32)p->m_data.size();
-	int w = p->getImageWidth();
-	int h = p->getImageHeight();
-	int ps = p->getPixelSize();
-	
-	// Handle memory tiling
-	int tx = w;
-	int ty = h;
-	if(p->m_tile.value() != 0)
+
+	// Controls fire on every keystroke and drag motion, a burst of them becomes one frame once
+	// the event queue is empty (see RedrawIdleCallback)
+	++p->m_redrawStats.requested;
+	if(p->m_redrawPending || p->m_redrawDeferred)
+	{
+		++p->m_redrawStats.merged;
+		return;
+	}
+
+	p->m_redrawPending = true;
+	Fl::add_idle(RedrawIdleCallback, p);
+}
+
+void PixelDbgWnd::RedrawTimeoutCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	p->m_redrawDeferred = false;
+	p->m_redrawPending = true;
+	Fl::add_idle(RedrawIdleCallback, p);
+}
+
+void PixelDbgWnd::RedrawIdleCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	Fl::remove_idle(RedrawIdleCallback, p);
+	p->m_redrawPending = false;
+
+	// Not more than one frame per interval, later changes are merged into the deferred one
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - p->m_lastRedraw).count();
+	if(elapsed < p->m_frameInterval)
+	{
+		++p->m_redrawStats.deferred;
+		p->m_redrawDeferred = true;
+		Fl::add_timeout(p->m_frameInterval - elapsed, RedrawTimeoutCallback, p);
+		return;
+	}
+
+	if(!p->isValid())
 	{
-		tx = atoi(p->m_tileX.value());
-		ty = atoi(p->m_tileY.value());
+		return;
 	}
+
+	p->m_lastRedraw = std::chrono::steady_clock::now();
 	
 	// Print byte count
-	u32 maxVisible = std::min((u32)(p->m_currentFileSize - p->m_accumOffset), (u32)p->getNumVisibleBytes());
-	const char* byteCount = formatString("Visible: %.2f %%", float(maxVisible) / float(p->getNumVisibleBytes()) * 100.0f);
+	u64 maxVisible = std::min((u64)(p->m_currentFileSize - p->m_accumOffset), p->getNumVisibleBytes());
+	const char* byteCount = formatString("Visible: %.2f %%", double(maxVisible) / double(p->getNumVisibleBytes()) * 100.0);
 	p->m_byteCount.copy_label(byteCount);
 
-	if(!text || length == 0 || ps <= 0)
+	if(!p->m_file.isOpen() || p->m_data.size() == 0 || p->getPixelSize() <= 0)
 	{
 		return;
 	}
-	
-	// Wipe old data
-	u32 size = u32(w) * u32(h) * 3;
-	u32 stride = u32(w) * 3;
-	memset(p->m_pixels, 0, size);
 
-	// Update bitwise ops before passing them to convert function
-	const std::vector<BitwiseOp>* bwOps = NULL;
-	if(p->isBitwiseOpMode())
+	// (Re)index the RLE stream if the run encoding changed
+	if(p->updateRleIndex())
 	{
-		p->updateBitwiseOps();
-		bwOps = &p->m_bitwiseOpVec;
+		p->updateScrollbar(p->m_accumOffset, true);
 	}
-	
-	// Convert data (plain, palette, DXT, RLE, ...)
-	u32 flags = p->getRGBAIgnoreMask();
-	if(p->isDXTMode())
-	{
-		int rgbaBits[4];
-		if(p->getRGBABits(rgbaBits))
-		{
-			int type = 1;
-			switch(p->m_DXTType.value())
-			{
-			case 0: type = 1; break;
-			case 1: type = 3; break;
-			case 2: type = 5; break;
-			}
 
-			p->convertDXT(text, length, p->m_pixels, flags, type, rgbaBits[3] == 1);
-		}
+	// Reading and converting happens on the render thread, see FrameCallback
+	ViewState state;
+	p->getViewState(state);
+	p->m_renderer.submit(state);
+	++p->m_redrawStats.submitted;
+
+	// Whole file summary follows the pixel format, the visible part is scanned first
+	if(p->m_minimapFormat.compile(state.format, state.flags, state.paletteMode ? state.palette : NULL, state.bitwise ? &state.bwTable : NULL))
+	{
+		p->m_minimap.attach(p->m_file, p->m_minimapFormat);
 	}
-	else if(p->isRLEMode())
+	p->m_minimap.setFocus(p->m_accumOffset, p->getNumVisibleBytes());
+}
+
+void PixelDbgWnd::FrameNotify(void* param) // Render thread
+{
+	Fl::awake(FrameCallback, param);
+}
+
+void PixelDbgWnd::FrameCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(!p || !p->m_renderer.takeFrame(p->m_frame))
 	{
-		u32 RLmask = p->m_RLEType.value() == 2 ? 0x7f : 0xff;
-		bool RLmsb = p->m_RLEType.value() == 1;
+		return;
+	}
 
-		p->convertRLE(text, length, p->m_pixels, flags, RLmask, RLmsb, bwOps);
+	Frame& frame = p->m_frame;
+	frame.stagesRun |= 1 << RS_Present;
+	++p->m_redrawStats.presented;
+
+	if(frame.colorsCounted && p->m_colorCount.value() != 0)
+	{
+		const char* colorCount = formatString("Colors: %u", frame.numColors);
+		p->m_colorCount.copy_label(colorCount);
 	}
-	else
+
+	if(frame.paletteUsed && p->isPaletteMode())
 	{
-		length = std::min(kMaxBufferSize, length);
-		p->convertRaw(text, length, p->m_pixels, flags, bwOps, u32(tx), u32(ty), p->isPaletteMode() ? p->m_palette : NULL);
+		p->m_paletteIndices.copy_label(formatString("Used: %u-%u", frame.paletteMin, frame.paletteMax));
 	}
 	
-	//
-	// See if we have other ops to perform on the data (we could combine some of them for performance but maybe later):
-	//
+	// Show new image
+	if(p->m_image)
+	{
+		p->m_image->Fl_RGB_Image::~Fl_RGB_Image();
+	}
+	p->m_image = new (p->m_rawMemoryFlRGBImage) Fl_RGB_Image(&frame.pixels[0], frame.width, frame.height, 3);
+	p->getImageBox().image(p->m_image);
+	p->getImageBox().resize(p->m_leftArea.w(), 2, p->w() - p->getSideBarWidth() - p->m_leftArea.w(), p->h() - 2 - p->m_imageHScroll->h());
+
+	// We are called from the event loop, the window is flushed once we return
+	p->redraw();
+}
+
+void PixelDbgWnd::RleIndexNotify(void* param) // Index thread
+{
+	Fl::awake(RleIndexCallback, param);
+}
 
-	// Vertical flip ?
-	if(p->m_flipV.value() != 0)
+void PixelDbgWnd::RleIndexCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	// Scroll range grows while the stream is indexed
+	if(p && p->isRLEMode() && p->m_currentFileSize > 0)
 	{
-		for(u32 y=0; y<u32(h/2); ++y)
-		{
-			u8* src = p->m_pixels + y * stride;
-			u8* dest = p->m_pixels + (u32(h) - y - 1) * stride;
-			
-			for(u32 x=0; x<u32(w); ++x, src+=3, dest+=3)
-			{
-				std::swap(src[0], dest[0]);
-				std::swap(src[1], dest[1]);
-				std::swap(src[2], dest[2]);
-			}
-		}
+		p->updateScrollbar(p->m_accumOffset, true);
 	}
-	
-	// Horizontal flip ?
-	if(p->m_flipH.value() != 0)
+}
+
+void PixelDbgWnd::MinimapNotify(void* param) // Minimap thread
+{
+	Fl::awake(MinimapCallback, param);
+}
+
+void PixelDbgWnd::MinimapCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(p)
+	{
+		p->updateMinimap();
+	}
+}
+
+void PixelDbgWnd::CarveListCallback(Fl_Widget* widget, void* param)
+{
+	if(!param)
+	{
+		return;
+	}
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(widget == p->m_carveSort)
 	{
-		for(u32 y=0; y<u32(h); ++y)
+		p->updateCarveList();
+	}
+	else if(widget == p->m_carveList)
+	{
+		int line = p->m_carveList->value();
+		if(line > 1 && line - 2 < (int)p->m_carveHits.size())
 		{
-			u8* line = p->m_pixels + y * stride;
-			
-			for(u32 x=0; x<u32(w/2); ++x)
-			{
-				u32 rx = u32(w - 1) - x;
-				
-				std::swap(line[x*3+0], line[rx*3+0]);
-				std::swap(line[x*3+1], line[rx*3+1]);
-				std::swap(line[x*3+2], line[rx*3+2]);
-			}
+			p->adoptCarvedImage(p->m_carveHits[line - 2]);
 		}
 	}
-	
-	// Count colors ?
-	if(p->m_colorCount.value() != 0)
+}
+
+void PixelDbgWnd::CarveNotify(void* param) // Carver thread
+{
+	Fl::awake(CarveCallback, param);
+}
+
+void PixelDbgWnd::CarveCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(p)
+	{
+		p->updateCarveList();
+	}
+}
+
+void PixelDbgWnd::DuplicateListCallback(Fl_Widget* widget, void* param)
+{
+	if(!param)
+	{
+		return;
+	}
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(widget == p->m_dupWindow)
+	{
+		// Closed, the tint and the minimap marks go with it
+		p->m_dupWindow->hide();
+		p->updateMinimap();
+		RedrawCallback(&p->m_compare, p);
+	}
+	else if(widget == p->m_dupList)
 	{
-		for(u32 y=0; y<u32(h); ++y)
+		int line = p->m_dupList->value();
+		if(line > 1 && line - 2 < (int)p->m_dupOffsets.size() && p->m_dupOffsets[line - 2] != ~0ull)
 		{
-			u8* line = p->m_pixels + y * stride;
-			
-			for(u32 x=0; x<u32(w); ++x, line+=3)
-			{
-				u32 color = line[0] | (line[1] << 8) | (line[2] << 16);
-				p->m_colorSet.insert(color);
-			}
+			p->seekOffset((off_t)p->m_dupOffsets[line - 2], false);
 		}
-	
-		const char* colorCount = formatString("Colors: %u", p->m_colorSet.size());
-		p->m_colorCount.copy_label(colorCount);
-		p->m_colorSet.clear();
 	}
+}
+
+void PixelDbgWnd::DuplicateNotify(void* param) // Duplicate finder thread
+{
+	Fl::awake(DuplicateCallback, param);
+}
+
+void PixelDbgWnd::DuplicateCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
 
-	// Recalculate used min/max indices in palette mode
-	if(p->isPaletteMode())
+	if(p)
 	{
-		u8 inmin = 255, inmax = 0;
-		int w = p->getImageWidth();
-		int h = p->getImageHeight();
-		const u8* data = reinterpret_cast<const u8*>(p->m_data.value());
+		p->updateDuplicateList();
 
-		for(u32 i=0; i<(u32)p->m_data.size(); ++i)
+		// Regions are known once the chunks are merged
+		if(p->m_dupWindow && p->m_dupWindow->shown() && p->m_duplicateFinder.getStats().phase >= DuplicateFinder::DP_Merging)
 		{
-			u8 index = data[i];
-			if(index < inmin) inmin = index;
-			else if(index > inmax) inmax = index;
+			p->updateMinimap();
+			RedrawCallback(&p->m_compare, p);
 		}
+	}
+}
 
-		p->m_paletteIndices.copy_label(formatString("Used: %u-%u", inmin, inmax));
+void PixelDbgWnd::SearchNotify(void* param) // Search thread
+{
+	Fl::awake(SearchCallback, param);
+}
+
+void PixelDbgWnd::SearchCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(p)
+	{
+		p->updateSearchStatus();
 	}
-	
-	// Show new image
-	if(p->m_image)
+}
+
+void PixelDbgWnd::DiffIndexNotify(void* param) // Diff index thread
+{
+	Fl::awake(DiffIndexCallback, param);
+}
+
+void PixelDbgWnd::DiffIndexCallback(void* param)
+{
+	PixelDbgWnd* p = static_cast<PixelDbgWnd*>(param);
+
+	if(p)
 	{
-		p->m_image->Fl_RGB_Image::~Fl_RGB_Image();
+		p->updateDiffStatus();
 	}
-	p->m_image = new (p->m_rawMemoryFlRGBImage) Fl_RGB_Image(p->m_pixels, w, h, 3);
-	p->getImageBox().image(p->m_image);
+}
+
+void PixelDbgWnd::getViewState(ViewState& state, bool wholeImage /* false */)
+{
+	int w = getImageWidth();
+	int h = getImageHeight();
+	
+	state.file = &m_file;
+	state.offset = m_accumOffset;
+	state.width = (u32)w;
+	state.height = (u32)h;
+	getPixelFormat(state.format);
+	state.flags = getRGBAIgnoreMask();
 	
-	int newWidth = std::min(p->w() - p->m_imageScroll->w() - 5, p->w() - p->m_imageScroll->w() - 5);
-	p->getImageBox().resize(p->m_leftArea.w(), 2, p->w() - 15 - p->m_leftArea.w(), p->h() - 2);
+	// Handle memory tiling
+	state.tileX = (u32)w;
+	state.tileY = (u32)h;
+	if(m_tile.value() != 0)
+	{
+		state.tileX = (u32)atoi(m_tileX.value());
+		state.tileY = (u32)atoi(m_tileY.value());
+	}
+
+	state.paletteMode = isPaletteMode();
+	if(state.paletteMode)
+	{
+		memcpy(state.palette, m_palette, sizeof(m_palette));
+	}
+
+	// Update bitwise ops before passing them to convert function
+	state.bitwise = isBitwiseOpMode();
+	if(state.bitwise)
+	{
+		updateBitwiseOps();
+		state.bwTable = m_bitwiseTable;
+	}
+
+	state.DXTMode = isDXTMode();
+	switch(m_DXTType.value())
+	{
+	case 0: state.DXTType = 1; break;
+	case 1: state.DXTType = 3; break;
+	case 2: state.DXTType = 5; break;
+	}
+	state.oneBitAlpha = state.format.rgbaBits[3] == 1;
+
+	state.RLEMode = isRLEMode();
+	state.RLmask = m_RLEType.value() == 2 ? 0x7f : 0xff;
+	state.RLmsb = m_RLEType.value() == 1;
+	state.RLskip = state.RLEMode ? m_rleSkip : 0;
+
+	state.flipV = m_flipV.value() != 0;
+	state.flipH = m_flipH.value() != 0;
+	state.countColors = m_colorCount.value() != 0;
+	state.topColors = m_topColors;
+	state.entropyBlockSize = getEntropyBlockSize();
+	state.zoom = getZoom();
+	state.zoomAverage = m_zoomAverage.value() != 0;
+	state.windowWidth = getMaxViewportWidth();
+	state.windowHeight = getMaxViewportHeight();
+
+	if(wholeImage)
+	{
+		state.viewX = 0;
+		state.viewY = 0;
+		state.viewWidth = state.getZoomedWidth();
+		state.viewHeight = state.getZoomedHeight();
+		return;
+	}
+
+	// Comparison grid, every cell shows the start of the view in another format
+	if(isComparing())
+	{
+		state.zoom = 1;
+		state.viewX = 0;
+		state.viewY = 0;
+		state.viewWidth = getViewportWidth();
+		state.viewHeight = getViewportHeight();
+		state.candidates = m_candidates;
+		state.gridColumns = getGridColumns();
+		return;
+	}
+
+	// Only the visible part is decoded. The scroll position is in flipped image space,
+	// the viewport in the unflipped one (both zoomed).
+	u32 viewWidth = getViewportWidth();
+	u32 viewHeight = getViewportHeight();
+
+	// RLE streams are scrolled through the index, the image always starts at the first visible row
+	if(state.RLEMode)
+	{
+		state.height = viewHeight;
+	}
+
+	u32 zoomedWidth = state.getZoomedWidth();
+	u32 zoomedHeight = state.getZoomedHeight();
+	u32 viewX = std::min(m_viewX, zoomedWidth - viewWidth);
+	u32 viewY = state.RLEMode ? 0 : std::min(m_viewY, zoomedHeight - viewHeight);
+
+	state.viewX = state.flipH ? zoomedWidth - viewX - viewWidth : viewX;
+	state.viewY = state.flipV ? zoomedHeight - viewY - viewHeight : viewY;
+	state.viewWidth = viewWidth;
+	state.viewHeight = viewHeight;
+
+	// Second source of the diff view, data before its start is shown black (there is no frame past its end)
+	if(isDiffMode())
+	{
+		state.diffFile = m_diffFile.isOpen() ? &m_diffFile : &m_file;
+		i64 diffOffset = (i64)m_accumOffset + getDiffShift();
+		state.diffOffset = diffOffset >= 0 ? (off_t)diffOffset : state.diffFile->size();
+		state.diffMode = (u32)m_diffMode.value();
+	}
 
-	if(widget != p)
+	// Duplicate blocks are tinted while their list is open (RLE pixels have no fixed offsets)
+	if(m_dupWindow && m_dupWindow->shown() && !state.RLEMode)
 	{
-		// Flush main window but only if we are not resizing.
-		// With flush the image will be visible but vanish when we resize.
-		// Without flush the image won't be visible until we resize.
-		// Seems to be a problem with FLTK so this workaround is needed.
-		p->flush();
+		m_duplicateFinder.getRegions((u64)m_accumOffset, getNumVisibleBytes(), state.highlights);
 	}
 }
 
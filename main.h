@@ -32,6 +32,9 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <string>
+#include <algorithm>
+#include <chrono>
 #include <FL/Fl.H>
 #include <FL/Fl_Double_Window.H>
 #include <FL/Fl_Box.H>
@@ -43,44 +46,27 @@
 #include <FL/Fl_Check_Button.H>
 #include <FL/Fl_Scroll.H>
 #include <FL/Fl_Scrollbar.H>
+#include <FL/Fl_Hold_Browser.H>
 #include <FL/Fl_BMP_Image.H>
 #include <FL/Fl_Native_File_Chooser.H>
 #include <FL/fl_message.H>
+#include <FL/fl_draw.H>
 #ifdef _WIN32
 #include <windows.h>
 #endif
-
-typedef signed char i8;
-typedef unsigned char u8;
-typedef signed short i16;
-typedef unsigned short u16;
-typedef signed int i32;
-typedef unsigned int u32;
-
-#define IS64BIT (INTPTR_MAX == INT64_MAX)
-
-#ifdef _MSC_VER
-#define snprintf _snprintf
-#endif
-
-#pragma pack(push, packing)
-#pragma pack(1)
-struct TgaHeader
-{
-	u8 identsize;		// Size of id field that follows 18 byte header (0 usually)
-	u8 colormaptype;	// Type of color map 0 = none, 1 = has palette
-	u8 imagetype;		// Type of image 0 = none,1 = indexed,2 = rgb,3 = grey, +8 = rle packed
-	u16 palletestart;	// First color map entry in palette
-	u16 palettelength;	// Number of colors in palette
-	u8 palettebits;		// Number of bits per palette entry 15,16,24,32
-	u16 xstart;			// Image x origin
-	u16 ystart;			// Image y origin
-	u16 width;			// Image width
-	u16 height;			// Image height
-	u8 bpp;				// Image bit depth
-	u8 descriptor;		// Image descriptor bits (vh flip bits)
-};
-#pragma pack(pop)
+#include "common.h"
+#include "mappedfile.h"
+#include "prefetch.h"
+#include "decoder.h"
+#include "renderer.h"
+#include "rleindex.h"
+#include "minimap.h"
+#include "stride.h"
+#include "formatdetect.h"
+#include "carver.h"
+#include "dupfinder.h"
+#include "search.h"
+#include "diffindex.h"
 
 template <typename T> class Point2D
 {
@@ -98,42 +84,48 @@ class PixelDbgWnd : public Fl_Double_Window
 public:
 	static const u32 kMaxDim;
 	static const u32 kMaxBufferSize;
-	static const u32 kMaxImageSize;
+	static const u32 kMinimapWidth;
+	static const char* const kDefaultCandidates;
+	static const char* const kSuggestCandidates;
+	static const u32 kMaxSuggestions;
+	static const u32 kMaxStrideCandidates;
 	static const u32 kVersionMajor;
 	static const u32 kVersionMinor;
 	
 	#define RECT_RIGHT(__wdg__) __wdg__.x() + __wdg__.w()
 	#define RECT_BOTTOM(__wdg__) __wdg__.y() + __wdg__.h()
 
-	enum ConvertFlags
+	// Command line tunables (see parseOptions in main.cpp)
+	struct Options
 	{
-		CF_IgnoreChannelOrder = (1<<0),
-		CF_IgnoreTiles = (1<<1),
-		CF_IgnoreRedChannel = (1<<2),
-		CF_IgnoreGreenChannel = (1<<3),
-		CF_IgnoreBlueChannel = (1<<4),
-		CF_IgnoreAlphaChannel = (1<<5)
-	};
-
-	struct BitwiseOp
-	{
-		enum Op
+		Options() :
+			frameCacheBudget(FrameCache::kDefaultBudget),
+			threads(0),
+			topColors(0),
+			benchmark(false),
+			selfTest(false),
+			minimapCache(Minimap::getDefaultCacheDir()),
+			compareFormats(kDefaultCandidates),
+			maxFps(60)
 		{
-			OP_NOP = 0,
-			OP_AND,
-			OP_OR,
-			OP_XOR,
-			OP_SHL,
-			OP_SHR,
-			OP_ROL,
-			OP_ROR
-		};
-
-		Op op;
-		u8 r, g, b; // bits
+		}
+
+		size_t frameCacheBudget; // Bytes
+		u32 threads; // Render threads, 0 = one per core
+		u32 topColors; // Most frequent colors listed in the statistics while counting colors
+		bool benchmark; // Run the decoder benchmark instead of the UI
+		bool selfTest; // Run the self test instead of the UI
+		std::string minimapCache; // Directory of the minimap cache files, empty = none
+		std::string compareFormats; // Candidates of the comparison grid (see parseCandidates)
+		u32 maxFps; // Frames submitted per second at most, bursts of changes in between are merged
+		std::string entropyProfile; // File to print the entropy profile of instead of running the UI
+		std::string carve; // File to list the embedded images of instead of running the UI
+		std::string search; // File to list the matches of searchPattern in instead of running the UI
+		std::string searchPattern; // See PatternSearch::parsePattern
+		std::string duplicates; // File to list the duplicate blocks of instead of running the UI
 	};
 
-	PixelDbgWnd(const char* text) :
+	PixelDbgWnd(const char* text, const Options& options = Options()) :
 		Fl_Double_Window(881, 536, text),
 		m_leftArea(0, 0, 220, h()),
 		m_dimGroup(5, 1, 195, 91),
@@ -141,9 +133,11 @@ public:
 		m_formatGroup(5, 178, 195, 124),
 		m_paletteGroup(5, 305, 195, 108),
 		m_bitwiseGroup(5, 416, 195, 119),
-		m_opsGroup(5, 538, 195, 116),
-		m_width(120, 5, 70, 20, "Width [1, 1024]:"),
-		m_height(120, 27, 70, 20, "Height [1, 1024]:"),
+		m_opsGroup(5, 538, 195, 238),
+		m_searchGroup(5, 779, 195, 50),
+		m_diffGroup(5, 832, 195, 72),
+		m_width(120, 5, 70, 20, "Width:"),
+		m_height(120, 27, 70, 20, "Height:"),
 		m_data(50, 49, 140, 21, "Data:"),
 		m_backwardButton(145, 70, 23, 20, "@<"),
 		m_forwardButton(168, 70, 23, 20, "@>"),
@@ -187,15 +181,59 @@ public:
 		m_flipV(11, RECT_BOTTOM(m_RLEMode) + 2, 110, 20, "Flip vertically"),
 		m_flipH(11, RECT_BOTTOM(m_flipV) + 2, 125, 20, "Flip horizontally"),
 		m_colorCount(11, RECT_BOTTOM(m_flipH) + 2, 150, 20, "Count colors"),
-		m_aboutButton(5, RECT_BOTTOM(m_opsGroup) + 4, 195, 23, "About"),
+		m_zoom(60, RECT_BOTTOM(m_colorCount) + 2, 70, 20, "Zoom:"),
+		m_zoomAverage(135, RECT_BOTTOM(m_colorCount) + 2, 60, 20, "Avg."),
+		m_compare(11, RECT_BOTTOM(m_zoom) + 2, 120, 20, "Compare formats"),
+		m_suggestButton(133, RECT_BOTTOM(m_zoom) + 2, 55, 20, "Suggest"),
+		m_entropy(11, RECT_BOTTOM(m_compare) + 2, 80, 20, "Entropy"),
+		m_entropyBlock(113, RECT_BOTTOM(m_compare) + 2, 75, 20),
+		m_carveButton(15, RECT_BOTTOM(m_entropy) + 4, 175, 25, "Find embedded images"),
+		m_dupButton(15, RECT_BOTTOM(m_carveButton) + 2, 175, 25, "Find duplicate blocks"),
+		m_search(50, m_searchGroup.y() + 4, 140, 20, "Find:"),
+		m_findPrevButton(15, RECT_BOTTOM(m_search) + 2, 23, 20, "@<"),
+		m_findNextButton(38, RECT_BOTTOM(m_search) + 2, 23, 20, "@>"),
+		m_searchStatus(65, RECT_BOTTOM(m_search) + 2, 125, 20),
+		m_diff(11, m_diffGroup.y() + 4, 55, 20, "Diff"),
+		m_diffMode(70, m_diffGroup.y() + 4, 120, 20),
+		m_diffShift(50, RECT_BOTTOM(m_diff) + 2, 80, 20, "Shift:"),
+		m_diffFileButton(135, RECT_BOTTOM(m_diff) + 2, 55, 20, "File..."),
+		m_diffPrevButton(15, RECT_BOTTOM(m_diffShift) + 2, 23, 20, "@<"),
+		m_diffNextButton(38, RECT_BOTTOM(m_diffShift) + 2, 23, 20, "@>"),
+		m_diffStatus(65, RECT_BOTTOM(m_diffShift) + 2, 125, 20),
+		m_aboutButton(5, RECT_BOTTOM(m_diffGroup) + 4, 96, 23, "About"),
+		m_statsButton(104, RECT_BOTTOM(m_diffGroup) + 4, 96, 23, "Statistics"),
 		m_windowSize(w(), h()),
 		m_cursorChanged(false),
 		m_accumOffset(0),
 		m_offsetChanged(false),
-		m_currentFileSize(0)
+		m_currentFileSize(0),
+		m_renderer(FrameNotify, this, options.frameCacheBudget, options.threads),
+		m_rleIndex(RleIndexNotify, this),
+		m_minimap(MinimapNotify, this),
+		m_carver(CarveNotify, this, options.threads),
+		m_patternSearch(SearchNotify, this, options.threads),
+		m_searching(false),
+		m_diffIndex(DiffIndexNotify, this, options.threads),
+		m_duplicateFinder(DuplicateNotify, this, options.threads),
+		m_minimapDrag(false),
+		m_rlePixel(0),
+		m_rleSkip(0),
+		m_topColors(options.topColors),
+		m_viewX(0),
+		m_viewY(0),
+		m_displayedZoom(0),
+		m_strideOverlay(false),
+		m_strideOffset(0),
+		m_strideUnitWidth(1),
+		m_strideTime(0.0),
+		m_suggestTime(0.0),
+		m_frameInterval(1.0 / (double)std::max(options.maxFps, 1u)),
+		m_redrawPending(false),
+		m_redrawDeferred(false),
+		m_lastRedraw(std::chrono::steady_clock::now() - std::chrono::hours(1))
 	{
-		// Limit window size on resize (1x70 as minimum image)
-		size_range(242, 93, 1265, 1075);
+		// Limit window size on resize (1x70 as minimum image), larger images are scrolled
+		size_range(242, 108);
 
 		m_leftArea.end();
 		m_leftArea.type(Fl_Scroll::VERTICAL_ALWAYS);
@@ -212,24 +250,28 @@ public:
 		m_paletteGroup.color(FL_DARK1);
 		m_opsGroup.box(FL_ENGRAVED_BOX);
 		m_opsGroup.color(FL_DARK1);
+		m_searchGroup.box(FL_ENGRAVED_BOX);
+		m_searchGroup.color(FL_DARK1);
+		m_diffGroup.box(FL_ENGRAVED_BOX);
+		m_diffGroup.color(FL_DARK1);
 		
-		m_width.maximum_size(4);
+		m_width.maximum_size(7);
 		m_width.insert("640");
 		m_width.type(FL_INT_INPUT);
 		m_width.textfont(FL_COURIER);
 		m_width.textsize(12);
 		m_width.when(FL_WHEN_CHANGED);
 		m_width.callback(DimCallback, this);
-		m_width.tooltip("Image width to display loaded data.");
+		m_width.tooltip("Image width to display loaded data (1 to 1048576). Images wider than the window are scrolled horizontally. CTRL + D guesses it from the data at the offset.");
 
-		m_height.maximum_size(4);
-		m_height.insert("534");
+		m_height.maximum_size(7);
+		m_height.insert("519");
 		m_height.type(FL_INT_INPUT);
 		m_height.textfont(FL_COURIER);
 		m_height.textsize(12);
 		m_height.when(FL_WHEN_CHANGED);
 		m_height.callback(DimCallback, this);
-		m_height.tooltip("Image height to display loaded data.");
+		m_height.tooltip("Image height to display loaded data (1 to 1048576). Images higher than the window are scrolled vertically, otherwise the scrollbar moves through the file.");
 		
 		m_data.maximum_size(kMaxBufferSize);
 		m_data.textfont(FL_COURIER);
@@ -258,7 +300,7 @@ public:
 		m_offset.textsize(12);
 		m_offset.when(FL_WHEN_ENTER_KEY_ALWAYS);
 		m_offset.callback(OffsetCallback, this);
-		m_offset.tooltip("File offset to read from when opening file. Offset can be picked from the image by holding CTRL. Using up/down keys will reload file from previous/next offset.");
+		m_offset.tooltip("File offset to read from when opening file. Offset can be picked from the image by holding CTRL. Using up/down keys will reload file from previous/next offset. CTRL + J jumps to a pixel number.");
 
 		m_saveButton.box(FL_THIN_UP_BOX);
 		m_saveButton.when(FL_WHEN_RELEASE);
@@ -270,7 +312,7 @@ public:
 		m_autoReload.down_box(FL_DIAMOND_DOWN_BOX);
 		m_autoReload.when(FL_WHEN_CHANGED);
 		m_autoReload.callback(OffsetCallback, this);
-		m_autoReload.tooltip("If checked, auto-reload current file after each offset pick (CTRL + mouse move). On a compressed data stream (i.e. S3TC/RLE) picking might be not very accurate.");
+		m_autoReload.tooltip("If checked, auto-reload current file after each offset pick (CTRL + mouse move). On S3TC compressed data the offset of the picked block is used, on RLE data the offset of the picked run.");
 		
 		m_redChannel.maximum_size(1);
 		m_redChannel.insert("3");
@@ -541,7 +583,7 @@ public:
 		m_RLEMode.down_box(FL_DIAMOND_DOWN_BOX);
 		m_RLEMode.callback(RLECallback, this);
 		m_RLEMode.tooltip("If checked, interpret data stream as RLE compressed. Last or first byte always represents the run length and following or preceding bytes hold the pixel color as described by the pixel format."
-			              " RLE compressed stream doesn't work well with picking and scroll bar length.");
+			              " The stream is indexed in the background from the current offset on, scroll bar, picking and jumping to a pixel (CTRL + J) are exact within the indexed part.");
 		
 		m_RLEType.textfont(FL_COURIER);
 		m_RLEType.textsize(12);
@@ -567,16 +609,161 @@ public:
 		m_colorCount.when(FL_WHEN_CHANGED);
 		m_colorCount.down_box(FL_DIAMOND_DOWN_BOX);
 		m_colorCount.callback(OpsCallback, this);
-		m_colorCount.tooltip("If checked, count unique colors every time the image changes.");
+		m_colorCount.tooltip("If checked, count unique colors every time the image changes. Start with --top-colors <n> to list the most frequent colors in the statistics.");
+
+		m_zoom.textfont(FL_COURIER);
+		m_zoom.textsize(12);
+		for(u32 zoom=1; zoom<=ViewState::kMaxZoom; zoom*=2)
+		{
+			char label[16];
+			snprintf(label, sizeof(label), "1:%u", zoom);
+			m_zoom.add(label);
+		}
+		m_zoom.value(0);
+		m_zoom.when(FL_WHEN_CHANGED);
+		m_zoom.callback(OpsCallback, this);
+		m_zoom.tooltip("Zoom out, every screen pixel shows a block of image pixels (CTRL + mouse wheel on the image). Neighbouring levels are prepared in the background. Not available on RLE data.");
+
+		m_zoomAverage.when(FL_WHEN_CHANGED);
+		m_zoomAverage.down_box(FL_DIAMOND_DOWN_BOX);
+		m_zoomAverage.callback(OpsCallback, this);
+		m_zoomAverage.tooltip("If checked, zoomed pixels average their block (up to 4x4 evenly spread pixels), otherwise the centre pixel is shown.");
+
+		m_compare.when(FL_WHEN_CHANGED);
+		m_compare.down_box(FL_DIAMOND_DOWN_BOX);
+		m_compare.callback(OpsCallback, this);
+		m_compare.tooltip("If checked, show the start of the view decoded with every candidate format side by side (start with --compare-formats <list> to choose them). Click a cell to adopt its format.");
+		if(parseCandidates(options.compareFormats.c_str(), m_candidates) == 0)
+		{
+			m_compare.deactivate();
+		}
+		m_configuredCandidates = m_candidates;
+		parseCandidates(kSuggestCandidates, m_suggestCandidates);
+
+		m_suggestButton.box(FL_THIN_UP_BOX);
+		m_suggestButton.when(FL_WHEN_RELEASE);
+		m_suggestButton.callback(ButtonCallback, this);
+		m_suggestButton.tooltip("Score common pixel formats by how smooth the data at the offset looks with the current width (set it first, e.g. with CTRL + D) and show the best ones in the comparison grid (CTRL + G). Unchecking the grid brings back the configured formats.");
+
+		m_entropy.when(FL_WHEN_CHANGED);
+		m_entropy.down_box(FL_DIAMOND_DOWN_BOX);
+		m_entropy.callback(OpsCallback, this);
+		m_entropy.tooltip("If checked, blend a heat map of the byte entropy over the image (blue = constant, red = compressed or encrypted) and color the minimap by entropy. Start with --entropy-profile <file> to print the entropy of a whole file. Not available on RLE data.");
+
+		m_entropyBlock.textfont(FL_COURIER);
+		m_entropyBlock.textsize(12);
+		for(u32 size=EntropyEngine::kMinBlockSize; size<=EntropyEngine::kMaxBlockSize; size*=4)
+		{
+			char label[16];
+			if(size >= 1024 * 1024)
+			{
+				snprintf(label, sizeof(label), "%u MB", size / (1024 * 1024));
+			}
+			else if(size >= 1024)
+			{
+				snprintf(label, sizeof(label), "%u KB", size / 1024);
+			}
+			else
+			{
+				snprintf(label, sizeof(label), "%u B", size);
+			}
+			m_entropyBlock.add(label);
+
+			if(size == EntropyEngine::kDefaultBlockSize)
+			{
+				m_entropyBlock.value(m_entropyBlock.size() - 2);
+			}
+		}
+		m_entropyBlock.when(FL_WHEN_CHANGED);
+		m_entropyBlock.callback(OpsCallback, this);
+		m_entropyBlock.deactivate();
+		m_entropyBlock.tooltip("Bytes per block of the entropy heat map.");
+
+		m_carveButton.box(FL_THIN_UP_BOX);
+		m_carveButton.when(FL_WHEN_RELEASE);
+		m_carveButton.callback(ButtonCallback, this);
+		m_carveButton.tooltip("Scan the whole file for embedded BMP, TGA, DDS, PNG, KTX and JPEG images in the background and list them. Selecting an image jumps to its pixels and adopts its size and format (PNG and JPEG are compressed, only their header is shown). Start with --carve <file> to print the list.");
+
+		m_dupButton.box(FL_THIN_UP_BOX);
+		m_dupButton.when(FL_WHEN_RELEASE);
+		m_dupButton.callback(ButtonCallback, this);
+		m_dupButton.tooltip("Cut the whole file into content-defined chunks in the background and list the blocks which occur more than once, largest first. Selecting a copy jumps to it, while the list is open duplicate bytes are tinted magenta in the image and marked on the minimap. Start with --duplicates <file> to print the list.");
+
+		m_search.maximum_size(1024);
+		m_search.textfont(FL_COURIER);
+		m_search.textsize(12);
+		m_search.when(FL_WHEN_ENTER_KEY_ALWAYS);
+		m_search.callback(ButtonCallback, this);
+		m_search.tooltip("Byte pattern to find (CTRL + F), Enter or F3 finds the next match, SHIFT + F3 the previous one. Hex bytes with ? for any nibble (42 4d ?? 00), ASCII in quotes (\"RIFF\") or UTF-16 with a u prefix (u\"Texture\"), ? within quotes is any character. Start with --search <file> <pattern> to print all matches.");
+
+		m_findPrevButton.box(FL_THIN_UP_BOX);
+		m_findPrevButton.when(FL_WHEN_RELEASE);
+		m_findPrevButton.callback(ButtonCallback, this);
+		m_findPrevButton.tooltip("Find the previous match before the offset (SHIFT + F3).");
+
+		m_findNextButton.box(FL_THIN_UP_BOX);
+		m_findNextButton.when(FL_WHEN_RELEASE);
+		m_findNextButton.callback(ButtonCallback, this);
+		m_findNextButton.tooltip("Find the next match behind the offset (F3).");
+
+		m_searchStatus.align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+		m_searchStatus.labelsize(12);
+
+		m_diff.when(FL_WHEN_CHANGED);
+		m_diff.down_box(FL_DIAMOND_DOWN_BOX);
+		m_diff.callback(OpsCallback, this);
+		m_diff.tooltip("If checked, compare the data at the offset with the data at offset + shift (in the file picked with File... or the opened one) and show the differences. F4 / SHIFT + F4 jump to the next / previous difference. Not available on RLE data.");
+
+		m_diffMode.add("XOR");
+		m_diffMode.add("Difference");
+		m_diffMode.add("Changed pixels");
+		m_diffMode.value(0);
+		m_diffMode.when(FL_WHEN_CHANGED);
+		m_diffMode.callback(OpsCallback, this);
+		m_diffMode.tooltip("XOR of both images, their absolute difference per channel or the changed pixels in red over the dimmed image.");
+
+		m_diffShift.maximum_size(m_offset.maximum_size());
+		m_diffShift.insert("0");
+		m_diffShift.type(FL_INT_INPUT);
+		m_diffShift.textfont(FL_COURIER);
+		m_diffShift.textsize(12);
+		m_diffShift.when(FL_WHEN_ENTER_KEY_ALWAYS);
+		m_diffShift.callback(OpsCallback, this);
+		m_diffShift.tooltip("Bytes between the offset and the offset of the compared data, can be negative.");
+
+		m_diffFileButton.box(FL_THIN_UP_BOX);
+		m_diffFileButton.when(FL_WHEN_RELEASE);
+		m_diffFileButton.callback(ButtonCallback, this);
+		m_diffFileButton.tooltip("Pick the file to compare with, cancel to compare the opened file with itself.");
+
+		m_diffPrevButton.box(FL_THIN_UP_BOX);
+		m_diffPrevButton.when(FL_WHEN_RELEASE);
+		m_diffPrevButton.callback(ButtonCallback, this);
+		m_diffPrevButton.tooltip("Jump to the previous difference before the offset (SHIFT + F4).");
+
+		m_diffNextButton.box(FL_THIN_UP_BOX);
+		m_diffNextButton.when(FL_WHEN_RELEASE);
+		m_diffNextButton.callback(ButtonCallback, this);
+		m_diffNextButton.tooltip("Jump to the next difference behind the image (F4).");
+
+		m_diffStatus.align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+		m_diffStatus.labelsize(12);
 
 		m_aboutButton.box(FL_THIN_UP_BOX);
 		m_aboutButton.when(FL_WHEN_RELEASE);
 		m_aboutButton.callback(ButtonCallback, this);
 
+		m_statsButton.box(FL_THIN_UP_BOX);
+		m_statsButton.when(FL_WHEN_RELEASE);
+		m_statsButton.callback(ButtonCallback, this);
+		m_statsButton.tooltip("Show performance counters (read-ahead, caches, timings).");
+
 		// Don't know how to get those controls into extra box without allocating memory (need to end left area scroll before calling right area ctor)
 		m_rightArea = new Fl_Box(m_leftArea.w() + 5, 0, w() - m_leftArea.w(), h());
-		m_imageScroll = new Fl_Scrollbar(w() - 15, 0, 15, h());
-		m_imageBox = new Fl_Box(m_leftArea.w(), 2, w() - 15 - m_leftArea.w(), h() - 2);
+		m_imageScroll = new Fl_Scrollbar(w() - 15, 0, 15, h() - 15);
+		m_imageHScroll = new Fl_Scrollbar(m_leftArea.w(), h() - 15, w() - 15 - m_leftArea.w(), 15);
+		m_minimapBox = new Fl_Box(w() - 15 - kMinimapWidth, 0, kMinimapWidth, h() - 15);
+		m_imageBox = new Fl_Box(m_leftArea.w(), 2, w() - 15 - kMinimapWidth - m_leftArea.w(), h() - 17);
 
 		m_imageScroll->type(FL_VERTICAL);
 		m_imageScroll->align(FL_ALIGN_RIGHT);
@@ -584,15 +771,33 @@ public:
 		m_imageScroll->when(FL_WHEN_CHANGED);
 		m_imageScroll->callback(ScrollbarCallback, this);
 		m_imageScroll->deactivate();
+
+		m_imageHScroll->type(FL_HORIZONTAL);
+		m_imageHScroll->value(0, 1, 0, 1);
+		m_imageHScroll->when(FL_WHEN_CHANGED);
+		m_imageHScroll->callback(ScrollbarCallback, this);
+		m_imageHScroll->deactivate();
+
+		m_minimapBox->box(FL_FLAT_BOX);
+		m_minimapBox->color(FL_DARK3);
+		m_minimapBox->tooltip("Whole file at a glance: mean color of the current format, blue marks zero-filled and red high-entropy (compressed or encrypted) data, yellow the visible bytes. Click or drag to jump there.");
+		m_minimap.setCacheDir(options.minimapCache);
+		m_minimapImage = NULL;
+		m_carveWindow = NULL;
+		m_carveSort = NULL;
+		m_carveStatus = NULL;
+		m_carveList = NULL;
+		m_dupWindow = NULL;
+		m_dupStatus = NULL;
+		m_dupList = NULL;
 		
-		m_pixels = new u8[kMaxImageSize]; // BGR as pixels in window
-		m_text = new char[kMaxBufferSize]; // BGRA as text in editbox
 		m_image = 0;
 		
 		// Show current pixel format
 		updatePixelFormat(true);
 
 		memset(m_currentFile, 0, sizeof(m_currentFile));
+		memset(&m_redrawStats, 0, sizeof(m_redrawStats));
 		
 		// Fill palette (use green tint at startup)
 		for(int i=0; i<256; ++i)
@@ -606,24 +811,21 @@ public:
 			m_rawPalette[i*3+2] = m_palette[i*3+2];
 			m_rawPalette[i*3+3] = 0;
 		}
-
-		// Create a pixel pipeline with 5 bitwise ops
-		m_bitwiseOpVec.reserve(5);
-		m_bitwiseOpVec.push_back(BitwiseOp());
-		m_bitwiseOpVec.push_back(BitwiseOp());
-		m_bitwiseOpVec.push_back(BitwiseOp());
-		m_bitwiseOpVec.push_back(BitwiseOp());
-		m_bitwiseOpVec.push_back(BitwiseOp());
 	}
 	
 	~PixelDbgWnd()
 	{
-		delete [] m_text;
-		delete [] m_pixels;
+		Fl::remove_idle(RedrawIdleCallback, this);
+		Fl::remove_timeout(RedrawTimeoutCallback, this);
 
 		delete m_imageScroll;
+		delete m_imageHScroll;
 		delete m_imageBox;
+		delete m_minimapBox;
 		delete m_rightArea;
+		delete m_minimapImage;
+		delete m_carveWindow; // With its widgets
+		delete m_dupWindow;
 
 		if(m_image)
 		{
@@ -633,6 +835,7 @@ public:
 	
 	virtual void draw();
 	virtual int handle(int event);
+	virtual void hide();
 
 	bool isFormatValid() const;
 	int getRedBits() const;
@@ -640,20 +843,44 @@ public:
 	int getBlueBits() const;
 	int getAlphaBits() const;
 	bool getPixelFormat(int bitMask[4], int rgbaChannels[4], int rgbaBits[4], int& pixelSize) const;
+	bool getPixelFormat(PixelFormat& format) const;
 	bool getRGBABits(int rgbaBits[4]);
 	bool getRGBABitsFromHexString(const char* rgb, int* r = NULL, int* g = NULL, int* b = NULL);
 	int getPixelSize() const;
 	bool updatePixelFormat(bool startup = false);
 	bool updateBitwiseOps();
 	void updateScrollbar(off_t pos, bool resize);
-	void convertRaw(const u8* data, u32 size, u8* rgbOut, u32 flags = 0, const std::vector<BitwiseOp>* bwOps = NULL, u32 tileX = 0xffff, u32 tileY = 0xffff, u8* palette = NULL);
-	void convertDXT(const u8* data, u32 size, u8* rgbOut, u32 flags, int DXTType, bool oneBitAlpha = false);
-	void convertRLE(const u8* data, u32 size, u8* rgbOut, u32 flags, u32 RLmask, bool RLmsb, const std::vector<BitwiseOp>* bwOps = NULL);
+	bool updateRleIndex();
 	void convertPalette(const u8* data, u32 size, u8* rgbOut);
-	void flipVertically(int w, int h, void* data);
 	size_t readFile(const char* name, void* out, size_t size, off_t offset = 0);
-	bool writeBitmap(const char* filename, int width, int height, void* data);
-	bool writeTga(const char* filename);
+	size_t viewFile(off_t offset);
+	bool viewPixel(u64 pixel); // RLE mode, pixel counted from the index origin
+	off_t getOffsetAt(u32 x, u32 y); // File offset of an image position
+	void jumpToPixel();
+	void setZoom(u32 zoom); // Keeps the centre of the view
+	void seekOffset(off_t offset, bool keepAlignment = true); // Scroll to a file offset, by default keeping the pixel alignment
+	void updateMinimap(); // Rebuild the minimap image from the scanned cells
+	bool getGridCellAt(int x, int y, u32& index) const; // Comparison grid cell under a window position
+	void adoptCandidate(u32 index); // Switch to a candidate format of the comparison grid
+	void detectStrides(); // Rank row widths and pixel sizes of the data at the offset (CTRL + D)
+	void applyStride(u32 index); // Switch to a width of the stride overlay
+	void suggestFormats(); // Show the most likely formats of the data at the offset in the comparison grid (CTRL + G)
+	void showCarveList(); // Starts scanning the file for embedded images
+	void updateCarveList(); // Sorted copy of the images found so far
+	void adoptCarvedImage(const ImageCarver::Hit& hit); // Jump to an embedded image and switch to its size and format
+	void showDuplicateList(); // Starts looking for duplicate blocks in the file
+	void updateDuplicateList(); // Largest runs found, one line per copy
+	void findPattern(bool forward); // Starts searching for the pattern of the find field from the offset on (or before it)
+	void updateSearchStatus(); // Jumps to the match once the search is complete
+	void updateDiffIndex(); // Restarts comparing both sources of the diff view
+	void findDifference(bool forward); // Jumps to the next difference behind the image (or the last one before the offset)
+	void updateDiffStatus();
+	static u32 parseCandidates(const char* list, std::vector<FormatCandidate>& candidates); // Returns the number of valid ones
+	std::string getStatistics() const;
+	void getViewState(ViewState& state, bool wholeImage = false); // Visible viewport or the whole image
+	bool writeBitmap(const char* filename, int width, int height, const void* data); // 24bpp RGB rows
+	bool writeBitmap(const char* filename); // Current view
+	bool writeTga(const char* filename); // Current view
 	
 	// Inline
 	const char* getCurrentFileName() const
@@ -712,12 +939,90 @@ public:
 		#endif
 	}
 
-	u32 getNumVisibleBytes() const
+	// Image pixels per screen pixel and axis (no zoom on RLE data)
+	u32 getZoom() const
 	{
-		u32 w = (u32)getImageWidth();
-		u32 h = (u32)getImageHeight();
-		u32 s = (u32)getPixelSize();
-		u32 b = w * h * s;
+		return isRLEMode() ? 1 : 1u << m_zoom.value();
+	}
+
+	// Image size in screen pixels
+	u32 getZoomedWidth() const
+	{
+		return (u32)((std::max(getImageWidth(), 1) + getZoom() - 1) / getZoom());
+	}
+
+	u32 getZoomedHeight() const
+	{
+		return (u32)((std::max(getImageHeight(), 1) + getZoom() - 1) / getZoom());
+	}
+
+	// Room for the image in the window
+	u32 getMaxViewportWidth() const
+	{
+		return (u32)std::max(1, w() - getImageBox().x() - getSideBarWidth() - 6);
+	}
+
+	u32 getMaxViewportHeight() const
+	{
+		return (u32)std::max(1, h() - getImageBox().y() - m_imageHScroll->h());
+	}
+
+	// Part of the image shown in the window (the comparison grid takes all of it)
+	u32 getViewportWidth() const
+	{
+		return isComparing() ? getMaxViewportWidth() : std::min(getZoomedWidth(), getMaxViewportWidth());
+	}
+
+	u32 getViewportHeight() const
+	{
+		return isComparing() ? getMaxViewportHeight() : std::min(getZoomedHeight(), getMaxViewportHeight());
+	}
+
+	// Vertical scrollbar moves through the image instead of the file
+	bool isScrollingRows() const
+	{
+		return !isRLEMode() && !isComparing() && getZoomedHeight() > getViewportHeight();
+	}
+
+	// Bytes per block of the entropy heat map, 0 if it is off
+	u32 getEntropyBlockSize() const
+	{
+		return m_entropy.value() != 0 && !isRLEMode() ? EntropyEngine::kMinBlockSize << (2 * m_entropyBlock.value()) : 0;
+	}
+
+	bool isComparing() const
+	{
+		return m_compare.value() != 0 && !m_candidates.empty();
+	}
+
+	bool isDiffMode() const
+	{
+		return m_diff.value() != 0 && !isRLEMode() && m_file.isOpen();
+	}
+
+	// Offset of the compared data relative to the offset
+	i64 getDiffShift() const
+	{
+		return atoll(m_diffShift.value());
+	}
+
+	// Square-ish grid, wider than high
+	u32 getGridColumns() const
+	{
+		u32 columns = 1;
+		while(columns * columns < m_candidates.size())
+		{
+			++columns;
+		}
+		return columns;
+	}
+
+	u64 getNumVisibleBytes() const
+	{
+		u64 w = (u64)getImageWidth();
+		u64 h = (u64)getImageHeight();
+		u64 s = (u64)getPixelSize();
+		u64 b = w * h * s;
 
 		if(isDXTMode())
 		{
@@ -771,6 +1076,12 @@ public:
 		return *m_imageBox;
 	}
 
+	// Minimap and scrollbar right of the image
+	int getSideBarWidth() const
+	{
+		return m_imageScroll->w() + m_minimapBox->w();
+	}
+
 private:
 	static void ButtonCallback(Fl_Widget* widget, void* param);
 	static void OffsetCallback(Fl_Widget* widget, void* param);
@@ -784,6 +1095,24 @@ private:
 	static void OpsCallback(Fl_Widget* widget, void* param);
 	static void ScrollbarCallback(Fl_Widget* widget, void* param);
 	static void RedrawCallback(Fl_Widget* widget, void* param);
+	static void RedrawIdleCallback(void* param);
+	static void RedrawTimeoutCallback(void* param);
+	static void FrameNotify(void* param);
+	static void FrameCallback(void* param);
+	static void RleIndexNotify(void* param);
+	static void RleIndexCallback(void* param);
+	static void MinimapNotify(void* param);
+	static void MinimapCallback(void* param);
+	static void CarveListCallback(Fl_Widget* widget, void* param);
+	static void CarveNotify(void* param);
+	static void CarveCallback(void* param);
+	static void DuplicateListCallback(Fl_Widget* widget, void* param);
+	static void DuplicateNotify(void* param);
+	static void DuplicateCallback(void* param);
+	static void SearchNotify(void* param);
+	static void SearchCallback(void* param);
+	static void DiffIndexNotify(void* param);
+	static void DiffIndexCallback(void* param);
 
 	// UI controls
 	Fl_Scroll m_leftArea;
@@ -793,6 +1122,8 @@ private:
 	Fl_Box m_paletteGroup;
 	Fl_Box m_bitwiseGroup;
 	Fl_Box m_opsGroup;
+	Fl_Box m_searchGroup;
+	Fl_Box m_diffGroup;
 	Fl_Input m_width;
 	Fl_Input m_height;
 	Fl_Output m_data;
@@ -838,16 +1169,49 @@ private:
 	Fl_Check_Button m_flipV;
 	Fl_Check_Button m_flipH;
 	Fl_Check_Button m_colorCount;
+	Fl_Choice m_zoom;
+	Fl_Check_Button m_zoomAverage;
+	Fl_Check_Button m_compare;
+	Fl_Button m_suggestButton;
+	Fl_Check_Button m_entropy;
+	Fl_Choice m_entropyBlock;
+	Fl_Button m_carveButton;
+	Fl_Button m_dupButton;
+	Fl_Input m_search;
+	Fl_Button m_findPrevButton;
+	Fl_Button m_findNextButton;
+	Fl_Box m_searchStatus;
+	Fl_Check_Button m_diff;
+	Fl_Choice m_diffMode;
+	Fl_Input m_diffShift;
+	Fl_Button m_diffFileButton;
+	Fl_Button m_diffPrevButton;
+	Fl_Button m_diffNextButton;
+	Fl_Box m_diffStatus;
 	Fl_Button m_aboutButton;
+	Fl_Button m_statsButton;
 	Fl_Box* m_rightArea;
 	Fl_Box* m_imageBox;
 	Fl_Scrollbar* m_imageScroll;
+	Fl_Scrollbar* m_imageHScroll;
+	Fl_Box* m_minimapBox;
+	Fl_RGB_Image* m_minimapImage;
 	Fl_RGB_Image* m_image;
+	Fl_Double_Window* m_carveWindow; // Jump list of embedded images, created on first use
+	Fl_Choice* m_carveSort;
+	Fl_Box* m_carveStatus;
+	Fl_Hold_Browser* m_carveList;
+	Fl_Double_Window* m_dupWindow; // Duplicate blocks, created on first use
+	Fl_Box* m_dupStatus;
+	Fl_Hold_Browser* m_dupList;
 	
 	// Data
 	Point2D<int> m_windowSize; // Cached size for resize checks
-	u8* m_pixels; // Displayed pixel data in main window
-	char* m_text; // Data text full size (to avoid memory reallocs)
+	Frame m_frame; // Displayed frame in main window
+	MappedFile m_file; // Currently opened file (mapped for the whole session)
+	MappedFile m_diffFile; // Compared with the opened file, if not open the opened file is compared with itself
+	MappedWindow m_view; // Visible part of the mapped file
+	Prefetcher m_prefetcher; // Read-ahead of neighbouring windows
 	bool m_cursorChanged;
 	off_t m_accumOffset;
 	bool m_offsetChanged;
@@ -857,8 +1221,58 @@ private:
 	char m_rawMemoryFlRGBImage[sizeof(Fl_RGB_Image)];
 	u8 m_palette[256 * 3];
 	u8 m_rawPalette[256 * 4];
-	std::vector<BitwiseOp> m_bitwiseOpVec;
-	std::set<u32> m_colorSet;
+	std::vector<BitwiseOp> m_bitwiseOpVec; // One per stage widget
+	BitwiseTable m_bitwiseTable; // m_bitwiseOpVec compiled, see updateBitwiseOps
+	Renderer m_renderer; // Reads and converts frames on a worker thread
+	RleIndex m_rleIndex; // Pixel to offset index of the RLE stream
+	Minimap m_minimap; // Summary of the whole file, scanned in the background
+	CompiledFormat m_minimapFormat; // Format the minimap colors are decoded with
+	std::vector<Minimap::Cell> m_minimapCells; // To avoid memory allocs
+	std::vector<u8> m_minimapPixels;
+	ImageCarver m_carver; // Embedded images, scanned in the background
+	std::vector<ImageCarver::Hit> m_carveHits; // In list order
+	PatternSearch m_patternSearch; // Runs in the background
+	bool m_searching; // Result not shown yet
+	DiffIndex m_diffIndex; // Changed chunks of both diff sources, hashed in the background
+	DuplicateFinder m_duplicateFinder; // Repeated blocks of the file, found in the background
+	std::vector<u64> m_dupOffsets; // Offset per line of the duplicate list, ~0 for headers
+	bool m_minimapDrag; // Mouse button went down on the minimap
+	u64 m_rlePixel; // First visible pixel in RLE mode
+	u32 m_rleSkip; // Pixels of the first run which lie before the view
+	u32 m_topColors; // See Options
+	u32 m_viewX; // Scroll position inside of the image (as displayed, i.e. flipped and zoomed)
+	u32 m_viewY;
+	int m_displayedZoom; // Zoom choice the scroll position belongs to
+	std::vector<FormatCandidate> m_candidates; // Formats of the comparison grid
+	std::vector<FormatCandidate> m_configuredCandidates; // See Options::compareFormats
+	std::vector<FormatCandidate> m_suggestCandidates; // Formats scored by suggestFormats
+	std::vector<float> m_candidateScores; // Per grid cell while it shows suggestions, empty otherwise
+	FormatDetector m_formatDetector;
+	StrideDetector m_strideDetector; // Keeps its buffers between detections
+	std::vector<StrideDetector::Candidate> m_strideCandidates; // In units, see m_strideUnitWidth
+	std::vector<StrideDetector::Candidate> m_pixelSizeCandidates;
+	bool m_strideOverlay; // Detection results are shown over the image
+	off_t m_strideOffset; // Offset the data was analysed at
+	u32 m_strideUnitWidth; // Pixels per unit (4 for DXT blocks)
+	double m_strideTime; // ms
+	double m_suggestTime; // ms
+
+	// Redraw requests are merged until the event queue is empty and submitted at most once per
+	// frame interval (see RedrawCallback)
+	struct RedrawStats
+	{
+		u32 requested;
+		u32 merged; // Arrived while a redraw was pending already
+		u32 deferred; // Waited for the next frame interval
+		u32 submitted;
+		u32 presented; // Frames handed to the window
+	};
+
+	double m_frameInterval; // Seconds
+	bool m_redrawPending; // Waiting for the idle callback
+	bool m_redrawDeferred; // Waiting for the frame interval timeout
+	std::chrono::steady_clock::time_point m_lastRedraw;
+	RedrawStats m_redrawStats;
 };
 
 #endif
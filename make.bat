@@ -5,8 +5,8 @@ set arg1=%1
 set arg2=%2
 windres pdbg.rc -O coff -o pdbg.res
 IF %PROCESSOR_ARCHITECTURE% == x86 (
-g++ main.cpp -o PixelDbg.exe -mwindows -s -O3 -I%arg1% -Wint-to-pointer-cast -L%arg2% -lfltk -lgdi32 -lcomctl32 -lole32 -luuid -lcomdlg32 pdbg.res
+g++ main.cpp mappedfile.cpp prefetch.cpp decoder.cpp renderer.cpp framecache.cpp benchmark.cpp simd.cpp threadpool.cpp rleindex.cpp colorcount.cpp minimap.cpp stride.cpp entropy.cpp carver.cpp formatdetect.cpp search.cpp diffindex.cpp dupfinder.cpp -o PixelDbg.exe -mwindows -std=c++11 -s -O3 -I%arg1% -Wint-to-pointer-cast -L%arg2% -lfltk -lgdi32 -lcomctl32 -lole32 -luuid -lcomdlg32 pdbg.res
 )
 IF %PROCESSOR_ARCHITECTURE% == AMD64 (
-g++ main.cpp -o PixelDbg64.exe -mwindows -D_FILE_OFFSET_BITS=64 -s -O3 -I%arg1% -Wint-to-pointer-cast -L%arg2% -lfltk -lgdi32 -lcomctl32 -lole32 -luuid -lcomdlg32 pdbg.res
+g++ main.cpp mappedfile.cpp prefetch.cpp decoder.cpp renderer.cpp framecache.cpp benchmark.cpp simd.cpp threadpool.cpp rleindex.cpp colorcount.cpp minimap.cpp stride.cpp entropy.cpp carver.cpp formatdetect.cpp search.cpp diffindex.cpp dupfinder.cpp -o PixelDbg64.exe -mwindows -D_FILE_OFFSET_BITS=64 -std=c++11 -s -O3 -I%arg1% -Wint-to-pointer-cast -L%arg2% -lfltk -lgdi32 -lcomctl32 -lole32 -luuid -lcomdlg32 pdbg.res
 )
\ No newline at end of file
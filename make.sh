@@ -11,9 +11,9 @@ lib_dir=${args[1]}
 
 MACHINE_TYPE=`uname -m`
 if [ ${MACHINE_TYPE} == 'x86_64' ]; then
-  g++ main.cpp -D_FILE_OFFSET_BITS=64 -o pixeldbg64 -s -O3 -I$incl_dir -L$lib_dir -lfltk -lX11
+  g++ main.cpp mappedfile.cpp prefetch.cpp decoder.cpp renderer.cpp framecache.cpp benchmark.cpp simd.cpp threadpool.cpp rleindex.cpp colorcount.cpp minimap.cpp stride.cpp entropy.cpp carver.cpp formatdetect.cpp search.cpp diffindex.cpp dupfinder.cpp -D_FILE_OFFSET_BITS=64 -std=c++11 -pthread -o pixeldbg64 -s -O3 -I$incl_dir -L$lib_dir -lfltk -lX11
 else
-  g++ main.cpp -o pixeldbg -s -O3 -I$incl_dir -L$lib_dir -lfltk -lX11
+  g++ main.cpp mappedfile.cpp prefetch.cpp decoder.cpp renderer.cpp framecache.cpp benchmark.cpp simd.cpp threadpool.cpp rleindex.cpp colorcount.cpp minimap.cpp stride.cpp entropy.cpp carver.cpp formatdetect.cpp search.cpp diffindex.cpp dupfinder.cpp -std=c++11 -pthread -o pixeldbg -s -O3 -I$incl_dir -L$lib_dir -lfltk -lX11
 fi
 
 if [ -f ./pixeldbg ]
@@ -0,0 +1,481 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+const size_t MappedFile::kIdentitySampleSize = 4096;
+const size_t MappedWindow::kMinWindowSize = 64 * 1024 * 1024;
+const size_t MappedWindow::kMinCopySize = 1024 * 1024;
+
+//
+// MappedFile
+//
+MappedFile::MappedFile() :
+	#ifdef _WIN32
+	m_file(INVALID_HANDLE_VALUE),
+	m_mapping(NULL),
+	#else
+	m_fd(-1),
+	#endif
+	m_open(false),
+	m_mapped(true),
+	m_size(0),
+	m_base(NULL),
+	m_generation(0),
+	m_identity(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+size_t MappedFile::granularity()
+{
+	static size_t s_granularity = 0;
+	if(s_granularity == 0)
+	{
+		#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		s_granularity = info.dwAllocationGranularity;
+		#else
+		s_granularity = (size_t)sysconf(_SC_PAGESIZE);
+		#endif
+	}
+
+	return s_granularity;
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+	#ifdef _WIN32
+	m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	#else
+	m_fd = ::open(filename, O_RDONLY);
+	if(m_fd == -1)
+	{
+		return false;
+	}
+	#endif
+
+	m_open = true;
+
+	if(!mapWhole())
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::refresh()
+{
+	if(!m_open)
+	{
+		return false;
+	}
+
+	// Rewrites which keep the size only show in the modification time or the sampled content
+	off_t filesize;
+	u64 identity;
+	if(!queryIdentity(filesize, identity))
+	{
+		return false;
+	}
+
+	return filesize == m_size && identity == m_identity ? true : mapWhole();
+}
+
+void MappedFile::setMapped(bool mapped)
+{
+	if(mapped == m_mapped)
+	{
+		return;
+	}
+
+	// A failed remap shows on the next refresh()
+	m_mapped = mapped;
+	if(m_open)
+	{
+		mapWhole();
+	}
+}
+
+void MappedFile::close()
+{
+	if(m_base)
+	{
+		unmapRegion(m_base, (size_t)m_size);
+		m_base = NULL;
+	}
+
+	#ifdef _WIN32
+	if(m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if(m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+	#else
+	if(m_fd != -1)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+	#endif
+
+	m_open = false;
+	m_size = 0;
+	m_identity = 0;
+	++m_generation;
+}
+
+bool MappedFile::mapWhole()
+{
+	if(m_base)
+	{
+		unmapRegion(m_base, (size_t)m_size);
+		m_base = NULL;
+	}
+	++m_generation;
+
+	#ifdef _WIN32
+	if(m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	#endif
+
+	// Single stat for the file size, everything else is derived from it
+	if(!queryIdentity(m_size, m_identity))
+	{
+		return false;
+	}
+
+	#ifdef _WIN32
+	// Mapping objects can't be created for empty files
+	if(m_size > 0 && m_mapped)
+	{
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(!m_mapping)
+		{
+			return false;
+		}
+	}
+	#endif
+
+	#if IS64BIT
+	if(m_size > 0 && m_mapped)
+	{
+		// Whole file at once, falls back to windows if that fails
+		m_base = (u8*)mapRegion(0, (size_t)m_size);
+	}
+	#endif
+
+	return true;
+}
+
+bool MappedFile::queryIdentity(off_t& size, u64& identity) const
+{
+	#ifdef _WIN32
+	BY_HANDLE_FILE_INFORMATION info;
+	if(!GetFileInformationByHandle(m_file, &info))
+	{
+		return false;
+	}
+	size = (off_t)(((u64)info.nFileSizeHigh << 32) | info.nFileSizeLow);
+
+	u64 ident[4] = { info.dwVolumeSerialNumber, ((u64)info.nFileIndexHigh << 32) | info.nFileIndexLow, (u64)size,
+	                 ((u64)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime };
+	#else
+	struct stat st;
+	if(fstat(m_fd, &st) != 0)
+	{
+		return false;
+	}
+	size = st.st_size;
+
+	// Sub-second part where the platform has one, rewrites within a second are common while debugging
+	#if defined __APPLE__
+	u64 nanoseconds = (u64)st.st_mtimespec.tv_nsec;
+	#elif defined __linux__
+	u64 nanoseconds = (u64)st.st_mtim.tv_nsec;
+	#else
+	u64 nanoseconds = 0;
+	#endif
+
+	u64 ident[5] = { (u64)st.st_dev, (u64)st.st_ino, (u64)st.st_size, (u64)st.st_mtime, nanoseconds };
+	#endif
+
+	identity = hashBytes(ident, sizeof(ident));
+
+	// Timestamps miss rewrites within their granularity (or ones which restore them), the first, middle
+	// and last block of content catch most of those. Rewrites keeping all three blocks still go unnoticed.
+	off_t samples[3] = { 0, size / 2, size - (off_t)kIdentitySampleSize };
+	for(int i=0; i<3; ++i)
+	{
+		u8 sample[kIdentitySampleSize];
+		size_t length = copyRegion(sample, sizeof(sample), std::max(samples[i], (off_t)0));
+		identity = hashBytes(sample, length, identity);
+	}
+
+	return true;
+}
+
+void* MappedFile::mapRegion(off_t offset, size_t size) const
+{
+	#ifdef _WIN32
+	u64 o = (u64)offset;
+	void* view = MapViewOfFile(m_mapping, FILE_MAP_READ, (DWORD)(o >> 32), (DWORD)(o & 0xffffffff), size);
+	return view;
+	#else
+	void* view = mmap(NULL, size, PROT_READ, MAP_SHARED, m_fd, offset);
+	return view != MAP_FAILED ? view : NULL;
+	#endif
+}
+
+void MappedFile::unmapRegion(void* view, size_t size)
+{
+	#ifdef _WIN32
+	UnmapViewOfFile(view);
+	#else
+	munmap(view, size);
+	#endif
+}
+
+size_t MappedFile::copyRegion(void* out, size_t size, off_t offset) const
+{
+	size_t copied = 0;
+	while(copied < size)
+	{
+		#ifdef _WIN32
+		u64 o = (u64)offset + copied;
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = (DWORD)(o & 0xffffffff);
+		overlapped.OffsetHigh = (DWORD)(o >> 32);
+		DWORD got = 0;
+		if(!ReadFile(m_file, (u8*)out + copied, (DWORD)std::min(size - copied, (size_t)0x40000000), &got, &overlapped) || got == 0)
+		{
+			break;
+		}
+		#else
+		ssize_t got = pread(m_fd, (u8*)out + copied, size - copied, offset + (off_t)copied);
+		if(got < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(got <= 0)
+		{
+			break;
+		}
+		#endif
+
+		copied += (size_t)got;
+	}
+
+	return copied;
+}
+
+size_t MappedFile::read(void* out, size_t size, off_t offset) const
+{
+	// Straight into the caller's buffer, no window to copy through
+	if(!m_mapped)
+	{
+		if(!m_open || offset < 0 || offset >= m_size)
+		{
+			return 0;
+		}
+		return copyRegion(out, (size_t)std::min((off_t)size, m_size - offset), offset);
+	}
+
+	MappedWindow window;
+	size_t avail = window.map(*this, offset, size);
+	if(avail > 0)
+	{
+		memcpy(out, window.data(), avail);
+	}
+
+	return avail;
+}
+
+void MappedFile::willNeed(off_t offset, size_t size) const
+{
+	#ifdef _WIN32
+	// No portable read-ahead hint before Windows 8, touching the pages has to do
+	(void)offset;
+	(void)size;
+	#else
+	if(m_fd != -1)
+	{
+		posix_fadvise(m_fd, offset, (off_t)size, POSIX_FADV_WILLNEED);
+	}
+	#endif
+}
+
+
+//
+// MappedWindow
+//
+MappedWindow::MappedWindow() :
+	m_file(NULL),
+	m_generation(0),
+	m_view(NULL),
+	m_viewSize(0),
+	m_viewOffset(0),
+	m_data(NULL),
+	m_size(0),
+	m_offset(0)
+{
+}
+
+MappedWindow::~MappedWindow()
+{
+	unmap();
+}
+
+size_t MappedWindow::map(const MappedFile& file, off_t offset, size_t size)
+{
+	if(!file.isOpen() || offset < 0 || offset >= file.size())
+	{
+		unmap();
+		return 0;
+	}
+
+	size = (size_t)std::min((off_t)size, file.size() - offset);
+	m_offset = offset;
+	m_size = size;
+
+	// Whole file is mapped, nothing else to do
+	if(file.data())
+	{
+		release();
+		m_file = &file;
+		m_data = file.data() + offset;
+		return size;
+	}
+
+	// Reuse current view (or copy) if it still covers the requested range
+	if(m_viewSize > 0 && m_file == &file && m_generation == file.generation() &&
+	   offset >= m_viewOffset && offset + (off_t)size <= m_viewOffset + (off_t)m_viewSize)
+	{
+		m_data = m_view + (offset - m_viewOffset);
+		return size;
+	}
+
+	release();
+
+	if(!file.isMapped())
+	{
+		// A short copy means the file shrank since its size was queried
+		size_t length = (size_t)std::min((off_t)std::max(size, kMinCopySize), file.size() - offset);
+		m_copy.resize(length);
+		length = file.copyRegion(&m_copy[0], length, offset);
+		if(length == 0)
+		{
+			m_data = NULL;
+			m_size = 0;
+			return 0;
+		}
+
+		m_file = &file;
+		m_generation = file.generation();
+		m_viewOffset = offset;
+		m_viewSize = length;
+		m_data = &m_copy[0];
+		m_size = std::min(size, length);
+		return m_size;
+	}
+
+	// Align view start to allocation granularity and map a bit more to avoid remapping on every step
+	off_t start = offset - (offset % (off_t)MappedFile::granularity());
+	off_t length = std::max((off_t)(offset - start) + (off_t)size, (off_t)kMinWindowSize);
+	length = std::min(length, file.size() - start);
+
+	m_view = (u8*)file.mapRegion(start, (size_t)length);
+	if(!m_view)
+	{
+		m_data = NULL;
+		m_size = 0;
+		return 0;
+	}
+
+	m_file = &file;
+	m_generation = file.generation();
+	m_viewOffset = start;
+	m_viewSize = (size_t)length;
+	m_data = m_view + (offset - start);
+
+	return size;
+}
+
+void MappedWindow::unmap()
+{
+	release();
+	std::vector<u8>().swap(m_copy);
+
+	m_file = NULL;
+	m_viewOffset = 0;
+	m_data = NULL;
+	m_size = 0;
+	m_offset = 0;
+}
+
+void MappedWindow::release()
+{
+	if(m_view)
+	{
+		MappedFile::unmapRegion(m_view, m_viewSize);
+		m_view = NULL;
+	}
+
+	m_viewSize = 0;
+}
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __MAPPEDFILE_H
+#define __MAPPEDFILE_H
+
+#include <vector>
+#include "common.h"
+
+//
+// Read-only memory mapping of a whole file. The file stays open (and mapped) until
+// close() is called or another file is opened. On 64-bit builds the complete file is
+// mapped once and data() points straight at it. On 32-bit builds (or if the address
+// space is exhausted) only small windows can be mapped, see MappedWindow. Files other
+// processes may truncate aren't mapped at all (setMapped), reads and windows copy instead,
+// so a shrinking file shows as short reads rather than faults.
+//
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* filename);
+	bool refresh(); // Re-check the identity of the file, remap if it changed
+	void close();
+	void setMapped(bool mapped); // Map or copy, remaps an open file if the mode changed
+
+	// Copy bytes from the file, returns number of bytes actually copied
+	size_t read(void* out, size_t size, off_t offset) const;
+
+	// Hint that the given range will be accessed soon (asynchronous read-ahead)
+	void willNeed(off_t offset, size_t size) const;
+
+	bool isOpen() const { return m_open; }
+	bool isMapped() const { return m_mapped; }
+	bool isWindowed() const { return m_base == NULL && m_size > 0; }
+	off_t size() const { return m_size; }
+	const u8* data() const { return m_base; }
+	u32 generation() const { return m_generation; }
+	u64 identity() const { return m_identity; } // Changes if another file is opened or the file was modified
+	
+	static size_t granularity();
+
+private:
+	friend class MappedWindow;
+
+	static const size_t kIdentitySampleSize;
+
+	// Not copyable
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	bool mapWhole();
+	bool queryIdentity(off_t& size, u64& identity) const; // Size and a hash of device, index, size, modification time and sampled content
+	void* mapRegion(off_t offset, size_t size) const;
+	static void unmapRegion(void* view, size_t size);
+	size_t copyRegion(void* out, size_t size, off_t offset) const; // Short if the file shrank
+
+	#ifdef _WIN32
+	void* m_file; // HANDLE
+	void* m_mapping; // HANDLE
+	#else
+	int m_fd;
+	#endif
+	bool m_open;
+	bool m_mapped;
+	off_t m_size;
+	u8* m_base;
+	u32 m_generation; // Bumped on every (re)map so windows can detect stale views
+	u64 m_identity;
+};
+
+//
+// Addressable byte range of a MappedFile. With a whole-file mapping this is a plain
+// pointer into it, otherwise a view of at least kMinWindowSize bytes is mapped and
+// reused as long as requested ranges fall inside of it. Files which aren't mapped get
+// a copy of at least kMinCopySize bytes instead.
+//
+class MappedWindow
+{
+public:
+	static const size_t kMinWindowSize;
+	static const size_t kMinCopySize;
+
+	MappedWindow();
+	~MappedWindow();
+
+	// Make [offset, offset + size) addressable. Returns number of valid bytes (clamped to file size).
+	size_t map(const MappedFile& file, off_t offset, size_t size);
+	void unmap();
+
+	const u8* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	off_t offset() const { return m_offset; }
+
+private:
+	// Not copyable
+	MappedWindow(const MappedWindow&);
+	MappedWindow& operator=(const MappedWindow&);
+
+	void release();
+
+	const MappedFile* m_file;
+	u32 m_generation;
+	u8* m_view;
+	size_t m_viewSize;
+	off_t m_viewOffset;
+	std::vector<u8> m_copy;
+	const u8* m_data;
+	size_t m_size;
+	off_t m_offset;
+};
+
+#endif
+
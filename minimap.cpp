@@ -0,0 +1,624 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "minimap.h"
+#include "entropy.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+
+const u32 Minimap::kMaxCells = 4096;
+const u32 Minimap::kMinCellSize = 4096;
+const u32 Minimap::kSampleSize = 64 * 1024;
+const u32 Minimap::kNoiseEntropy = 240; // 7.5 bits per byte
+const u32 Minimap::kZeroShare = 250; // 98 %
+
+namespace
+{
+	const u32 kCacheMagic = 0x4d4d4450; // "PDMM"
+	const u32 kCacheVersion = 1;
+	const u32 kSamplesPerCell = 4; // Places a large cell is sampled at
+	const double kNotifyIntervalMs = 200.0; // Progress notifications are throttled to this
+	const int kCellPauseMs = 1; // Between two cells, keeps the worker from competing with the UI
+	const u64 kCacheBudget = 32 * 1024 * 1024; // Bytes of cache files kept, the least recently written go first
+
+	// Cache file header, followed by the cells
+	struct CacheHeader
+	{
+		u32 magic;
+		u32 version;
+		u64 identity;
+		u64 fileSize;
+		u64 signature;
+		u64 cellSize;
+		u32 numCells;
+		u32 numScanned;
+	};
+
+	void createDirectories(const std::string& path)
+	{
+		for(size_t i=1; i<=path.size(); ++i)
+		{
+			if(i == path.size() || path[i] == '/' || path[i] == '\\')
+			{
+				std::string dir = path.substr(0, i);
+				#ifdef _WIN32
+				CreateDirectoryA(dir.c_str(), NULL);
+				#else
+				mkdir(dir.c_str(), 0755);
+				#endif
+			}
+		}
+	}
+
+	struct CacheEntry
+	{
+		std::string path;
+		u64 size;
+		u64 time; // Last written
+	};
+
+	struct CacheEntryAge
+	{
+		bool operator()(const CacheEntry& a, const CacheEntry& b) const
+		{
+			return a.time < b.time;
+		}
+	};
+
+	// Removes the oldest cache files of the directory until the rest fits into the budget
+	void pruneCacheDir(const std::string& dir, u64 budget)
+	{
+		std::vector<CacheEntry> entries;
+
+		#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((dir + "\\*.map").c_str(), &data);
+		if(find != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				CacheEntry entry = { dir + "\\" + data.cFileName, ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow,
+				                     ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime };
+				entries.push_back(entry);
+			}
+			while(FindNextFileA(find, &data));
+			FindClose(find);
+		}
+		#else
+		DIR* d = opendir(dir.c_str());
+		if(d)
+		{
+			while(dirent* file = readdir(d))
+			{
+				std::string name = file->d_name;
+				struct stat st;
+				if(name.size() > 4 && name.compare(name.size() - 4, 4, ".map") == 0 &&
+				   stat((dir + "/" + name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+				{
+					CacheEntry entry = { dir + "/" + name, (u64)st.st_size, (u64)st.st_mtime };
+					entries.push_back(entry);
+				}
+			}
+			closedir(d);
+		}
+		#endif
+
+		u64 total = 0;
+		for(size_t i=0; i<entries.size(); ++i)
+		{
+			total += entries[i].size;
+		}
+
+		std::sort(entries.begin(), entries.end(), CacheEntryAge());
+		for(size_t i=0; i<entries.size() && total>budget; ++i)
+		{
+			if(remove(entries[i].path.c_str()) == 0)
+			{
+				total -= entries[i].size;
+			}
+		}
+	}
+}
+
+Minimap::Minimap(NotifyFunc notify, void* param) :
+	m_notify(notify),
+	m_param(param),
+	m_generation(0),
+	m_quit(false),
+	m_pending(false),
+	m_file(NULL),
+	m_identity(0),
+	m_fileSize(0),
+	m_cellSize(0),
+	m_scanned(0),
+	m_loaded(0),
+	m_saved(0),
+	m_focusFirst(0),
+	m_focusLast(0)
+{
+}
+
+Minimap::~Minimap()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+}
+
+std::string Minimap::getDefaultCacheDir()
+{
+	#ifdef _WIN32
+	const char* base = getenv("LOCALAPPDATA");
+	return base && base[0] != 0 ? std::string(base) + "\\PixelDbg\\minimap" : std::string();
+	#else
+	const char* base = getenv("XDG_CACHE_HOME");
+	if(base && base[0] != 0)
+	{
+		return std::string(base) + "/pixeldbg/minimap";
+	}
+
+	base = getenv("HOME");
+	return base && base[0] != 0 ? std::string(base) + "/.cache/pixeldbg/minimap" : std::string();
+	#endif
+}
+
+void Minimap::setCacheDir(const std::string& dir)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cacheDir = dir;
+}
+
+bool Minimap::attach(const MappedFile& file, const CompiledFormat& format)
+{
+	if(!file.isOpen() || file.size() <= 0 || !format.isValid())
+	{
+		detach();
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_file == &file && m_identity == file.identity() && m_fileSize == file.size() && m_format.signature == format.signature)
+		{
+			return false;
+		}
+	}
+
+	detach();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = &file;
+	m_identity = file.identity();
+	m_fileSize = file.size();
+	m_format = format;
+
+	// Cells are at least kMinCellSize bytes, small files get fewer of them
+	m_cellSize = std::max(((u64)m_fileSize + kMaxCells - 1) / kMaxCells, (u64)kMinCellSize);
+	Cell empty;
+	memset(&empty, 0, sizeof(empty));
+	m_cells.assign((size_t)(((u64)m_fileSize + m_cellSize - 1) / m_cellSize), empty);
+	m_focusFirst = 0;
+	m_focusLast = 0;
+
+	load();
+
+	if(m_scanned < m_cells.size())
+	{
+		m_pending = true;
+
+		// Worker is started on first use
+		if(!m_thread.joinable())
+		{
+			m_thread = std::thread(&Minimap::run, this);
+		}
+		m_cond.notify_one();
+	}
+
+	return true;
+}
+
+void Minimap::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		save();
+		m_file = NULL;
+		m_pending = false;
+		m_cells.clear();
+		m_cellSize = 0;
+		m_scanned = 0;
+		m_loaded = 0;
+		m_saved = 0;
+	}
+
+	// Wait for the sample currently being read, afterwards the worker won't access the file anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+	m_window.unmap();
+}
+
+void Minimap::setFocus(off_t offset, u64 size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if(m_cells.empty() || offset < 0)
+	{
+		return;
+	}
+
+	u32 last = (u32)m_cells.size() - 1;
+	m_focusFirst = (u32)std::min((u64)offset / m_cellSize, (u64)last);
+	m_focusLast = (u32)std::min(((u64)offset + std::max(size, (u64)1) - 1) / m_cellSize, (u64)last);
+}
+
+Minimap::Stats Minimap::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Stats stats;
+	stats.numCells = (u32)m_cells.size();
+	stats.scanned = m_scanned;
+	stats.loaded = m_loaded;
+	stats.cellSize = m_cellSize;
+	stats.complete = !m_cells.empty() && m_scanned == m_cells.size();
+	return stats;
+}
+
+void Minimap::getCells(std::vector<Cell>& cells) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	cells = m_cells;
+}
+
+u32 Minimap::getCellAt(off_t offset) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if(m_cells.empty() || offset < 0)
+	{
+		return 0;
+	}
+
+	return (u32)std::min((u64)offset / m_cellSize, (u64)m_cells.size() - 1);
+}
+
+off_t Minimap::getCellOffset(u32 cell) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (off_t)(cell * m_cellSize);
+}
+
+void Minimap::run()
+{
+	// Background work, the UI and the renderer come first
+	#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+	#elif defined __linux__
+	setpriority(PRIO_PROCESS, 0, 10); // Nice value of the calling thread only
+	#endif
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_pending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		m_pending = false;
+		u32 generation = m_generation;
+		lock.unlock();
+
+		scan(generation);
+
+		lock.lock();
+	}
+}
+
+void Minimap::scan(u32 generation)
+{
+	const MappedFile* file;
+	CompiledFormat format;
+	u64 fileSize, cellSize;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation || !m_file)
+		{
+			return;
+		}
+
+		file = m_file;
+		format = m_format;
+		fileSize = (u64)m_fileSize;
+		cellSize = m_cellSize;
+	}
+
+	m_lastNotify = std::chrono::steady_clock::time_point();
+
+	for(;;)
+	{
+		u32 cell;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation || !nextCell(cell))
+			{
+				return;
+			}
+		}
+
+		Cell result;
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			u64 start = (u64)cell * cellSize;
+			scanCell(*file, format, start, std::min(cellSize, fileSize - start), result);
+		}
+
+		bool complete;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			m_cells[cell] = result;
+			++m_scanned;
+			complete = m_scanned == m_cells.size();
+			if(complete)
+			{
+				save();
+			}
+		}
+
+		notify(complete);
+
+		if(complete)
+		{
+			return;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(kCellPauseMs));
+	}
+}
+
+bool Minimap::nextCell(u32& cell) const
+{
+	u32 numCells = (u32)m_cells.size();
+
+	for(u32 i=m_focusFirst; i<=m_focusLast && i<numCells; ++i)
+	{
+		if(!(m_cells[i].flags & CELL_Scanned))
+		{
+			cell = i;
+			return true;
+		}
+	}
+
+	// Spread out from the focus, alternating between both directions
+	for(u32 d=1; d<numCells; ++d)
+	{
+		if(m_focusLast + d < numCells && !(m_cells[m_focusLast + d].flags & CELL_Scanned))
+		{
+			cell = m_focusLast + d;
+			return true;
+		}
+
+		if(m_focusFirst >= d && !(m_cells[m_focusFirst - d].flags & CELL_Scanned))
+		{
+			cell = m_focusFirst - d;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Minimap::scanCell(const MappedFile& file, const CompiledFormat& format, u64 start, u64 length, Cell& result)
+{
+	u32 pieces = length > kSampleSize ? kSamplesPerCell : 1;
+	u32 pieceSize = pieces > 1 ? kSampleSize / pieces : (u32)length;
+	u32 ps = format.pixelSize;
+
+	u32 histogram[256];
+	memset(histogram, 0, sizeof(histogram));
+	u64 sum[3] = { 0, 0, 0 };
+	u64 numBytes = 0;
+	u64 numPixels = 0;
+
+	for(u32 i=0; i<pieces; ++i)
+	{
+		// Evenly spread over the cell, at a pixel boundary of the file
+		u64 offset = start + (length - pieceSize) * (2 * i + 1) / (2 * pieces);
+		offset -= offset % ps;
+
+		size_t size = m_window.map(file, (off_t)offset, pieceSize);
+		const u8* data = m_window.data();
+		if(!data || size == 0)
+		{
+			continue;
+		}
+
+		EntropyEngine::countBytes(data, size, histogram);
+		numBytes += size;
+
+		u32 count = (u32)(size / ps);
+		m_rgb.resize(count * 3 + 3);
+		decodeSpan(format, data, count, &m_rgb[0]);
+		for(u32 j=0; j<count * 3; j+=3)
+		{
+			sum[0] += m_rgb[j + 0];
+			sum[1] += m_rgb[j + 1];
+			sum[2] += m_rgb[j + 2];
+		}
+		numPixels += count;
+	}
+
+	memset(&result, 0, sizeof(result));
+	result.flags = CELL_Scanned;
+	if(numBytes == 0)
+	{
+		return;
+	}
+
+	double entropy = EntropyEngine::getEntropy(histogram, numBytes);
+
+	u64 n = std::max(numPixels, (u64)1);
+	result.rgb[0] = (u8)(sum[0] / n);
+	result.rgb[1] = (u8)(sum[1] / n);
+	result.rgb[2] = (u8)(sum[2] / n);
+	result.zeros = (u8)(histogram[0] * 255 / numBytes);
+	result.entropy = (u8)std::min(entropy * 32.0 + 0.5, 255.0);
+
+	if(result.zeros >= kZeroShare)
+	{
+		result.flags |= CELL_Zero;
+	}
+	else if(result.entropy >= kNoiseEntropy)
+	{
+		result.flags |= CELL_Noise;
+	}
+}
+
+std::string Minimap::getCacheFile() const
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx-%016llx.map", (unsigned long long)m_identity, (unsigned long long)m_format.signature);
+
+	#ifdef _WIN32
+	return m_cacheDir + "\\" + name;
+	#else
+	return m_cacheDir + "/" + name;
+	#endif
+}
+
+bool Minimap::load()
+{
+	if(m_cacheDir.empty() || m_cells.empty())
+	{
+		return false;
+	}
+
+	FILE* f = fopen(getCacheFile().c_str(), "rb");
+	if(!f)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	std::vector<Cell> cells(m_cells.size());
+	bool valid = fread(&header, sizeof(header), 1, f) == 1 && header.magic == kCacheMagic && header.version == kCacheVersion &&
+	             header.identity == m_identity && header.fileSize == (u64)m_fileSize && header.signature == m_format.signature &&
+	             header.cellSize == m_cellSize && header.numCells == cells.size() &&
+	             fread(&cells[0], sizeof(Cell), cells.size(), f) == cells.size();
+	fclose(f);
+
+	if(!valid)
+	{
+		return false;
+	}
+
+	m_scanned = 0;
+	for(size_t i=0; i<cells.size(); ++i)
+	{
+		if(cells[i].flags & CELL_Scanned)
+		{
+			++m_scanned;
+		}
+	}
+
+	m_cells.swap(cells);
+	m_loaded = m_scanned;
+	m_saved = m_scanned;
+
+	return true;
+}
+
+void Minimap::save()
+{
+	if(m_cacheDir.empty() || !m_file || m_scanned <= m_saved)
+	{
+		return;
+	}
+
+	createDirectories(m_cacheDir);
+
+	FILE* f = fopen(getCacheFile().c_str(), "wb");
+	if(!f)
+	{
+		return;
+	}
+
+	CacheHeader header = { kCacheMagic, kCacheVersion, m_identity, (u64)m_fileSize, m_format.signature, m_cellSize, (u32)m_cells.size(), m_scanned };
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&m_cells[0], sizeof(Cell), m_cells.size(), f) == m_cells.size();
+	fclose(f);
+
+	// A new file may push the directory over its budget
+	if(written && m_saved == 0)
+	{
+		pruneCacheDir(m_cacheDir, kCacheBudget);
+	}
+
+	if(written)
+	{
+		m_saved = m_scanned;
+	}
+}
+
+void Minimap::notify(bool force)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(force || std::chrono::duration<double, std::milli>(now - m_lastNotify).count() >= kNotifyIntervalMs)
+	{
+		m_lastNotify = now;
+		if(m_notify)
+		{
+			m_notify(m_param);
+		}
+	}
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __MINIMAP_H
+#define __MINIMAP_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "common.h"
+#include "mappedfile.h"
+#include "decoder.h"
+
+//
+// Summary of the whole file in up to kMaxCells equally sized cells: mean color of the cell
+// decoded with the current pixel format, share of zero bytes and byte entropy. Large cells
+// are sampled at a few evenly spread places. A low priority worker scans the cells around
+// the focus (the visible bytes) first and spreads out from there. Results are stored in a
+// small file per file and format in the cache directory, so a reopened file shows the
+// map immediately. The directory is kept to a size budget by removing the oldest files.
+//
+class Minimap
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	static const u32 kMaxCells;
+	static const u32 kMinCellSize;
+	static const u32 kSampleSize;
+	static const u32 kNoiseEntropy;
+	static const u32 kZeroShare;
+
+	enum CellFlags
+	{
+		CELL_Scanned = (1<<0),
+		CELL_Zero = (1<<1), // Almost only zero bytes
+		CELL_Noise = (1<<2) // High entropy (compressed or encrypted)
+	};
+
+	struct Cell
+	{
+		u8 rgb[3]; // Mean color
+		u8 flags; // CellFlags
+		u8 zeros; // Share of zero bytes (255 = all)
+		u8 entropy; // Bits per byte * 32
+		u8 reserved[2];
+	};
+
+	struct Stats
+	{
+		u32 numCells;
+		u32 scanned; // Cells scanned or loaded
+		u32 loaded; // Cells taken from the cache file
+		u64 cellSize; // In bytes
+		bool complete;
+	};
+
+	Minimap(NotifyFunc notify, void* param);
+	~Minimap();
+
+	static std::string getDefaultCacheDir(); // Per user cache directory
+
+	void setCacheDir(const std::string& dir); // Empty disables the cache files
+
+	// Starts scanning in the background unless the map already belongs to the same file and
+	// format. Previous results are loaded from the cache directory. Returns true if the map
+	// was (re)started. File must stay open until detach() is called.
+	bool attach(const MappedFile& file, const CompiledFormat& format);
+	void detach(); // Stores what was scanned so far
+
+	void setFocus(off_t offset, u64 size); // Scanned first
+
+	Stats getStats() const;
+	void getCells(std::vector<Cell>& cells) const;
+	u32 getCellAt(off_t offset) const; // Index of the cell holding the offset
+	off_t getCellOffset(u32 cell) const;
+
+private:
+	// Not copyable
+	Minimap(const Minimap&);
+	Minimap& operator=(const Minimap&);
+
+	void run();
+	void scan(u32 generation);
+	bool nextCell(u32& cell) const; // Unscanned cell closest to the focus
+	void scanCell(const MappedFile& file, const CompiledFormat& format, u64 start, u64 length, Cell& result);
+	std::string getCacheFile() const;
+	bool load();
+	void save();
+	void notify(bool force);
+
+	NotifyFunc m_notify;
+	void* m_param;
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex
+	std::mutex m_workMutex; // Held by the worker while it reads file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	std::atomic<u32> m_generation; // Bumped to abort a running scan
+	bool m_quit;
+	bool m_pending; // Scan requested
+
+	const MappedFile* m_file;
+	MappedWindow m_window; // Worker only
+	CompiledFormat m_format;
+	u64 m_identity;
+	off_t m_fileSize;
+	u64 m_cellSize;
+	std::vector<Cell> m_cells;
+	u32 m_scanned;
+	u32 m_loaded;
+	u32 m_saved; // Scanned cells in the cache file
+	u32 m_focusFirst; // Cells holding the visible bytes
+	u32 m_focusLast;
+	std::string m_cacheDir;
+	std::vector<u8> m_rgb; // Worker only
+	std::chrono::steady_clock::time_point m_lastNotify; // Worker only
+};
+
+#endif
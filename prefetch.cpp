@@ -0,0 +1,323 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include "prefetch.h"
+
+const size_t Prefetcher::kChunkSize = 1024 * 1024;
+const u32 Prefetcher::kDefaultMaxChunks = 64;
+const u32 Prefetcher::kDefaultDepth = 2;
+const u32 Prefetcher::kHistorySize;
+
+Prefetcher::Prefetcher(u32 maxChunks /* kDefaultMaxChunks */, u32 depth /* kDefaultDepth */) :
+	m_generation(0),
+	m_quit(false),
+	m_file(NULL),
+	m_maxChunks(std::max(maxChunks, 1u)),
+	m_depth(std::max(depth, 1u)),
+	m_historyPos(0),
+	m_lastOffset(0),
+	m_hasLastOffset(false)
+{
+	memset(m_history, 0, sizeof(m_history));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+Prefetcher::~Prefetcher()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+}
+
+void Prefetcher::attach(const MappedFile& file)
+{
+	detach();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = &file;
+	m_hasLastOffset = false;
+	m_historyPos = 0;
+	memset(m_history, 0, sizeof(m_history));
+
+	// Worker is started on first use
+	if(!m_thread.joinable())
+	{
+		m_thread = std::thread(&Prefetcher::run, this);
+	}
+}
+
+void Prefetcher::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		m_file = NULL;
+		m_queue.clear();
+		m_warm.clear();
+		m_stats.cachedChunks = 0;
+	}
+
+	// Wait for the chunk currently being touched, afterwards the worker won't access the file anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+	m_window.unmap();
+}
+
+bool Prefetcher::request(off_t offset, size_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(!m_file || size == 0 || offset < 0 || offset >= m_file->size())
+	{
+		return false;
+	}
+
+	size = (size_t)std::min((off_t)size, m_file->size() - offset);
+
+	++m_stats.requests;
+
+	// Hit if every chunk of the view is warm already
+	off_t first = offset / (off_t)kChunkSize;
+	off_t last = (offset + (off_t)size - 1) / (off_t)kChunkSize;
+	bool hit = true;
+	for(off_t c=first; c<=last; ++c)
+	{
+		if(!isWarm(c))
+		{
+			hit = false;
+			break;
+		}
+	}
+
+	if(hit)
+	{
+		++m_stats.hits;
+	}
+	else
+	{
+		++m_stats.misses;
+	}
+
+	// Track scroll direction and average step
+	if(m_hasLastOffset && offset != m_lastOffset)
+	{
+		m_history[m_historyPos++ % kHistorySize] = offset - m_lastOffset;
+	}
+	m_lastOffset = offset;
+	m_hasLastOffset = true;
+
+	off_t sum = 0;
+	off_t absSum = 0;
+	u32 count = std::min(m_historyPos, kHistorySize);
+	for(u32 i=0; i<count; ++i)
+	{
+		sum += m_history[i];
+		absSum += m_history[i] < 0 ? -m_history[i] : m_history[i];
+	}
+
+	int direction = 0;
+	if(count > 0 && (sum < 0 ? -sum : sum) * 2 >= absSum) // Mostly one way
+	{
+		direction = sum < 0 ? -1 : 1;
+	}
+	m_stats.direction = direction;
+
+	// Stale predictions are dropped, new targets are queued nearest first
+	m_queue.clear();
+	off_t step = std::max((off_t)size, count > 0 ? absSum / (off_t)count : (off_t)0);
+	
+	// Current view first (pages which are already warm are skipped by the worker)
+	if(!hit)
+	{
+		queueRange(offset, size);
+	}
+
+	for(u32 i=1; i<=m_depth; ++i)
+	{
+		if(direction >= 0)
+		{
+			queueRange(offset + step * (off_t)i, size);
+		}
+		if(direction <= 0)
+		{
+			queueRange(offset - step * (off_t)i, size);
+		}
+	}
+
+	// Always keep one window behind the predicted direction
+	if(direction != 0)
+	{
+		queueRange(offset - step * direction, size);
+	}
+
+	m_cond.notify_one();
+
+	return hit;
+}
+
+Prefetcher::Stats Prefetcher::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void Prefetcher::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	u32 cached = m_stats.cachedChunks;
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.cachedChunks = cached;
+}
+
+void Prefetcher::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(m_queue.empty())
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		off_t chunk = m_queue.front();
+		m_queue.pop_front();
+
+		if(isWarm(chunk))
+		{
+			continue;
+		}
+
+		// The file is only valid as long as the generation is current, detach() waits for the touch
+		u32 generation = m_generation;
+		const MappedFile* file = m_file;
+		lock.unlock();
+
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation == m_generation && file)
+			{
+				touch(file, chunk);
+			}
+		}
+
+		lock.lock();
+		if(generation == m_generation)
+		{
+			markWarm(chunk);
+			++m_stats.chunksLoaded;
+		}
+	}
+}
+
+void Prefetcher::touch(const MappedFile* file, off_t chunk)
+{
+	off_t offset = chunk * (off_t)kChunkSize;
+	if(offset >= file->size())
+	{
+		return;
+	}
+
+	size_t size = (size_t)std::min((off_t)kChunkSize, file->size() - offset);
+
+	// Let the OS read the whole chunk in one go, then fault pages into our address space
+	file->willNeed(offset, size);
+	if(!file->isMapped())
+	{
+		// Reads are copies, there are no pages to fault in
+		return;
+	}
+
+	const u8* data = file->data() ? file->data() + offset : NULL;
+	if(!data)
+	{
+		if(m_window.map(*file, offset, size) == 0)
+		{
+			return;
+		}
+		data = m_window.data();
+	}
+
+	size_t page = MappedFile::granularity();
+	volatile u8 sink = 0;
+	for(size_t i=0; i<size; i+=page)
+	{
+		sink += data[i];
+	}
+	(void)sink;
+}
+
+bool Prefetcher::isWarm(off_t chunk) const
+{
+	return std::find(m_warm.begin(), m_warm.end(), chunk) != m_warm.end();
+}
+
+void Prefetcher::markWarm(off_t chunk)
+{
+	std::deque<off_t>::iterator iter = std::find(m_warm.begin(), m_warm.end(), chunk);
+	if(iter != m_warm.end())
+	{
+		m_warm.erase(iter);
+	}
+
+	m_warm.push_back(chunk);
+
+	while(m_warm.size() > m_maxChunks)
+	{
+		m_warm.pop_front();
+		++m_stats.chunksEvicted;
+	}
+
+	m_stats.cachedChunks = (u32)m_warm.size();
+}
+
+void Prefetcher::queueRange(off_t offset, size_t size)
+{
+	off_t fileSize = m_file->size();
+	offset = std::max(offset, (off_t)0);
+	if(offset >= fileSize)
+	{
+		return;
+	}
+
+	off_t end = std::min(offset + (off_t)size, fileSize);
+	for(off_t c = offset / (off_t)kChunkSize; c * (off_t)kChunkSize < end; ++c)
+	{
+		if(!isWarm(c) && std::find(m_queue.begin(), m_queue.end(), c) == m_queue.end())
+		{
+			m_queue.push_back(c);
+		}
+	}
+}
+
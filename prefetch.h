@@ -0,0 +1,108 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __PREFETCH_H
+#define __PREFETCH_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "common.h"
+#include "mappedfile.h"
+
+//
+// Read-ahead of the view windows around the current offset. The scroll direction is
+// predicted from the last few offset changes and the windows ahead (and one behind)
+// are faulted in by a worker thread, so the UI thread only ever hits warm pages.
+// The file is tracked in chunks, the set of warm chunks is a bounded LRU.
+//
+class Prefetcher
+{
+public:
+	static const size_t kChunkSize;
+	static const u32 kDefaultMaxChunks;
+	static const u32 kDefaultDepth;
+	static const u32 kHistorySize = 4;
+
+	struct Stats
+	{
+		u32 requests; // Number of views requested by the UI
+		u32 hits; // Views which were completely warm
+		u32 misses; // Views which had to be read from disk
+		u32 chunksLoaded; // Chunks faulted in by the worker
+		u32 chunksEvicted; // Chunks dropped from the warm set
+		u32 cachedChunks; // Current number of warm chunks
+		int direction; // Last predicted direction (-1, 0 or 1)
+	};
+
+	Prefetcher(u32 maxChunks = kDefaultMaxChunks, u32 depth = kDefaultDepth);
+	~Prefetcher();
+
+	// File must stay open until detach() is called
+	void attach(const MappedFile& file);
+	void detach();
+
+	// Called on every view change, returns true if the requested view was already warm
+	bool request(off_t offset, size_t size);
+
+	Stats getStats() const;
+	void resetStats();
+
+private:
+	// Not copyable
+	Prefetcher(const Prefetcher&);
+	Prefetcher& operator=(const Prefetcher&);
+
+	void run();
+	void touch(const MappedFile* file, off_t chunk);
+	bool isWarm(off_t chunk) const;
+	void markWarm(off_t chunk);
+	void queueRange(off_t offset, size_t size);
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex
+	std::mutex m_workMutex; // Held by the worker while it touches file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	std::atomic<u32> m_generation;
+	bool m_quit;
+
+	const MappedFile* m_file;
+	MappedWindow m_window; // Worker only, used on windowed mappings
+	std::deque<off_t> m_queue; // Chunks to load (front first)
+	std::deque<off_t> m_warm; // Warm chunks (front is least recently used)
+	u32 m_maxChunks;
+	u32 m_depth;
+
+	off_t m_history[kHistorySize]; // Last offset deltas
+	u32 m_historyPos;
+	off_t m_lastOffset;
+	bool m_hasLastOffset;
+	Stats m_stats;
+};
+
+#endif
+
@@ -0,0 +1,1441 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include "renderer.h"
+
+namespace
+{
+	// Frames are only abandoned as long as the screen got something new within this time,
+	// otherwise a continuous stream of requests (scrollbar drag) would starve the display.
+	const double kMaxStarvationTime = 100.0;
+
+	// Smallest piece of a frame worth handing to another thread
+	const u32 kMinPixelsPerTask = 16384;
+
+	// More tasks than threads, so uneven tasks (i.e. rows past the end of the data) even out
+	const u32 kTasksPerThread = 4;
+
+	// Most bytes mapped for a single frame, canvas parts behind it stay black
+	#if IS64BIT
+	const u64 kMaxFrameBytes = 0x40000000;
+	#else
+	const u64 kMaxFrameBytes = 0x10000000;
+	#endif
+
+	// Pixels per axis averaged for a zoomed pixel, larger blocks are sampled evenly
+	const u32 kMaxZoomTaps = 4;
+
+	// Up to this zoom level canvas rows are decoded as a whole, above only the sampled pixels
+	const u32 kMaxRowZoom = 16;
+
+	// Most bytes the entropy heat map of a frame is computed from, zoomed out frames show
+	// it for their top part only
+	const u64 kMaxOverlayBytes = 64 * 1024 * 1024;
+
+	double elapsedMs(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Part of the file a viewport is decoded from
+	struct ViewSource
+	{
+		off_t offset;
+		u64 size;
+		Viewport view; // Relative to offset
+	};
+
+	// Only the bytes behind a canvas rectangle are mapped. Untiled rows and DXT block rows above it
+	// are skipped by moving the offset, tiles and runs have to be addressed from the canvas start.
+	bool getViewSource(const ViewState& state, u32 x, u32 y, u32 width, u32 height, ViewSource& source)
+	{
+		u32 w = state.width;
+		u32 h = state.height;
+		u32 ps = (u32)state.format.pixelSize;
+
+		if(w == 0 || h == 0 || ps == 0 || x >= w || y >= h || width == 0 || height == 0)
+		{
+			return false;
+		}
+
+		u32 vw = std::min(width, w - x);
+		u32 vh = std::min(height, h - y);
+		source.view = Viewport(w, h, x, y, vw, vh);
+		source.offset = state.offset;
+
+		if(state.DXTMode)
+		{
+			// At least a block per row, so images narrower than a block still get a (black) frame
+			u64 rowBytes = (u64)std::max(w / 4, 1u) * (state.DXTType > 1 ? 16 : 8);
+			u32 firstRow = y / 4;
+			u32 endRow = (y + vh + 3) / 4;
+
+			source.offset += (off_t)(firstRow * rowBytes);
+			source.size = (endRow - firstRow) * rowBytes;
+			source.view.y -= firstRow * 4;
+			source.view.canvasHeight -= firstRow * 4;
+		}
+		else if(state.RLEMode)
+		{
+			// Worst case is a run per pixel, plus the partly skipped first one
+			source.size = ((u64)w * (y + vh) + 1) * (ps + 1);
+		}
+		else if(state.tileX != w || state.tileY < h)
+		{
+			// Tiles (or a single tile narrower than the image) are read from the canvas start
+			source.size = (u64)w * std::max(h, state.tileY) * ps;
+		}
+		else
+		{
+			source.offset += (off_t)((u64)y * w * ps);
+			source.size = (u64)w * vh * ps;
+			source.view.y = 0;
+			source.view.canvasHeight -= y;
+		}
+
+		source.size = std::min(source.size, kMaxFrameBytes);
+
+		return source.offset >= 0 && source.size > 0;
+	}
+
+	// Visible part of the (zoomed) canvas
+	bool getZoomedView(const ViewState& state, Viewport& view)
+	{
+		u32 w = state.getZoomedWidth();
+		u32 h = state.getZoomedHeight();
+
+		if(state.zoom == 0 || state.zoom > ViewState::kMaxZoom || w == 0 || h == 0 || state.viewX >= w || state.viewY >= h || state.viewWidth == 0 || state.viewHeight == 0)
+		{
+			return false;
+		}
+
+		view = Viewport(w, h, state.viewX, state.viewY, std::min(state.viewWidth, w - state.viewX), std::min(state.viewHeight, h - state.viewY));
+		return true;
+	}
+
+	// Viewport of a frame and, at 1:1, the bytes behind it (zoomed frames map their rows while decoding)
+	bool mapView(const ViewState& state, MappedWindow& window, Viewport& view, const u8*& data, u32& size)
+	{
+		data = NULL;
+		size = 0;
+
+		if(!state.file || !state.format.valid || !getZoomedView(state, view))
+		{
+			return false;
+		}
+
+		if(state.zoom > 1)
+		{
+			return true;
+		}
+
+		ViewSource source;
+		if(!getViewSource(state, view.x, view.y, view.width, view.height, source))
+		{
+			return false;
+		}
+
+		size = (u32)window.map(*state.file, source.offset, (size_t)source.size);
+		data = window.data();
+		view = source.view;
+
+		return data != NULL && size > 0;
+	}
+
+	// Decodes count pixels of a canvas row, pixels without data are left alone
+	void decodeCanvasRow(const ViewState& state, const CompiledFormat& compiled, MappedWindow& window, u32 x, u32 y, u32 count, u8* rgbOut)
+	{
+		ViewSource source;
+		if(!getViewSource(state, x, y, count, 1, source))
+		{
+			return;
+		}
+
+		u32 length = (u32)window.map(*state.file, source.offset, (size_t)source.size);
+		if(!window.data() || length == 0)
+		{
+			return;
+		}
+
+		OutputLayout out(rgbOut, source.view.width, 1);
+
+		if(state.DXTMode)
+		{
+			convertDXT(state.format, window.data(), length, source.view, out, state.flags, state.DXTType, state.oneBitAlpha);
+		}
+		else
+		{
+			convertRaw(compiled, window.data(), length, source.view, out, state.flags, state.tileX, state.tileY);
+		}
+	}
+
+	// Zoomed out frames: every output pixel summarises a zoom x zoom block of the canvas, either
+	// by its centre pixel or by the average of up to kMaxZoomTaps x kMaxZoomTaps evenly spread
+	// pixels. Only canvas rows holding such pixels are mapped and decoded, on coarse levels
+	// only the pixels themselves. Parts are ranges of output rows.
+	void decodeZoomed(const ViewState& state, const CompiledFormat& compiled, const Viewport& view, const OutputLayout& out, u32 part, u32 numParts)
+	{
+		u32 zoom = state.zoom;
+		u32 taps = state.zoomAverage ? std::min(zoom, kMaxZoomTaps) : 1;
+		u32 first = (u32)((u64)view.height * part / numParts);
+		u32 last = (u32)((u64)view.height * (part + 1) / numParts);
+
+		MappedWindow window;
+		std::vector<u32> sums(view.width * 4); // R, G, B and number of pixels
+		std::vector<u8> row;
+
+		for(u32 r=first; r<last; ++r)
+		{
+			std::fill(sums.begin(), sums.end(), 0);
+
+			for(u32 ty=0; ty<taps; ++ty)
+			{
+				u64 y = (u64)(view.y + r) * zoom + (2 * ty + 1) * zoom / (2 * taps);
+				if(y >= state.height)
+				{
+					break;
+				}
+
+				// Whole row once, the pixels are picked from it
+				u64 left = (u64)view.x * zoom;
+				u32 count = (u32)std::min<u64>((u64)view.width * zoom, state.width - left);
+				if(zoom <= kMaxRowZoom)
+				{
+					row.assign(count * 3, 0);
+					decodeCanvasRow(state, compiled, window, (u32)left, (u32)y, count, &row[0]);
+				}
+
+				for(u32 c=0; c<view.width; ++c)
+				{
+					u32* sum = &sums[c * 4];
+
+					for(u32 tx=0; tx<taps; ++tx)
+					{
+						u64 x = (u64)c * zoom + (2 * tx + 1) * zoom / (2 * taps);
+						if(x >= count)
+						{
+							break;
+						}
+
+						u8 pixel[3] = { 0, 0, 0 };
+						const u8* rgb = pixel;
+						if(zoom <= kMaxRowZoom)
+						{
+							rgb = &row[x * 3];
+						}
+						else
+						{
+							decodeCanvasRow(state, compiled, window, (u32)(left + x), (u32)y, 1, pixel);
+						}
+
+						sum[0] += rgb[0];
+						sum[1] += rgb[1];
+						sum[2] += rgb[2];
+						++sum[3];
+					}
+				}
+			}
+
+			for(u32 c=0; c<view.width; ++c)
+			{
+				const u32* sum = &sums[c * 4];
+				u8* dest = out.pixel(c, r);
+				u32 n = std::max(sum[3], 1u);
+
+				dest[0] = (u8)(sum[0] / n);
+				dest[1] = (u8)(sum[1] / n);
+				dest[2] = (u8)(sum[2] / n);
+			}
+		}
+	}
+
+	// Position of the viewport's first row counted in (zoomed) rows from the start of the file,
+	// plus a key of everything else. Views with the same key are shifted copies of each other
+	// and share their rows. Only available if rows follow each other in the file.
+	bool getRowPosition(const ViewState& state, FrameKey& key, u64& top)
+	{
+		if(state.RLEMode || (!state.DXTMode && (state.tileX != state.width || state.tileY < state.height)) || state.offset < 0)
+		{
+			return false;
+		}
+
+		// Bytes per row, or per block row of 4 rows
+		u64 stride = state.DXTMode ? (u64)std::max(state.width / 4, 1u) * (state.DXTType > 1 ? 16 : 8) : (u64)state.width * state.format.pixelSize;
+		u64 rowsPerStride = state.DXTMode ? 4 : 1;
+		if(stride == 0)
+		{
+			return false;
+		}
+
+		u64 canvasTop = (u64)state.offset / stride * rowsPerStride;
+		top = canvasTop / state.zoom + state.viewY;
+
+		key = FrameKey(state);
+		key.offset = (u64)state.offset % stride;
+		key.height = 0;
+		key.viewY = (u32)(canvasTop % state.zoom);
+		key.rehash();
+
+		return true;
+	}
+
+	// Whether a decoded row only depends on its position, rows cut off at the end of the mapping
+	// or the canvas would change once they are scrolled further in
+	bool isRowComplete(const ViewState& state, const Viewport& view, u32 size, u32 row)
+	{
+		if(state.zoom > 1)
+		{
+			return (u64)(state.viewY + row + 1) * state.zoom <= state.height;
+		}
+
+		if(state.DXTMode)
+		{
+			u64 stride = (u64)std::max(state.width / 4, 1u) * (state.DXTType > 1 ? 16 : 8);
+			return ((view.y + row) / 4 + 1) * stride <= size;
+		}
+
+		return (u64)(view.y + row + 1) * state.width * state.format.pixelSize <= size;
+	}
+
+	// Copy of a frame mirrored along the given axes
+	void orientFrame(const u8* src, u8* dst, u32 width, u32 height, bool flipV, bool flipH)
+	{
+		size_t rowSize = (size_t)width * 3;
+		for(u32 y=0; y<height; ++y)
+		{
+			const u8* in = src + (size_t)(flipV ? height - 1 - y : y) * rowSize;
+			u8* out = dst + (size_t)y * rowSize;
+
+			if(!flipH)
+			{
+				memcpy(out, in, rowSize);
+				continue;
+			}
+
+			for(u32 x=0; x<width; ++x)
+			{
+				const u8* p = in + (size_t)(width - 1 - x) * 3;
+				out[x * 3 + 0] = p[0];
+				out[x * 3 + 1] = p[1];
+				out[x * 3 + 2] = p[2];
+			}
+		}
+	}
+
+	struct DecodeJob
+	{
+		const ViewState* state;
+		const CompiledFormat* format;
+		const u8* data;
+		u32 size;
+		Viewport view;
+		OutputLayout out;
+		u32 numTasks;
+	};
+
+	void decodeTask(void* param, u32 task)
+	{
+		const DecodeJob* job = static_cast<const DecodeJob*>(param);
+		const ViewState& state = *job->state;
+
+		if(state.zoom > 1)
+		{
+			decodeZoomed(state, *job->format, job->view, job->out, task, job->numTasks);
+		}
+		else if(state.DXTMode)
+		{
+			convertDXT(state.format, job->data, job->size, job->view, job->out, state.flags, state.DXTType, state.oneBitAlpha, task, job->numTasks);
+		}
+		else
+		{
+			convertRaw(*job->format, job->data, job->size, job->view, job->out, state.flags, state.tileX, state.tileY, task, job->numTasks);
+		}
+	}
+
+	// Runs a decode job on the pool, or on the calling thread if there is none
+	void decodeView(const ViewState& state, const Viewport& view, const u8* data, u32 size, CompiledFormat& compiled, ThreadPool* pool, u32 numTasks, const OutputLayout& out)
+	{
+		const BitwiseTable* bwTable = state.bitwise ? &state.bwTable : NULL;
+
+		// RLE has to be walked from the start, everything else is split across the pool
+		if(state.RLEMode && !state.DXTMode)
+		{
+			if(compiled.compile(state.format, state.flags, NULL, bwTable))
+			{
+				convertRLE(compiled, data, size, view, out, state.RLmask, state.RLmsb, state.RLskip);
+			}
+			return;
+		}
+
+		if(!state.DXTMode && !compiled.compile(state.format, state.flags, state.paletteMode ? state.palette : NULL, bwTable))
+		{
+			return;
+		}
+
+		DecodeJob job;
+		job.state = &state;
+		job.format = &compiled;
+		job.data = data;
+		job.size = size;
+		job.view = view;
+		job.out = out;
+		job.numTasks = pool ? numTasks : 1;
+
+		if(pool)
+		{
+			pool->run(decodeTask, &job, job.numTasks);
+		}
+		else
+		{
+			decodeTask(&job, 0);
+		}
+	}
+
+	// View of a comparison grid cell: the top left of the canvas decoded with the candidate's format
+	bool getCandidateState(const ViewState& state, u32 index, ViewState& cell)
+	{
+		const FormatCandidate& candidate = state.candidates[index];
+		u32 x, y, width, height;
+		if(!state.getGridCell(index, x, y, width, height) || !candidate.format.valid)
+		{
+			return false;
+		}
+
+		cell = state;
+		cell.candidates.clear();
+		cell.format = candidate.format;
+		cell.flags = 0;
+		cell.zoom = 1;
+		cell.viewX = 0;
+		cell.viewY = 0;
+		cell.viewWidth = std::min(width, state.width);
+		cell.viewHeight = std::min(height, state.height);
+		cell.RLEMode = false;
+		cell.DXTMode = candidate.kind == FormatCandidate::FC_DXT;
+		cell.DXTType = candidate.DXTType;
+		cell.oneBitAlpha = cell.DXTMode && candidate.DXTType == 1 && candidate.format.rgbaBits[3] == 1;
+		cell.paletteMode = candidate.kind == FormatCandidate::FC_Palette || candidate.kind == FormatCandidate::FC_Gray;
+
+		if(candidate.kind == FormatCandidate::FC_Gray)
+		{
+			for(u32 i=0; i<256; ++i)
+			{
+				cell.palette[i * 3 + 0] = cell.palette[i * 3 + 1] = cell.palette[i * 3 + 2] = (u8)i;
+			}
+		}
+
+		return true;
+	}
+
+	// Cell of a frame pitch wide frame, flipped like a whole frame
+	OutputLayout getCellLayout(u8* frame, u32 pitch, u32 x, u32 y, u32 width, u32 height, bool flipV, bool flipH)
+	{
+		OutputLayout out;
+		out.origin = frame + ((size_t)y * pitch + x) * 3;
+		out.rowStride = (ptrdiff_t)pitch * 3;
+		out.width = width;
+		out.height = height;
+
+		if(flipV)
+		{
+			out.origin += (ptrdiff_t)(height - 1) * out.rowStride;
+			out.rowStride = -out.rowStride;
+		}
+
+		if(flipH)
+		{
+			out.origin += (ptrdiff_t)(width - 1) * 3;
+			out.pixelStride = -3;
+		}
+
+		return out;
+	}
+
+	// Tasks are interleaved over the jobs, so every candidate gets its parts going right away
+	struct GridJob
+	{
+		DecodeJob* jobs;
+		u32 numJobs;
+	};
+
+	void gridTask(void* param, u32 task)
+	{
+		const GridJob* grid = static_cast<const GridJob*>(param);
+		decodeTask(&grid->jobs[task % grid->numJobs], task / grid->numJobs);
+	}
+};
+
+//
+// ViewState
+//
+const u32 ViewState::kMaxZoom = 4096;
+
+ViewState::ViewState() :
+	file(NULL),
+	offset(0),
+	width(0),
+	height(0),
+	viewX(0),
+	viewY(0),
+	viewWidth(0),
+	viewHeight(0),
+	windowWidth(0),
+	windowHeight(0),
+	zoom(1),
+	zoomAverage(false),
+	flags(0),
+	tileX(0),
+	tileY(0),
+	paletteMode(false),
+	bitwise(false),
+	DXTMode(false),
+	DXTType(1),
+	oneBitAlpha(false),
+	RLEMode(false),
+	RLmask(0xff),
+	RLmsb(false),
+	RLskip(0),
+	flipV(false),
+	flipH(false),
+	countColors(false),
+	topColors(0),
+	entropyBlockSize(0),
+	gridColumns(0),
+	diffFile(NULL),
+	diffOffset(0),
+	diffMode(DM_Xor)
+{
+	memset(&format, 0, sizeof(format));
+	memset(palette, 0, sizeof(palette));
+}
+
+bool ViewState::zoomTo(u32 level)
+{
+	if(level == 0 || level > kMaxZoom || (level & (level - 1)) != 0 || RLEMode || width == 0 || height == 0 || zoom == 0)
+	{
+		return false;
+	}
+
+	// Canvas position in the centre of the viewport
+	u64 centreX = ((u64)viewX * 2 + viewWidth) * zoom / 2;
+	u64 centreY = ((u64)viewY * 2 + viewHeight) * zoom / 2;
+
+	zoom = level;
+	u32 w = getZoomedWidth();
+	u32 h = getZoomedHeight();
+	viewWidth = std::max(1u, std::min(w, windowWidth));
+	viewHeight = std::max(1u, std::min(h, windowHeight));
+	viewX = (u32)std::min<u64>(centreX / zoom - std::min<u64>(centreX / zoom, viewWidth / 2), w - viewWidth);
+	viewY = (u32)std::min<u64>(centreY / zoom - std::min<u64>(centreY / zoom, viewHeight / 2), h - viewHeight);
+
+	return true;
+}
+
+bool ViewState::getGridCell(u32 index, u32& x, u32& y, u32& width, u32& height) const
+{
+	u32 n = (u32)candidates.size();
+	if(index >= n || gridColumns == 0)
+	{
+		return false;
+	}
+
+	u32 rows = (n + gridColumns - 1) / gridColumns;
+	width = viewWidth / gridColumns;
+	height = viewHeight / rows;
+	x = (index % gridColumns) * width;
+	y = (index / gridColumns) * height;
+
+	return width > 0 && height > 0;
+}
+
+
+//
+// Frame
+//
+Frame::Frame() :
+	width(0),
+	height(0),
+	serial(0),
+	colorsCounted(false),
+	numColors(0),
+	paletteUsed(false),
+	paletteMin(0),
+	paletteMax(0),
+	renderTime(0.0),
+	stagesRun(0),
+	numThreads(1),
+	cached(false)
+{
+	std::fill(stageTime, stageTime + RS_NumStages, 0.0);
+}
+
+
+//
+// Renderer
+//
+Renderer::Renderer(NotifyFunc notify, void* param, size_t cacheBudget /* FrameCache::kDefaultBudget */, u32 numThreads /* 0 */) :
+	m_notify(notify),
+	m_param(param),
+	m_latestSerial(0),
+	m_quit(false),
+	m_hasPending(false),
+	m_hasReady(false),
+	m_cache(cacheBudget),
+	m_pool(numThreads),
+	m_countTopColors(0),
+	m_numColors(0),
+	m_counted(false)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_thread = std::thread(&Renderer::run, this);
+}
+
+Renderer::~Renderer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+		++m_latestSerial;
+	}
+	m_cond.notify_all();
+	m_thread.join();
+}
+
+u32 Renderer::submit(const ViewState& state)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(m_hasPending)
+	{
+		++m_stats.dropped;
+	}
+
+	m_pending = state;
+	m_hasPending = true;
+	++m_stats.submitted;
+
+	u32 serial = ++m_latestSerial;
+	m_cond.notify_one();
+
+	return serial;
+}
+
+void Renderer::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_hasPending = false;
+		++m_latestSerial;
+	}
+
+	// Wait for the frame in progress, it will notice the serial change and bail out
+	std::lock_guard<std::mutex> work(m_workMutex);
+	m_window.unmap();
+}
+
+bool Renderer::takeFrame(Frame& frame)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(!m_hasReady)
+	{
+		return false;
+	}
+
+	std::swap(frame, m_ready);
+	m_hasReady = false;
+
+	return true;
+}
+
+Renderer::Stats Renderer::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void Renderer::run()
+{
+	std::chrono::steady_clock::time_point lastPresent = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_hasPending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		ViewState state = m_pending;
+		u32 serial = m_latestSerial;
+		m_hasPending = false;
+		lock.unlock();
+
+		bool done = false;
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			
+			// Only allow cancellation if the display isn't starving
+			bool cancellable = elapsedMs(lastPresent) < kMaxStarvationTime;
+			done = !isStale(serial) && render(state, serial, cancellable, true, m_work);
+		}
+
+		lock.lock();
+		if(done && !m_quit)
+		{
+			std::swap(m_work, m_ready);
+			m_hasReady = true;
+			++m_stats.rendered;
+			m_stats.lastRenderTime = m_ready.renderTime;
+			for(u32 i=0; i<RS_NumStages; ++i)
+			{
+				m_stats.stageRuns[i] += (m_ready.stagesRun >> i) & 1;
+			}
+			lastPresent = std::chrono::steady_clock::now();
+
+			lock.unlock();
+			m_notify(m_param);
+			lock.lock();
+
+			// Nothing else to do, get the neighbouring zoom levels ready
+			if(!m_hasPending && !m_quit)
+			{
+				lock.unlock();
+				prerender(state, serial);
+				lock.lock();
+			}
+		}
+		else
+		{
+			++m_stats.cancelled;
+		}
+	}
+}
+
+void Renderer::prerender(const ViewState& state, u32 serial)
+{
+	if(!state.candidates.empty())
+	{
+		return;
+	}
+
+	u32 levels[2] = { state.zoom * 2, state.zoom / 2 };
+
+	for(u32 i=0; i<2; ++i)
+	{
+		ViewState next = state;
+		if(!next.zoomTo(levels[i]))
+		{
+			continue;
+		}
+
+		// Only the decoded pixels end up in the cache
+		next.countColors = false;
+
+		std::lock_guard<std::mutex> work(m_workMutex);
+		if(isStale(serial) || !render(next, serial, true, false, m_prerendered))
+		{
+			return;
+		}
+
+		if(!m_prerendered.cached)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_stats.prerendered;
+		}
+	}
+}
+
+bool Renderer::render(const ViewState& state, u32 serial, bool cancellable, bool reuseRows, Frame& frame)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if(!state.candidates.empty())
+	{
+		return renderGrid(state, serial, cancellable, frame);
+	}
+
+	if(state.diffFile)
+	{
+		return renderDiff(state, serial, cancellable, reuseRows, frame);
+	}
+
+	#define RENDER_CANCEL_POINT() if(cancellable && isStale(serial)) { return false; }
+
+	Viewport view;
+	if(!state.file || !state.format.valid || !getZoomedView(state, view))
+	{
+		return false;
+	}
+
+	u32 w = view.width;
+	u32 h = view.height;
+	u32 size = w * h * 3;
+
+	frame.pixels.resize(size);
+	frame.width = w;
+	frame.height = h;
+	frame.serial = serial;
+	frame.colorsCounted = false;
+	frame.topColors.clear();
+	frame.paletteUsed = false;
+	frame.numThreads = m_pool.getNumThreads();
+	frame.cached = false;
+	frame.stagesRun = 0;
+	std::fill(frame.stageTime, frame.stageTime + RS_NumStages, 0.0);
+
+	// Bitwise ops are a pass of their own over the decoded frame, so changing them doesn't decode
+	// again. Only on unzoomed rows with data for every pixel, pixels without data have to stay
+	// black and averaged samples need the table each, there it stays in the decoder.
+	FrameKey key(state);
+	FrameKey plainKey = key;
+	bool bitwisePass = key.bitwiseHash != 0 && state.zoom == 1 && !state.RLEMode && state.tileX == state.width && state.tileY >= state.height &&
+		key.entropyBlockSize == 0 && key.highlightHash == 0;
+	if(bitwisePass)
+	{
+		plainKey.bitwiseHash = 0;
+		plainKey.rehash();
+	}
+
+	// Revisited views (same offset and format) come straight from the cache
+	m_entry.pixels.swap(frame.pixels);
+	bool cached = m_cache.lookup(key, m_entry);
+	m_entry.pixels.swap(frame.pixels);
+
+	if(!cached && !derive(key, plainKey, state, frame))
+	{
+		u8* pixels = &frame.pixels[0];
+
+		// Read (straight from the mapping, only what lies behind the viewport)
+		Viewport zoomedView = view;
+		std::chrono::steady_clock::time_point fetchStart = std::chrono::steady_clock::now();
+		const u8* text = NULL;
+		u32 length = 0;
+		if(!mapView(state, m_window, view, text, length))
+		{
+			return false;
+		}
+		frame.stageTime[RS_Fetch] = elapsedMs(fetchStart);
+		frame.stagesRun |= 1 << RS_Fetch;
+
+		RENDER_CANCEL_POINT();
+
+		// Pixels without data stay black, the bitwise table mustn't tint them now or in derive()
+		m_entry.complete = isRowComplete(state, view, length, h - 1);
+		if(bitwisePass && !m_entry.complete)
+		{
+			bitwisePass = false;
+		}
+
+		ViewState plainState;
+		if(bitwisePass)
+		{
+			plainState = state;
+			plainState.bitwise = false;
+		}
+		const ViewState& decodeState = bitwisePass ? plainState : state;
+
+		// Wipe old data
+		memset(pixels, 0, size);
+
+		// Scrolling keeps the rows which stay visible
+		std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+		u32 decoded = h;
+		if(reuseRows)
+		{
+			decoded = decodeScrolled(decodeState, view, text, length, pixels);
+		}
+		else
+		{
+			decode(decodeState, view, text, length, pixels);
+		}
+		frame.stageTime[RS_Decode] = elapsedMs(decodeStart);
+		frame.stagesRun |= 1 << RS_Decode;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.decodedRows += decoded;
+			m_stats.reusedRows += h - decoded;
+		}
+
+		// Recalculate used min/max indices in palette mode (not on zoomed frames, their rows aren't mapped as a whole)
+		m_entry.paletteUsed = state.paletteMode && text;
+		if(m_entry.paletteUsed)
+		{
+			u8 inmin = 255, inmax = 0;
+
+			for(u32 i=0; i<length; ++i)
+			{
+				u8 index = text[i];
+				if(index < inmin) inmin = index;
+				else if(index > inmax) inmax = index;
+			}
+
+			m_entry.paletteMin = inmin;
+			m_entry.paletteMax = inmax;
+		}
+
+		// The frame without its bitwise ops is kept as well, the next change of them starts from there
+		if(bitwisePass)
+		{
+			m_entry.pixels.swap(frame.pixels);
+			m_cache.insert(plainKey, m_entry);
+			m_entry.pixels.swap(frame.pixels);
+
+			std::chrono::steady_clock::time_point bitwiseStart = std::chrono::steady_clock::now();
+			state.bwTable.apply(pixels, w * h);
+			frame.stageTime[RS_Bitwise] = elapsedMs(bitwiseStart);
+			frame.stagesRun |= 1 << RS_Bitwise;
+		}
+
+		if(key.entropyBlockSize > 0)
+		{
+			std::chrono::steady_clock::time_point entropyStart = std::chrono::steady_clock::now();
+			overlayEntropy(state, zoomedView, pixels);
+			frame.stageTime[RS_Entropy] = elapsedMs(entropyStart);
+			frame.stagesRun |= 1 << RS_Entropy;
+		}
+
+		if(key.highlightHash != 0)
+		{
+			std::chrono::steady_clock::time_point highlightStart = std::chrono::steady_clock::now();
+			overlayHighlights(state, zoomedView, pixels);
+			frame.stageTime[RS_Highlight] = elapsedMs(highlightStart);
+			frame.stagesRun |= 1 << RS_Highlight;
+		}
+
+		m_entry.pixels.swap(frame.pixels);
+		m_cache.insert(key, m_entry);
+		m_entry.pixels.swap(frame.pixels);
+	}
+
+	frame.cached = cached;
+	frame.paletteUsed = m_entry.paletteUsed;
+	frame.paletteMin = m_entry.paletteMin;
+	frame.paletteMax = m_entry.paletteMax;
+
+	RENDER_CANCEL_POINT();
+	
+	// Count colors ? Only again if the pixels changed since the last count.
+	if(state.countColors)
+	{
+		std::chrono::steady_clock::time_point countStart = std::chrono::steady_clock::now();
+
+		if(!m_counted || !(m_countKey == key) || m_countTopColors != state.topColors)
+		{
+			const u8* pixels = &frame.pixels[0];
+			m_numColors = m_colorCounter.count(pixels, w * h, &m_pool);
+			m_colorCounter.getTopColors(pixels, w * h, state.topColors, m_topColors);
+			m_countKey = key;
+			m_countTopColors = state.topColors;
+			m_counted = true;
+			frame.stagesRun |= 1 << RS_Statistics;
+		}
+
+		frame.numColors = m_numColors;
+		frame.topColors = m_topColors;
+		frame.colorsCounted = true;
+		frame.stageTime[RS_Statistics] = elapsedMs(countStart);
+	}
+
+	#undef RENDER_CANCEL_POINT
+
+	frame.renderTime = elapsedMs(start);
+
+	return true;
+}
+
+bool Renderer::derive(const FrameKey& key, const FrameKey& plainKey, const ViewState& state, Frame& frame)
+{
+	// Same rectangle with other flips, or without the bitwise ops and with any flips
+	bool bitwisePass = !(plainKey == key);
+	FrameKey source;
+	bool found = false;
+
+	for(u32 i=0; i<8 && !found; ++i)
+	{
+		bool plain = i >= 4;
+		if((plain && !bitwisePass) || i == 0)
+		{
+			continue;
+		}
+
+		source = plain ? plainKey : key;
+		source.flipV = key.flipV ^ (i & 1);
+		source.flipH = key.flipH ^ ((i >> 1) & 1);
+		source.rehash();
+		found = m_cache.contains(source) && m_cache.lookup(source, m_entry) && (!plain || m_entry.complete);
+	}
+
+	if(!found || m_entry.pixels.size() != frame.pixels.size())
+	{
+		return false;
+	}
+
+	// Flips are mirrored copies of the cached frame
+	if(source.flipV != key.flipV || source.flipH != key.flipH)
+	{
+		std::chrono::steady_clock::time_point orientStart = std::chrono::steady_clock::now();
+		orientFrame(&m_entry.pixels[0], &frame.pixels[0], frame.width, frame.height, source.flipV != key.flipV, source.flipH != key.flipH);
+		frame.stageTime[RS_Orientation] = elapsedMs(orientStart);
+		frame.stagesRun |= 1 << RS_Orientation;
+	}
+	else
+	{
+		m_entry.pixels.swap(frame.pixels);
+	}
+
+	if(source.bitwiseHash != key.bitwiseHash)
+	{
+		std::chrono::steady_clock::time_point bitwiseStart = std::chrono::steady_clock::now();
+		state.bwTable.apply(&frame.pixels[0], frame.width * frame.height);
+		frame.stageTime[RS_Bitwise] = elapsedMs(bitwiseStart);
+		frame.stagesRun |= 1 << RS_Bitwise;
+	}
+
+	m_entry.pixels.swap(frame.pixels);
+	m_cache.insert(key, m_entry);
+	m_entry.pixels.swap(frame.pixels);
+
+	return true;
+}
+
+void Renderer::overlayEntropy(const ViewState& state, const Viewport& view, u8* pixels)
+{
+	u32 blockSize = state.entropyBlockSize;
+	u32 zoom = state.zoom;
+	u32 unitSize = state.DXTMode ? (state.DXTType > 1 ? 16 : 8) : (u32)state.format.pixelSize;
+	u32 unitWidth = state.DXTMode ? 4 : 1; // Pixels per unit and axis
+	u64 rowBytes = (u64)std::max(state.width / unitWidth, 1u) * unitSize;
+
+	// Bytes behind the canvas rows of the view, in blocks aligned to the file so the heat map
+	// stays put while scrolling
+	u64 firstRow = (u64)view.y * zoom / unitWidth;
+	u64 endRow = (std::min((u64)(view.y + view.height) * zoom, (u64)state.height) + unitWidth - 1) / unitWidth;
+	u64 start = (u64)state.offset + firstRow * rowBytes;
+	u64 first = start / blockSize * blockSize;
+	u64 end = std::min((u64)state.offset + endRow * rowBytes, first + kMaxOverlayBytes);
+	end = (end + blockSize - 1) / blockSize * blockSize;
+
+	size_t size = m_entropyWindow.map(*state.file, (off_t)first, (size_t)(end - first));
+	if(!m_entropyWindow.data() || size == 0)
+	{
+		return;
+	}
+
+	EntropyEngine::computeBlocks(m_entropyWindow.data(), size, blockSize, m_entropy, &m_pool);
+	u64 numBlocks = m_entropy.size();
+	m_heat.resize(numBlocks * 3);
+	for(u64 i=0; i<numBlocks; ++i)
+	{
+		EntropyEngine::getHeatColor(m_entropy[i], &m_heat[i * 3]);
+	}
+
+	// Every pixel is blended half and half with the block holding its unit (tiles are ignored
+	// like when picking offsets), pixels behind the mapped bytes keep their color
+	OutputLayout out(pixels, view.width, view.height, state.flipV, state.flipH);
+	for(u32 y=0; y<view.height; ++y)
+	{
+		u64 cy = std::min((u64)(view.y + y) * zoom + zoom / 2, (u64)state.height - 1);
+		u64 rowOffset = (u64)state.offset + cy / unitWidth * rowBytes - first;
+
+		for(u32 x=0; x<view.width; ++x)
+		{
+			u64 cx = std::min((u64)(view.x + x) * zoom + zoom / 2, (u64)state.width - 1);
+			u64 block = (rowOffset + cx / unitWidth * unitSize) / blockSize;
+			if(block >= numBlocks)
+			{
+				continue;
+			}
+
+			const u8* heat = &m_heat[block * 3];
+			u8* p = out.pixel(x, y);
+			p[0] = (u8)((p[0] + heat[0] + 1) >> 1);
+			p[1] = (u8)((p[1] + heat[1] + 1) >> 1);
+			p[2] = (u8)((p[2] + heat[2] + 1) >> 1);
+		}
+	}
+}
+
+void Renderer::overlayHighlights(const ViewState& state, const Viewport& view, u8* pixels)
+{
+	u32 zoom = state.zoom;
+	u32 unitSize = state.DXTMode ? (state.DXTType > 1 ? 16 : 8) : (u32)state.format.pixelSize;
+	u32 unitWidth = state.DXTMode ? 4 : 1;
+	u64 rowBytes = (u64)std::max(state.width / unitWidth, 1u) * unitSize;
+	const std::vector<ByteRange>& ranges = state.highlights;
+
+	// Pixels whose unit starts in a range are tinted magenta (tiles are ignored like by the heat
+	// map). Offsets only grow through the canvas, so the ranges are walked through once.
+	OutputLayout out(pixels, view.width, view.height, state.flipV, state.flipH);
+	size_t range = 0;
+	for(u32 y=0; y<view.height; ++y)
+	{
+		u64 cy = std::min((u64)(view.y + y) * zoom + zoom / 2, (u64)state.height - 1);
+		u64 rowOffset = (u64)state.offset + cy / unitWidth * rowBytes;
+
+		for(u32 x=0; x<view.width; ++x)
+		{
+			u64 cx = std::min((u64)(view.x + x) * zoom + zoom / 2, (u64)state.width - 1);
+			u64 offset = rowOffset + cx / unitWidth * unitSize;
+			while(range < ranges.size() && ranges[range].offset + ranges[range].size <= offset)
+			{
+				++range;
+			}
+			if(range == ranges.size())
+			{
+				break;
+			}
+			if(offset < ranges[range].offset)
+			{
+				continue;
+			}
+
+			u8* p = out.pixel(x, y);
+			p[0] = (u8)((p[0] + 256) >> 1);
+			p[1] = (u8)(p[1] >> 1);
+			p[2] = (u8)((p[2] + 256) >> 1);
+		}
+	}
+}
+
+bool Renderer::renderGrid(const ViewState& state, u32 serial, bool cancellable, Frame& frame)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	u32 w = state.viewWidth;
+	u32 h = state.viewHeight;
+	u32 n = (u32)state.candidates.size();
+	if(!state.file || w == 0 || h == 0 || state.offset < 0)
+	{
+		return false;
+	}
+
+	// Every cell is read from the view's offset on, so one mapping of the largest one serves all
+	std::vector<ViewState> cells(n);
+	std::vector<ViewSource> sources(n);
+	std::vector<u8> used(n, 0);
+	u64 bytes = 0;
+
+	for(u32 i=0; i<n; ++i)
+	{
+		ViewSource& source = sources[i];
+		if(getCandidateState(state, i, cells[i]) && getViewSource(cells[i], 0, 0, cells[i].viewWidth, cells[i].viewHeight, source))
+		{
+			used[i] = 1;
+			bytes = std::max(bytes, (u64)(source.offset - state.offset) + source.size);
+		}
+	}
+
+	bytes = std::min(bytes, kMaxFrameBytes);
+	std::chrono::steady_clock::time_point fetchStart = std::chrono::steady_clock::now();
+	u32 length = bytes > 0 ? (u32)m_window.map(*state.file, state.offset, (size_t)bytes) : 0;
+	const u8* text = m_window.data();
+	if(!text || length == 0)
+	{
+		return false;
+	}
+	double fetchTime = elapsedMs(fetchStart);
+
+	if(cancellable && isStale(serial))
+	{
+		return false;
+	}
+
+	frame.pixels.assign((size_t)w * h * 3, 0);
+	frame.width = w;
+	frame.height = h;
+	frame.serial = serial;
+	frame.colorsCounted = false;
+	frame.topColors.clear();
+	frame.paletteUsed = false;
+	frame.stagesRun = 1 << RS_Fetch;
+	std::fill(frame.stageTime, frame.stageTime + RS_NumStages, 0.0);
+	frame.stageTime[RS_Fetch] = fetchTime;
+	frame.numThreads = m_pool.getNumThreads();
+	frame.cached = false;
+
+	// One job per candidate, all of them split across the pool in a single run
+	std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+	m_gridCompiled.resize(n);
+	std::vector<DecodeJob> jobs;
+	u32 numTasks = 1;
+
+	for(u32 i=0; i<n; ++i)
+	{
+		const ViewState& cell = cells[i];
+		const ViewSource& source = sources[i];
+		u64 delta = (u64)(source.offset - state.offset);
+		if(!used[i] || delta >= length)
+		{
+			continue;
+		}
+
+		if(!cell.DXTMode && !m_gridCompiled[i].compile(cell.format, cell.flags, cell.paletteMode ? cell.palette : NULL, cell.bitwise ? &cell.bwTable : NULL))
+		{
+			continue;
+		}
+
+		u32 x, y, width, height;
+		state.getGridCell(i, x, y, width, height);
+
+		DecodeJob job;
+		job.state = &cell;
+		job.format = &m_gridCompiled[i];
+		job.data = text + delta;
+		job.size = (u32)std::min<u64>(length - delta, source.size);
+		job.view = source.view;
+		job.out = getCellLayout(&frame.pixels[0], w, x, y, source.view.width, source.view.height, state.flipV, state.flipH);
+		job.numTasks = 0;
+		jobs.push_back(job);
+
+		numTasks = std::max(numTasks, getNumTasks(source.view.width * source.view.height));
+	}
+
+	if(!jobs.empty())
+	{
+		for(size_t i=0; i<jobs.size(); ++i)
+		{
+			jobs[i].numTasks = numTasks;
+		}
+
+		GridJob grid = { &jobs[0], (u32)jobs.size() };
+		m_pool.run(gridTask, &grid, grid.numJobs * numTasks);
+	}
+
+	frame.stageTime[RS_Decode] = elapsedMs(decodeStart);
+	frame.stagesRun |= 1 << RS_Decode;
+	frame.renderTime = elapsedMs(start);
+
+	return true;
+}
+
+bool Renderer::renderDiff(const ViewState& state, u32 serial, bool cancellable, bool reuseRows, Frame& frame)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Both sides are plain frames of their own, so they are cached and derived as usual. The
+	// heat map would hide the differences.
+	ViewState view = state;
+	view.diffFile = NULL;
+	view.countColors = false;
+	view.entropyBlockSize = 0;
+	view.highlights.clear();
+	if(!render(view, serial, cancellable, reuseRows, frame))
+	{
+		return false;
+	}
+
+	// A second source without data there (i.e. before its start) stays black
+	ViewState other = view;
+	other.file = state.diffFile;
+	other.offset = state.diffOffset;
+	if(!render(other, serial, cancellable, false, m_diffFrame) || m_diffFrame.pixels.size() != frame.pixels.size())
+	{
+		if(cancellable && isStale(serial))
+		{
+			return false;
+		}
+		m_diffFrame.pixels.assign(frame.pixels.size(), 0);
+		m_diffFrame.cached = true;
+		m_diffFrame.stagesRun = 0;
+	}
+
+	for(u32 i=0; i<RS_NumStages; ++i)
+	{
+		frame.stageTime[i] += (m_diffFrame.stagesRun >> i) & 1 ? m_diffFrame.stageTime[i] : 0.0;
+	}
+	frame.stagesRun |= m_diffFrame.stagesRun;
+	frame.cached = frame.cached && m_diffFrame.cached;
+
+	std::chrono::steady_clock::time_point diffStart = std::chrono::steady_clock::now();
+	u8* pixels = &frame.pixels[0];
+	const u8* second = &m_diffFrame.pixels[0];
+	size_t size = frame.pixels.size();
+
+	switch(state.diffMode)
+	{
+	case DM_Xor:
+		for(size_t i=0; i<size; ++i)
+		{
+			pixels[i] ^= second[i];
+		}
+		break;
+
+	case DM_Difference:
+		for(size_t i=0; i<size; ++i)
+		{
+			pixels[i] = (u8)(pixels[i] > second[i] ? pixels[i] - second[i] : second[i] - pixels[i]);
+		}
+		break;
+
+	default:
+		for(size_t i=0; i<size; i+=3)
+		{
+			if(pixels[i] != second[i] || pixels[i + 1] != second[i + 1] || pixels[i + 2] != second[i + 2])
+			{
+				pixels[i] = 255;
+				pixels[i + 1] = 0;
+				pixels[i + 2] = 0;
+			}
+			else
+			{
+				pixels[i] /= 4;
+				pixels[i + 1] /= 4;
+				pixels[i + 2] /= 4;
+			}
+		}
+		break;
+	}
+
+	frame.stageTime[RS_Diff] = elapsedMs(diffStart);
+	frame.stagesRun |= 1 << RS_Diff;
+
+	// Counted on the combined frame, which isn't cached
+	if(state.countColors)
+	{
+		std::chrono::steady_clock::time_point countStart = std::chrono::steady_clock::now();
+		m_numColors = m_colorCounter.count(pixels, frame.width * frame.height, &m_pool);
+		m_colorCounter.getTopColors(pixels, frame.width * frame.height, state.topColors, m_topColors);
+		m_counted = false;
+
+		frame.numColors = m_numColors;
+		frame.topColors = m_topColors;
+		frame.colorsCounted = true;
+		frame.stageTime[RS_Statistics] = elapsedMs(countStart);
+		frame.stagesRun |= 1 << RS_Statistics;
+	}
+
+	frame.renderTime = elapsedMs(start);
+
+	return true;
+}
+
+void Renderer::decode(const ViewState& state, const Viewport& view, const u8* data, u32 size, u8* pixels)
+{
+	// Flips are part of the output addressing, zoomed pixels are expensive so they are split as far as possible
+	OutputLayout out(pixels, view.width, view.height, state.flipV, state.flipH);
+	decodeView(state, view, data, size, m_compiled, &m_pool, getNumTasks(state.zoom > 1 ? 0xffffffff : view.width * view.height), out);
+}
+
+u32 Renderer::decodeScrolled(const ViewState& state, const Viewport& view, const u8* data, u32 size, u8* pixels)
+{
+	FrameKey key;
+	u64 top;
+	if(!getRowPosition(state, key, top))
+	{
+		decode(state, view, data, size, pixels);
+		return view.height;
+	}
+
+	u32 h = view.height;
+	u32 rowSize = view.width * 3;
+	if(!(m_ring.key == key) || m_ring.rows.size() != h || m_ring.rowSize != rowSize)
+	{
+		m_ring.key = key;
+		m_ring.rowSize = rowSize;
+		m_ring.rows.assign(h, 0);
+		m_ring.valid.assign(h, 0);
+		m_ring.pixels.resize((size_t)h * rowSize);
+	}
+
+	// Rows are moved as a whole, only the vertical flip changes where they go
+	OutputLayout out(pixels, view.width, h, state.flipV, state.flipH);
+	u32 decoded = 0;
+
+	for(u32 r=0; r<h; )
+	{
+		if(isRowKept(state, view, size, top, r))
+		{
+			u32 slot = (u32)((top + r) % h);
+			memcpy(&pixels[(size_t)(state.flipV ? h - 1 - r : r) * rowSize], &m_ring.pixels[(size_t)slot * rowSize], rowSize);
+			++r;
+			continue;
+		}
+
+		// Decode the whole run of missing rows at once
+		u32 end = r + 1;
+		while(end < h && !isRowKept(state, view, size, top, end))
+		{
+			++end;
+		}
+
+		Viewport band = view;
+		band.y += r;
+		band.height = end - r;
+		OutputLayout bandOut = out;
+		bandOut.origin = out.pixel(0, r);
+		bandOut.height = band.height;
+		decodeView(state, band, data, size, m_compiled, &m_pool, getNumTasks(state.zoom > 1 ? 0xffffffff : band.width * band.height), bandOut);
+
+		for(u32 i=r; i<end; ++i)
+		{
+			if(isRowComplete(state, view, size, i))
+			{
+				u32 slot = (u32)((top + i) % h);
+				memcpy(&m_ring.pixels[(size_t)slot * rowSize], &pixels[(size_t)(state.flipV ? h - 1 - i : i) * rowSize], rowSize);
+				m_ring.rows[slot] = top + i;
+				m_ring.valid[slot] = 1;
+			}
+		}
+
+		decoded += end - r;
+		r = end;
+	}
+
+	return decoded;
+}
+
+bool Renderer::isRowKept(const ViewState& state, const Viewport& view, u32 size, u64 top, u32 row) const
+{
+	u32 slot = (u32)((top + row) % m_ring.rows.size());
+	return m_ring.valid[slot] && m_ring.rows[slot] == top + row && isRowComplete(state, view, size, row);
+}
+
+bool Renderer::exportView(const ViewState& state, const OutputLayout& out)
+{
+	MappedWindow window;
+	Viewport view;
+	const u8* data = NULL;
+	u32 size = 0;
+	if(!mapView(state, window, view, data, size) || out.width != view.width || out.height != view.height)
+	{
+		return false;
+	}
+
+	CompiledFormat compiled;
+	decodeView(state, view, data, size, compiled, NULL, 1, out);
+
+	return true;
+}
+
+u32 Renderer::getNumTasks(u32 numPixels) const
+{
+	u32 maxTasks = m_pool.getNumThreads() * kTasksPerThread;
+	return std::max<u32>(1, std::min(numPixels / kMinPixelsPerTask, maxTasks));
+}
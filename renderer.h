@@ -0,0 +1,291 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __RENDERER_H
+#define __RENDERER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "common.h"
+#include "mappedfile.h"
+#include "decoder.h"
+#include "framecache.h"
+#include "threadpool.h"
+#include "colorcount.h"
+#include "entropy.h"
+
+//
+// Format the comparison grid decodes its window with (see PixelDbgWnd::parseCandidates)
+//
+struct FormatCandidate
+{
+	enum Kind
+	{
+		FC_Raw = 0,
+		FC_DXT,
+		FC_Palette, // 8 bit indices into the view's palette
+		FC_Gray // 8 bit indices into a gray ramp
+	};
+
+	Kind kind;
+	PixelFormat format; // Raw and DXT formats, 1 byte pixels otherwise
+	int DXTType;
+	char name[16];
+};
+
+//
+// How a diff view combines the view with the same view of its second source
+//
+enum DiffMode
+{
+	DM_Xor = 0, // Both frames XORed, equal pixels are black
+	DM_Difference, // Absolute difference per channel
+	DM_Mask // Changed pixels red over the dimmed view
+};
+
+//
+// Snapshot of everything needed to render a frame. Captured from the UI controls on the
+// UI thread, so the worker never has to touch any widget.
+//
+struct ViewState
+{
+	static const u32 kMaxZoom;
+
+	ViewState();
+
+	// Size of the canvas in zoomed pixels
+	u32 getZoomedWidth() const { return (u32)(((u64)width + zoom - 1) / zoom); }
+	u32 getZoomedHeight() const { return (u32)(((u64)height + zoom - 1) / zoom); }
+
+	// Switch to another zoom level (power of two) keeping the centre of the viewport, returns false if it isn't valid
+	bool zoomTo(u32 level);
+
+	// Cell of a candidate in the comparison grid, returns false if there is none
+	bool getGridCell(u32 index, u32& x, u32& y, u32& width, u32& height) const;
+
+	const MappedFile* file;
+	off_t offset; // Start of the canvas
+	u32 width; // Canvas size
+	u32 height;
+	u32 viewX; // Decoded rectangle of the zoomed canvas (flips already applied, see PixelDbgWnd::getViewState)
+	u32 viewY;
+	u32 viewWidth;
+	u32 viewHeight;
+	u32 windowWidth; // Room for the viewport, used when zooming
+	u32 windowHeight;
+	u32 zoom; // Canvas pixels per output pixel and axis (1:zoom)
+	bool zoomAverage; // Average a zoomed block instead of sampling its centre
+	PixelFormat format;
+	u32 flags; // ConvertFlags
+	u32 tileX;
+	u32 tileY;
+	bool paletteMode;
+	u8 palette[256 * 3];
+	bool bitwise;
+	BitwiseTable bwTable; // Compiled chain of bitwise ops
+	bool DXTMode;
+	int DXTType; // 1, 3 or 5
+	bool oneBitAlpha;
+	bool RLEMode;
+	u32 RLmask;
+	bool RLmsb;
+	u32 RLskip; // Pixels of the first run which lie before the view
+	bool flipV;
+	bool flipH;
+	bool countColors;
+	u32 topColors; // Most frequent colors listed when counting
+	u32 entropyBlockSize; // Bytes per block of the entropy heat map over the frame, 0 = off
+	std::vector<ByteRange> highlights; // Ascending file ranges tinted over the frame (i.e. duplicate blocks)
+	std::vector<FormatCandidate> candidates; // Comparison grid instead of the view if not empty
+	u32 gridColumns;
+	const MappedFile* diffFile; // Second source of a diff view, NULL = no diff
+	off_t diffOffset; // Start of its canvas
+	u32 diffMode; // DiffMode
+};
+
+//
+// Stages of a frame in pipeline order. A stage only runs if its inputs changed, otherwise its
+// output is taken from the frame cache (see Renderer::render).
+//
+enum RenderStage
+{
+	RS_Fetch = 0, // Map the bytes behind the view
+	RS_Decode, // Pixel format, tiles, palette, zoom
+	RS_Bitwise, // Bitwise table applied to the decoded frame
+	RS_Orientation, // Flips applied to a frame decoded with other flips
+	RS_Entropy, // Heat map of the byte entropy blended over the frame
+	RS_Highlight, // Highlighted byte ranges tinted
+	RS_Diff, // Frame combined with the one of the second source
+	RS_Statistics, // Color count
+	RS_Present, // Image handed to the window (UI thread)
+	RS_NumStages
+};
+
+//
+// Finished frame as handed back to the UI thread
+//
+struct Frame
+{
+	Frame();
+
+	std::vector<u8> pixels; // 24bpp RGB
+	u32 width; // Viewport size
+	u32 height;
+	u32 serial; // Serial of the view state the frame was rendered from
+	bool colorsCounted;
+	u32 numColors;
+	std::vector<ColorCounter::Color> topColors; // Most frequent first
+	bool paletteUsed;
+	u8 paletteMin;
+	u8 paletteMax;
+	double renderTime; // In milliseconds
+	double stageTime[RS_NumStages]; // In milliseconds, 0 for stages that didn't run
+	u32 stagesRun; // Bit per RenderStage
+	u32 numThreads; // Threads the frame was split across
+	bool cached; // Taken from the frame cache
+};
+
+//
+// Renders frames on a worker thread. Only the latest submitted view state is rendered,
+// older pending requests are dropped and a frame in progress is abandoned as soon as a
+// newer request arrives. Finished frames are announced through the notify function
+// (called on the worker thread, i.e. forward it with Fl::awake). Once idle the worker
+// renders the neighbouring zoom levels of the last view into the cache. Frames scrolled
+// by whole rows only decode the newly exposed rows, the others are kept in a row ring.
+// Comparison grids decode the start of the view under every candidate format from a
+// single mapping, all candidates at once on the pool. Frames which only differ from a
+// cached one by their flips or bitwise ops are derived from it instead of being decoded,
+// a color count is only repeated if the pixels changed. Diff views render both sources
+// through the same stages (and cache) and combine the two frames.
+//
+class Renderer
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	struct Stats
+	{
+		u32 submitted; // View states submitted by the UI
+		u32 rendered; // Frames completed
+		u32 dropped; // Requests replaced before rendering started
+		u32 cancelled; // Frames abandoned while rendering
+		u32 prerendered; // Neighbouring zoom levels rendered ahead
+		u64 decodedRows; // Rows decoded for frames which weren't cached
+		u64 reusedRows; // Rows taken from the previous frames while scrolling
+		double lastRenderTime; // In milliseconds
+		u32 stageRuns[RS_NumStages]; // Rendered frames each stage ran for (present is counted by the UI)
+	};
+
+	Renderer(NotifyFunc notify, void* param, size_t cacheBudget = FrameCache::kDefaultBudget, u32 numThreads = 0);
+	~Renderer();
+
+	// Queue a new view state (latest wins), returns its serial
+	u32 submit(const ViewState& state);
+
+	// Drop pending work and wait until the worker is idle (i.e. before closing the file)
+	void cancel();
+
+	// Swap in the latest finished frame, returns false if there is none
+	bool takeFrame(Frame& frame);
+
+	Stats getStats() const;
+	FrameCache::Stats getCacheStats() const { return m_cache.getStats(); }
+	u32 getNumThreads() const { return m_pool.getNumThreads(); }
+	ThreadPool& getPool() { return m_pool; } // Shared with analyses on the UI thread, jobs are serialized
+
+	// Decode a view on the calling thread straight into a caller provided layout (i.e. image export).
+	// The layout's size has to match the viewport.
+	static bool exportView(const ViewState& state, const OutputLayout& out);
+
+private:
+	// Not copyable
+	Renderer(const Renderer&);
+	Renderer& operator=(const Renderer&);
+
+	void run();
+	bool render(const ViewState& state, u32 serial, bool cancellable, bool reuseRows, Frame& frame);
+	void prerender(const ViewState& state, u32 serial);
+	bool renderGrid(const ViewState& state, u32 serial, bool cancellable, Frame& frame);
+	bool renderDiff(const ViewState& state, u32 serial, bool cancellable, bool reuseRows, Frame& frame);
+	bool derive(const FrameKey& key, const FrameKey& plainKey, const ViewState& state, Frame& frame); // Frame from a cached one with other flips or bitwise ops
+	void decode(const ViewState& state, const Viewport& view, const u8* data, u32 size, u8* pixels);
+	void overlayEntropy(const ViewState& state, const Viewport& view, u8* pixels); // view of the zoomed canvas
+	void overlayHighlights(const ViewState& state, const Viewport& view, u8* pixels);
+	u32 decodeScrolled(const ViewState& state, const Viewport& view, const u8* data, u32 size, u8* pixels); // Returns decoded rows
+	bool isRowKept(const ViewState& state, const Viewport& view, u32 size, u64 top, u32 row) const; // Row can be copied from the ring
+	u32 getNumTasks(u32 numPixels) const;
+	bool isStale(u32 serial) const { return serial != m_latestSerial; }
+
+	// Decoded rows of the last frames by absolute row of the canvas (see getRowPosition in renderer.cpp).
+	// Slot of a row is its index modulo the number of slots, i.e. the viewport height.
+	struct RowRing
+	{
+		FrameKey key; // Everything but the vertical position
+		u32 rowSize; // Bytes
+		std::vector<u64> rows; // Row held by each slot
+		std::vector<u8> valid;
+		std::vector<u8> pixels;
+	};
+
+	NotifyFunc m_notify;
+	void* m_param;
+
+	mutable std::mutex m_mutex; // Protects pending state, ready frame and stats
+	std::mutex m_workMutex; // Held by the worker while rendering
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	std::atomic<u32> m_latestSerial;
+	bool m_quit;
+
+	ViewState m_pending;
+	bool m_hasPending;
+	Frame m_work; // Worker only
+	Frame m_prerendered; // Worker only
+	Frame m_diffFrame; // Worker only, second source of a diff view
+	Frame m_ready;
+	bool m_hasReady;
+	MappedWindow m_window; // Worker only
+	FrameCache m_cache; // Decoded (and flipped) frames
+	FrameCache::Entry m_entry; // Worker only
+	CompiledFormat m_compiled; // Worker only, kept until the format changes
+	std::vector<CompiledFormat> m_gridCompiled; // Worker only, one per candidate
+	RowRing m_ring; // Worker only
+	ThreadPool m_pool; // Splits decoding of a frame
+	ColorCounter m_colorCounter; // Worker only
+	MappedWindow m_entropyWindow; // Worker only, bytes behind the heat map
+	std::vector<float> m_entropy; // Worker only, per block
+	std::vector<u8> m_heat; // Worker only, color per block
+	FrameKey m_countKey; // Worker only, frame the last color count belongs to
+	u32 m_countTopColors;
+	u32 m_numColors;
+	std::vector<ColorCounter::Color> m_topColors;
+	bool m_counted;
+	Stats m_stats;
+};
+
+#endif
+
@@ -0,0 +1,328 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include "rleindex.h"
+
+const u32 RleIndex::kRunsPerCheckpoint = 1024;
+
+namespace
+{
+	const size_t kChunkSize = 1024 * 1024; // Bytes scanned per lock of the file
+	const double kNotifyIntervalMs = 200.0; // Progress notifications are throttled to this
+
+	struct PixelLess
+	{
+		template<typename T>
+		bool operator()(u64 pixel, const T& checkpoint) const { return pixel < checkpoint.pixel; }
+	};
+}
+
+RleIndex::RleIndex(NotifyFunc notify, void* param) :
+	m_notify(notify),
+	m_param(param),
+	m_generation(0),
+	m_quit(false),
+	m_pending(false),
+	m_file(NULL),
+	m_identity(0),
+	m_fileSize(0),
+	m_origin(0),
+	m_pixelSize(0),
+	m_RLmask(0xff),
+	m_RLmsb(false),
+	m_indexedPixels(0),
+	m_indexedEnd(0),
+	m_complete(false)
+{
+}
+
+RleIndex::~RleIndex()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+}
+
+bool RleIndex::build(const MappedFile& file, off_t origin, u32 pixelSize, u32 RLmask, bool RLmsb)
+{
+	if(!file.isOpen() || pixelSize == 0 || origin < 0)
+	{
+		detach();
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_file == &file && m_identity == file.identity() && m_fileSize == file.size() &&
+		   m_pixelSize == pixelSize && m_RLmask == RLmask && m_RLmsb == RLmsb)
+		{
+			return false;
+		}
+	}
+
+	detach();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = &file;
+	m_identity = file.identity();
+	m_fileSize = file.size();
+	m_origin = origin;
+	m_pixelSize = pixelSize;
+	m_RLmask = RLmask;
+	m_RLmsb = RLmsb;
+
+	Checkpoint first = { 0, origin };
+	m_checkpoints.push_back(first);
+	m_indexedEnd = origin;
+	m_pending = true;
+
+	// Worker is started on first use
+	if(!m_thread.joinable())
+	{
+		m_thread = std::thread(&RleIndex::run, this);
+	}
+	m_cond.notify_one();
+
+	return true;
+}
+
+void RleIndex::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		m_file = NULL;
+		m_pending = false;
+		m_pixelSize = 0;
+		m_checkpoints.clear();
+		m_indexedPixels = 0;
+		m_indexedEnd = 0;
+		m_complete = false;
+	}
+
+	// Wait for the chunk currently being scanned, afterwards the worker won't access the file anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+	m_window.unmap();
+}
+
+bool RleIndex::isComplete() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_complete;
+}
+
+off_t RleIndex::getOrigin() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_origin;
+}
+
+u64 RleIndex::getIndexedPixels() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_indexedPixels;
+}
+
+off_t RleIndex::getIndexedBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_file ? m_indexedEnd - m_origin : 0;
+}
+
+u32 RleIndex::getNumCheckpoints() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (u32)m_checkpoints.size();
+}
+
+bool RleIndex::seekPixel(u64 pixel, Position& pos) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(!m_file || pixel >= m_indexedPixels)
+	{
+		return false;
+	}
+
+	// Last checkpoint at or before the pixel, the runs behind it are walked
+	std::vector<Checkpoint>::const_iterator iter = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), pixel, PixelLess());
+	--iter;
+
+	u32 step = m_pixelSize + 1;
+	u32 RLbyte = m_RLmsb ? m_pixelSize : 0;
+	std::vector<u8> runs(kRunsPerCheckpoint * step);
+	size_t size = m_file->read(&runs[0], runs.size(), iter->offset);
+
+	u64 first = iter->pixel;
+	for(size_t i=0; i+step<=size; i+=step)
+	{
+		u64 len = (runs[i + RLbyte] & m_RLmask) + 1;
+		if(pixel < first + len)
+		{
+			pos.offset = iter->offset + (off_t)i;
+			pos.pixel = first;
+			pos.skip = (u32)(pixel - first);
+			return true;
+		}
+		first += len;
+	}
+
+	return false;
+}
+
+void RleIndex::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_pending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		m_pending = false;
+		u32 generation = m_generation;
+		lock.unlock();
+
+		scan(generation);
+
+		lock.lock();
+	}
+}
+
+bool RleIndex::scan(u32 generation)
+{
+	const MappedFile* file;
+	off_t fileSize, pos;
+	u32 step, RLbyte, RLmask;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation || !m_file)
+		{
+			return false;
+		}
+
+		file = m_file;
+		fileSize = m_fileSize;
+		pos = m_origin;
+		step = m_pixelSize + 1;
+		RLbyte = m_RLmsb ? m_pixelSize : 0;
+		RLmask = m_RLmask;
+	}
+
+	m_lastNotify = std::chrono::steady_clock::time_point();
+	u64 pixel = 0;
+	u32 runs = 0; // Since the last checkpoint
+	std::vector<Checkpoint> found;
+	
+	for(;;)
+	{
+		found.clear();
+		bool stalled;
+
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation != m_generation)
+			{
+				return false;
+			}
+
+			size_t size = (size_t)std::min((off_t)(kChunkSize + step), fileSize - pos);
+			const u8* data = file->data() ? file->data() + pos : NULL;
+			if(!data)
+			{
+				size = m_window.map(*file, pos, size);
+				data = m_window.data();
+				size = data ? size : 0;
+			}
+
+			size_t i = 0;
+			for(; i+step<=size; i+=step)
+			{
+				if(runs == kRunsPerCheckpoint)
+				{
+					Checkpoint checkpoint = { pixel, pos + (off_t)i };
+					found.push_back(checkpoint);
+					runs = 0;
+				}
+
+				pixel += (data[i + RLbyte] & RLmask) + 1;
+				++runs;
+			}
+
+			pos += (off_t)i;
+			stalled = i == 0;
+		}
+
+		// A trailing partial run is ignored just like the decoder does. If the next window can't be
+		// mapped the index ends there, it would never get any further.
+		bool complete = stalled || fileSize - pos < (off_t)step;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return false;
+			}
+
+			m_checkpoints.insert(m_checkpoints.end(), found.begin(), found.end());
+			m_indexedPixels = pixel;
+			m_indexedEnd = pos;
+			m_complete = complete;
+		}
+
+		notify(complete);
+
+		if(complete)
+		{
+			return true;
+		}
+	}
+}
+
+void RleIndex::notify(bool force)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(force || std::chrono::duration<double, std::milli>(now - m_lastNotify).count() >= kNotifyIntervalMs)
+	{
+		m_lastNotify = now;
+		if(m_notify)
+		{
+			m_notify(m_param);
+		}
+	}
+}
+
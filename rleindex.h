@@ -0,0 +1,118 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __RLEINDEX_H
+#define __RLEINDEX_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "common.h"
+#include "mappedfile.h"
+
+//
+// Sparse index of an RLE stream mapping decoded pixel counts to compressed byte offsets.
+// A worker thread walks the runs from the stream origin to the end of the file and stores
+// a checkpoint every kRunsPerCheckpoint runs. Seeking is a binary search over the
+// checkpoints followed by a short forward walk. The index can be used while it's still
+// being built, up to the pixels indexed so far.
+//
+class RleIndex
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	static const u32 kRunsPerCheckpoint;
+
+	struct Position
+	{
+		off_t offset; // Run containing the pixel
+		u64 pixel; // First pixel of that run
+		u32 skip; // Pixels of the run before the requested one
+	};
+
+	RleIndex(NotifyFunc notify, void* param);
+	~RleIndex();
+
+	// Starts indexing the stream at origin in the background unless the index already covers
+	// the same file and run encoding (the origin is kept in that case). Returns true if indexing
+	// (re)started. File must stay open until detach() is called.
+	bool build(const MappedFile& file, off_t origin, u32 pixelSize, u32 RLmask, bool RLmsb);
+	void detach();
+
+	bool isComplete() const;
+	off_t getOrigin() const;
+	u64 getIndexedPixels() const; // Total number of pixels once complete
+	off_t getIndexedBytes() const;
+	u32 getNumCheckpoints() const;
+
+	// Run containing the pixel (counted from the origin), false if not indexed yet
+	bool seekPixel(u64 pixel, Position& pos) const;
+
+private:
+	struct Checkpoint
+	{
+		u64 pixel;
+		off_t offset;
+	};
+
+	// Not copyable
+	RleIndex(const RleIndex&);
+	RleIndex& operator=(const RleIndex&);
+
+	void run();
+	bool scan(u32 generation); // Returns false if aborted
+	void notify(bool force);
+
+	NotifyFunc m_notify;
+	void* m_param;
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex
+	std::mutex m_workMutex; // Held by the worker while it reads file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	std::atomic<u32> m_generation; // Bumped to abort a running scan
+	bool m_quit;
+	bool m_pending; // Scan requested
+
+	const MappedFile* m_file;
+	MappedWindow m_window; // Worker only
+	u64 m_identity;
+	off_t m_fileSize;
+	off_t m_origin;
+	u32 m_pixelSize;
+	u32 m_RLmask;
+	bool m_RLmsb;
+	std::vector<Checkpoint> m_checkpoints; // Sorted by pixel, the first one is the origin
+	u64 m_indexedPixels;
+	off_t m_indexedEnd; // End of the last indexed run
+	bool m_complete;
+	std::chrono::steady_clock::time_point m_lastNotify; // Worker only
+};
+
+#endif
+
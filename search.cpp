@@ -0,0 +1,608 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "search.h"
+#include "simd.h"
+
+const u32 PatternSearch::kChunkSize = 16 * 1024 * 1024;
+const u32 PatternSearch::kMaxPatternSize = 256;
+const u32 PatternSearch::kMinHorspoolSize = 16;
+
+namespace
+{
+	const u32 kChunksPerThread = 2; // Chunks per thread and batch
+	const double kNotifyIntervalMs = 200.0;
+	const u32 kMaxListed = 1000; // Matches printed by runSearch
+	const u64 kNoMatch = ~(u64)0;
+
+	int hexValue(char c)
+	{
+		if(c >= '0' && c <= '9')
+		{
+			return c - '0';
+		}
+		if(c >= 'a' && c <= 'f')
+		{
+			return c - 'a' + 10;
+		}
+		if(c >= 'A' && c <= 'F')
+		{
+			return c - 'A' + 10;
+		}
+		return -1;
+	}
+
+	void addByte(PatternSearch::Pattern& pattern, u8 value, u8 mask)
+	{
+		pattern.bytes.push_back(value & mask);
+		pattern.mask.push_back(mask);
+	}
+
+	// Next character of UTF-8 text, characters beyond 16 bits (and broken sequences) become '?'
+	u32 readUtf8(const char*& text)
+	{
+		u8 c = (u8)*text++;
+		u32 length = c >= 0xf0 ? 3 : (c >= 0xe0 ? 2 : (c >= 0xc0 ? 1 : 0));
+		u32 code = length == 0 ? c : c & (0x3f >> length);
+
+		for(u32 i=0; i<length; ++i)
+		{
+			if(((u8)*text & 0xc0) != 0x80)
+			{
+				return '?';
+			}
+			code = (code << 6) | ((u8)*text++ & 0x3f);
+		}
+
+		return code <= 0xffff ? code : '?';
+	}
+
+	bool matchesAt(const PatternSearch::Pattern& pattern, const u8* data)
+	{
+		for(size_t i=0; i<pattern.bytes.size(); ++i)
+		{
+			if((data[i] & pattern.mask[i]) != pattern.bytes[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+struct PatternSearch::Batch
+{
+	const MappedFile* file;
+	const Pattern* pattern;
+	u64 fileSize;
+	u64 from;
+	bool forward;
+	u64 first; // Chunk of the first task, chunks are counted away from the start offset
+	const std::atomic<u32>* generation;
+	u32 expected; // Generation the batch belongs to
+	std::atomic<u32> nearest; // Task with the match closest to the start offset so far
+	std::atomic<u64> scanned; // Bytes
+	std::vector<u64> matches; // Per task, kNoMatch if none
+};
+
+PatternSearch::PatternSearch(NotifyFunc notify, void* param, u32 numThreads /* 0 */) :
+	m_notify(notify),
+	m_param(param),
+	m_numThreads(numThreads),
+	m_pool(NULL),
+	m_generation(0),
+	m_quit(false),
+	m_pending(false),
+	m_file(NULL),
+	m_fileSize(0),
+	m_from(0),
+	m_forward(true),
+	m_scanned(0),
+	m_complete(false),
+	m_found(false),
+	m_offset(0),
+	m_seconds(0.0)
+{
+}
+
+PatternSearch::~PatternSearch()
+{
+	detach();
+
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+
+	delete m_pool;
+}
+
+bool PatternSearch::parsePattern(const char* text, Pattern& pattern)
+{
+	pattern.bytes.clear();
+	pattern.mask.clear();
+
+	const char* p = text;
+	while(*p != 0)
+	{
+		if(*p == ' ' || *p == '\t' || *p == ',')
+		{
+			++p;
+			continue;
+		}
+
+		bool wide = (*p == 'u' || *p == 'U') && p[1] == '"';
+		if(*p == '"' || wide)
+		{
+			p += wide ? 2 : 1;
+			while(*p != 0 && *p != '"')
+			{
+				bool any = false;
+				if(*p == '\\' && p[1] != 0)
+				{
+					++p;
+				}
+				else if(*p == '?')
+				{
+					any = true;
+					++p;
+				}
+
+				u32 code = any ? 0 : (wide ? readUtf8(p) : (u8)*p++);
+				addByte(pattern, (u8)code, any ? 0 : 0xff);
+				if(wide)
+				{
+					addByte(pattern, (u8)(code >> 8), any ? 0 : 0xff);
+				}
+			}
+
+			if(*p != '"')
+			{
+				return false;
+			}
+			++p;
+			continue;
+		}
+
+		// Hex byte, ? for a nibble that can be anything
+		int high = hexValue(p[0]);
+		int low = hexValue(p[1]);
+		if((high < 0 && p[0] != '?') || (low < 0 && p[1] != '?'))
+		{
+			return false;
+		}
+
+		addByte(pattern, (u8)((std::max(high, 0) << 4) | std::max(low, 0)), (u8)((high >= 0 ? 0xf0 : 0) | (low >= 0 ? 0x0f : 0)));
+		p += 2;
+	}
+
+	u32 size = (u32)pattern.bytes.size();
+	if(size == 0 || size > kMaxPatternSize)
+	{
+		return false;
+	}
+
+	// The vector filter compares whole bytes
+	pattern.first = size;
+	pattern.last = 0;
+	for(u32 i=0; i<size; ++i)
+	{
+		if(pattern.mask[i] == 0xff)
+		{
+			pattern.first = std::min(pattern.first, i);
+			pattern.last = i;
+		}
+	}
+	if(pattern.first == size)
+	{
+		return false;
+	}
+
+	// Bytes matching a pattern byte shift the window to align with its last occurrence. Long
+	// patterns skip far enough per step to beat the scalar filter unless wildcards near the end
+	// keep the shifts short, the vector filter is faster still (it is bound by memory).
+	u32 total = 0;
+	for(u32 c=0; c<256; ++c)
+	{
+		pattern.shift[c] = size;
+		for(u32 i=0; i+1<size; ++i)
+		{
+			if(((u8)c & pattern.mask[i]) == pattern.bytes[i])
+			{
+				pattern.shift[c] = size - 1 - i;
+			}
+		}
+		total += pattern.shift[c];
+	}
+	pattern.horspool = getSimdLevel() == SIMD_None && size >= kMinHorspoolSize && total / 256 >= kMinHorspoolSize / 2;
+
+	return true;
+}
+
+bool PatternSearch::start(const MappedFile& file, const Pattern& pattern, u64 from, bool forward)
+{
+	if(!file.isOpen() || file.size() <= 0 || pattern.bytes.empty())
+	{
+		detach();
+		return false;
+	}
+
+	detach();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = &file;
+	m_fileSize = (u64)file.size();
+	m_pattern = pattern;
+	m_from = std::min(from, m_fileSize);
+	m_forward = forward;
+	m_pending = true;
+
+	// Worker and pool are created on first use
+	if(!m_thread.joinable())
+	{
+		m_pool = new ThreadPool(m_numThreads);
+		m_thread = std::thread(&PatternSearch::run, this);
+	}
+	m_cond.notify_one();
+
+	return true;
+}
+
+void PatternSearch::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_generation;
+		m_file = NULL;
+		m_pending = false;
+		m_fileSize = 0;
+		m_scanned = 0;
+		m_complete = false;
+		m_found = false;
+		m_offset = 0;
+		m_seconds = 0.0;
+	}
+
+	// Wait for the batch currently being searched, afterwards the pool won't access the file anymore
+	std::lock_guard<std::mutex> work(m_workMutex);
+}
+
+PatternSearch::Stats PatternSearch::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Stats stats;
+	stats.fileSize = m_fileSize;
+	stats.scanned = m_scanned;
+	stats.numThreads = m_pool ? m_pool->getNumThreads() : 0;
+	stats.seconds = m_seconds;
+	stats.forward = m_forward;
+	stats.complete = m_complete;
+	stats.found = m_found;
+	stats.offset = m_offset;
+	return stats;
+}
+
+bool PatternSearch::findInChunk(const Pattern& pattern, const u8* data, size_t size, size_t scanSize, bool first, size_t& position)
+{
+	size_t patternSize = pattern.bytes.size();
+	if(patternSize == 0 || size < patternSize)
+	{
+		return false;
+	}
+
+	size_t end = std::min(scanSize, size - patternSize + 1);
+	bool found = false;
+
+	if(pattern.horspool)
+	{
+		for(size_t i=0; i<end; i+=pattern.shift[data[i + patternSize - 1]])
+		{
+			if(matchesAt(pattern, data + i))
+			{
+				position = i;
+				found = true;
+				if(first)
+				{
+					break;
+				}
+			}
+		}
+		return found;
+	}
+
+	// Runs without the first and last full byte are skipped by the vector filter where the CPU
+	// has one, the rest is checked here
+	u32 a = pattern.first;
+	u32 b = pattern.last;
+	u8 byteA = pattern.bytes[a];
+	u8 byteB = pattern.bytes[b];
+	size_t i = 0;
+	while(i < end)
+	{
+		i += skipPairSimd(data + i + a, end - i, byteA, byteB, b - a);
+
+		size_t stop = std::min(i + 32, end);
+		for(; i<stop; ++i)
+		{
+			if(data[i + a] == byteA && data[i + b] == byteB && matchesAt(pattern, data + i))
+			{
+				position = i;
+				found = true;
+				if(first)
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	return found;
+}
+
+void PatternSearch::chunkTask(void* param, u32 task)
+{
+	Batch* batch = static_cast<Batch*>(param);
+	if(*batch->generation != batch->expected || task > batch->nearest)
+	{
+		return;
+	}
+
+	// Positions [start, end) of the chunk
+	u64 chunk = batch->first + task;
+	u64 start, end;
+	if(batch->forward)
+	{
+		start = batch->from + chunk * kChunkSize;
+		end = std::min(start + kChunkSize, batch->fileSize);
+	}
+	else
+	{
+		end = batch->from - chunk * kChunkSize;
+		start = end > kChunkSize ? end - kChunkSize : 0;
+	}
+
+	size_t patternSize = batch->pattern->bytes.size();
+	MappedWindow window;
+	size_t size = window.map(*batch->file, (off_t)start, (size_t)std::min<u64>(end - start + patternSize - 1, batch->fileSize - start));
+	if(!window.data() || size == 0)
+	{
+		return;
+	}
+
+	// Forward searches stop at the first match, only the bytes up to it count as scanned
+	size_t position;
+	size_t scanned = (size_t)(end - start);
+	if(findInChunk(*batch->pattern, window.data(), size, (size_t)(end - start), batch->forward, position))
+	{
+		batch->matches[task] = start + position;
+		if(batch->forward)
+		{
+			scanned = std::min(position + patternSize, scanned);
+		}
+
+		u32 nearest = batch->nearest;
+		while(task < nearest && !batch->nearest.compare_exchange_weak(nearest, task))
+		{
+		}
+	}
+	batch->scanned += scanned;
+}
+
+void PatternSearch::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(!m_pending)
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		m_pending = false;
+		u32 generation = m_generation;
+		lock.unlock();
+
+		search(generation);
+
+		lock.lock();
+	}
+}
+
+void PatternSearch::search(u32 generation)
+{
+	Pattern pattern;
+	Batch batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation || !m_file)
+		{
+			return;
+		}
+
+		pattern = m_pattern;
+		batch.file = m_file;
+		batch.fileSize = m_fileSize;
+		batch.from = m_from;
+		batch.forward = m_forward;
+	}
+
+	batch.pattern = &pattern;
+	batch.generation = &m_generation;
+	batch.expected = generation;
+	batch.scanned = 0;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	m_lastNotify = std::chrono::steady_clock::time_point();
+
+	u64 range = batch.forward ? batch.fileSize - batch.from : batch.from;
+	u64 numChunks = (range + kChunkSize - 1) / kChunkSize;
+	u32 chunksPerBatch = m_pool->getNumThreads() * kChunksPerThread;
+	u64 batchSize = (u64)chunksPerBatch * kChunkSize;
+
+	for(u64 first=0; first<numChunks; first+=chunksPerBatch)
+	{
+		// Next batch is read while this one is searched
+		u64 next = (first + chunksPerBatch) * kChunkSize;
+		if(next < range)
+		{
+			u64 size = std::min(batchSize, range - next);
+			batch.file->willNeed((off_t)(batch.forward ? batch.from + next : batch.from - next - size), (size_t)size);
+		}
+
+		u32 numTasks = (u32)std::min<u64>(chunksPerBatch, numChunks - first);
+		batch.first = first;
+		batch.nearest = numTasks;
+		batch.matches.assign(numTasks, kNoMatch);
+
+		{
+			std::lock_guard<std::mutex> work(m_workMutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			m_pool->run(chunkTask, &batch, numTasks);
+		}
+
+		bool complete;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(generation != m_generation)
+			{
+				return;
+			}
+
+			// Tasks are ordered by their distance from the start offset
+			if(batch.nearest < numTasks)
+			{
+				m_found = true;
+				m_offset = batch.matches[batch.nearest];
+			}
+
+			m_scanned = batch.scanned;
+			m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			m_complete = complete = m_found || next >= range;
+		}
+
+		notify(complete);
+		if(complete)
+		{
+			return;
+		}
+	}
+
+	// Nothing to search, i.e. backwards from the start of the file
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(generation != m_generation)
+		{
+			return;
+		}
+		m_complete = true;
+	}
+	notify(true);
+}
+
+void PatternSearch::notify(bool force)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(force || std::chrono::duration<double, std::milli>(now - m_lastNotify).count() >= kNotifyIntervalMs)
+	{
+		m_lastNotify = now;
+		if(m_notify)
+		{
+			m_notify(m_param);
+		}
+	}
+}
+
+int runSearch(const char* filename, const char* text, u32 numThreads)
+{
+	PatternSearch::Pattern pattern;
+	if(!PatternSearch::parsePattern(text, pattern))
+	{
+		printf("Invalid pattern %s\n", text);
+		return 1;
+	}
+
+	MappedFile file;
+	if(!file.open(filename))
+	{
+		printf("Can't open %s\n", filename);
+		return 1;
+	}
+
+	// Every match restarts the search behind it
+	PatternSearch search(NULL, NULL, numThreads);
+	u64 from = 0;
+	double seconds = 0.0;
+	u32 numMatches = 0;
+	PatternSearch::Stats stats;
+	do
+	{
+		bool started = search.start(file, pattern, from, true);
+
+		stats = search.getStats();
+		if(!started)
+		{
+			// Empty file, there's nothing to wait for
+			break;
+		}
+		while(!stats.complete)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			stats = search.getStats();
+		}
+
+		seconds += stats.seconds;
+		if(stats.found)
+		{
+			if(numMatches < kMaxListed)
+			{
+				printf("%llu\n", (unsigned long long)stats.offset);
+			}
+			++numMatches;
+			from = stats.offset + 1;
+		}
+	}
+	while(stats.found);
+
+	// Every byte of the file was covered once the last search ran into its end
+	printf("\n%u matches%s in %.1f MB, %.1f ms on %u threads (%.2f GB/s)\n", numMatches, numMatches > kMaxListed ? " (list truncated)" : "",
+		file.size() / (1024.0 * 1024.0), seconds * 1000.0, stats.numThreads,
+		seconds > 0.0 ? file.size() / seconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __SEARCH_H
+#define __SEARCH_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "common.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+//
+// Finds a byte pattern in a file. A worker splits the range from the start offset to the end
+// (or to the beginning of the file when searching backwards) into chunks which are searched in
+// parallel on a pool of its own, chunks overlap by the pattern length. Candidates are found by
+// a vector filter on two bytes of the pattern and verified, without vector instructions long
+// patterns are skipped through with a Boyer-Moore-Horspool shift table instead. Chunks beyond
+// the nearest match are skipped.
+//
+class PatternSearch
+{
+public:
+	typedef void (*NotifyFunc)(void* param);
+
+	static const u32 kChunkSize;
+	static const u32 kMaxPatternSize;
+	static const u32 kMinHorspoolSize; // Without a vector filter
+
+	struct Pattern
+	{
+		std::vector<u8> bytes; // Masked
+		std::vector<u8> mask; // Bits of each byte which have to match, 0 = any byte
+		u32 first; // First and last byte without wildcard bits, compared by the vector filter
+		u32 last;
+		bool horspool; // Skipped through with the shift table
+		u32 shift[256]; // Horspool shift by the last byte of the window
+	};
+
+	struct Stats
+	{
+		u64 fileSize;
+		u64 scanned; // Bytes
+		u32 numThreads;
+		double seconds; // Searching time so far
+		bool forward;
+		bool complete;
+		bool found;
+		u64 offset; // Of the match
+	};
+
+	// 0 threads = one per hardware thread
+	PatternSearch(NotifyFunc notify, void* param, u32 numThreads = 0);
+	~PatternSearch();
+
+	// Hex bytes with ? for any nibble ("42 4d ?? ??"), ASCII in quotes ("RIFF") and UTF-16 LE
+	// with a u prefix (u"Texture"), ? is any character within quotes and \ quotes the next one.
+	// Tokens can be mixed, at least one byte has to be given in full.
+	static bool parsePattern(const char* text, Pattern& pattern);
+
+	// Starts looking for the first match at or after from (the last one before from if not
+	// forward) in the background, a running search is aborted. File must stay open until
+	// detach() is called.
+	bool start(const MappedFile& file, const Pattern& pattern, u64 from, bool forward);
+	void detach();
+
+	Stats getStats() const;
+
+	// First match (last if not first) starting in data[0, scanSize), matches may reach up to size
+	static bool findInChunk(const Pattern& pattern, const u8* data, size_t size, size_t scanSize, bool first, size_t& position);
+
+private:
+	// Not copyable
+	PatternSearch(const PatternSearch&);
+	PatternSearch& operator=(const PatternSearch&);
+
+	struct Batch;
+	static void chunkTask(void* param, u32 task);
+
+	void run();
+	void search(u32 generation);
+	void notify(bool force);
+
+	NotifyFunc m_notify;
+	void* m_param;
+	u32 m_numThreads;
+
+	mutable std::mutex m_mutex; // Protects everything below except the work mutex
+	std::mutex m_workMutex; // Held by the worker while the pool reads file memory
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	ThreadPool* m_pool; // Created with the worker
+	std::atomic<u32> m_generation; // Bumped to abort a running search
+	bool m_quit;
+	bool m_pending; // Search requested
+
+	const MappedFile* m_file;
+	u64 m_fileSize;
+	Pattern m_pattern;
+	u64 m_from;
+	bool m_forward;
+	u64 m_scanned;
+	bool m_complete;
+	bool m_found;
+	u64 m_offset;
+	double m_seconds;
+	std::chrono::steady_clock::time_point m_lastNotify; // Worker only
+};
+
+// Prints the offsets of a pattern in a file and the search throughput to stdout, returns non-zero on errors
+int runSearch(const char* filename, const char* pattern, u32 numThreads);
+
+#endif
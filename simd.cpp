@@ -0,0 +1,941 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include "simd.h"
+#include "decoder.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+	#define SIMD_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SIMD_TARGET(x)
+	#else
+		#define SIMD_TARGET(x) __attribute__((target(x)))
+	#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define SIMD_ARM
+	#include <arm_neon.h>
+#endif
+
+namespace
+{
+	SimdLevel g_simdLevel = detectSimdLevel();
+
+	// Multipliers of the chunk hash rounds (those of xxHash32)
+	const u32 kHashPrime1 = 2654435761u;
+	const u32 kHashPrime2 = 2246822519u;
+
+	// Byte shuffle for 4 pixels of ps bytes starting at byte base into 12 RGB bytes (0x80 = zero)
+	void buildByteShuffle(const CompiledFormat& format, u32 ps, u32 base, u8 shuffle[16])
+	{
+		memset(shuffle, 0x80, 16);
+
+		for(u32 p=0; p<4; ++p)
+		{
+			for(u32 c=0; c<3; ++c)
+			{
+				if(format.mask[c] != 0)
+				{
+					shuffle[p * 3 + c] = (u8)(base + p * ps + format.shift[c] / 8);
+				}
+			}
+		}
+	}
+
+	// Shuffles interleaving 8 R and G bytes (rg) and 8 B bytes (bb) into 24 RGB bytes
+	void buildInterleave(u8 rgShuffle[32], u8 bShuffle[32])
+	{
+		memset(rgShuffle, 0x80, 32);
+		memset(bShuffle, 0x80, 32);
+
+		for(u32 k=0; k<24; ++k)
+		{
+			u32 p = k / 3;
+			u32 c = k % 3;
+
+			if(c < 2)
+			{
+				rgShuffle[k] = (u8)(c * 8 + p);
+			}
+			else
+			{
+				bShuffle[k] = (u8)p;
+			}
+		}
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET("ssse3")
+	u32 decodeBytesSSSE3(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		u32 ps = format.pixelSize;
+		u8 shuffle[16], lastShuffle[16];
+		buildByteShuffle(format, ps, 0, shuffle);
+
+		// 24 bit: the last group is loaded 4 bytes early so we never read past the 16 pixels
+		buildByteShuffle(format, ps, ps == 3 ? 4 : 0, lastShuffle);
+		u32 lastOffset = ps == 3 ? 32 : 48;
+
+		__m128i mask = _mm_loadu_si128((const __m128i*)shuffle);
+		__m128i lastMask = _mm_loadu_si128((const __m128i*)lastShuffle);
+		u32 n = 0;
+
+		for(; n+16<=count; n+=16, data+=16*ps, rgbOut+=48)
+		{
+			__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), mask);
+			__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 4 * ps)), mask);
+			__m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 8 * ps)), mask);
+			__m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + lastOffset)), lastMask);
+
+			_mm_storeu_si128((__m128i*)(rgbOut + 0), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+			_mm_storeu_si128((__m128i*)(rgbOut + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+			_mm_storeu_si128((__m128i*)(rgbOut + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	u32 decodeBytes32AVX2(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		u8 shuffle[16];
+		buildByteShuffle(format, 4, 0, shuffle);
+
+		__m128i lane = _mm_loadu_si128((const __m128i*)shuffle);
+		__m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(lane), lane, 1);
+		__m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7); // 12 bytes of each lane back to back
+		u32 n = 0;
+
+		for(; n+16<=count; n+=16, data+=64, rgbOut+=48)
+		{
+			__m256i a = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(data + 0)), mask), pack);
+			__m256i b = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(data + 32)), mask), pack);
+
+			_mm_storeu_si128((__m128i*)(rgbOut + 0), _mm256_castsi256_si128(a));
+			_mm_storel_epi64((__m128i*)(rgbOut + 16), _mm256_extracti128_si256(a, 1));
+			_mm_storeu_si128((__m128i*)(rgbOut + 24), _mm256_castsi256_si128(b));
+			_mm_storel_epi64((__m128i*)(rgbOut + 40), _mm256_extracti128_si256(b, 1));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("ssse3")
+	u32 decode16SSSE3(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		u8 rgShuffle[32], bShuffle[32];
+		buildInterleave(rgShuffle, bShuffle);
+
+		__m128i rs = _mm_cvtsi32_si128((int)format.shift[0]);
+		__m128i gs = _mm_cvtsi32_si128((int)format.shift[1]);
+		__m128i bs = _mm_cvtsi32_si128((int)format.shift[2]);
+		__m128i ru = _mm_cvtsi32_si128((int)format.scale[0]);
+		__m128i gu = _mm_cvtsi32_si128((int)format.scale[1]);
+		__m128i bu = _mm_cvtsi32_si128((int)format.scale[2]);
+		__m128i rm = _mm_set1_epi16((short)format.mask[0]);
+		__m128i gm = _mm_set1_epi16((short)format.mask[1]);
+		__m128i bm = _mm_set1_epi16((short)format.mask[2]);
+		__m128i rg0 = _mm_loadu_si128((const __m128i*)rgShuffle);
+		__m128i rg1 = _mm_loadu_si128((const __m128i*)(rgShuffle + 16));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)bShuffle);
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(bShuffle + 16));
+		__m128i zero = _mm_setzero_si128();
+		u32 n = 0;
+
+		for(; n+8<=count; n+=8, data+=16, rgbOut+=24)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)data);
+			__m128i r = _mm_sll_epi16(_mm_and_si128(_mm_srl_epi16(v, rs), rm), ru);
+			__m128i g = _mm_sll_epi16(_mm_and_si128(_mm_srl_epi16(v, gs), gm), gu);
+			__m128i b = _mm_sll_epi16(_mm_and_si128(_mm_srl_epi16(v, bs), bm), bu);
+
+			__m128i rg = _mm_packus_epi16(r, g);
+			__m128i bb = _mm_packus_epi16(b, zero);
+
+			_mm_storeu_si128((__m128i*)rgbOut, _mm_or_si128(_mm_shuffle_epi8(rg, rg0), _mm_shuffle_epi8(bb, b0)));
+			_mm_storel_epi64((__m128i*)(rgbOut + 16), _mm_or_si128(_mm_shuffle_epi8(rg, rg1), _mm_shuffle_epi8(bb, b1)));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	u32 decode16AVX2(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		u8 rgShuffle[32], bShuffle[32];
+		buildInterleave(rgShuffle, bShuffle);
+
+		__m128i rs = _mm_cvtsi32_si128((int)format.shift[0]);
+		__m128i gs = _mm_cvtsi32_si128((int)format.shift[1]);
+		__m128i bs = _mm_cvtsi32_si128((int)format.shift[2]);
+		__m128i ru = _mm_cvtsi32_si128((int)format.scale[0]);
+		__m128i gu = _mm_cvtsi32_si128((int)format.scale[1]);
+		__m128i bu = _mm_cvtsi32_si128((int)format.scale[2]);
+		__m256i rm = _mm256_set1_epi16((short)format.mask[0]);
+		__m256i gm = _mm256_set1_epi16((short)format.mask[1]);
+		__m256i bm = _mm256_set1_epi16((short)format.mask[2]);
+		__m256i rg0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)rgShuffle));
+		__m256i rg1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(rgShuffle + 16)));
+		__m256i b0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)bShuffle));
+		__m256i b1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(bShuffle + 16)));
+		__m256i zero = _mm256_setzero_si256();
+		u32 n = 0;
+
+		// Packing works per 128 bit lane, each lane ends up with 8 pixels of output
+		for(; n+16<=count; n+=16, data+=32, rgbOut+=48)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)data);
+			__m256i r = _mm256_sll_epi16(_mm256_and_si256(_mm256_srl_epi16(v, rs), rm), ru);
+			__m256i g = _mm256_sll_epi16(_mm256_and_si256(_mm256_srl_epi16(v, gs), gm), gu);
+			__m256i b = _mm256_sll_epi16(_mm256_and_si256(_mm256_srl_epi16(v, bs), bm), bu);
+
+			__m256i rg = _mm256_packus_epi16(r, g);
+			__m256i bb = _mm256_packus_epi16(b, zero);
+			__m256i lo = _mm256_or_si256(_mm256_shuffle_epi8(rg, rg0), _mm256_shuffle_epi8(bb, b0));
+			__m256i hi = _mm256_or_si256(_mm256_shuffle_epi8(rg, rg1), _mm256_shuffle_epi8(bb, b1));
+
+			_mm_storeu_si128((__m128i*)(rgbOut + 0), _mm256_castsi256_si128(lo));
+			_mm_storel_epi64((__m128i*)(rgbOut + 16), _mm256_castsi256_si128(hi));
+			_mm_storeu_si128((__m128i*)(rgbOut + 24), _mm256_extracti128_si256(lo, 1));
+			_mm_storel_epi64((__m128i*)(rgbOut + 40), _mm256_extracti128_si256(hi, 1));
+		}
+
+		return n;
+	}
+	SIMD_TARGET("ssse3")
+	u32 butterfliesSSE(float* aRe, float* aIm, float* bRe, float* bIm, const float* wRe, const float* wIm, u32 count)
+	{
+		u32 n = 0;
+
+		for(; n+4<=count; n+=4)
+		{
+			__m128 wr = _mm_loadu_ps(wRe + n);
+			__m128 wi = _mm_loadu_ps(wIm + n);
+			__m128 br = _mm_loadu_ps(bRe + n);
+			__m128 bi = _mm_loadu_ps(bIm + n);
+			__m128 ar = _mm_loadu_ps(aRe + n);
+			__m128 ai = _mm_loadu_ps(aIm + n);
+			__m128 tr = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+			__m128 ti = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+
+			_mm_storeu_ps(aRe + n, _mm_add_ps(ar, tr));
+			_mm_storeu_ps(aIm + n, _mm_add_ps(ai, ti));
+			_mm_storeu_ps(bRe + n, _mm_sub_ps(ar, tr));
+			_mm_storeu_ps(bIm + n, _mm_sub_ps(ai, ti));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("ssse3")
+	u32 butterfliesDifSSE(float* aRe, float* aIm, float* bRe, float* bIm, const float* wRe, const float* wIm, u32 count)
+	{
+		u32 n = 0;
+
+		for(; n+4<=count; n+=4)
+		{
+			__m128 wr = _mm_loadu_ps(wRe + n);
+			__m128 wi = _mm_loadu_ps(wIm + n);
+			__m128 ar = _mm_loadu_ps(aRe + n);
+			__m128 ai = _mm_loadu_ps(aIm + n);
+			__m128 br = _mm_loadu_ps(bRe + n);
+			__m128 bi = _mm_loadu_ps(bIm + n);
+			__m128 dr = _mm_sub_ps(ar, br);
+			__m128 di = _mm_sub_ps(ai, bi);
+
+			_mm_storeu_ps(aRe + n, _mm_add_ps(ar, br));
+			_mm_storeu_ps(aIm + n, _mm_add_ps(ai, bi));
+			_mm_storeu_ps(bRe + n, _mm_sub_ps(_mm_mul_ps(dr, wr), _mm_mul_ps(di, wi)));
+			_mm_storeu_ps(bIm + n, _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr)));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	u32 butterfliesAVX2(float* aRe, float* aIm, float* bRe, float* bIm, const float* wRe, const float* wIm, u32 count)
+	{
+		u32 n = 0;
+
+		for(; n+8<=count; n+=8)
+		{
+			__m256 wr = _mm256_loadu_ps(wRe + n);
+			__m256 wi = _mm256_loadu_ps(wIm + n);
+			__m256 br = _mm256_loadu_ps(bRe + n);
+			__m256 bi = _mm256_loadu_ps(bIm + n);
+			__m256 ar = _mm256_loadu_ps(aRe + n);
+			__m256 ai = _mm256_loadu_ps(aIm + n);
+			__m256 tr = _mm256_sub_ps(_mm256_mul_ps(wr, br), _mm256_mul_ps(wi, bi));
+			__m256 ti = _mm256_add_ps(_mm256_mul_ps(wr, bi), _mm256_mul_ps(wi, br));
+
+			_mm256_storeu_ps(aRe + n, _mm256_add_ps(ar, tr));
+			_mm256_storeu_ps(aIm + n, _mm256_add_ps(ai, ti));
+			_mm256_storeu_ps(bRe + n, _mm256_sub_ps(ar, tr));
+			_mm256_storeu_ps(bIm + n, _mm256_sub_ps(ai, ti));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	u32 butterfliesDifAVX2(float* aRe, float* aIm, float* bRe, float* bIm, const float* wRe, const float* wIm, u32 count)
+	{
+		u32 n = 0;
+
+		for(; n+8<=count; n+=8)
+		{
+			__m256 wr = _mm256_loadu_ps(wRe + n);
+			__m256 wi = _mm256_loadu_ps(wIm + n);
+			__m256 ar = _mm256_loadu_ps(aRe + n);
+			__m256 ai = _mm256_loadu_ps(aIm + n);
+			__m256 br = _mm256_loadu_ps(bRe + n);
+			__m256 bi = _mm256_loadu_ps(bIm + n);
+			__m256 dr = _mm256_sub_ps(ar, br);
+			__m256 di = _mm256_sub_ps(ai, bi);
+
+			_mm256_storeu_ps(aRe + n, _mm256_add_ps(ar, br));
+			_mm256_storeu_ps(aIm + n, _mm256_add_ps(ai, bi));
+			_mm256_storeu_ps(bRe + n, _mm256_sub_ps(_mm256_mul_ps(dr, wr), _mm256_mul_ps(di, wi)));
+			_mm256_storeu_ps(bIm + n, _mm256_add_ps(_mm256_mul_ps(dr, wi), _mm256_mul_ps(di, wr)));
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("ssse3")
+	void stageSSE(float* re, float* im, u32 fftSize, u32 half, const float* wRe, const float* wIm, bool dif)
+	{
+		for(u32 k=0; k<fftSize; k+=2*half)
+		{
+			if(dif)
+			{
+				butterfliesDifSSE(re + k, im + k, re + k + half, im + k + half, wRe, wIm, half);
+			}
+			else
+			{
+				butterfliesSSE(re + k, im + k, re + k + half, im + k + half, wRe, wIm, half);
+			}
+		}
+	}
+
+	SIMD_TARGET("avx2")
+	void stageAVX2(float* re, float* im, u32 fftSize, u32 half, const float* wRe, const float* wIm, bool dif)
+	{
+		for(u32 k=0; k<fftSize; k+=2*half)
+		{
+			if(dif)
+			{
+				butterfliesDifAVX2(re + k, im + k, re + k + half, im + k + half, wRe, wIm, half);
+			}
+			else
+			{
+				butterfliesAVX2(re + k, im + k, re + k + half, im + k + half, wRe, wIm, half);
+			}
+		}
+	}
+	// Signature pairs (BM, DD, 0x89 P, 0xab K, 0xff 0xd8) and TGA image types 1-3 and 9-11
+	// behind a colormap type of 0 or 1 with a zero origin 6 bytes on, see ImageCarver::scanChunk
+	SIMD_TARGET("ssse3")
+	size_t skipCarveSSE(const u8* data, size_t count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t n = 0;
+
+		for(; n+16<=count; n+=16)
+		{
+			const u8* p = data + n;
+			__m128i b0 = _mm_loadu_si128((const __m128i*)p);
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(p + 1));
+			__m128i prev = _mm_loadu_si128((const __m128i*)(p - 1));
+			__m128i origin = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i*)(p + 6)), _mm_loadu_si128((const __m128i*)(p + 7))),
+			                              _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + 8)), _mm_loadu_si128((const __m128i*)(p + 9))));
+
+			__m128i sig = _mm_and_si128(_mm_cmpeq_epi8(b0, _mm_set1_epi8('B')), _mm_cmpeq_epi8(b1, _mm_set1_epi8('M')));
+			sig = _mm_or_si128(sig, _mm_and_si128(_mm_cmpeq_epi8(b0, _mm_set1_epi8('D')), _mm_cmpeq_epi8(b1, _mm_set1_epi8('D'))));
+			sig = _mm_or_si128(sig, _mm_and_si128(_mm_cmpeq_epi8(b0, _mm_set1_epi8((char)0x89)), _mm_cmpeq_epi8(b1, _mm_set1_epi8('P'))));
+			sig = _mm_or_si128(sig, _mm_and_si128(_mm_cmpeq_epi8(b0, _mm_set1_epi8((char)0xab)), _mm_cmpeq_epi8(b1, _mm_set1_epi8('K'))));
+			sig = _mm_or_si128(sig, _mm_and_si128(_mm_cmpeq_epi8(b0, _mm_set1_epi8((char)0xff)), _mm_cmpeq_epi8(b1, _mm_set1_epi8((char)0xd8))));
+
+			__m128i tga = _mm_andnot_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(_mm_and_si128(b0, _mm_set1_epi8((char)0xf4)), zero));
+			tga = _mm_and_si128(tga, _mm_cmpeq_epi8(_mm_and_si128(prev, _mm_set1_epi8((char)0xfe)), zero));
+			tga = _mm_and_si128(tga, _mm_cmpeq_epi8(origin, zero));
+
+			if(_mm_movemask_epi8(_mm_or_si128(sig, tga)) != 0)
+			{
+				break;
+			}
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	size_t skipCarveAVX2(const u8* data, size_t count)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		size_t n = 0;
+
+		for(; n+32<=count; n+=32)
+		{
+			const u8* p = data + n;
+			__m256i b0 = _mm256_loadu_si256((const __m256i*)p);
+			__m256i b1 = _mm256_loadu_si256((const __m256i*)(p + 1));
+			__m256i prev = _mm256_loadu_si256((const __m256i*)(p - 1));
+			__m256i origin = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256((const __m256i*)(p + 6)), _mm256_loadu_si256((const __m256i*)(p + 7))),
+			                                 _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(p + 8)), _mm256_loadu_si256((const __m256i*)(p + 9))));
+
+			__m256i sig = _mm256_and_si256(_mm256_cmpeq_epi8(b0, _mm256_set1_epi8('B')), _mm256_cmpeq_epi8(b1, _mm256_set1_epi8('M')));
+			sig = _mm256_or_si256(sig, _mm256_and_si256(_mm256_cmpeq_epi8(b0, _mm256_set1_epi8('D')), _mm256_cmpeq_epi8(b1, _mm256_set1_epi8('D'))));
+			sig = _mm256_or_si256(sig, _mm256_and_si256(_mm256_cmpeq_epi8(b0, _mm256_set1_epi8((char)0x89)), _mm256_cmpeq_epi8(b1, _mm256_set1_epi8('P'))));
+			sig = _mm256_or_si256(sig, _mm256_and_si256(_mm256_cmpeq_epi8(b0, _mm256_set1_epi8((char)0xab)), _mm256_cmpeq_epi8(b1, _mm256_set1_epi8('K'))));
+			sig = _mm256_or_si256(sig, _mm256_and_si256(_mm256_cmpeq_epi8(b0, _mm256_set1_epi8((char)0xff)), _mm256_cmpeq_epi8(b1, _mm256_set1_epi8((char)0xd8))));
+
+			__m256i tga = _mm256_andnot_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(_mm256_and_si256(b0, _mm256_set1_epi8((char)0xf4)), zero));
+			tga = _mm256_and_si256(tga, _mm256_cmpeq_epi8(_mm256_and_si256(prev, _mm256_set1_epi8((char)0xfe)), zero));
+			tga = _mm256_and_si256(tga, _mm256_cmpeq_epi8(origin, zero));
+
+			if(_mm256_movemask_epi8(_mm256_or_si256(sig, tga)) != 0)
+			{
+				break;
+			}
+		}
+
+		return n;
+	}
+
+	// First and last byte of a search pattern, see PatternSearch::findInChunk
+	SIMD_TARGET("ssse3")
+	size_t skipPairSSE(const u8* data, size_t count, u8 a, u8 b, size_t distance)
+	{
+		const __m128i va = _mm_set1_epi8((char)a);
+		const __m128i vb = _mm_set1_epi8((char)b);
+		size_t n = 0;
+
+		for(; n+16<=count; n+=16)
+		{
+			__m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + n)), va);
+			__m128i last = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + n + distance)), vb);
+			if(_mm_movemask_epi8(_mm_and_si128(first, last)) != 0)
+			{
+				break;
+			}
+		}
+
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	size_t skipPairAVX2(const u8* data, size_t count, u8 a, u8 b, size_t distance)
+	{
+		const __m256i va = _mm256_set1_epi8((char)a);
+		const __m256i vb = _mm256_set1_epi8((char)b);
+		size_t n = 0;
+
+		for(; n+32<=count; n+=32)
+		{
+			__m256i first = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + n)), va);
+			__m256i last = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + n + distance)), vb);
+			if(_mm256_movemask_epi8(_mm256_and_si256(first, last)) != 0)
+			{
+				break;
+			}
+		}
+
+		return n;
+	}
+
+	// Low 32 bits of the lane products, SSSE3 has no 32 bit multiply
+	SIMD_TARGET("ssse3")
+	inline __m128i mulLoSSE(__m128i a, __m128i b)
+	{
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	// Lanes 0-3 and 4-7 of the chunk hash, see DiffIndex::hashChunk
+	SIMD_TARGET("ssse3")
+	size_t hashStripesSSE(const u8* data, size_t count, u32 lanes[8])
+	{
+		const __m128i prime1 = _mm_set1_epi32((int)kHashPrime1);
+		const __m128i prime2 = _mm_set1_epi32((int)kHashPrime2);
+		__m128i lo = _mm_loadu_si128((const __m128i*)lanes);
+		__m128i hi = _mm_loadu_si128((const __m128i*)(lanes + 4));
+		size_t n = 0;
+
+		for(; n+32<=count; n+=32)
+		{
+			lo = _mm_add_epi32(lo, mulLoSSE(_mm_loadu_si128((const __m128i*)(data + n)), prime2));
+			hi = _mm_add_epi32(hi, mulLoSSE(_mm_loadu_si128((const __m128i*)(data + n + 16)), prime2));
+			lo = mulLoSSE(_mm_or_si128(_mm_slli_epi32(lo, 13), _mm_srli_epi32(lo, 19)), prime1);
+			hi = mulLoSSE(_mm_or_si128(_mm_slli_epi32(hi, 13), _mm_srli_epi32(hi, 19)), prime1);
+		}
+
+		_mm_storeu_si128((__m128i*)lanes, lo);
+		_mm_storeu_si128((__m128i*)(lanes + 4), hi);
+		return n;
+	}
+
+	SIMD_TARGET("avx2")
+	size_t hashStripesAVX2(const u8* data, size_t count, u32 lanes[8])
+	{
+		const __m256i prime1 = _mm256_set1_epi32((int)kHashPrime1);
+		const __m256i prime2 = _mm256_set1_epi32((int)kHashPrime2);
+		__m256i acc = _mm256_loadu_si256((const __m256i*)lanes);
+		size_t n = 0;
+
+		for(; n+32<=count; n+=32)
+		{
+			acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(data + n)), prime2));
+			acc = _mm256_mullo_epi32(_mm256_or_si256(_mm256_slli_epi32(acc, 13), _mm256_srli_epi32(acc, 19)), prime1);
+		}
+
+		_mm256_storeu_si256((__m256i*)lanes, acc);
+		return n;
+	}
+#endif
+
+#ifdef SIMD_ARM
+	u32 decodeBytesNEON(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		u32 ps = format.pixelSize;
+		uint8x16_t rm = vdupq_n_u8((u8)format.mask[0]);
+		uint8x16_t gm = vdupq_n_u8((u8)format.mask[1]);
+		uint8x16_t bm = vdupq_n_u8((u8)format.mask[2]);
+		u32 ro = format.shift[0] / 8, go = format.shift[1] / 8, bo = format.shift[2] / 8;
+		uint8x16_t ch[4];
+		ch[3] = vdupq_n_u8(0);
+		u32 n = 0;
+
+		// The structured loads split the channels, the store interleaves RGB again
+		for(; n+16<=count; n+=16, data+=16*ps, rgbOut+=48)
+		{
+			if(ps == 4)
+			{
+				uint8x16x4_t v = vld4q_u8(data);
+				ch[0] = v.val[0];
+				ch[1] = v.val[1];
+				ch[2] = v.val[2];
+				ch[3] = v.val[3];
+			}
+			else
+			{
+				uint8x16x3_t v = vld3q_u8(data);
+				ch[0] = v.val[0];
+				ch[1] = v.val[1];
+				ch[2] = v.val[2];
+			}
+
+			uint8x16x3_t out;
+			out.val[0] = vandq_u8(ch[ro], rm);
+			out.val[1] = vandq_u8(ch[go], gm);
+			out.val[2] = vandq_u8(ch[bo], bm);
+			vst3q_u8(rgbOut, out);
+		}
+
+		return n;
+	}
+
+	u32 decode16NEON(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+	{
+		int16x8_t rs = vdupq_n_s16(-(int)format.shift[0]);
+		int16x8_t gs = vdupq_n_s16(-(int)format.shift[1]);
+		int16x8_t bs = vdupq_n_s16(-(int)format.shift[2]);
+		int16x8_t ru = vdupq_n_s16((int)format.scale[0]);
+		int16x8_t gu = vdupq_n_s16((int)format.scale[1]);
+		int16x8_t bu = vdupq_n_s16((int)format.scale[2]);
+		uint16x8_t rm = vdupq_n_u16((u16)format.mask[0]);
+		uint16x8_t gm = vdupq_n_u16((u16)format.mask[1]);
+		uint16x8_t bm = vdupq_n_u16((u16)format.mask[2]);
+		u32 n = 0;
+
+		for(; n+8<=count; n+=8, data+=16, rgbOut+=24)
+		{
+			// Byte load, the data isn't necessarily 2 byte aligned
+			uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(data));
+
+			uint8x8x3_t out;
+			out.val[0] = vmovn_u16(vshlq_u16(vandq_u16(vshlq_u16(v, rs), rm), ru));
+			out.val[1] = vmovn_u16(vshlq_u16(vandq_u16(vshlq_u16(v, gs), gm), gu));
+			out.val[2] = vmovn_u16(vshlq_u16(vandq_u16(vshlq_u16(v, bs), bm), bu));
+			vst3_u8(rgbOut, out);
+		}
+
+		return n;
+	}
+	u32 butterfliesNEON(float* aRe, float* aIm, float* bRe, float* bIm, const float* wRe, const float* wIm, u32 count)
+	{
+		u32 n = 0;
+
+		for(; n+4<=count; n+=4)
+		{
+			float32x4_t wr = vld1q_f32(wRe + n);
+			float32x4_t wi = vld1q_f32(wIm + n);
+			float32x4_t br = vld1q_f32(bRe + n);
+			float32x4_t bi = vld1q_f32(bIm + n);
+			float32x4_t ar = vld1q_f32(aRe + n);
+			float32x4_t ai = vld1q_f32(aIm + n);
+			float32x4_t tr = vsubq_f32(vmulq_f32(wr, br), vmulq_f32(wi, bi));
+			float32x4_t ti = vaddq_f32(vmulq_f32(wr, bi), vmulq_f32(wi, br));
+
+			vst1q_f32(aRe + n, vaddq_f32(ar, tr));
+			vst1q_f32(aIm + n, vaddq_f32(ai, ti));
+			vst1q_f32(bRe + n, vsubq_f32(ar, tr));
+			vst1q_f32(bIm + n, vsubq_f32(ai, ti));
+		}
+
+		return n;
+	}
+
+	u32 butterfliesDifNEON(float* aRe, float* aIm, float* bRe, float* bIm, const float* wRe, const float* wIm, u32 count)
+	{
+		u32 n = 0;
+
+		for(; n+4<=count; n+=4)
+		{
+			float32x4_t wr = vld1q_f32(wRe + n);
+			float32x4_t wi = vld1q_f32(wIm + n);
+			float32x4_t ar = vld1q_f32(aRe + n);
+			float32x4_t ai = vld1q_f32(aIm + n);
+			float32x4_t br = vld1q_f32(bRe + n);
+			float32x4_t bi = vld1q_f32(bIm + n);
+			float32x4_t dr = vsubq_f32(ar, br);
+			float32x4_t di = vsubq_f32(ai, bi);
+
+			vst1q_f32(aRe + n, vaddq_f32(ar, br));
+			vst1q_f32(aIm + n, vaddq_f32(ai, bi));
+			vst1q_f32(bRe + n, vsubq_f32(vmulq_f32(dr, wr), vmulq_f32(di, wi)));
+			vst1q_f32(bIm + n, vaddq_f32(vmulq_f32(dr, wi), vmulq_f32(di, wr)));
+		}
+
+		return n;
+	}
+
+	void stageNEON(float* re, float* im, u32 fftSize, u32 half, const float* wRe, const float* wIm, bool dif)
+	{
+		for(u32 k=0; k<fftSize; k+=2*half)
+		{
+			if(dif)
+			{
+				butterfliesDifNEON(re + k, im + k, re + k + half, im + k + half, wRe, wIm, half);
+			}
+			else
+			{
+				butterfliesNEON(re + k, im + k, re + k + half, im + k + half, wRe, wIm, half);
+			}
+		}
+	}
+	size_t skipCarveNEON(const u8* data, size_t count)
+	{
+		const uint8x16_t zero = vdupq_n_u8(0);
+		size_t n = 0;
+
+		for(; n+16<=count; n+=16)
+		{
+			const u8* p = data + n;
+			uint8x16_t b0 = vld1q_u8(p);
+			uint8x16_t b1 = vld1q_u8(p + 1);
+			uint8x16_t prev = vld1q_u8(p - 1);
+			uint8x16_t origin = vorrq_u8(vorrq_u8(vld1q_u8(p + 6), vld1q_u8(p + 7)), vorrq_u8(vld1q_u8(p + 8), vld1q_u8(p + 9)));
+
+			uint8x16_t sig = vandq_u8(vceqq_u8(b0, vdupq_n_u8('B')), vceqq_u8(b1, vdupq_n_u8('M')));
+			sig = vorrq_u8(sig, vandq_u8(vceqq_u8(b0, vdupq_n_u8('D')), vceqq_u8(b1, vdupq_n_u8('D'))));
+			sig = vorrq_u8(sig, vandq_u8(vceqq_u8(b0, vdupq_n_u8(0x89)), vceqq_u8(b1, vdupq_n_u8('P'))));
+			sig = vorrq_u8(sig, vandq_u8(vceqq_u8(b0, vdupq_n_u8(0xab)), vceqq_u8(b1, vdupq_n_u8('K'))));
+			sig = vorrq_u8(sig, vandq_u8(vceqq_u8(b0, vdupq_n_u8(0xff)), vceqq_u8(b1, vdupq_n_u8(0xd8))));
+
+			uint8x16_t tga = vbicq_u8(vceqq_u8(vandq_u8(b0, vdupq_n_u8(0xf4)), zero), vceqq_u8(b0, zero));
+			tga = vandq_u8(tga, vceqq_u8(vandq_u8(prev, vdupq_n_u8(0xfe)), zero));
+			tga = vandq_u8(tga, vceqq_u8(origin, zero));
+
+			uint64x2_t any = vreinterpretq_u64_u8(vorrq_u8(sig, tga));
+			if((vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) != 0)
+			{
+				break;
+			}
+		}
+
+		return n;
+	}
+
+	size_t skipPairNEON(const u8* data, size_t count, u8 a, u8 b, size_t distance)
+	{
+		const uint8x16_t va = vdupq_n_u8(a);
+		const uint8x16_t vb = vdupq_n_u8(b);
+		size_t n = 0;
+
+		for(; n+16<=count; n+=16)
+		{
+			uint8x16_t pair = vandq_u8(vceqq_u8(vld1q_u8(data + n), va), vceqq_u8(vld1q_u8(data + n + distance), vb));
+			uint64x2_t any = vreinterpretq_u64_u8(pair);
+			if((vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) != 0)
+			{
+				break;
+			}
+		}
+
+		return n;
+	}
+
+	size_t hashStripesNEON(const u8* data, size_t count, u32 lanes[8])
+	{
+		const uint32x4_t prime1 = vdupq_n_u32(kHashPrime1);
+		const uint32x4_t prime2 = vdupq_n_u32(kHashPrime2);
+		uint32x4_t lo = vld1q_u32(lanes);
+		uint32x4_t hi = vld1q_u32(lanes + 4);
+		size_t n = 0;
+
+		for(; n+32<=count; n+=32)
+		{
+			lo = vmlaq_u32(lo, vreinterpretq_u32_u8(vld1q_u8(data + n)), prime2);
+			hi = vmlaq_u32(hi, vreinterpretq_u32_u8(vld1q_u8(data + n + 16)), prime2);
+			lo = vmulq_u32(vsriq_n_u32(vshlq_n_u32(lo, 13), lo, 19), prime1);
+			hi = vmulq_u32(vsriq_n_u32(vshlq_n_u32(hi, 13), hi, 19), prime1);
+		}
+
+		vst1q_u32(lanes, lo);
+		vst1q_u32(lanes + 4, hi);
+		return n;
+	}
+#endif
+};
+
+SimdLevel detectSimdLevel()
+{
+	static SimdLevel level = SIMD_None;
+	static bool detected = false;
+
+	if(detected)
+	{
+		return level;
+	}
+
+	#if defined SIMD_X86 && defined _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx2 = false;
+
+	// AVX2 also needs the OS to save the YMM registers
+	if(maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	level = avx2 ? SIMD_AVX2 : ssse3 ? SIMD_SSSE3 : SIMD_None;
+	#elif defined SIMD_X86
+	__builtin_cpu_init();
+	level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 : __builtin_cpu_supports("ssse3") ? SIMD_SSSE3 : SIMD_None;
+	#elif defined SIMD_ARM
+	// NEON is part of every ARMv8 CPU and a build option on ARMv7, nothing to detect at runtime
+	level = SIMD_NEON;
+	#endif
+
+	detected = true;
+	return level;
+}
+
+SimdLevel getSimdLevel()
+{
+	return g_simdLevel;
+}
+
+void setSimdLevel(SimdLevel level)
+{
+	// Never go beyond what the CPU supports
+	SimdLevel best = detectSimdLevel();
+	g_simdLevel = (level == SIMD_None || best == SIMD_None) ? SIMD_None : (level > best ? best : level);
+}
+
+const char* getSimdName(SimdLevel level)
+{
+	switch(level)
+	{
+	case SIMD_SSSE3:
+		return "SSSE3";
+	case SIMD_AVX2:
+		return "AVX2";
+	case SIMD_NEON:
+		return "NEON";
+	default:
+		return "None";
+	}
+}
+
+bool hasSimdKernel(const CompiledFormat& format, SimdLevel level)
+{
+	if(level == SIMD_None)
+	{
+		return false;
+	}
+
+	switch(format.kernel)
+	{
+	case CompiledFormat::K_Bytes24:
+	case CompiledFormat::K_Bytes32:
+	case CompiledFormat::K_Table16:
+		return true;
+	default:
+		return false;
+	}
+}
+
+u32 decodeSpanSimd(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut)
+{
+	// Not worth setting up the vectors for short spans (narrow tiles, RLE runs)
+	if(count < 16)
+	{
+		return 0;
+	}
+
+	switch(format.simd)
+	{
+	#ifdef SIMD_X86
+	case SIMD_AVX2:
+		if(format.kernel == CompiledFormat::K_Bytes32)
+		{
+			return decodeBytes32AVX2(format, data, count, rgbOut);
+		}
+		else if(format.kernel == CompiledFormat::K_Table16)
+		{
+			return decode16AVX2(format, data, count, rgbOut);
+		}
+		return decodeBytesSSSE3(format, data, count, rgbOut);
+	case SIMD_SSSE3:
+		if(format.kernel == CompiledFormat::K_Table16)
+		{
+			return decode16SSSE3(format, data, count, rgbOut);
+		}
+		return decodeBytesSSSE3(format, data, count, rgbOut);
+	#endif
+	#ifdef SIMD_ARM
+	case SIMD_NEON:
+		if(format.kernel == CompiledFormat::K_Table16)
+		{
+			return decode16NEON(format, data, count, rgbOut);
+		}
+		return decodeBytesNEON(format, data, count, rgbOut);
+	#endif
+	default:
+		return 0;
+	}
+}
+
+bool fftStageSimd(float* re, float* im, u32 fftSize, u32 half, const float* wRe, const float* wIm, bool dif)
+{
+	switch(g_simdLevel)
+	{
+	#ifdef SIMD_X86
+	case SIMD_AVX2:
+		if(half % 8 == 0)
+		{
+			stageAVX2(re, im, fftSize, half, wRe, wIm, dif);
+			return true;
+		}
+		// Fall through
+	case SIMD_SSSE3:
+		if(half % 4 == 0)
+		{
+			stageSSE(re, im, fftSize, half, wRe, wIm, dif);
+			return true;
+		}
+		return false;
+	#endif
+	#ifdef SIMD_ARM
+	case SIMD_NEON:
+		if(half % 4 == 0)
+		{
+			stageNEON(re, im, fftSize, half, wRe, wIm, dif);
+			return true;
+		}
+		return false;
+	#endif
+	default:
+		return false;
+	}
+}
+
+size_t skipCarveSimd(const u8* data, size_t count)
+{
+	switch(g_simdLevel)
+	{
+	#ifdef SIMD_X86
+	case SIMD_AVX2:
+		return skipCarveAVX2(data, count);
+	case SIMD_SSSE3:
+		return skipCarveSSE(data, count);
+	#endif
+	#ifdef SIMD_ARM
+	case SIMD_NEON:
+		return skipCarveNEON(data, count);
+	#endif
+	default:
+		return 0;
+	}
+}
+
+size_t skipPairSimd(const u8* data, size_t count, u8 a, u8 b, size_t distance)
+{
+	switch(g_simdLevel)
+	{
+	#ifdef SIMD_X86
+	case SIMD_AVX2:
+		return skipPairAVX2(data, count, a, b, distance);
+	case SIMD_SSSE3:
+		return skipPairSSE(data, count, a, b, distance);
+	#endif
+	#ifdef SIMD_ARM
+	case SIMD_NEON:
+		return skipPairNEON(data, count, a, b, distance);
+	#endif
+	default:
+		return 0;
+	}
+}
+
+size_t hashStripesSimd(const u8* data, size_t count, u32 lanes[8])
+{
+	switch(g_simdLevel)
+	{
+	#ifdef SIMD_X86
+	case SIMD_AVX2:
+		return hashStripesAVX2(data, count, lanes);
+	case SIMD_SSSE3:
+		return hashStripesSSE(data, count, lanes);
+	#endif
+	#ifdef SIMD_ARM
+	case SIMD_NEON:
+		return hashStripesNEON(data, count, lanes);
+	#endif
+	default:
+		return 0;
+	}
+}
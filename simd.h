@@ -0,0 +1,74 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __SIMD_H
+#define __SIMD_H
+
+#include "common.h"
+
+struct CompiledFormat;
+
+enum SimdLevel
+{
+	SIMD_None = 0,
+	SIMD_SSSE3,
+	SIMD_AVX2,
+	SIMD_NEON
+};
+
+// Best instruction set of the CPU we run on (detected once)
+SimdLevel detectSimdLevel();
+
+// Instruction set used by newly compiled formats, can be lowered (i.e. SIMD_None for the scalar path)
+SimdLevel getSimdLevel();
+void setSimdLevel(SimdLevel level);
+const char* getSimdName(SimdLevel level);
+
+// Whether there is a vector kernel for the compiled format
+bool hasSimdKernel(const CompiledFormat& format, SimdLevel level);
+
+// Decodes as many whole vectors of pixels as possible, returns the number of pixels done.
+// The remainder is left to the scalar kernel.
+u32 decodeSpanSimd(const CompiledFormat& format, const u8* data, u32 count, u8* rgbOut);
+
+// One radix-2 stage of an FFT on split complex arrays: pairs half apart within every group of
+// 2 * half values, decimation in time (a, b) = (a + w * b, a - w * b) or in frequency
+// (a, b) = (a + b, (a - b) * w) with the stage's half twiddles. Returns false if there is no
+// vector kernel for the stage, it is left to the scalar loop then.
+bool fftStageSimd(float* re, float* im, u32 fftSize, u32 half, const float* wRe, const float* wIm, bool dif);
+
+// Leading bytes of data[0, count) which can't start an embedded image header (see
+// ImageCarver::scanChunk), whole vectors only. Reads data[-1] up to data[count + 8].
+size_t skipCarveSimd(const u8* data, size_t count);
+
+// Leading positions of data[0, count) where data[i] isn't a or data[i + distance] isn't b (two
+// bytes of a search pattern), whole vectors only. Reads data[0, count + distance).
+size_t skipPairSimd(const u8* data, size_t count, u8 a, u8 b, size_t distance);
+
+// Rounds of the 8 lanes of a chunk hash (see DiffIndex::hashChunk) over the whole 32 byte
+// stripes of data[0, count), returns the bytes done. The rest is left to the scalar rounds.
+size_t hashStripesSimd(const u8* data, size_t count, u32 lanes[8]);
+
+#endif
+
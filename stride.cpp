@@ -0,0 +1,509 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "stride.h"
+#include "simd.h"
+
+const u32 StrideDetector::kMaxWindow = 4 * 1024 * 1024;
+const u32 StrideDetector::kMaxPixelSize = 4;
+const u32 StrideDetector::kMinStride = 8;
+const u32 StrideDetector::kMaxStride = 16384;
+
+namespace
+{
+	// Bytes looked at for the pixel size, the byte pattern repeats often enough within them
+	const u32 kPixelSizeWindow = 1024 * 1024;
+
+	// Byte products summed up in 32 bits at a time
+	const u32 kProductChunk = 65536;
+
+	// A divisor of a stride scoring at least this share of it is the actual stride, the other one a multiple
+	const float kFundamentalShare = 0.95f;
+
+	// Transform size in lags, blocks are the rest of the transform (the window reaches one lag range further)
+	const u32 kTransformLags = 4;
+
+	const double kPi = 3.14159265358979323846;
+
+	struct BetterScore
+	{
+		bool operator()(const StrideDetector::Candidate& a, const StrideDetector::Candidate& b) const
+		{
+			return a.score != b.score ? a.score > b.score : a.value < b.value;
+		}
+	};
+
+	u32 reverseBits(u32 v, u32 bits)
+	{
+		u32 r = 0;
+		for(u32 b=0; b<bits; ++b)
+		{
+			r |= ((v >> b) & 1) << (bits - 1 - b);
+		}
+		return r;
+	}
+
+	// Decimation in frequency: natural order in, bit reversed order out
+	void transformDif(float* re, float* im, u32 fftSize, const float* twiddleRe, const float* twiddleIm)
+	{
+		for(u32 m=fftSize/2; m>=4; m/=2)
+		{
+			const float* wRe = twiddleRe + m - 1;
+			const float* wIm = twiddleIm + m - 1;
+
+			if(fftStageSimd(re, im, fftSize, m, wRe, wIm, true))
+			{
+				continue;
+			}
+
+			for(u32 k=0; k<fftSize; k+=2*m)
+			{
+				float* aRe = re + k;
+				float* aIm = im + k;
+				float* bRe = re + k + m;
+				float* bIm = im + k + m;
+
+				for(u32 j=0; j<m; ++j)
+				{
+					float dr = aRe[j] - bRe[j];
+					float di = aIm[j] - bIm[j];
+					aRe[j] += bRe[j];
+					aIm[j] += bIm[j];
+					bRe[j] = dr * wRe[j] - di * wIm[j];
+					bIm[j] = dr * wIm[j] + di * wRe[j];
+				}
+			}
+		}
+
+		// Last two stages at once, their twiddles are 1 and -i
+		for(u32 k=0; k+4<=fftSize; k+=4)
+		{
+			float r0 = re[k] + re[k + 2], i0 = im[k] + im[k + 2];
+			float r2 = re[k] - re[k + 2], i2 = im[k] - im[k + 2];
+			float r1 = re[k + 1] + re[k + 3], i1 = im[k + 1] + im[k + 3];
+			float r3 = im[k + 1] - im[k + 3], i3 = re[k + 3] - re[k + 1];
+
+			re[k] = r0 + r1;
+			im[k] = i0 + i1;
+			re[k + 1] = r0 - r1;
+			im[k + 1] = i0 - i1;
+			re[k + 2] = r2 + r3;
+			im[k + 2] = i2 + i3;
+			re[k + 3] = r2 - r3;
+			im[k + 3] = i2 - i3;
+		}
+	}
+
+	// Decimation in time: bit reversed order in, natural order out
+	void transformDit(float* re, float* im, u32 fftSize, const float* twiddleRe, const float* twiddleIm)
+	{
+		// First two stages at once, their twiddles are 1 and -i
+		for(u32 k=0; k+4<=fftSize; k+=4)
+		{
+			float r0 = re[k] + re[k + 1], i0 = im[k] + im[k + 1];
+			float r1 = re[k] - re[k + 1], i1 = im[k] - im[k + 1];
+			float r2 = re[k + 2] + re[k + 3], i2 = im[k + 2] + im[k + 3];
+			float r3 = re[k + 2] - re[k + 3], i3 = im[k + 2] - im[k + 3];
+
+			re[k] = r0 + r2;
+			im[k] = i0 + i2;
+			re[k + 2] = r0 - r2;
+			im[k + 2] = i0 - i2;
+			re[k + 1] = r1 + i3;
+			im[k + 1] = i1 - r3;
+			re[k + 3] = r1 - i3;
+			im[k + 3] = i1 + r3;
+		}
+
+		for(u32 m=4; m<fftSize; m*=2)
+		{
+			const float* wRe = twiddleRe + m - 1;
+			const float* wIm = twiddleIm + m - 1;
+
+			if(fftStageSimd(re, im, fftSize, m, wRe, wIm, false))
+			{
+				continue;
+			}
+
+			for(u32 k=0; k<fftSize; k+=2*m)
+			{
+				float* aRe = re + k;
+				float* aIm = im + k;
+				float* bRe = re + k + m;
+				float* bIm = im + k + m;
+
+				for(u32 j=0; j<m; ++j)
+				{
+					float tr = wRe[j] * bRe[j] - wIm[j] * bIm[j];
+					float ti = wRe[j] * bIm[j] + wIm[j] * bRe[j];
+					bRe[j] = aRe[j] - tr;
+					bIm[j] = aIm[j] - ti;
+					aRe[j] += tr;
+					aIm[j] += ti;
+				}
+			}
+		}
+	}
+
+	struct StrideJob
+	{
+		const float* samples;
+		u32 numSamples;
+		u32 fftSize;
+		u32 blockSize;
+		u32 numBlocks;
+		u32 numParts;
+		const float* twiddleRe;
+		const float* twiddleIm;
+		const u32* mirror;
+		float** parts; // Transform (re, im) and summed cross spectrum (re, im) of each part
+	};
+
+	// Part sums the cross spectra of its range of blocks. A block is correlated with the window of
+	// fftSize units from its start, both are real so they share one transform (block as real part,
+	// window as imaginary part) and are separated by the symmetry of the spectrum.
+	void blockTask(void* param, u32 task)
+	{
+		const StrideJob* job = static_cast<const StrideJob*>(param);
+		u32 first = (u32)((u64)job->numBlocks * task / job->numParts);
+		u32 last = (u32)((u64)job->numBlocks * (task + 1) / job->numParts);
+		u32 fftSize = job->fftSize;
+		float* re = job->parts[task];
+		float* im = re + fftSize;
+		float* sumRe = im + fftSize;
+		float* sumIm = sumRe + fftSize;
+
+		memset(sumRe, 0, fftSize * 2 * sizeof(float));
+
+		for(u32 b=first; b<last; ++b)
+		{
+			u32 start = b * job->blockSize;
+			u32 count = std::min(fftSize, job->numSamples - start);
+			u32 blockCount = std::min(job->blockSize, count);
+
+			memcpy(re, job->samples + start, blockCount * sizeof(float));
+			memset(re + blockCount, 0, (fftSize - blockCount) * sizeof(float));
+			memcpy(im, job->samples + start, count * sizeof(float));
+			memset(im + count, 0, (fftSize - count) * sizeof(float));
+
+			transformDif(re, im, fftSize, job->twiddleRe, job->twiddleIm);
+
+			for(u32 k=0; k<fftSize; ++k)
+			{
+				u32 j = job->mirror[k];
+				float ar = (re[k] + re[j]) * 0.5f; // Block
+				float ai = (im[k] - im[j]) * 0.5f;
+				float br = (im[k] + im[j]) * 0.5f; // Window
+				float bi = (re[j] - re[k]) * 0.5f;
+
+				// conj(block) * window
+				sumRe[k] += ar * br + ai * bi;
+				sumIm[k] += ar * bi - ai * br;
+			}
+		}
+	}
+};
+
+StrideDetector::StrideDetector() :
+	m_fftSize(0)
+{
+}
+
+void StrideDetector::rankPixelSizes(const u8* data, u32 size, std::vector<Candidate>& out)
+{
+	out.clear();
+
+	u32 n = std::min(size, kPixelSizeWindow);
+	if(!data || n <= kMaxPixelSize * 2)
+	{
+		return;
+	}
+
+	// Autocorrelation of the bytes at the first few lags. Products are summed as integers in
+	// chunks which can't overflow 32 bits, the mean is taken out afterwards.
+	u64 total = 0;
+	for(u32 i=0; i<n; ++i)
+	{
+		total += data[i];
+	}
+	double mean = (double)total / n;
+
+	double r[8] = { 0.0 };
+	u64 head = total; // Sum of the first n - k bytes
+	u64 tail = total; // Sum of the last n - k bytes
+	for(u32 k=0; k<=kMaxPixelSize; ++k)
+	{
+		if(k > 0)
+		{
+			head -= data[n - k];
+			tail -= data[k - 1];
+		}
+
+		u64 products = 0;
+		for(u32 start=0; start<n-k; start+=kProductChunk)
+		{
+			u32 end = std::min(start + kProductChunk, n - k);
+			u32 sum = 0;
+			for(u32 i=start; i<end; ++i)
+			{
+				sum += (u32)data[i] * data[i + k];
+			}
+			products += sum;
+		}
+
+		r[k] = (double)products - mean * (double)(head + tail) + mean * mean * (n - k);
+	}
+
+	if(r[0] <= 0.0)
+	{
+		return;
+	}
+
+	double rho[8];
+	for(u32 k=0; k<=kMaxPixelSize; ++k)
+	{
+		rho[k] = r[k] / r[0] * n / (n - k);
+	}
+
+	// Bytes of the same channel correlate stronger than the bytes between them
+	for(u32 ps=1; ps<=kMaxPixelSize; ++ps)
+	{
+		double between = 0.0;
+		for(u32 k=1; k<ps; ++k)
+		{
+			between += rho[k];
+		}
+
+		Candidate candidate;
+		candidate.value = ps;
+		candidate.score = (float)(ps > 1 ? rho[ps] - between / (ps - 1) : rho[1]);
+		out.push_back(candidate);
+	}
+
+	std::sort(out.begin(), out.end(), BetterScore());
+}
+
+void StrideDetector::rankStrides(const u8* data, u32 size, u32 unitSize, u32 maxCandidates, std::vector<Candidate>& out, ThreadPool* pool /* NULL */)
+{
+	out.clear();
+
+	u32 n = unitSize > 0 ? std::min(size, kMaxWindow) / unitSize : 0;
+	if(!data || n < kMinStride * 4 || maxCandidates == 0)
+	{
+		return;
+	}
+
+	// Units are summed over their bytes
+	m_samples.resize(n);
+	double mean = 0.0;
+	for(u32 i=0; i<n; ++i)
+	{
+		u32 sum = 0;
+		for(u32 b=0; b<unitSize; ++b)
+		{
+			sum += data[i * unitSize + b];
+		}
+
+		m_samples[i] = (float)sum;
+		mean += sum;
+	}
+	mean /= n;
+
+	for(u32 i=0; i<n; ++i)
+	{
+		m_samples[i] -= (float)mean;
+	}
+
+	// Lags [0, half)
+	u32 maxLag = std::min(kMaxStride, n / 2);
+	u32 half = 1;
+	while(half < maxLag)
+	{
+		half *= 2;
+	}
+	maxLag = std::min(maxLag, half - 1);
+
+	u32 fftSize = half * kTransformLags;
+	prepare(fftSize);
+
+	StrideJob job;
+	job.samples = &m_samples[0];
+	job.numSamples = n;
+	job.fftSize = fftSize;
+	job.blockSize = fftSize - half;
+	job.numBlocks = (n + job.blockSize - 1) / job.blockSize;
+	job.numParts = pool ? std::min(pool->getNumThreads(), job.numBlocks) : 1;
+	job.twiddleRe = &m_twiddleRe[0];
+	job.twiddleIm = &m_twiddleIm[0];
+	job.mirror = &m_mirror[0];
+
+	if(m_parts.size() < job.numParts)
+	{
+		m_parts.resize(job.numParts);
+	}
+
+	std::vector<float*> parts(job.numParts);
+	for(u32 p=0; p<job.numParts; ++p)
+	{
+		m_parts[p].resize(fftSize * 4);
+		parts[p] = &m_parts[p][0];
+	}
+	job.parts = &parts[0];
+
+	if(pool && job.numParts > 1)
+	{
+		pool->run(blockTask, &job, job.numParts);
+	}
+	else
+	{
+		blockTask(&job, 0);
+	}
+
+	// Inverse transform as the conjugate of the forward one, only the real part is needed
+	float* re = parts[0];
+	float* im = re + fftSize;
+	const float* sumRe = im + fftSize;
+	const float* sumIm = sumRe + fftSize;
+	for(u32 k=0; k<fftSize; ++k)
+	{
+		float r = sumRe[k];
+		float i = sumIm[k];
+		for(u32 p=1; p<job.numParts; ++p)
+		{
+			r += parts[p][fftSize * 2 + k];
+			i += parts[p][fftSize * 3 + k];
+		}
+
+		re[k] = r;
+		im[k] = -i;
+	}
+	transformDit(re, im, fftSize, job.twiddleRe, job.twiddleIm);
+
+	if(re[0] <= 0.0f)
+	{
+		return;
+	}
+
+	// Peaks of the normalized autocorrelation (corrected for the shrinking overlap)
+	std::vector<Candidate> peaks;
+	std::vector<float> rho(maxLag + 2, 0.0f);
+	for(u32 k=1; k<=maxLag; ++k)
+	{
+		rho[k] = (float)(re[k] / re[0] * ((double)n / (n - k)));
+	}
+
+	std::vector<u8> isPeak(maxLag + 1, 0);
+	for(u32 k=kMinStride; k<=maxLag; ++k)
+	{
+		if(rho[k] > 0.0f && rho[k] > rho[k - 1] && rho[k] >= rho[k + 1])
+		{
+			Candidate peak;
+			peak.value = k;
+			peak.score = rho[k];
+			peaks.push_back(peak);
+			isPeak[k] = 1;
+		}
+	}
+
+	std::sort(peaks.begin(), peaks.end(), BetterScore());
+
+	// Rows also repeat at multiples of the stride, a multiple is replaced by its smallest
+	// divisor which correlates about as well
+	for(size_t i=0; i<peaks.size() && out.size()<maxCandidates; ++i)
+	{
+		Candidate peak = peaks[i];
+		u32 k = peak.value;
+		for(u32 d=1; d*d<=k; ++d)
+		{
+			if(k % d != 0)
+			{
+				continue;
+			}
+
+			// Both divisors of the pair, the smaller one first
+			u32 pair[2] = { d, k / d };
+			for(u32 p=0; p<2; ++p)
+			{
+				u32 v = pair[p];
+				if(v >= kMinStride && v < peak.value && isPeak[v] && rho[v] >= rho[k] * kFundamentalShare)
+				{
+					peak.value = v;
+					peak.score = rho[v];
+				}
+			}
+		}
+
+		bool known = false;
+		for(size_t j=0; j<out.size() && !known; ++j)
+		{
+			known = out[j].value == peak.value;
+		}
+
+		if(!known)
+		{
+			out.push_back(peak);
+		}
+	}
+
+	std::sort(out.begin(), out.end(), BetterScore());
+}
+
+void StrideDetector::prepare(u32 fftSize)
+{
+	if(m_fftSize == fftSize)
+	{
+		return;
+	}
+
+	u32 bits = 0;
+	while((1u << bits) < fftSize)
+	{
+		++bits;
+	}
+
+	// Spectra stay in bit reversed order between the transforms, bin k holds frequency reverse(k)
+	m_mirror.resize(fftSize);
+	for(u32 k=0; k<fftSize; ++k)
+	{
+		m_mirror[k] = reverseBits((fftSize - reverseBits(k, bits)) & (fftSize - 1), bits);
+	}
+
+	// Contiguous twiddles per stage, so the butterflies of a stage read them in order
+	m_twiddleRe.resize(fftSize);
+	m_twiddleIm.resize(fftSize);
+	for(u32 m=1; m<fftSize; m*=2)
+	{
+		for(u32 j=0; j<m; ++j)
+		{
+			double angle = -kPi * j / m;
+			m_twiddleRe[m - 1 + j] = (float)cos(angle);
+			m_twiddleIm[m - 1 + j] = (float)sin(angle);
+		}
+	}
+
+	m_fftSize = fftSize;
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __STRIDE_H
+#define __STRIDE_H
+
+#include <vector>
+#include "common.h"
+#include "threadpool.h"
+
+//
+// Guesses the layout of raw data from its autocorrelation. Pixel sizes show up as the byte
+// lag the stream repeats at, row strides as peaks at the lag of one row (counted in units
+// of the pixel size, i.e. pixels or DXT blocks). The autocorrelation of the units is computed
+// with FFTs over blocks of the data, summed up in the frequency domain. Blocks are spread over
+// the pool if there is one. Not thread safe, the buffers are kept for the next call.
+//
+class StrideDetector
+{
+public:
+	static const u32 kMaxWindow; // Bytes analysed
+	static const u32 kMaxPixelSize;
+	static const u32 kMinStride; // In units
+	static const u32 kMaxStride;
+
+	struct Candidate
+	{
+		u32 value; // Pixel size in bytes or row stride in units
+		float score; // Correlation, 1 = perfect repetition
+	};
+
+	StrideDetector();
+
+	// Pixel sizes (1 to kMaxPixelSize), best first
+	void rankPixelSizes(const u8* data, u32 size, std::vector<Candidate>& out);
+
+	// Up to maxCandidates row strides of the data seen as unitSize byte units, best first
+	void rankStrides(const u8* data, u32 size, u32 unitSize, u32 maxCandidates, std::vector<Candidate>& out, ThreadPool* pool = NULL);
+
+private:
+	// Not copyable
+	StrideDetector(const StrideDetector&);
+	StrideDetector& operator=(const StrideDetector&);
+
+	void prepare(u32 fftSize); // Twiddles and spectrum symmetry of an fftSize transform
+
+	u32 m_fftSize;
+	std::vector<float> m_twiddleRe; // Per stage, stage of half size m starts at m - 1
+	std::vector<float> m_twiddleIm;
+	std::vector<u32> m_mirror; // Bin of the conjugate frequency, spectra are in bit reversed order
+	std::vector<float> m_samples; // Units with the mean removed
+	std::vector<std::vector<float> > m_parts; // Transform and summed cross spectrum of each part
+};
+
+#endif
@@ -0,0 +1,161 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(u32 numThreads /* 0 */) :
+	m_func(NULL),
+	m_param(NULL),
+	m_numTasks(0),
+	m_job(0),
+	m_active(0),
+	m_nextTask(0),
+	m_finished(0),
+	m_quit(false)
+{
+	if(numThreads == 0)
+	{
+		numThreads = getDefaultThreadCount();
+	}
+
+	// The caller is one of the threads
+	for(u32 i=1; i<numThreads; ++i)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::worker, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for(size_t i=0; i<m_threads.size(); ++i)
+	{
+		m_threads[i].join();
+	}
+}
+
+u32 ThreadPool::getDefaultThreadCount()
+{
+	u32 count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void ThreadPool::run(TaskFunc func, void* param, u32 numTasks)
+{
+	if(numTasks == 0)
+	{
+		return;
+	}
+
+	// Not worth waking anybody up
+	if(m_threads.empty() || numTasks == 1)
+	{
+		for(u32 i=0; i<numTasks; ++i)
+		{
+			func(param, i);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> run(m_runMutex);
+	{
+		// A worker that woke up late may still be looking at the previous job
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_active > 0)
+		{
+			m_done.wait(lock);
+		}
+
+		m_func = func;
+		m_param = param;
+		m_numTasks = numTasks;
+		m_nextTask = 0;
+		m_finished = 0;
+		++m_job;
+	}
+	m_wake.notify_all();
+
+	execute(func, param, numTasks);
+
+	// Wait for the tasks and for every worker to leave the job
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while(m_finished < numTasks || m_active > 0)
+	{
+		m_done.wait(lock);
+	}
+}
+
+void ThreadPool::worker()
+{
+	u32 lastJob = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_quit)
+	{
+		if(m_job == lastJob)
+		{
+			m_wake.wait(lock);
+			continue;
+		}
+
+		lastJob = m_job;
+		TaskFunc func = m_func;
+		void* param = m_param;
+		u32 numTasks = m_numTasks;
+		++m_active;
+		lock.unlock();
+
+		execute(func, param, numTasks);
+
+		lock.lock();
+		--m_active;
+		m_done.notify_all();
+	}
+}
+
+void ThreadPool::execute(TaskFunc func, void* param, u32 numTasks)
+{
+	for(;;)
+	{
+		u32 task = m_nextTask++;
+		if(task >= numTasks)
+		{
+			break;
+		}
+
+		func(param, task);
+
+		if(++m_finished == numTasks)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_done.notify_all();
+		}
+	}
+}
+
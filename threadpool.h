@@ -0,0 +1,81 @@
+/***************************************************************************
+ *                                                                         *
+ *   Copyright (C) 2013-2014 Nikita Kindt (n.kindt.pdbg@gmail.com)         *
+ *                                                                         *
+ *   File is part of PixelDbg:                                             *
+ *   https://sourceforge.net/projects/pixeldbg/                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "common.h"
+
+//
+// Persistent pool of worker threads for splitting a job into independent tasks. The calling
+// thread works on the job as well and run() returns once every task is done. Only one job
+// runs at a time, concurrent callers are serialized.
+//
+class ThreadPool
+{
+public:
+	typedef void (*TaskFunc)(void* param, u32 task);
+
+	// 0 threads = one per hardware thread
+	explicit ThreadPool(u32 numThreads = 0);
+	~ThreadPool();
+
+	// Threads working on a job, including the caller
+	u32 getNumThreads() const { return (u32)m_threads.size() + 1; }
+
+	// Calls func(param, task) for every task in [0, numTasks) and waits for all of them
+	void run(TaskFunc func, void* param, u32 numTasks);
+
+	static u32 getDefaultThreadCount();
+
+private:
+	// Not copyable
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void worker();
+	void execute(TaskFunc func, void* param, u32 numTasks);
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_runMutex; // Held by the caller of run
+	std::mutex m_mutex; // Protects the job description below
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	TaskFunc m_func;
+	void* m_param;
+	u32 m_numTasks;
+	u32 m_job; // Incremented for every job
+	u32 m_active; // Workers inside the current job
+	std::atomic<u32> m_nextTask;
+	std::atomic<u32> m_finished;
+	bool m_quit;
+};
+
+#endif
+